@@ -6,8 +6,11 @@
 #define MAX_INPUT 256
 #define MAX_TERMS 10
 #define PI 3.14159265359
-#define EPSILON 0.0001 // Para cálculos numéricos de limites
-#define TRAPEZOID_STEPS 1000 // Número de passos para integração numérica
+#define LIMITE_PASSOS 20 // Máximo de pontos por lado no limite
+#define LIMITE_TOL 1e-13 // Tolerância relativa do limite
+#define LIMITE_FOLGA 1e-6 // Erro acima disso: o limite lateral não converge
+#define INTEG_TOL 1e-10 // Tolerância da integração numérica
+#define MAX_INTERVALOS 500 // Limite de subdivisões da integração adaptativa
 
 // Estrutura para representar um termo de um polinômio (ex.: 3x^2)
 typedef struct {
@@ -126,28 +129,110 @@ void print_trig(TrigTerm *trig_terms, int num_trig) {
     if (first) printf("0");
 }
 
-// Função para calcular limite numericamente (aproximação)
-double calculate_limit(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double a) {
-    double left = a - EPSILON;
-    double right = a + EPSILON;
-    double val_left = eval_polynomial(terms, num_terms, left) + eval_trig(trig_terms, num_trig, left);
-    double val_right = eval_polynomial(terms, num_terms, right) + eval_trig(trig_terms, num_trig, right);
-    // Média dos valores para aproximação simples
-    return (val_left + val_right) / 2.0;
+// Nós e pesos de Gauss-Kronrod 7/15 em [0, 1] (os nós de índice ímpar são os de Gauss)
+static const double gk_nos[8] = {
+    0.991455371120812639, 0.949107912342758525, 0.864864423359769073, 0.741531185599394440,
+    0.586087235467691130, 0.405845151377397167, 0.207784955007898468, 0.0
+};
+static const double gk_pesos[8] = {
+    0.022935322010529225, 0.063092092629978553, 0.104790010322250184, 0.140653259715525919,
+    0.169004726639267903, 0.190350578064785410, 0.204432940075298892, 0.209482141084727828
+};
+static const double gauss_pesos[4] = {
+    0.129484966168869693, 0.279705391489276668, 0.381830050505118945, 0.417959183673469388
+};
+
+// Um subintervalo com a integral pela regra de Kronrod e o erro |Kronrod - Gauss|
+typedef struct {
+    double a, b;
+    double valor;
+    double erro;
+} Intervalo;
+
+static double eval_funcao(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double x) {
+    return eval_polynomial(terms, num_terms, x) + eval_trig(trig_terms, num_trig, x);
+}
+
+// Limite de um lado (dir = -1 esquerda, +1 direita) por extrapolação de
+// Richardson: f(a + dir*h) com h caindo pela metade, e a coluna j da tabela
+// cancela o termo em h^j. Para quando a diagonal volta a crescer (ruído de
+// arredondamento) ou o erro fica abaixo da tolerância; devolve NAN quando
+// não converge (tan em pi/2).
+double calculate_limit(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double a, double dir, double *erro) {
+    double t[LIMITE_PASSOS][LIMITE_PASSOS];
+    double h = 0.5 * fmax(1.0, fabs(a));
+    double melhor = NAN, diag_ant = INFINITY;
+    *erro = INFINITY;
+    for (int n = 0; n < LIMITE_PASSOS; n++, h /= 2.0) {
+        t[n][0] = eval_funcao(terms, num_terms, trig_terms, num_trig, a + dir * h);
+        double linha = NAN, erro_linha = INFINITY;
+        for (int j = 1; j <= n; j++) {
+            t[n][j] = t[n][j - 1] + (t[n][j - 1] - t[n - 1][j - 1]) / (ldexp(1.0, j) - 1.0);
+            double e = fmax(fabs(t[n][j] - t[n][j - 1]), fabs(t[n][j] - t[n - 1][j - 1]));
+            if (e <= erro_linha) {
+                erro_linha = e;
+                linha = t[n][j];
+            }
+        }
+        if (n > 0) {
+            double diag = fabs(t[n][n] - t[n - 1][n - 1]);
+            if (n >= 4 && diag > 2.0 * diag_ant && diag > 2.0 * *erro) break;
+            diag_ant = diag;
+        }
+        if (erro_linha <= *erro) {
+            *erro = erro_linha;
+            melhor = linha;
+        }
+        if (*erro <= LIMITE_TOL * fmax(1.0, fabs(melhor))) break;
+    }
+    if (*erro > LIMITE_FOLGA * fmax(1.0, fabs(melhor))) return NAN;
+    return fabs(melhor) <= *erro ? 0.0 : melhor; // menor que o próprio erro é zero
 }
 
-// Função para integração numérica usando a regra do trapézio
-double integrate_trapezoid(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double a, double b) {
-    double h = (b - a) / TRAPEZOID_STEPS;
-    double sum = 0.0;
-    for (int i = 0; i < TRAPEZOID_STEPS; i++) {
-        double x0 = a + i * h;
-        double x1 = a + (i + 1) * h;
-        double f0 = eval_polynomial(terms, num_terms, x0) + eval_trig(trig_terms, num_trig, x0);
-        double f1 = eval_polynomial(terms, num_terms, x1) + eval_trig(trig_terms, num_trig, x1);
-        sum += (f0 + f1) * h / 2.0;
+static Intervalo gauss_kronrod(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double a, double b) {
+    double c = (a + b) / 2.0, h = (b - a) / 2.0;
+    double fc = eval_funcao(terms, num_terms, trig_terms, num_trig, c);
+    double kronrod = fc * gk_pesos[7], gauss = fc * gauss_pesos[3];
+    for (int j = 0; j < 7; j++) {
+        double dx = h * gk_nos[j];
+        double par = eval_funcao(terms, num_terms, trig_terms, num_trig, c - dx) +
+                     eval_funcao(terms, num_terms, trig_terms, num_trig, c + dx);
+        kronrod += gk_pesos[j] * par;
+        if (j % 2 == 1) gauss += gauss_pesos[j / 2] * par;
     }
-    return sum;
+    Intervalo iv = { a, b, kronrod * h, fabs((kronrod - gauss) * h) };
+    return iv;
+}
+
+// Função para integração numérica adaptativa (Gauss-Kronrod 7/15): divide ao meio
+// o subintervalo de maior erro até o erro total ficar abaixo da tolerância.
+// Devolve a integral; o erro estimado e o número de avaliações saem por ponteiro,
+// e *convergiu fica 0 quando o limite de subdivisões chega antes da tolerância.
+double integrate_adaptive(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig,
+                          double a, double b, double tol, double *erro, int *avaliacoes, int *convergiu) {
+    Intervalo intervalos[MAX_INTERVALOS];
+    int n = 1;
+    intervalos[0] = gauss_kronrod(terms, num_terms, trig_terms, num_trig, a, b);
+    double valor = intervalos[0].valor, erro_total = intervalos[0].erro;
+    while (erro_total > fmax(tol, tol * fabs(valor)) && n < MAX_INTERVALOS) {
+        int pior = 0;
+        for (int i = 1; i < n; i++) {
+            if (intervalos[i].erro > intervalos[pior].erro) pior = i;
+        }
+        Intervalo iv = intervalos[pior];
+        double meio = (iv.a + iv.b) / 2.0;
+        intervalos[pior] = gauss_kronrod(terms, num_terms, trig_terms, num_trig, iv.a, meio);
+        intervalos[n++] = gauss_kronrod(terms, num_terms, trig_terms, num_trig, meio, iv.b);
+        valor = erro_total = 0.0;
+        for (int i = 0; i < n; i++) {
+            valor += intervalos[i].valor;
+            erro_total += intervalos[i].erro;
+        }
+    }
+    *erro = erro_total;
+    *avaliacoes = 15 * (2 * n - 1);
+    *convergiu = erro_total <= fmax(tol, tol * fabs(valor));
+    return valor;
 }
 
 // Função principal da calculadora
@@ -236,8 +321,20 @@ int main(int argc, char *argv[]) {
                 num_trig++;
             }
         }
-        double limit_val = calculate_limit(terms, num_terms, trig_terms, num_trig, a);
-        printf("Limite aproximado em x = %.2f: %.2f\n", a, limit_val);
+        double erro_esq, erro_dir;
+        double esq = calculate_limit(terms, num_terms, trig_terms, num_trig, a, -1.0, &erro_esq);
+        double dir = calculate_limit(terms, num_terms, trig_terms, num_trig, a, 1.0, &erro_dir);
+        if (isnan(esq)) printf("Pela esquerda: não converge (a função diverge ou oscila)\n");
+        else printf("Pela esquerda: %.12g (erro estimado %.1g)\n", esq, erro_esq);
+        if (isnan(dir)) printf("Pela direita: não converge (a função diverge ou oscila)\n");
+        else printf("Pela direita: %.12g (erro estimado %.1g)\n", dir, erro_dir);
+        if (isnan(esq) || isnan(dir)) {
+            printf("O limite em x = %g não existe\n", a);
+        } else if (fabs(esq - dir) <= 10.0 * (erro_esq + erro_dir) + LIMITE_TOL * fmax(1.0, fabs(esq))) {
+            printf("Limite em x = %g: %.12g\n", a, (esq + dir) / 2.0);
+        } else {
+            printf("Os limites laterais são diferentes: o limite em x = %g não existe\n", a);
+        }
     } else if (strcmp(argv[1], "integ") == 0 && argc >= 5) {
         double a = atof(argv[2]);
         double b = atof(argv[3]);
@@ -260,8 +357,15 @@ int main(int argc, char *argv[]) {
                 num_trig++;
             }
         }
-        double integral_val = integrate_trapezoid(terms, num_terms, trig_terms, num_trig, a, b);
-        printf("Integral aproximada de %.2f a %.2f: %.2f\n", a, b, integral_val);
+        double erro;
+        int avaliacoes, convergiu;
+        double integral_val = integrate_adaptive(terms, num_terms, trig_terms, num_trig, a, b, INTEG_TOL, &erro, &avaliacoes, &convergiu);
+        printf("Integral aproximada de %.2f a %.2f: %.10g\n", a, b, integral_val);
+        printf("Erro estimado: %.2g (%d avaliações)\n", erro, avaliacoes);
+        if (!convergiu) {
+            printf("Aviso: tolerância não atingida (%.1g) em %d subintervalos; a função pode ter uma singularidade ou a integral divergir.\n",
+                   INTEG_TOL, MAX_INTERVALOS);
+        }
     } else {
         printf("Comando ou argumentos inválidos.\n");
         return 1;
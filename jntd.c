@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -13,7 +14,19 @@
 #include <stdbool.h>
 #include <termios.h> 
 #include <ctype.h>
+#include <poll.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <spawn.h>
 #include <openssl/sha.h>
+#include <math.h>
+#include <stdatomic.h>
 #include "plugins/plugin_todo.c"
 #include "plugin.h"
 
@@ -39,6 +52,8 @@
 #define MAX_HISTORY 50
 //define o tamanho maximo do input do usario + extras como calc
 #define COMBINED_PROMPT_LEN 2048 // Já estava adequado, mas mantido para clareza
+//define o tamanho maximo de uma linha de comando no editor
+#define COMMAND_LINE_MAX 4096
 
 char input_copy[1024];
 char dir_novo[100];
@@ -46,7 +61,7 @@ char *path[100];
 char dir_ant[100];
 char *command_history[MAX_HISTORY];
 int history_count = 0;
-char buf[512];
+char buf[COMMAND_LINE_MAX];
 int linhazinhas[100];
 char quiz[1024];
 int countar = 0;
@@ -58,6 +73,14 @@ volatile int timer_running = 0;
 volatile int quiz_timer_running = 0;
 volatile int current_timer_seconds = 0;
 int plugin_count = 0;
+// false quando o JNTD roda sem terminal (jntd -c, script ou stdin redirecionado):
+// nada de modo raw, sequencias de escape ou mensagens de boas-vindas
+bool interactive = true;
+// > 0 enquanto o comando bench roda: sem historico, log nem pool de jobs
+int bench_depth = 0;
+// linha digitada com espaco na frente (como HISTCONTROL=ignorespace): fica
+// fora do historico e do log
+bool history_private = false;
 
 pthread_t timer_thread;
 pthread_t quiz_thread;
@@ -81,12 +104,55 @@ Alias alias_list[MAX_ALIASES];
 int alias_count = 0;
 
 //Estrutura dos plugins//
+#define PLUGIN_DIR "plugins"
+#define PLUGIN_MANIFEST PLUGIN_DIR "/.jntd_manifest"
+#define PLUGIN_MANIFEST_VERSION 1
+#define PLUGIN_MAX_ARGS 256
+
+typedef struct PluginHost PluginHost;
+
+// Uma biblioteca em plugins/. Os metadados vem do manifesto em cache; o
+// dlopen (e o init) so acontece no primeiro uso de um dos seus comandos.
 typedef struct {
-        void *handle;
-        Plugin *plugin;
+        char *name;
+        char *file;        // nome do .so dentro de plugins/
+        long long mtime_ns;
+        off_t size;
+        int abi_version;   // 1 = register_plugin, 2 = register_plugin_v2
+        void *handle;      // NULL enquanto nao foi carregado
+        bool failed;       // dlopen/init falhou: nao tenta de novo nesta sessao
+        bool removed;      // o arquivo sumiu ou foi substituido por outra entrada
+        int *in_flight;    // chamadas em andamento (atomico, endereco fixo para os workers); recarga espera zerar
+        bool isolated;     // roda num processo host separado (comando 'plugin isolate')
+        PluginHost *host;  // processo host ativo, se isolado
+        Plugin *v1;
+        PluginV2 *v2;
 } LoadedPlugin;
 
-LoadedPlugin loaded_plugins[20];
+// Cada plugin pode expor varios comandos; esta e a tabela que o dispatch,
+// o roteador e o Tab consultam. run so e preenchido quando o plugin carrega
+// (e fica NULL em plugins v1).
+typedef struct {
+        char *name;
+        char *descri;
+        unsigned caps;
+        plugin_command_func run;
+        int plugin;        // indice em loaded_plugins
+} PluginCommandEntry;
+
+LoadedPlugin *loaded_plugins = NULL;
+int plugin_capacity = 0;
+PluginCommandEntry *plugin_commands = NULL;
+int plugin_command_count = 0;
+int plugin_command_capacity = 0;
+// nome do comando (sem diferenciar maiusculas) -> indice em plugin_commands,
+// enderecamento aberto com sondagem linear; -1 marca posicao livre
+int *plugin_command_map = NULL;
+int plugin_command_map_cap = 0;
+// inotify sobre plugins/ no modo interativo; -1 desliga a recarga a quente
+int plugin_watch_fd = -1;
+// 'plugin isolate all' (ou JNTD_PLUGIN_ISOLATION=all): novos plugins ja entram isolados
+bool plugin_isolate_all = false;
 
 //Estrutura de memoria
 typedef struct {
@@ -120,7 +186,7 @@ static const CmdEntry cmds[] = {
     { "cd", NULL, "O comando cd, você troca de diretorio, use cd <destino>." },
     { "pwd", "pwd", "Fala o diretorio atual" },
     { "vim", "vim", "Abre o editor, aceita nome para editar um arquivo." },
-    { "todo", NULL, "Gerencia tarefas (add, list, remove, edit, check, vim)." },
+    { "todo", NULL, "Gerencia tarefas (add, list, search, remove, edit, check, vim, import, export)." },
     { "quiz", NULL, "Mostra todas as perguntas do quiz do integrado." },
     { "quizt", NULL, "Define o intervalo de tempo entre os QUIZ'es." },
     { "quizale", NULL, "Uma pergunta aleatoria do QUIZ é feita." },
@@ -132,12 +198,15 @@ static const CmdEntry cmds[] = {
     { "buscar", NULL, "Uma função para buscar coisas pelo JNTD." },
     { "elinks", "elinks", "Elinks é um código que te permite fazer pesquisas na internet sem sair do terminal. Todos os direitos vão para o criador." },
     { "awrit", "awrit", "Awrit é um codigo que te permite usar o Chorimium pelo TERMINAL! Isso, sem que você saia dele, Todos os direitos vão para o craidor," },
-    { "hash", NULL, "Verifica ou gera hashes SHA-256 para arquivos." }
+    { "hash", NULL, "Verifica ou gera hashes SHA-256 para arquivos." },
+    { "plugin", NULL, "Gerencia plugins: list, isolate/inproc <plugin|all> (processo separado) e bench." },
+    { "jobs", NULL, "Lista os comandos de plugin rodando em segundo plano; 'jobs wait' espera todos." },
+    { "bench", NULL, "Mede um comando: bench [-n N] [-w aquecimento] [-s] <comando...>." }
 };
 
 // Declaração antecipada das funções
-void dispatch(const char *user_in);
-void handle_ollama_interaction();
+int dispatch(const char *user_in);
+int handle_ollama_interaction(const char *args);
 void enable_raw_mode();
 void disable_raw_mode();
 void display_help();
@@ -145,66 +214,609 @@ void log_action(const char *action, const char *details);
 int is_safe_command(const char *cmd);
 void add_to_history(const char *cmd);
 void display_history();
-void cd(const char *args);
+int cd(const char *args);
 int jntd_mkdir(const char *args);
-void rscript(const char *args);
-void func_quiz();
+int rscript(const char *args);
+int func_quiz();
 char *read_random_line();
 void *timer_background(void *arg);
 void *quiz_timer_background(void *arg);
 void load_plugins();
-void execute_plugin(const char* name, const char* args);
+static void plugin_host_stop(LoadedPlugin *lp);
+void unload_plugins();
+void plugin_watch_start();
+void plugin_watch_poll();
+int jobs_report_finished();
+int plugin_notices_report();
+static void plugin_notify(const char *plugin, const char *message);
+static void plugin_load_notifiers();
+int handle_bench_command(const char *args);
+int execute_plugin(const char* name, const char* args);
 void save_aliases_to_file();
-void handle_hash_command();
+void router_mark_dirty();
+void completion_mark_dirty();
+int handle_hash_command();
 
 //implementação dos plugins, sempre antes do dispatch//
+static uint32_t plugin_name_hash(const char *s) {
+    uint32_t h = 2166136261u; // FNV-1a sobre o nome em minusculas
+    while (*s) {
+        h ^= (unsigned char)tolower((unsigned char)*s++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void plugin_map_put(int *map, int cap, int idx) {
+    uint32_t i = plugin_name_hash(plugin_commands[idx].name) & (cap - 1);
+    while (map[i] >= 0) i = (i + 1) & (cap - 1);
+    map[i] = idx;
+}
+
+static PluginCommandEntry *find_plugin_command(const char *name) {
+    if (plugin_command_map_cap == 0) return NULL;
+    uint32_t i = plugin_name_hash(name) & (plugin_command_map_cap - 1);
+    while (plugin_command_map[i] >= 0) {
+        PluginCommandEntry *c = &plugin_commands[plugin_command_map[i]];
+        if (strcasecmp(c->name, name) == 0) return c;
+        i = (i + 1) & (plugin_command_map_cap - 1);
+    }
+    return NULL;
+}
+
+static long long stat_mtime_ns(const struct stat *st) {
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// Reusa a posicao de um plugin removido, se houver; senao acrescenta.
+static int add_plugin(const char *name, const char *file, long long mtime_ns, off_t size, int abi_version) {
+    for (int i = 0; i < plugin_count; i++) {
+        LoadedPlugin *lp = &loaded_plugins[i];
+        if (!lp->removed) continue;
+        int *in_flight = lp->in_flight;   // zerado: plugin_retire esperou as chamadas
+        memset(lp, 0, sizeof(*lp));
+        lp->name = strdup(name);
+        lp->file = strdup(file);
+        lp->mtime_ns = mtime_ns;
+        lp->size = size;
+        lp->abi_version = abi_version;
+        lp->isolated = plugin_isolate_all;
+        lp->in_flight = in_flight;
+        return i;
+    }
+    if (plugin_count == plugin_capacity) {
+        int new_cap = plugin_capacity ? plugin_capacity * 2 : 16;
+        LoadedPlugin *grown = realloc(loaded_plugins, new_cap * sizeof(LoadedPlugin));
+        if (!grown) return -1;
+        loaded_plugins = grown;
+        plugin_capacity = new_cap;
+    }
+    LoadedPlugin *lp = &loaded_plugins[plugin_count];
+    memset(lp, 0, sizeof(*lp));
+    lp->name = strdup(name);
+    lp->file = strdup(file);
+    lp->mtime_ns = mtime_ns;
+    lp->size = size;
+    lp->abi_version = abi_version;
+    lp->isolated = plugin_isolate_all;
+    lp->in_flight = calloc(1, sizeof(int));
+    return plugin_count++;
+}
+
+static PluginCommandEntry *add_plugin_command(const char *name, const char *descri, unsigned caps, int plugin) {
+    PluginCommandEntry *existing = find_plugin_command(name);
+    if (existing) {
+        if (existing->plugin != plugin) {
+            fprintf(stderr, "Aviso: comando '%s' ja registrado pelo plugin '%s'; ignorado.\n",
+                    name, loaded_plugins[existing->plugin].name);
+        }
+        return existing->plugin == plugin ? existing : NULL;
+    }
+    if (plugin_command_count == plugin_command_capacity) {
+        int new_cap = plugin_command_capacity ? plugin_command_capacity * 2 : 32;
+        PluginCommandEntry *grown = realloc(plugin_commands, new_cap * sizeof(PluginCommandEntry));
+        if (!grown) return NULL;
+        plugin_commands = grown;
+        plugin_command_capacity = new_cap;
+    }
+    if ((plugin_command_count + 1) * 2 > plugin_command_map_cap) {
+        int new_cap = plugin_command_map_cap ? plugin_command_map_cap * 2 : 64;
+        int *map = malloc(new_cap * sizeof(int));
+        if (!map) return NULL;
+        memset(map, 0xff, new_cap * sizeof(int));
+        free(plugin_command_map);
+        plugin_command_map = map;
+        plugin_command_map_cap = new_cap;
+        for (int i = 0; i < plugin_command_count; i++) plugin_map_put(map, new_cap, i);
+    }
+    PluginCommandEntry *c = &plugin_commands[plugin_command_count];
+    c->name = strdup(name);
+    c->descri = descri ? strdup(descri) : NULL;
+    c->caps = caps;
+    c->run = NULL;
+    c->plugin = plugin;
+    plugin_map_put(plugin_command_map, plugin_command_map_cap, plugin_command_count++);
+    return c;
+}
+
+static void plugin_registry_clear() {
+    for (int i = 0; i < plugin_command_count; i++) {
+        free(plugin_commands[i].name);
+        free(plugin_commands[i].descri);
+    }
+    for (int i = 0; i < plugin_count; i++) {
+        free(loaded_plugins[i].name);
+        free(loaded_plugins[i].file);
+        free(loaded_plugins[i].in_flight);
+    }
+    plugin_count = 0;
+    plugin_command_count = 0;
+    if (plugin_command_map) memset(plugin_command_map, 0xff, plugin_command_map_cap * sizeof(int));
+}
+
+// Abre a biblioteca e pega o descritor (v2 ou v1), sem chamar init.
+static void *plugin_open(const char *path, Plugin **v1, PluginV2 **v2) {
+    *v1 = NULL;
+    *v2 = NULL;
+    //carrega a biblioteca compartilhada//
+    void *handle = dlopen(path, RTLD_LAZY);
+    if (!handle) {
+        fprintf(stderr, "Erro ao carregar o plugin %s: %s\n", path, dlerror());
+        return NULL;
+    }
+    // Prefere a ABI v2; sem ela, cai para a register_plugin da v1//
+    plugin_register_v2_func register_v2 = (plugin_register_v2_func)dlsym(handle, "register_plugin_v2");
+    if (register_v2) {
+        PluginV2 *p2 = register_v2();
+        if (!p2 || p2->abi_version != JNTD_PLUGIN_ABI_VERSION || !p2->name || !p2->commands || p2->command_count <= 0) {
+            fprintf(stderr, "Erro: plugin %s usa ABI %d (esperado %d) ou nao declara comandos.\n",
+                    path, p2 ? p2->abi_version : 0, JNTD_PLUGIN_ABI_VERSION);
+            dlclose(handle);
+            return NULL;
+        }
+        *v2 = p2;
+        return handle;
+    }
+    // Procura a função registrar plugin dentro da biblioteca//
+    Plugin *(*register_func)();//declara uma função de pointer//
+    register_func = dlsym(handle, "register_plugin");
+    if (!register_func) {
+        fprintf(stderr, "Erro: Plugin %s não tem função register_plugin.\n", path);
+        dlclose(handle);
+        return NULL;
+    }
+    //chama a função para conseguir a data do plugin//
+    Plugin *p = register_func();
+    if (!p || !p->name) {
+        fprintf(stderr, "Erro: register_plugin em %s retornou NULL.\n", path);
+        dlclose(handle);
+        return NULL;
+    }
+    *v1 = p;
+    return handle;
+}
+
+// Tira os comandos do plugin da tabela e refaz o mapa de nomes.
+static void plugin_remove_commands(int plugin) {
+    int kept = 0;
+    for (int i = 0; i < plugin_command_count; i++) {
+        if (plugin_commands[i].plugin == plugin) {
+            free(plugin_commands[i].name);
+            free(plugin_commands[i].descri);
+        } else {
+            plugin_commands[kept++] = plugin_commands[i];
+        }
+    }
+    plugin_command_count = kept;
+    memset(plugin_command_map, 0xff, plugin_command_map_cap * sizeof(int));
+    for (int i = 0; i < plugin_command_count; i++) plugin_map_put(plugin_command_map, plugin_command_map_cap, i);
+}
+
+// Registra os comandos que a biblioteca declara. v1 le a linha crua e pode
+// perguntar algo ao usuario: entra como NEEDS_TTY.
+static void plugin_register_commands(int plugin, Plugin *v1, PluginV2 *v2) {
+    if (v1) {
+        add_plugin_command(v1->name, NULL, PLUGIN_CAP_NEEDS_TTY, plugin);
+        return;
+    }
+    for (int i = 0; i < v2->command_count; i++) {
+        const PluginCommand *c = &v2->commands[i];
+        if (c->name && c->run) add_plugin_command(c->name, c->descri, c->caps, plugin);
+    }
+}
+
+// Copia o .so para um arquivo temporario novo (inode proprio) para o dlopen.
+static bool plugin_copy_for_load(const char *path, char *copy, size_t copy_size) {
+    const char *tmp = getenv("TMPDIR");
+    snprintf(copy, copy_size, "%s/jntd-plugin-XXXXXX.so", tmp && *tmp ? tmp : "/tmp");
+    int out = mkstemps(copy, 3);
+    if (out < 0) return false;
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    bool ok = in >= 0;
+    char block[65536];
+    ssize_t n;
+    while (ok && (n = read(in, block, sizeof(block))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        for (ssize_t done = 0; ok && done < n;) {
+            ssize_t w = write(out, block + done, n - done);
+            if (w < 0 && errno != EINTR) ok = false;
+            else if (w > 0) done += w;
+        }
+    }
+    if (in >= 0) close(in);
+    close(out);
+    if (!ok) unlink(copy);
+    return ok;
+}
+
+// Como plugin_open, mas com recarga a quente abre uma copia: o .so original
+// pode ser sobrescrito pelo compilador enquanto esta mapeado, e o glibc
+// devolveria o handle antigo (em cache) para o mesmo caminho.
+static void *plugin_open_fresh(const char *path, Plugin **v1, PluginV2 **v2) {
+    char copy[PATH_MAX];
+    if (plugin_watch_fd >= 0 && plugin_copy_for_load(path, copy, sizeof(copy))) {
+        void *handle = plugin_open(copy, v1, v2);
+        unlink(copy);
+        return handle;
+    }
+    return plugin_open(path, v1, v2);
+}
+
+// Le uma biblioteca so para o manifesto: registra nome e comandos e fecha.
+// Retorna o indice do plugin, ou -1. O dlopen roda os construtores da
+// biblioteca (__attribute__((constructor)), inicializadores globais) no
+// processo do shell, mesmo sem init; register_plugin(_v2) tambem e chamada.
+// Plugins nao devem ter efeitos colaterais nessas etapas: o que precisa de
+// recursos vai no init, que so roda no primeiro uso.
+static int plugin_probe(const char *file) {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), PLUGIN_DIR "/%s", file);
+    if (stat(path, &st) != 0) return -1;
+    Plugin *v1;
+    PluginV2 *v2;
+    void *handle = plugin_open_fresh(path, &v1, &v2);
+    if (!handle) return -1;
+    int idx = add_plugin(v2 ? v2->name : v1->name, file, stat_mtime_ns(&st), st.st_size, v2 ? 2 : 1);
+    if (idx >= 0) plugin_register_commands(idx, v1, v2);
+    dlclose(handle);
+    return idx;
+}
+
+static void manifest_write_field(FILE *f, const char *s) {
+    for (; s && *s; s++) fputc(*s == '\t' || *s == '\n' ? ' ' : *s, f);
+}
+
+// O manifesto e reescrito no lugar: so criar o arquivo muda o mtime da
+// pasta, e isso acontece antes de lermos o mtime que fica gravado nele.
+static void plugin_manifest_save() {
+    int fd = open(PLUGIN_MANIFEST, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    struct stat dir_st;
+    FILE *f = fdopen(fd, "w");
+    if (!f || stat(PLUGIN_DIR, &dir_st) != 0) {
+        if (f) fclose(f); else close(fd);
+        return;
+    }
+    fprintf(f, "jntd-manifest %d %lld %ld\n", PLUGIN_MANIFEST_VERSION,
+            (long long)dir_st.st_mtim.tv_sec, (long)dir_st.st_mtim.tv_nsec);
+    for (int i = 0; i < plugin_count; i++) {
+        LoadedPlugin *lp = &loaded_plugins[i];
+        if (lp->removed) continue;
+        fputs("P\t", f);
+        manifest_write_field(f, lp->name);
+        fprintf(f, "\t%s\t%lld\t%lld\t%d\n", lp->file, lp->mtime_ns, (long long)lp->size, lp->abi_version);
+        for (int k = 0; k < plugin_command_count; k++) {
+            PluginCommandEntry *c = &plugin_commands[k];
+            if (c->plugin != i) continue;
+            fputs("C\t", f);
+            manifest_write_field(f, c->name);
+            fprintf(f, "\t%u\t", c->caps);
+            manifest_write_field(f, c->descri);
+            fputc('\n', f);
+        }
+    }
+    fputs("end\n", f);
+    fflush(f);
+    if (ftruncate(fd, ftell(f)) != 0) perror("Erro ao gravar o manifesto de plugins");
+    fclose(f);
+}
+
+// Carrega o manifesto se ele ainda descreve a pasta; false pede reconstrucao.
+static bool plugin_manifest_load(const struct stat *dir_st) {
+    FILE *f = fopen(PLUGIN_MANIFEST, "r");
+    if (!f) return false;
+    char line[1024];
+    int version;
+    long long sec;
+    long nsec;
+    bool ok = fgets(line, sizeof(line), f) &&
+              sscanf(line, "jntd-manifest %d %lld %ld", &version, &sec, &nsec) == 3 &&
+              version == PLUGIN_MANIFEST_VERSION &&
+              sec == (long long)dir_st->st_mtim.tv_sec && nsec == (long)dir_st->st_mtim.tv_nsec;
+    bool complete = false;
+    int current = -1;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strcmp(line, "end") == 0) {
+            complete = true;
+            break;
+        }
+        char *fields[6] = {0};
+        int n = 0;
+        for (char *p = line; p && n < 6; n++) {
+            fields[n] = p;
+            p = strchr(p, '\t');
+            if (p) *p++ = '\0';
+        }
+        if (strcmp(fields[0], "P") == 0 && n == 6) {
+            current = add_plugin(fields[1], fields[2], atoll(fields[3]),
+                                 (off_t)atoll(fields[4]), atoi(fields[5]));
+        } else if (strcmp(fields[0], "C") == 0 && n >= 3 && current >= 0) {
+            add_plugin_command(fields[1], n > 3 && fields[3][0] ? fields[3] : NULL,
+                               (unsigned)strtoul(fields[2], NULL, 10), current);
+        } else {
+            ok = false;
+        }
+    }
+    fclose(f);
+    if (!ok || !complete) {
+        plugin_registry_clear();
+        return false;
+    }
+    return true;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Reconstroi o manifesto abrindo cada .so da pasta (so quando ela mudou);
+// veja plugin_probe sobre o que o dlopen executa.
+static void plugin_manifest_rebuild() {
+    plugin_registry_clear();
+    DIR *dir = opendir(PLUGIN_DIR);
+    if (!dir) return;
+    char **files = NULL;
+    int count = 0, cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len < 4 || strcmp(ent->d_name + len - 3, ".so") != 0) continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            char **grown = realloc(files, cap * sizeof(char *));
+            if (!grown) break;
+            files = grown;
+        }
+        files[count++] = strdup(ent->d_name);
+    }
+    closedir(dir);
+    // ordem estavel: em caso de nomes repetidos, o primeiro arquivo vence
+    qsort(files, count, sizeof(char *), compare_strings);
+    for (int i = 0; i < count; i++) {
+        plugin_probe(files[i]);
+        free(files[i]);
+    }
+    free(files);
+    plugin_manifest_save();
+}
+
 void load_plugins() {
-    DIR *dir = opendir("plugins");
-    if (!dir) {
+    struct stat dir_st;
+    const char *isolation = getenv("JNTD_PLUGIN_ISOLATION");
+    plugin_isolate_all = isolation && strcmp(isolation, "all") == 0;
+    if (stat(PLUGIN_DIR, &dir_st) != 0) {
         printf("Pasta de plugins não encontrada. Criando...\n");
-        mkdir("plugins", 0700);  // Cria a pasta se não existir
+        mkdir(PLUGIN_DIR, 0700);  // Cria a pasta se não existir
         return;
     }
+    if (!plugin_manifest_load(&dir_st)) plugin_manifest_rebuild();
+    router_mark_dirty();
+    completion_mark_dirty();
+}
 
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL && plugin_count < 20) {
-        if (strstr(ent->d_name, ".so")) {
-		char plugin_path[512];
-		snprintf(plugin_path, sizeof(plugin_path), "plugins/%s", ent->d_name);
+// Abre de verdade o plugin na primeira chamada: dlopen, resolve as funcoes
+// dos comandos e roda o init. Se a biblioteca mudou desde o manifesto, os
+// comandos sao sincronizados com o que ela declara agora.
+static bool plugin_ensure_loaded(int idx) {
+    LoadedPlugin *lp = &loaded_plugins[idx];
+    if (lp->handle) return true;
+    if (lp->failed) return false;
 
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), PLUGIN_DIR "/%s", lp->file);
+    Plugin *v1;
+    PluginV2 *v2;
+    void *handle = NULL;
+    if (stat(path, &st) == 0) handle = plugin_open_fresh(path, &v1, &v2);
+    if (!handle) {
+        lp->failed = true;
+        return false;
+    }
+    if (v2 && interactive) {
+        plugin_set_notifier_func set_notifier = (plugin_set_notifier_func)dlsym(handle, "plugin_set_notifier");
+        if (set_notifier) set_notifier(plugin_notify);
+    }
+    if (v2 && v2->init && v2->init() != 0) {
+        fprintf(stderr, "Erro: init do plugin %s falhou.\n", path);
+        dlclose(handle);
+        lp->failed = true;
+        return false;
+    }
+    lp->handle = handle;
+    lp->v1 = v1;
+    lp->v2 = v2;
 
-		//carrega a biblioteca compartilhada//
-		void *handle = dlopen(plugin_path, RTLD_LAZY);
-		if (!handle) {
-			fprintf(stderr, "Erro ao carregar o plugin %s: %s\n", plugin_path, dlerror());
-			continue;
-		}
-		// Procura a função registrar plugin dentro da biblioteca//
-		Plugin *(*register_func)();//declara uma função de pointer//
-		register_func = dlsym(handle, "register_plugin");
-		if (!register_func) {
-			fprintf(stderr, "Erro: Plugin %s não tem função register_plugin.\n", plugin_path);
-			dlclose(handle);
-			continue;
-		}
-		//chama a função para conseguir a data do plugin//
-		Plugin *p = register_func();
-		if (!p) {
-			fprintf(stderr, "Erro: register_plugin em %s retornou NULL.\n", plugin_path);
-			dlclose(handle);
-			continue;
-		}
-		//armazena o handle e a data do plugin//
-		loaded_plugins[plugin_count].handle = handle;
-		loaded_plugins[plugin_count].plugin = p;
-		plugin_count++;
-		printf("Plugin '%s' carregado com sucesso.\n", p->name);
-	}
+    bool changed = stat_mtime_ns(&st) != lp->mtime_ns || st.st_size != lp->size || lp->abi_version != (v2 ? 2 : 1);
+    if (changed) {
+        lp->mtime_ns = stat_mtime_ns(&st);
+        lp->size = st.st_size;
+        lp->abi_version = v2 ? 2 : 1;
+        // troca o conjunto inteiro: comandos que a nova versao nao declara
+        // mais saem da tabela
+        plugin_remove_commands(idx);
+        plugin_register_commands(idx, v1, v2);
+        router_mark_dirty();
+        completion_mark_dirty();
     }
-    closedir(dir);
+    if (v2) {
+        for (int i = 0; i < v2->command_count; i++) {
+            PluginCommandEntry *c = v2->commands[i].name ? find_plugin_command(v2->commands[i].name) : NULL;
+            if (c && c->plugin == idx) {
+                c->run = v2->commands[i].run;
+                c->caps = v2->commands[i].caps;
+            }
+        }
+    }
+    if (changed) plugin_manifest_save();
+    return true;
+}
+
+// Chama os shutdown dos plugins carregados e descarrega as bibliotecas.
+void unload_plugins() {
+    for (int i = plugin_count - 1; i >= 0; i--) {
+        LoadedPlugin *lp = &loaded_plugins[i];
+        plugin_host_stop(lp);
+        if (!lp->handle) continue;
+        if (lp->v2 && lp->v2->shutdown) lp->v2->shutdown();
+        dlclose(lp->handle);
+        lp->handle = NULL;
+    }
+    plugin_registry_clear();
+    router_mark_dirty();
+    completion_mark_dirty();
+}
+
+// Recarga a quente. Os eventos de plugins/ sao agrupados por arquivo e o
+// estado final e conferido com stat: um 'ld -o' gera DELETE + CLOSE_WRITE
+// e isso deve virar uma unica recarga, nao remocao seguida de adicao.
+#define PLUGIN_WATCH_MAX_NAMES 64
+
+void plugin_watch_start() {
+    if (plugin_watch_fd >= 0) return;
+    plugin_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (plugin_watch_fd < 0) return;
+    if (inotify_add_watch(plugin_watch_fd, PLUGIN_DIR,
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+        close(plugin_watch_fd);
+        plugin_watch_fd = -1;
+    }
+}
+
+static int plugin_find_by_file(const char *file) {
+    for (int i = 0; i < plugin_count; i++) {
+        if (!loaded_plugins[i].removed && strcmp(loaded_plugins[i].file, file) == 0) return i;
+    }
+    return -1;
+}
+
+// Descarrega e desregistra um plugin. Retorna false se ainda ha chamadas em
+// andamento; o evento fica pendente e e tentado de novo no proximo poll.
+static bool plugin_retire(int idx) {
+    LoadedPlugin *lp = &loaded_plugins[idx];
+    if (__atomic_load_n(lp->in_flight, __ATOMIC_ACQUIRE) > 0) return false;
+    plugin_host_stop(lp);
+    if (lp->handle) {
+        if (lp->v2 && lp->v2->shutdown) lp->v2->shutdown();
+        dlclose(lp->handle);
+        lp->handle = NULL;
+    }
+    plugin_remove_commands(idx);
+    // a posicao fica livre para o proximo add_plugin
+    free(lp->name);
+    free(lp->file);
+    lp->name = NULL;
+    lp->file = NULL;
+    lp->removed = true;
+    return true;
+}
+
+// Aplica o estado atual de um arquivo de plugins/; retorna false se precisa
+// esperar chamadas em andamento.
+static bool plugin_watch_apply(const char *file) {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), PLUGIN_DIR "/%s", file);
+    bool exists = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+    int idx = plugin_find_by_file(file);
+    if (idx >= 0 && exists && !loaded_plugins[idx].failed &&
+        loaded_plugins[idx].mtime_ns == stat_mtime_ns(&st) && loaded_plugins[idx].size == st.st_size) {
+        return true; // nada mudou (ex.: o proprio ensure_loaded ja sincronizou)
+    }
+    char *name = idx >= 0 ? strdup(loaded_plugins[idx].name) : NULL;
+    bool isolated = idx >= 0 && loaded_plugins[idx].isolated;
+    if (idx >= 0 && !plugin_retire(idx)) {
+        free(name);
+        return false;
+    }
+    int added = exists ? plugin_probe(file) : -1;
+    if (added >= 0 && isolated) loaded_plugins[added].isolated = true;
+    if (interactive) {
+        if (added >= 0 && name) printf("Plugin '%s' recarregado.\n", loaded_plugins[added].name);
+        else if (added >= 0) printf("Plugin '%s' adicionado.\n", loaded_plugins[added].name);
+        else if (name) printf("Plugin '%s' removido.\n", name);
+    }
+    free(name);
+    return true;
+}
+
+// Chamado entre comandos: le os eventos pendentes e aplica as mudancas.
+void plugin_watch_poll() {
+    static char *pending[PLUGIN_WATCH_MAX_NAMES];
+    static int pending_count = 0;
+    if (plugin_watch_fd < 0) return;
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    bool overflow = false;
+    while ((n = read(plugin_watch_fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) overflow = true;
+            size_t len = ev->len ? strlen(ev->name) : 0;
+            if (len < 4 || strcmp(ev->name + len - 3, ".so") != 0) continue;
+            bool seen = false;
+            for (int i = 0; i < pending_count && !seen; i++) seen = strcmp(pending[i], ev->name) == 0;
+            if (seen) continue;
+            if (pending_count == PLUGIN_WATCH_MAX_NAMES) overflow = true;
+            else pending[pending_count++] = strdup(ev->name);
+        }
+    }
+    if (overflow) {
+        // fila do inotify estourou: confere todos os plugins conhecidos e a pasta
+        DIR *dir = opendir(PLUGIN_DIR);
+        struct dirent *ent;
+        while (dir && (ent = readdir(dir)) != NULL && pending_count < PLUGIN_WATCH_MAX_NAMES) {
+            size_t len = strlen(ent->d_name);
+            if (len >= 4 && strcmp(ent->d_name + len - 3, ".so") == 0) pending[pending_count++] = strdup(ent->d_name);
+        }
+        if (dir) closedir(dir);
+        for (int i = 0; i < plugin_count && pending_count < PLUGIN_WATCH_MAX_NAMES; i++) {
+            if (!loaded_plugins[i].removed) pending[pending_count++] = strdup(loaded_plugins[i].file);
+        }
+    }
+    if (pending_count == 0) return;
+
+    int kept = 0;
+    for (int i = 0; i < pending_count; i++) {
+        if (plugin_watch_apply(pending[i])) free(pending[i]);
+        else pending[kept++] = pending[i];
+    }
+    pending_count = kept;
+    plugin_manifest_save();
+    plugin_load_notifiers();
+    router_mark_dirty();
+    completion_mark_dirty();
 }
 
-void handle_alias_command(const char *args) {
+int handle_alias_command(const char *args) {
 	if (!args || strlen(args) == 0) {
 		printf("Uso: alias <nome> \"<comando>\"\n");
 		printf("Exemplo: alias listar \"ls -la\"\n");
@@ -212,11 +824,11 @@ void handle_alias_command(const char *args) {
 		for (int i = 0; i < alias_count; i++) {
 			printf("  %s = \"%s\"\n", alias_list[i].name, alias_list[i].command);
 		}
-		return;
+		return 0;
 	}
 	if (alias_count >= MAX_ALIASES) {
 		printf("Erro: Limite de aliases atingido.\n");
-		return;
+		return 1;
 	}
 	char args_copy[256];
 	strncpy(args_copy, args, sizeof(args_copy) - 1);
@@ -225,7 +837,7 @@ void handle_alias_command(const char *args) {
 	char *command = strtok(NULL, "");
 	if (!name || !command) {
 		printf("Erro: Formato Invalido. Use: alias <nome>\"<comando>\"\n");
-		return;
+		return 2;
 	}
 	
 	if (command[0] == '"' || command[0] == '\'') {
@@ -240,11 +852,14 @@ void handle_alias_command(const char *args) {
 		printf("Erro de alocação de memoria!\n");
 		free(alias_list[alias_count].name);
 		free(alias_list[alias_count].command);
-		return;
+		return 1;
 	}
 	printf("Alias criado: %s -> %s\n", name, command);
 	alias_count++;
+	router_mark_dirty();
+	completion_mark_dirty();
 	save_aliases_to_file();
+	return 0;
 }
 
 void load_aliases_from_file() {
@@ -278,910 +893,4001 @@ void save_aliases_to_file() {
 	fclose(file);
 }
 
-//Função para executar os plugins
-void execute_plugin(const char* name, const char* args) {
-    for (int i = 0; i < plugin_count; i++) {
-        if (strcmp(name, loaded_plugins[i].plugin->name) == 0) {
-            // Desativa o modo raw para que o plugin possa usar I/O padrão
-            disable_raw_mode(); 
-            
-            printf("Executando plugin: %s com argumentos: %s\n", name, args ? args : "");
-            loaded_plugins[i].plugin->execute(args);
-            
-            // Reativa o modo raw para o shell principal
-            enable_raw_mode(); 
-            return;
+// Separa os argumentos de um plugin no lugar (buf e modificado). Espacos
+// separam, aspas simples ou duplas agrupam e '\\' escapa o proximo caractere.
+// argv[0] recebe o nome do comando; retorna argc.
+static int plugin_tokenize(const char *name, char *buf, char **argv, int max_args) {
+    int argc = 0;
+    argv[argc++] = (char *)name;
+    char *r = buf, *w = buf;
+    while (*r && argc < max_args - 1) {
+        while (*r == ' ' || *r == '\t') r++;
+        if (!*r) break;
+        argv[argc++] = w;
+        char quote = 0;
+        for (; *r; r++) {
+            if (quote) {
+                if (*r == quote) quote = 0;
+                else *w++ = *r;
+            } else if (*r == '"' || *r == '\'') {
+                quote = *r;
+            } else if (*r == '\\' && r[1]) {
+                *w++ = *++r;
+            } else if (*r == ' ' || *r == '\t') {
+                r++;
+                break;
+            } else {
+                *w++ = *r;
+            }
         }
+        *w++ = '\0';
     }
-    printf("Plugin '%s' não encontrado.\n", name);
+    argv[argc] = NULL;
+    // argumentos que nao couberam: -1 em vez de cortar em silencio
+    while (*r == ' ' || *r == '\t') r++;
+    return *r ? -1 : argc;
 }
 
-typedef struct {
-	FILE *fp;
-	size_t dl_total;
-} dl_status;
+static int plugin_too_many_args(FILE *out, const char *name) {
+    fprintf(out, "Erro: argumentos demais para '%s' (máximo %d).\n", name, PLUGIN_MAX_ARGS - 2);
+    return 2;
+}
 
+// Host de plugins fora do processo. Um plugin isolado roda num processo
+// filho que faz o dlopen e o init por conta propria; um plugin que trava ou
+// vaza memoria derruba so o filho. O filho e o proprio executavel de novo
+// (posix_spawn de /proc/self/exe com --plugin-host), nao um fork: o nucleo
+// ja tem threads (jobs, timers) e um fork copiaria locks presos por elas.
+// A memoria compartilhada (memfd) e os eventfds chegam nos fds
+// HOST_FD_SHM..HOST_FD_HOST. Nucleo e filho conversam por
+// dois aneis SPSC em memoria compartilhada (pedidos e respostas). Quem
+// espera gira um pouco e depois dorme num eventfd; quem escreve so faz a
+// syscall de acordar se o outro lado marcou que esta dormindo, entao uma
+// chamada com os dois lados ativos nao passa pelo kernel.
+#define HOST_RING_SIZE (1 << 16)
+#define HOST_OUT_CHUNK 4096
+#define HOST_SPIN 2000   // iteracoes de espera ativa antes de dormir (so com 2+ CPUs)
+#define HOST_POLL_MS 100
+#define HOST_FD_SHM 3
+#define HOST_FD_CORE 4
+#define HOST_FD_HOST 5
 
-//função para escrever no arquivo//
-static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream) {
-	dl_status *status = (dl_status *)stream;
-	size_t written = fwrite(ptr, size, nmemb, status->fp);
+// HOST_MSG_TOO_BIG nao trafega: e o que host_ring_recv retorna para uma
+// mensagem maior que o buffer (descartada; o protocolo quebrou)
+enum { HOST_MSG_CALL = 1, HOST_MSG_SHUTDOWN, HOST_MSG_READY, HOST_MSG_OUT, HOST_MSG_DONE, HOST_MSG_TOO_BIG };
 
-	status->dl_total += written;
+typedef struct {
+    _Alignas(64) uint64_t head;           // escrito so pelo produtor
+    _Alignas(64) uint64_t tail;           // escrito so pelo consumidor
+    _Alignas(64) int reader_waiting;      // consumidor dormindo no eventfd
+    int writer_waiting;                   // produtor esperando espaco
+    _Alignas(64) unsigned char data[HOST_RING_SIZE];
+} HostRing;
 
-    // Converte o total de bytes para megabytes
-    double mb_total = (double)status->dl_total / (1024.0 * 1024.0);
+typedef struct {
+    HostRing req;   // nucleo -> host
+    HostRing resp;  // host -> nucleo
+} HostShared;
 
-    // Imprime o progresso formatado em MB, usando  para atualizar a linha
-	printf("\rDownload: %.2f MB        ", mb_total);
-	fflush(stdout);
-	return written;
+struct PluginHost {
+    pid_t pid;
+    bool exited;    // o waitpid ja recolheu o filho
+    int wstatus;
+    int core_efd;   // o nucleo dorme aqui
+    int host_efd;   // o host dorme aqui
+    HostShared *shm;
+    unsigned long calls;
+};
 
+static inline void host_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile("pause");
+#endif
 }
 
-//Função para fazer o download da função//
-bool download_file(char *url, char *filename) {
-	bool sucess = true;
+static void host_wake(int *flag, int efd) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(flag, __ATOMIC_RELAXED)) {
+        uint64_t one = 1;
+        ssize_t w = write(efd, &one, sizeof(one));
+        (void)w;
+    }
+}
 
-	CURL *curl_handle = curl_easy_init();
+static bool host_ring_ready(HostRing *r, bool writer, size_t need) {
+    uint64_t used = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    return writer ? HOST_RING_SIZE - used >= need : used >= need;
+}
 
-	curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-	curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 0L);
-	curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
-	curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
-	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_data);
-	curl_easy_setopt(curl_handle, CURLOPT_FAILONERROR, 1L);
+// Espera ate haver espaco (writer) ou dados (leitor). Gira primeiro; depois
+// marca a flag e dorme no eventfd. timeout_ms < 0 espera indefinidamente.
+static bool host_ring_wait(HostRing *r, bool writer, size_t need, int efd, int timeout_ms) {
+    // Com uma CPU so, girar apenas atrasa o outro processo
+    static int spin = -1;
+    if (spin < 0) spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? HOST_SPIN : 0;
+    for (int i = 0; i < spin; i++) {
+        if (host_ring_ready(r, writer, need)) return true;
+        host_cpu_relax();
+    }
+    int *flag = writer ? &r->writer_waiting : &r->reader_waiting;
+    __atomic_store_n(flag, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool ready = host_ring_ready(r, writer, need);
+    if (!ready) {
+        struct pollfd pfd = { efd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            uint64_t v;
+            ssize_t n = read(efd, &v, sizeof(v));
+            (void)n;
+        }
+        ready = host_ring_ready(r, writer, need);
+    }
+    __atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+    return ready;
+}
 
-	FILE *pagefile = fopen(filename, "wb");
-	
-	if (!pagefile) {
-		perror("Erro ao baixar o arquivo");
-		curl_easy_cleanup(curl_handle);
-		return false;
-	}
+static void host_ring_copy_in(HostRing *r, uint64_t pos, const void *src, size_t n) {
+    size_t off = pos & (HOST_RING_SIZE - 1);
+    size_t first = n < HOST_RING_SIZE - off ? n : HOST_RING_SIZE - off;
+    memcpy(r->data + off, src, first);
+    memcpy(r->data, (const char *)src + first, n - first);
+}
 
-	dl_status status;
-	status.dl_total = 0;
-	status.fp = pagefile;
-	
-curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &status);
-	
-	for (int i = 0; i < 5; i++) {
-		CURLcode res = curl_easy_perform(curl_handle);
-		if (res != CURLE_OK) {
-			sucess = false;
-			fprintf(stderr, "Falha na tentativa %d: %s\n", i + 1, curl_easy_strerror(res));
-		} else {
-			sucess = true;
-		}
-		if (sucess) {
-			break;
-		}
-		sleep(1);
-	}
-	fclose(pagefile);
-	
-	if (!sucess) {
-		remove(filename);
-	}
-	printf("\n");
-    return sucess;
+static void host_ring_copy_out(HostRing *r, uint64_t pos, void *dst, size_t n) {
+    size_t off = pos & (HOST_RING_SIZE - 1);
+    size_t first = n < HOST_RING_SIZE - off ? n : HOST_RING_SIZE - off;
+    memcpy(dst, r->data + off, first);
+    memcpy((char *)dst + first, r->data, n - first);
 }
 
-//Função que faz copia entre arquvios de texto.
-int copy_f_t() {
-	FILE *fptr1, *fptr2;
-	char filename[100];
-	int c;
-	printf("Coloque o nome do arquivo para copiar\n");
-	scanf("%s", filename);
-	fptr1 = fopen(filename, "r");
-	if (fptr1 == NULL) {
-		printf("Não foi possivel abrir o arquivo %s\n", filename);
-		exit(1);
-	}
-	printf("Coloque o nome do arquivo para ser escrito\n");
-	scanf("%s", filename);
+// true se o processo do outro lado ja morreu (e guarda como)
+static bool host_peer_gone(PluginHost *peer) {
+    if (!peer) return false;
+    if (!peer->exited && waitpid(peer->pid, &peer->wstatus, WNOHANG) == peer->pid) peer->exited = true;
+    return peer->exited;
+}
 
-	fptr2 = fopen(filename, "w");
-	if (fptr2 == NULL) {
-		printf("Não foi possivel o arquivo %s\n", filename);
-		exit(1);
-	}
-	while ((c = fgetc(fptr1)) != EOF) {
-		fputc(c, fptr2);
-	}
-	printf("Conteudo copiado para %s\n", filename);
-	fclose(fptr1);
-	fclose(fptr2);
-	return 0;
+// Publica uma mensagem [tamanho][tipo][dados]; o cabecalho so fica visivel
+// junto com os dados. peer_efd acorda o leitor, self_efd e onde esperamos.
+static bool host_ring_send(HostRing *r, uint32_t type, const void *payload, uint32_t len,
+                           int peer_efd, int self_efd, PluginHost *peer) {
+    size_t need = 8 + (size_t)len;
+    while (!host_ring_wait(r, true, need, self_efd, peer ? HOST_POLL_MS : -1)) {
+        if (host_peer_gone(peer)) return false;
+    }
+    uint64_t head = r->head;
+    uint32_t hdr[2] = { len, type };
+    host_ring_copy_in(r, head, hdr, sizeof(hdr));
+    if (len) host_ring_copy_in(r, head + 8, payload, len);
+    __atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+    host_wake(&r->reader_waiting, peer_efd);
+    return true;
 }
 
-// Função para verificar segurança de comandos
-int is_safe_command(const char *cmd) {
-    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
-        if (strcasecmp(cmd, cmds[i].key) == 0) {
-            return 1; // Comando está na lista de permitidos
-        }
+// Le a proxima mensagem para buf (ate cap bytes); retorna o tipo, 0 se o
+// processo do outro lado morreu enquanto esperavamos, ou HOST_MSG_TOO_BIG se
+// a mensagem nao cabe em buf (ela e pulada, *len recebe o tamanho real).
+static uint32_t host_ring_recv(HostRing *r, void *buf, uint32_t cap, uint32_t *len,
+                               int peer_efd, int self_efd, PluginHost *peer) {
+    while (!host_ring_wait(r, false, 8, self_efd, peer ? HOST_POLL_MS : -1)) {
+        if (host_peer_gone(peer)) return 0;
     }
-    return 0; // Comando não reconhecido, não é seguro
+    uint64_t tail = r->tail;
+    uint32_t hdr[2];
+    host_ring_copy_out(r, tail, hdr, sizeof(hdr));
+    *len = hdr[0];
+    if (hdr[0] <= cap) host_ring_copy_out(r, tail + 8, buf, hdr[0]);
+    __atomic_store_n(&r->tail, tail + 8 + hdr[0], __ATOMIC_RELEASE);
+    host_wake(&r->writer_waiting, peer_efd);
+    return hdr[0] <= cap ? hdr[1] : HOST_MSG_TOO_BIG;
 }
 
-// Funções para histórico de comandos
-void add_to_history(const char *cmd) {
-    if (history_count < MAX_HISTORY) {
-        command_history[history_count] = strdup(cmd); // Aloca memoria
-        history_count++;
-    } else {
-        free(command_history[0]);
-        for (int i = 1; i < MAX_HISTORY; i++) {
-            command_history[i - 1] = command_history[i];
-        }
-        command_history[MAX_HISTORY - 1] = strdup(cmd);
+// --- lado do filho ---
+
+static ssize_t host_out_write(void *cookie, const char *buf, size_t size) {
+    PluginHost *h = cookie;
+    for (size_t done = 0; done < size;) {
+        uint32_t n = size - done < HOST_OUT_CHUNK ? size - done : HOST_OUT_CHUNK;
+        host_ring_send(&h->shm->resp, HOST_MSG_OUT, buf + done, n, h->core_efd, h->host_efd, NULL);
+        done += n;
     }
+    return size;
 }
 
-void display_history() {
-    printf("Historico de comandos:\n");
-    for (int i = 0; i < history_count; i++) {
-        printf("  %d: %s\n", i + 1, command_history[i]);
+static void plugin_host_main(PluginHost *h, const char *file) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    signal(SIGINT, SIG_IGN);
+
+    // stdout do filho tambem vai para o anel: printf de plugins v1 aparece na ordem certa
+    cookie_io_functions_t io = { NULL, host_out_write, NULL, NULL };
+    FILE *out = fopencookie(h, "w", io);
+    setvbuf(out, NULL, _IOFBF, HOST_OUT_CHUNK);
+    stdout = out;
+
+    char path[PATH_MAX], copy[PATH_MAX];
+    snprintf(path, sizeof(path), PLUGIN_DIR "/%s", file);
+    Plugin *v1;
+    PluginV2 *v2;
+    void *handle = NULL;
+    if (plugin_copy_for_load(path, copy, sizeof(copy))) {
+        handle = plugin_open(copy, &v1, &v2);
+        unlink(copy);
     }
-}
+    int32_t ready = handle && !(v2 && v2->init && v2->init() != 0) ? 0 : -1;
+    fflush(stderr);
+    host_ring_send(&h->shm->resp, HOST_MSG_READY, &ready, sizeof(ready), h->core_efd, h->host_efd, NULL);
+    if (ready != 0) _exit(1);
 
-void quiz_aleatorio() {
-    printf("Você deseja jogar o QUIZ? (s/n)\n");
-    char respostas[256];
-    if (fgets(respostas, sizeof(respostas), stdin) != NULL) {
-        respostas[strcspn(respostas, "\n")] = '\0'; // Remove newline character
-        if (strcasecmp(respostas, "s") == 0 || strcasecmp(respostas, "sim") == 0) {
-            char* linha_aleatoria = read_random_line();
-            if (linha_aleatoria != NULL) {
-                printf("Pergunta aleatória: %s\n", linha_aleatoria);
-                free(linha_aleatoria); // Libera a memória alocada por read_random_line
-            } else {
-                printf("Erro ao obter uma pergunta aleatória.\n");
+    static char msg[2 * COMMAND_LINE_MAX + 64];
+    for (;;) {
+        uint32_t len;
+        uint32_t type = host_ring_recv(&h->shm->req, msg, sizeof(msg) - 1, &len, h->core_efd, h->host_efd, NULL);
+        if (type != HOST_MSG_CALL) break;
+        msg[len] = '\0';
+        // payload: nome\0argumentos\0
+        const char *name = msg;
+        const char *args = msg + strlen(name) + 1;
+        int32_t status = 127;
+        if (v2) {
+            for (int i = 0; i < v2->command_count; i++) {
+                if (!v2->commands[i].name || strcasecmp(v2->commands[i].name, name) != 0) continue;
+                char buf[COMMAND_LINE_MAX];
+                char *argv[PLUGIN_MAX_ARGS];
+                snprintf(buf, sizeof(buf), "%s", args);
+                PluginCall call;
+                call.argc = plugin_tokenize(v2->commands[i].name, buf, argv, PLUGIN_MAX_ARGS);
+                call.argv = argv;
+                call.raw_args = args;
+                call.out = out;
+                status = call.argc < 0 ? plugin_too_many_args(out, name) : v2->commands[i].run(&call);
+                break;
             }
         } else {
-            printf("Não foi possível identificar a resposta\n");
+            v1->execute(*args ? args : NULL);
+            status = 0;
         }
-    } else {
-        printf("Erro ao ler a resposta\n");
+        fflush(out);
+        fflush(stderr);
+        host_ring_send(&h->shm->resp, HOST_MSG_DONE, &status, sizeof(status), h->core_efd, h->host_efd, NULL);
     }
+    if (v2 && v2->shutdown) v2->shutdown();
+    fflush(out);
+    _exit(0);
 }
 
-void timer() {
-	if (timer_running) {
-		printf("Um timer já está em execução! Cancele-o primeiro com 'timer cancel'.\n");
-		return;
-	}
-
-	printf("Um simples timer, que agora roda em segundo plano, qual a duração dele? (0 para cancelar)\n");
-	scanf("%d", &seconds);
-	if (seconds <= 0) {
-		printf("O Timer foi cancelado.\n");
-		return;
-	}
-	//Cria a thread para o timer//
-	#ifdef _WIN32
-	//No windows, criar thread com o CreateThread (precisa ser implementado se necessario)
-	printf("Thread no windows não implementado ainda, usando modo bloquante temporariamente.\n");
-	timer_background(&seconds);
-	#else
-	if (pthread_create(&timer_thread, NULL, timer_background, &seconds) != 0) {
-		perror("Erro ao criar thread do timer\n");
-		return;
-	}
-	//Opcional: desanexar a thread para não precisa de join//
-	pthread_detach(timer_thread);
-	#endif
+// Entrada de "jntd --plugin-host <arquivo>": monta o PluginHost com os fds
+// herdados e nao volta.
+static int plugin_host_exec_main(const char *file) {
+    PluginHost h = { .core_efd = HOST_FD_CORE, .host_efd = HOST_FD_HOST };
+    h.shm = mmap(NULL, sizeof(HostShared), PROT_READ | PROT_WRITE, MAP_SHARED, HOST_FD_SHM, 0);
+    close(HOST_FD_SHM);
+    if (h.shm == MAP_FAILED) return 1;
+    // o que o plugin rodar (system, popen) nao herda os eventfds
+    fcntl(HOST_FD_CORE, F_SETFD, FD_CLOEXEC);
+    fcntl(HOST_FD_HOST, F_SETFD, FD_CLOEXEC);
+    plugin_host_main(&h, file);
+    return 1;
 }
 
-void quiz_timer() {
-	if (quiz_timer_running) {
-		printf("Um quiz timer já está em execução! Cancele-o primeiro com 'quizt cancel'.\n");
-		return;
-	}
-	printf("Qual o intervalo de tempo QUIZES em segundos? (Aperte enter para o padrão, 10[600s] min)\n");
-	char input[256];
-	if (fgets(input, sizeof(input), stdin) == NULL || input[0] == '\n') {
-		seconds = 600;
-	} else {
-		seconds = atoi(input);
-		if (seconds <= 0) seconds = 600;
-	}
+// --- lado do nucleo ---
 
-	#ifdef _WIN32
-	printf("Thread no windows não implementado ainda, usando o modo bloqueado temporariamente.\n");
-	quiz_timer_background(&seconds);//simulação roda na thread principal por agr
-	#else
-	if (pthread_create(&quiz_thread, NULL, quiz_timer_background, &seconds) != 0) {
-		perror("Erro ao criar thread do quiz_timer");
-		return;
-	}
-	pthread_detach(quiz_thread);
-	#endif
+static void plugin_host_free(PluginHost *h) {
+    if (h->shm) munmap(h->shm, sizeof(HostShared));
+    if (h->core_efd >= 0) close(h->core_efd);
+    if (h->host_efd >= 0) close(h->host_efd);
+    free(h);
 }
 
-//função para cancelar timers
-void cancel_timer(const char *type) {
-	if (strcmp(type, "timer") == 0) {
-		if (timer_running) {
-			timer_running = 0;
-			printf("Timer cancelado.\n");
-		} else {
-			printf("Nenhum timer em execução.\n");
-		}
-	} else if (strcmp(type, "quizt") == 0) {
-		if (quiz_timer_running) {
-			quiz_timer_running = 0;
-			printf("Quiz timer cancelado.\n");
-			} else {
-				printf("Nenhum quiz timer em execução.\n");
-		}
-	}
+static void plugin_host_stop(LoadedPlugin *lp) {
+    PluginHost *h = lp->host;
+    if (!h) return;
+    lp->host = NULL;
+    if (!host_peer_gone(h)) {
+        host_ring_send(&h->shm->req, HOST_MSG_SHUTDOWN, NULL, 0, h->host_efd, h->core_efd, h);
+        // da um tempo para o shutdown do plugin; depois forca
+        for (int i = 0; i < 50 && !host_peer_gone(h); i++) usleep(2000);
+        if (!h->exited && kill(h->pid, SIGKILL) == 0) waitpid(h->pid, NULL, 0);
+    }
+    plugin_host_free(h);
 }
 
-void *timer_background(void *arg) {
-	int seconds = *(int*)arg;//Recebe o tempo em segundos
-	current_timer_seconds = seconds;
-	timer_running = 1;
-	printf("\rTimer iniciado em segundo plano: %d segundos\n", seconds);
-	while (current_timer_seconds > 0 && timer_running) {
-		// int horas = current_timer_seconds / 3600;
-		// int minutos = (current_timer_seconds % 3600) / 60;
-		// int segundos = current_timer_seconds % 60;
-		//printf("\rTimer: %02d:%02d:%02d\n", horas, minutos, segundos);
-		//fflush(stdout);
-		#ifdef _WIN32
-		sleep(1000);// 1 segundo no windows//
-		#else
-		sleep(1);
-		#endif
-		current_timer_seconds--;
-	}
-	if (timer_running) {
-		printf("\rO Tempo acabou!\n");
-		printf("Aperte enter para continuar\n");
-		return NULL;
-	} else {
-		printf("\rTimer cancelado!\n");
-	}
-	timer_running = 0;
-	return NULL;
+// Tira o fd da faixa HOST_FD_SHM..HOST_FD_HOST: dup2 de um fd para ele
+// mesmo nao limpa o FD_CLOEXEC em toda glibc, e o filho o perderia no exec.
+static int host_fd_above(int fd) {
+    if (fd < 0 || fd > HOST_FD_HOST) return fd;
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, HOST_FD_HOST + 1);
+    close(fd);
+    return moved;
 }
 
-void *quiz_timer_background(void *arg) {
-	int seconds = *(int*)arg; //Recebe o tempo em segudos//
-	quiz_timer_running = 1;
-	printf("Quiz Timer iniciado em segundo plano %d segundo\n", seconds);
-	while (quiz_timer_running) {
-		#ifdef _WIN32
-		Sleep(seconds * 1000);
-		#else
-		sleep(seconds);
-		#endif
+static PluginHost *plugin_host_start(LoadedPlugin *lp) {
+    PluginHost *h = calloc(1, sizeof(PluginHost));
+    if (!h) return NULL;
+    int shm_fd = host_fd_above(memfd_create("jntd-plugin-host", MFD_CLOEXEC));
+    h->core_efd = host_fd_above(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    h->host_efd = host_fd_above(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    h->shm = shm_fd < 0 || ftruncate(shm_fd, sizeof(HostShared)) != 0 ? MAP_FAILED :
+             mmap(NULL, sizeof(HostShared), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (h->shm == MAP_FAILED || h->core_efd < 0 || h->host_efd < 0) {
+        if (h->shm == MAP_FAILED) h->shm = NULL;
+        if (shm_fd >= 0) close(shm_fd);
+        plugin_host_free(h);
+        return NULL;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, shm_fd, HOST_FD_SHM);
+    posix_spawn_file_actions_adddup2(&fa, h->core_efd, HOST_FD_CORE);
+    posix_spawn_file_actions_adddup2(&fa, h->host_efd, HOST_FD_HOST);
+    char *argv[] = { "jntd", "--plugin-host", lp->file, NULL };
+    int err = posix_spawn(&h->pid, "/proc/self/exe", &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(shm_fd);
+    if (err != 0) {
+        fprintf(stderr, "Erro: o host do plugin '%s' nao iniciou: %s\n", lp->name, strerror(err));
+        plugin_host_free(h);
+        return NULL;
+    }
 
-		if (quiz_timer_running) {
-			printf("\n[Quiz Timer] Tempo para uma pergunta!\n");
-			quiz_aleatorio();
-			printf("> "); //Reexibe o prompt para o usuario//
-			fflush(stdout);
-		}
-	}
-	printf("Quiz Timer encerrado.\n");
-	return NULL;
+    int32_t ready = -1;
+    uint32_t len;
+    if (host_ring_recv(&h->shm->resp, &ready, sizeof(ready), &len, h->host_efd, h->core_efd, h) != HOST_MSG_READY ||
+        ready != 0) {
+        fprintf(stderr, "Erro: o host do plugin '%s' nao iniciou.\n", lp->name);
+        if (!host_peer_gone(h)) {
+            kill(h->pid, SIGKILL);
+            waitpid(h->pid, NULL, 0);
+        }
+        plugin_host_free(h);
+        return NULL;
+    }
+    return h;
 }
 
-void func_quiz() {
-    printf("Lista de QUIZ's:\n");
-    printf("------------------------------------------------\n");
-    FILE *quiz_f = fopen("quiz.txt", "r");
-    if (quiz_f == NULL) {
-        perror("Erro ao abrir o arquivo quiz.txt");
-        printf("Não foi possível listar os QUIZ's. Arquivo não encontrado ou sem permissão.\n");
-        return;
+// Executa um comando no host do plugin (subindo o processo se preciso).
+// A saida vai para sink (NULL descarta). Se o host morrer no meio, ele e
+// recolhido e sobe de novo na proxima chamada.
+static int plugin_host_call(LoadedPlugin *lp, const char *name, const char *args, FILE *sink) {
+    if (!lp->host && !(lp->host = plugin_host_start(lp))) return 126;
+    PluginHost *h = lp->host;
+
+    char msg[2 * COMMAND_LINE_MAX + 64];
+    int n = snprintf(msg, sizeof(msg), "%s%c%s", name, '\0', args ? args : "");
+    if (n < 0 || (size_t)n >= sizeof(msg)) n = sizeof(msg) - 1;
+    bool alive = host_ring_send(&h->shm->req, HOST_MSG_CALL, msg, n + 1, h->host_efd, h->core_efd, h);
+    h->calls++;
+
+    char buf[HOST_OUT_CHUNK];
+    uint32_t len;
+    while (alive) {
+        uint32_t type = host_ring_recv(&h->shm->resp, buf, sizeof(buf), &len, h->host_efd, h->core_efd, h);
+        if (type == HOST_MSG_OUT) {
+            if (sink) fwrite(buf, 1, len, sink);
+        } else if (type == HOST_MSG_DONE) {
+            int32_t status;
+            memcpy(&status, buf, sizeof(status));
+            return status;
+        } else {
+            if (type == HOST_MSG_TOO_BIG && !host_peer_gone(h)) {
+                fprintf(stderr, "Erro: o host do plugin '%s' mandou uma mensagem de %u bytes (máximo %zu).\n",
+                        lp->name, len, sizeof(buf));
+                kill(h->pid, SIGKILL);
+            }
+            break;
+        }
     }
-    while (fgets(quiz, sizeof(quiz), quiz_f) != NULL) {
-        quiz[strcspn(quiz, "\n")] = '\0'; // Remove nova linha do final
-        printf("%d: %s\n", ++countar, quiz);
+    // o filho morreu: descobre como e recolhe
+    if (!h->exited) waitpid(h->pid, &h->wstatus, 0);
+    int wstatus = h->wstatus;
+    lp->host = NULL;
+    plugin_host_free(h);
+    if (sink) fflush(sink);
+    if (WIFSIGNALED(wstatus)) {
+        fprintf(stderr, "Plugin '%s' caiu (sinal %d: %s); o shell continua. Ele reinicia na próxima chamada.\n",
+                lp->name, WTERMSIG(wstatus), strsignal(WTERMSIG(wstatus)));
+        return 128 + WTERMSIG(wstatus);
     }
-    fclose(quiz_f);
-    if (countar == 0) {
-	   printf("Nenhum QUIZ encontrado no arquivo.\n");
+    fprintf(stderr, "Plugin '%s' terminou inesperadamente (codigo %d).\n", lp->name, WEXITSTATUS(wstatus));
+    return 126;
+}
+
+// Roda um comando no proprio processo; a saida de comandos v2 vai para out.
+static int plugin_run_inproc(PluginCommandEntry *cmd, const char *args, FILE *out) {
+    LoadedPlugin *lp = &loaded_plugins[cmd->plugin];
+    __atomic_add_fetch(lp->in_flight, 1, __ATOMIC_ACQ_REL);
+    int status = 0;
+    if (cmd->run) {
+        char buf[COMMAND_LINE_MAX];
+        char *argv[PLUGIN_MAX_ARGS];
+        snprintf(buf, sizeof(buf), "%s", args ? args : "");
+        PluginCall call;
+        call.argc = plugin_tokenize(cmd->name, buf, argv, PLUGIN_MAX_ARGS);
+        call.argv = argv;
+        call.raw_args = args ? args : "";
+        call.out = out;
+        status = call.argc < 0 ? plugin_too_many_args(out, cmd->name) : cmd->run(&call);
+        fflush(out);
+    } else {
+        lp->v1->execute(args && *args ? args : NULL);
     }
-    printf("------------------------------------------------\n");
+    __atomic_sub_fetch(lp->in_flight, 1, __ATOMIC_ACQ_REL);
+    return status;
 }
 
-int contar_linhas() {
-	FILE *quizlin = fopen("quiz.txt", "r");
-	if (quizlin == NULL) {
-		perror("Erro ao abrir o arquivo quiz.txt");
-		printf("Não foi possível listar os QUIZ's. Arquivo não encontrado ou sem permissão.\n");
-		return 0;
-	}
-	int linhaslin = 0;
-	char buffin1[1024];
-	while (fgets(buffin1, sizeof(buffin1), quizlin) != NULL) {
-		linhaslin++;
-	}
-	fclose(quizlin);
-	return linhaslin;
+// Resolve o comando; carrega o plugin no processo se ele nao for isolado.
+// Retorna NULL (com a mensagem ja impressa e *status preenchido) se falhar.
+static PluginCommandEntry *plugin_resolve(const char *name, bool inproc, int *status) {
+    PluginCommandEntry *cmd = find_plugin_command(name);
+    if (!cmd) {
+        printf("Plugin '%s' não encontrado.\n", name);
+        *status = 127;
+        return NULL;
+    }
+    if (!inproc) return cmd;
+    int plugin = cmd->plugin;
+    if (!plugin_ensure_loaded(plugin)) {
+        printf("Plugin '%s' não pôde ser carregado.\n", loaded_plugins[plugin].name);
+        *status = 126;
+        return NULL;
+    }
+    // o carregamento pode ter sincronizado a tabela de comandos
+    cmd = find_plugin_command(name);
+    if (!cmd || (loaded_plugins[plugin].v2 && !cmd->run)) {
+        printf("Plugin '%s' não exporta mais o comando '%s'.\n", loaded_plugins[plugin].name, name);
+        *status = 127;
+        return NULL;
+    }
+    return cmd;
 }
 
-void a2(const char *cmd_args) {
-	pid_t pid = fork();
-	int status;
+// Comandos que leem do terminal ficam sempre no processo do shell.
+static bool plugin_runs_isolated(const PluginCommandEntry *cmd) {
+    return loaded_plugins[cmd->plugin].isolated && !(cmd->caps & PLUGIN_CAP_NEEDS_TTY);
+}
 
-	if (pid == -1) {
-		perror("Erro com o FORK\n");
-		exit(EXIT_FAILURE);
-	}
-	if (pid == 0) {
-		char *argv[MAX_PROMPT_LEN / 2 + 2]; // Max tokens + program name + NULL
-		int i = 0;
-		argv[i++] = "./a2";
+static double plugin_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
 
-		if (cmd_args && strlen(cmd_args) > 0) {
-			char args_copy[MAX_PROMPT_LEN];
-			strncpy(args_copy, cmd_args, sizeof(args_copy) - 1);
-			args_copy[sizeof(args_copy) - 1] = '\0';
+// Pool de workers para comandos de plugin THREAD_SAFE que nao precisam do
+// terminal. Cada worker tem sua fila (deque): o nucleo distribui os jobs em
+// rodizio, o dono tira do fim da propria fila e um worker ocioso rouba do
+// inicio da fila dos outros. A saida de cada job e capturada num memstream.
+// O prompt espera ate JOB_FOREGROUND_WAIT_MS; se o job nao terminou, ele
+// segue em segundo plano e o resultado aparece no prompt quando acabar.
+#define JOB_MAX_WORKERS 16
+#define JOB_DEQUE_CAP 256
+#define JOB_FOREGROUND_WAIT_MS 50
 
-			char *arg_token = strtok(args_copy, " ");
-			while (arg_token != NULL && i < (MAX_PROMPT_LEN / 2 + 1)) {
-				argv[i++] = arg_token;
-				arg_token = strtok(NULL, " ");
-			}
-		}
-		argv[i] = NULL;
+enum { JOB_QUEUED, JOB_RUNNING, JOB_DONE };
 
-		execvp("./a2", argv);
-		perror("Erro ao executar o a2\n");
-		exit(EXIT_FAILURE);
-	} else {
-		waitpid(pid, &status, 0);
-		if (WIFEXITED(status)) {
-			printf("Processo filho terminou com status: %d\n", WEXITSTATUS(status));
-		}
-	}
+typedef struct PluginJob {
+    int id;
+    char *line;                // comando como digitado, para 'jobs' e o relatorio
+    char *name;
+    char *args;
+    plugin_command_func run;
+    int *in_flight;            // contador do plugin: a recarga espera o job terminar
+    char *output;
+    size_t output_len;
+    int status;
+    int state;
+    bool background;           // o prompt ja voltou; relatar quando terminar
+    double queued_us;
+    double started_us;
+    double finished_us;
+    struct PluginJob *next;
+} PluginJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    PluginJob *items[JOB_DEQUE_CAP];
+    int top;                   // ladroes tiram daqui
+    int bottom;                // o dono empurra e tira daqui
+} JobDeque;
+
+typedef struct {
+    pthread_t threads[JOB_MAX_WORKERS];
+    JobDeque deques[JOB_MAX_WORKERS];
+    int workers;
+    int next_deque;            // rodizio das submissoes
+    pthread_mutex_t lock;      // protege pending, stopping, a lista de jobs e os estados
+    pthread_cond_t work;       // ha job na fila (ou o pool esta parando)
+    pthread_cond_t done;       // algum job terminou
+    int pending;
+    bool stopping;
+    int notify_fd;             // eventfd: job em segundo plano terminou
+    int next_id;
+    PluginJob *jobs;           // todos os jobs ainda nao relatados, do mais novo ao mais antigo
+} JobPool;
+
+static JobPool job_pool = { .notify_fd = -1 };
+
+static PluginJob *job_deque_pop_bottom(JobDeque *d) {
+    PluginJob *job = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) job = d->items[--d->bottom % JOB_DEQUE_CAP];
+    pthread_mutex_unlock(&d->lock);
+    return job;
 }
 
+static PluginJob *job_deque_steal(JobDeque *d) {
+    PluginJob *job = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) job = d->items[d->top++ % JOB_DEQUE_CAP];
+    pthread_mutex_unlock(&d->lock);
+    return job;
+}
 
-void git() {
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork");
-        exit(EXIT_FAILURE);
+static bool job_deque_push(JobDeque *d, PluginJob *job) {
+    pthread_mutex_lock(&d->lock);
+    bool ok = d->bottom - d->top < JOB_DEQUE_CAP;
+    if (ok) d->items[d->bottom++ % JOB_DEQUE_CAP] = job;
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static PluginJob *job_pool_take(int self) {
+    PluginJob *job = job_deque_pop_bottom(&job_pool.deques[self]);
+    for (int i = 1; !job && i < job_pool.workers; i++) {
+        job = job_deque_steal(&job_pool.deques[(self + i) % job_pool.workers]);
     }
-    if (pid == 0) {
-        // CORREÇÃO: Use apenas uma declaração de args
-        char *args[] = {"git", "log", "-1", "--pretty=%B", NULL};
-        execvp("git", args);
-        perror("Erro ao executar o execvp");
-        exit(EXIT_FAILURE);
-    } else {
-        int status;
-        waitpid(pid, &status, 0);
-        if (WIFEXITED(status)) {
-            printf("O processo filho terminou com status: %d\n", WEXITSTATUS(status));
+    return job;
+}
+
+static void plugin_job_run(PluginJob *job) {
+    FILE *out = open_memstream(&job->output, &job->output_len);
+    char buf[COMMAND_LINE_MAX];
+    char *argv[PLUGIN_MAX_ARGS];
+    snprintf(buf, sizeof(buf), "%s", job->args);
+    PluginCall call;
+    call.argc = plugin_tokenize(job->name, buf, argv, PLUGIN_MAX_ARGS);
+    call.argv = argv;
+    call.raw_args = job->args;
+    call.out = out ? out : stderr;
+    job->status = call.argc < 0 ? plugin_too_many_args(call.out, job->name) : job->run(&call);
+    if (out) fclose(out);
+}
+
+static void *job_worker_main(void *arg) {
+    int self = (int)(intptr_t)arg;
+    for (;;) {
+        pthread_mutex_lock(&job_pool.lock);
+        while (job_pool.pending == 0 && !job_pool.stopping) pthread_cond_wait(&job_pool.work, &job_pool.lock);
+        if (job_pool.pending == 0 && job_pool.stopping) {
+            pthread_mutex_unlock(&job_pool.lock);
+            return NULL;
+        }
+        // reserva um job antes de procurar: o push acontece antes do
+        // pending++, entao alguma fila tem um job para cada reserva
+        job_pool.pending--;
+        pthread_mutex_unlock(&job_pool.lock);
+
+        PluginJob *job;
+        while (!(job = job_pool_take(self))) sched_yield();
+
+        pthread_mutex_lock(&job_pool.lock);
+        job->state = JOB_RUNNING;
+        job->started_us = plugin_now_us();
+        pthread_mutex_unlock(&job_pool.lock);
+
+        plugin_job_run(job);
+        __atomic_sub_fetch(job->in_flight, 1, __ATOMIC_ACQ_REL);
+
+        pthread_mutex_lock(&job_pool.lock);
+        job->state = JOB_DONE;
+        job->finished_us = plugin_now_us();
+        bool notify = job->background;
+        pthread_cond_broadcast(&job_pool.done);
+        pthread_mutex_unlock(&job_pool.lock);
+        if (notify) {
+            uint64_t one = 1;
+            ssize_t w = write(job_pool.notify_fd, &one, sizeof(one));
+            (void)w;
         }
     }
 }
 
-char* read_speci_line(int line_number) {
-    FILE *quiz_f = fopen("quiz.txt", "r");
-    if (quiz_f == NULL) {
-        perror("Erro ao abrir o arquivo");
-        return NULL;
+static bool job_pool_start() {
+    if (job_pool.workers > 0) return true;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    // pelo menos dois: um job longo nao deve segurar o proximo
+    int workers = cpus < 2 ? 2 : cpus > JOB_MAX_WORKERS ? JOB_MAX_WORKERS : (int)cpus;
+    pthread_mutex_init(&job_pool.lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&job_pool.done, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&job_pool.work, NULL);
+    job_pool.notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&job_pool.deques[i].lock, NULL);
+        if (pthread_create(&job_pool.threads[i], NULL, job_worker_main, (void *)(intptr_t)i) != 0) break;
+        job_pool.workers++;
+    }
+    return job_pool.workers > 0;
+}
+
+static void plugin_job_free(PluginJob *job) {
+    free(job->line);
+    free(job->name);
+    free(job->args);
+    free(job->output);
+    free(job);
+}
+
+// Tira o job da lista (com job_pool.lock).
+static void job_pool_unlink(PluginJob *job) {
+    for (PluginJob **p = &job_pool.jobs; *p; p = &(*p)->next) {
+        if (*p == job) {
+            *p = job->next;
+            return;
+        }
+    }
+}
+
+static void plugin_job_print(PluginJob *job, bool header) {
+    if (header) {
+        printf("[%d] concluído (status %d, %.1f ms): %s\n", job->id, job->status,
+               (job->finished_us - job->queued_us) / 1000.0, job->line);
+    }
+    if (job->output_len) fwrite(job->output, 1, job->output_len, stdout);
+    fflush(stdout);
+}
+
+// Imprime os jobs em segundo plano que ja terminaram; retorna quantos.
+int jobs_report_finished() {
+    if (job_pool.workers == 0) return 0;
+    if (job_pool.notify_fd >= 0) {
+        uint64_t v;
+        ssize_t n = read(job_pool.notify_fd, &v, sizeof(v));
+        (void)n;
+    }
+    PluginJob *done[JOB_DEQUE_CAP];
+    int count = 0;
+    pthread_mutex_lock(&job_pool.lock);
+    for (PluginJob *job = job_pool.jobs; job && count < JOB_DEQUE_CAP; job = job->next) {
+        if (job->state == JOB_DONE && job->background) done[count++] = job;
+    }
+    for (int i = 0; i < count; i++) job_pool_unlink(done[i]);
+    pthread_mutex_unlock(&job_pool.lock);
+    // do mais antigo para o mais novo
+    for (int i = count - 1; i >= 0; i--) {
+        plugin_job_print(done[i], true);
+        plugin_job_free(done[i]);
+    }
+    return count;
+}
+
+// Avisos que os plugins mandam sem terem sido chamados (ex.: o prazo de um
+// TODO que acabou de vencer). Chegam de qualquer thread: entram numa fila e
+// o eventfd acorda o editor de linha, que os imprime acima do prompt.
+typedef struct PluginNotice {
+    struct PluginNotice *next;
+    char text[];
+} PluginNotice;
+
+static struct {
+    pthread_mutex_t lock;
+    PluginNotice *head;
+    PluginNotice *tail;
+    int fd;
+} plugin_notices = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, -1 };
+
+static void plugin_notify(const char *plugin, const char *message) {
+    if (!message) return;
+    size_t len = strlen(plugin ? plugin : "") + strlen(message) + 4;
+    PluginNotice *n = malloc(sizeof(PluginNotice) + len);
+    if (!n) return;
+    snprintf(n->text, len, "[%s] %s", plugin ? plugin : "", message);
+    n->next = NULL;
+    pthread_mutex_lock(&plugin_notices.lock);
+    if (plugin_notices.tail) plugin_notices.tail->next = n;
+    else plugin_notices.head = n;
+    plugin_notices.tail = n;
+    pthread_mutex_unlock(&plugin_notices.lock);
+    uint64_t one = 1;
+    if (plugin_notices.fd >= 0) {
+        ssize_t w = write(plugin_notices.fd, &one, sizeof(one));
+        (void)w;
+    }
+}
+
+// Imprime os avisos pendentes; retorna quantos.
+int plugin_notices_report() {
+    if (plugin_notices.fd >= 0) {
+        uint64_t v;
+        ssize_t n = read(plugin_notices.fd, &v, sizeof(v));
+        (void)n;
+    }
+    pthread_mutex_lock(&plugin_notices.lock);
+    PluginNotice *n = plugin_notices.head;
+    plugin_notices.head = plugin_notices.tail = NULL;
+    pthread_mutex_unlock(&plugin_notices.lock);
+    int count = 0;
+    while (n) {
+        PluginNotice *next = n->next;
+        printf("%s\n", n->text);
+        free(n);
+        n = next;
+        count++;
+    }
+    if (count) fflush(stdout);
+    return count;
+}
+
+// Plugins com comandos PLUGIN_CAP_NOTIFY avisam sem serem chamados, entao
+// no modo interativo sao carregados ja, sem esperar o primeiro uso.
+static void plugin_load_notifiers() {
+    if (!interactive) return;
+    if (plugin_notices.fd < 0) plugin_notices.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // por plugin: carregar pode trocar a tabela de comandos no meio
+    for (int i = 0; i < plugin_count; i++) {
+        if (loaded_plugins[i].removed) continue;
+        bool notify = false;
+        for (int k = 0; k < plugin_command_count && !notify; k++) {
+            PluginCommandEntry *c = &plugin_commands[k];
+            notify = c->plugin == i && (c->caps & PLUGIN_CAP_NOTIFY) && !plugin_runs_isolated(c);
+        }
+        if (notify) plugin_ensure_loaded(i);
+    }
+}
+
+// Submete o comando ao pool e espera ate JOB_FOREGROUND_WAIT_MS. Retorna o
+// status se terminou a tempo; senao o job segue em segundo plano e retorna 0.
+static int plugin_job_submit(PluginCommandEntry *cmd, const char *args) {
+    PluginJob *job = calloc(1, sizeof(PluginJob));
+    if (!job) return 1;
+    char line[COMMAND_LINE_MAX];
+    snprintf(line, sizeof(line), "%s%s%s", cmd->name, args && *args ? " " : "", args ? args : "");
+    job->line = strdup(line);
+    job->name = strdup(cmd->name);
+    job->args = strdup(args ? args : "");
+    job->run = cmd->run;
+    job->in_flight = loaded_plugins[cmd->plugin].in_flight;
+    job->queued_us = plugin_now_us();
+    __atomic_add_fetch(job->in_flight, 1, __ATOMIC_ACQ_REL);
+
+    pthread_mutex_lock(&job_pool.lock);
+    job->id = ++job_pool.next_id;
+    job->next = job_pool.jobs;
+    job_pool.jobs = job;
+    bool queued = false;
+    for (int tries = 0; tries < job_pool.workers && !queued; tries++) {
+        queued = job_deque_push(&job_pool.deques[job_pool.next_deque], job);
+        job_pool.next_deque = (job_pool.next_deque + 1) % job_pool.workers;
+    }
+    if (!queued) {
+        job_pool_unlink(job);
+        pthread_mutex_unlock(&job_pool.lock);
+        __atomic_sub_fetch(job->in_flight, 1, __ATOMIC_ACQ_REL);
+        plugin_job_free(job);
+        printf("Fila de jobs cheia; tente de novo quando algum terminar ('jobs').\n");
+        return 1;
+    }
+    job_pool.pending++;
+    pthread_cond_signal(&job_pool.work);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += JOB_FOREGROUND_WAIT_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (job->state != JOB_DONE) {
+        if (pthread_cond_timedwait(&job_pool.done, &job_pool.lock, &deadline) == ETIMEDOUT) break;
+    }
+    bool finished = job->state == JOB_DONE;
+    if (finished) job_pool_unlink(job);
+    else job->background = true;
+    pthread_mutex_unlock(&job_pool.lock);
+
+    if (!finished) {
+        printf("[%d] em segundo plano: %s\n", job->id, job->line);
+        return 0;
+    }
+    int status = job->status;
+    plugin_job_print(job, false);
+    plugin_job_free(job);
+    return status;
+}
+
+// jobs [wait]: lista os jobs em andamento; 'wait' espera todos terminarem.
+int handle_jobs_command(const char *args) {
+    if (job_pool.workers == 0) {
+        printf("Nenhum job.\n");
+        return 0;
+    }
+    if (args && strncmp(args, "wait", 4) == 0) {
+        pthread_mutex_lock(&job_pool.lock);
+        for (;;) {
+            bool running = false;
+            for (PluginJob *job = job_pool.jobs; job; job = job->next) running |= job->state != JOB_DONE;
+            if (!running) break;
+            pthread_cond_wait(&job_pool.done, &job_pool.lock);
+        }
+        pthread_mutex_unlock(&job_pool.lock);
+        jobs_report_finished();
+        return 0;
+    }
+    jobs_report_finished();
+    double now = plugin_now_us();
+    int shown = 0;
+    pthread_mutex_lock(&job_pool.lock);
+    for (PluginJob *job = job_pool.jobs; job; job = job->next) {
+        if (!shown++) printf("%-6s %-10s %10s  %s\n", "JOB", "ESTADO", "TEMPO", "COMANDO");
+        const char *state = job->state == JOB_QUEUED ? "na fila" : job->state == JOB_RUNNING ? "rodando" : "concluído";
+        char id[16];
+        snprintf(id, sizeof(id), "[%d]", job->id);
+        printf("%-6s %-10s %8.1f s  %s\n", id, state, (now - job->queued_us) / 1e6, job->line);
+    }
+    pthread_mutex_unlock(&job_pool.lock);
+    if (!shown) printf("Nenhum job em andamento. (%d workers)\n", job_pool.workers);
+    return 0;
+}
+
+// Na saida: deixa os workers terminarem o que esta na fila e relata tudo.
+void job_pool_shutdown() {
+    if (job_pool.workers == 0) return;
+    pthread_mutex_lock(&job_pool.lock);
+    int running = 0;
+    for (PluginJob *job = job_pool.jobs; job; job = job->next) running += job->state != JOB_DONE;
+    job_pool.stopping = true;
+    pthread_cond_broadcast(&job_pool.work);
+    pthread_mutex_unlock(&job_pool.lock);
+    if (running) printf("Aguardando %d job(s) em segundo plano...\n", running);
+    for (int i = 0; i < job_pool.workers; i++) pthread_join(job_pool.threads[i], NULL);
+    jobs_report_finished();
+    job_pool.workers = 0;
+    close(job_pool.notify_fd);
+    job_pool.notify_fd = -1;
+}
+
+//Função para executar os plugins
+int execute_plugin(const char* name, const char* args) {
+    int status = 0;
+    PluginCommandEntry *cmd = find_plugin_command(name);
+    bool isolated = cmd && plugin_runs_isolated(cmd);
+    if (!(cmd = plugin_resolve(name, !isolated, &status))) return status;
+
+    // So quem le do terminal precisa sair do modo raw
+    bool needs_tty = cmd->caps & PLUGIN_CAP_NEEDS_TTY;
+    if (needs_tty) disable_raw_mode();
+    if (interactive) printf("Executando plugin: %s com argumentos: %s\n", name, args ? args : "");
+
+    while (args && (*args == ' ' || *args == '\t')) args++;
+    // Thread-safe e sem terminal: vai para o pool (so no modo interativo;
+    // em lote a ordem da saida importa mais que o paralelismo)
+    if (!isolated && interactive && bench_depth == 0 && cmd->run && (cmd->caps & PLUGIN_CAP_THREAD_SAFE) &&
+        !(cmd->caps & PLUGIN_CAP_NEEDS_TTY) && job_pool_start()) {
+        return plugin_job_submit(cmd, args);
+    }
+    if (isolated) {
+        status = plugin_host_call(&loaded_plugins[cmd->plugin], cmd->name, args, stdout);
+        fflush(stdout);
+    } else {
+        status = plugin_run_inproc(cmd, args, stdout);
+    }
+
+    // Reativa o modo raw para o shell principal
+    if (needs_tty) enable_raw_mode();
+    return status;
+}
+
+static LoadedPlugin *plugin_find_by_name(const char *name) {
+    for (int i = 0; i < plugin_count; i++) {
+        if (!loaded_plugins[i].removed && strcasecmp(loaded_plugins[i].name, name) == 0) return &loaded_plugins[i];
+    }
+    PluginCommandEntry *cmd = find_plugin_command(name);
+    return cmd ? &loaded_plugins[cmd->plugin] : NULL;
+}
+
+// plugin list | isolate <nome|all> | inproc <nome|all> | bench [-n N] <comando> [args]
+int handle_plugin_command(const char *args) {
+    char sub[32] = {0}, target[128] = {0};
+    int consumed = 0;
+    if (!args || sscanf(args, "%31s %n", sub, &consumed) < 1 || strcmp(sub, "list") == 0) {
+        printf("%-16s %-24s %-10s %-9s %s\n", "PLUGIN", "ARQUIVO", "ESTADO", "PID", "CHAMADAS");
+        for (int i = 0; i < plugin_count; i++) {
+            LoadedPlugin *lp = &loaded_plugins[i];
+            if (lp->removed) continue;
+            const char *state = lp->host ? "isolado" : lp->isolated ? "isolado*" : lp->handle ? "carregado" :
+                                lp->failed ? "falhou" : "manifesto";
+            if (lp->host) printf("%-16s %-24s %-10s %-9d %lu\n", lp->name, lp->file, state, (int)lp->host->pid, lp->host->calls);
+            else printf("%-16s %-24s %-10s %-9s -\n", lp->name, lp->file, state, "-");
+        }
+        printf("(isolado* = sobe o processo host na primeira chamada)\n");
+        return 0;
+    }
+    const char *rest = args + consumed;
+
+    if (strcmp(sub, "isolate") == 0 || strcmp(sub, "inproc") == 0) {
+        bool isolate = strcmp(sub, "isolate") == 0;
+        if (sscanf(rest, "%127s", target) != 1) {
+            printf("Uso: plugin %s <plugin|all>\n", sub);
+            return 2;
+        }
+        bool all = strcmp(target, "all") == 0;
+        if (all) plugin_isolate_all = isolate;
+        LoadedPlugin *only = all ? NULL : plugin_find_by_name(target);
+        if (!all && !only) {
+            printf("Plugin '%s' não encontrado.\n", target);
+            return 127;
+        }
+        for (int i = 0; i < plugin_count; i++) {
+            LoadedPlugin *lp = &loaded_plugins[i];
+            if (lp->removed || (only && lp != only)) continue;
+            lp->isolated = isolate;
+            if (!isolate) plugin_host_stop(lp);
+            printf("Plugin '%s': %s.\n", lp->name, isolate ? "isolado em processo proprio" : "no processo do shell");
+        }
+        return 0;
+    }
+
+    if (strcmp(sub, "bench") == 0) {
+        int n = 10000;
+        if (sscanf(rest, "-n %d %n", &n, &consumed) >= 1) rest += consumed;
+        char name[128];
+        if (sscanf(rest, "%127s %n", name, &consumed) < 1 || n <= 0) {
+            printf("Uso: plugin bench [-n N] <comando> [args]\n");
+            return 2;
+        }
+        const char *cmd_args = rest + consumed;
+        int status = 0;
+        PluginCommandEntry *cmd = plugin_resolve(name, true, &status);
+        if (!cmd) return status;
+        if (cmd->caps & PLUGIN_CAP_NEEDS_TTY) {
+            printf("O comando '%s' precisa do terminal; nao da para medir isolado.\n", name);
+            return 2;
+        }
+        FILE *sink = fopen("/dev/null", "w");
+        if (!sink) return 1;
+        LoadedPlugin *lp = &loaded_plugins[cmd->plugin];
+        // saida de plugins v1 vai para stdout: silencia durante a medicao
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        dup2(fileno(sink), STDOUT_FILENO);
+
+        double t0 = plugin_now_us();
+        for (int i = 0; i < n; i++) plugin_run_inproc(cmd, cmd_args, sink);
+        double inproc = (plugin_now_us() - t0) / n;
+
+        bool had_host = lp->host != NULL;
+        double spawn = plugin_now_us();
+        int host_status = plugin_host_call(lp, cmd->name, cmd_args, NULL);
+        spawn = plugin_now_us() - spawn;
+        t0 = plugin_now_us();
+        for (int i = 0; i < n && lp->host; i++) plugin_host_call(lp, cmd->name, cmd_args, NULL);
+        double isolated = (plugin_now_us() - t0) / n;
+        if (!had_host && !lp->isolated) plugin_host_stop(lp);
+
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        fclose(sink);
+        if (host_status >= 126 && !lp->host) {
+            printf("O host do plugin falhou (status %d).\n", host_status);
+            return host_status;
+        }
+        printf("%s: %d chamadas\n", name, n);
+        printf("  no processo : %8.2f us/chamada\n", inproc);
+        printf("  isolado     : %8.2f us/chamada (+%.2f us pelo anel)\n", isolated, isolated - inproc);
+        if (!had_host) printf("  subir o host: %8.0f us (uma vez)\n", spawn);
+        return 0;
+    }
+
+    printf("Uso: plugin [list | isolate <plugin|all> | inproc <plugin|all> | bench [-n N] <comando> [args]]\n");
+    return 2;
+}
+
+typedef struct {
+	FILE *fp;
+	size_t dl_total;
+} dl_status;
+
+
+//função para escrever no arquivo//
+static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream) {
+	dl_status *status = (dl_status *)stream;
+	size_t written = fwrite(ptr, size, nmemb, status->fp);
+
+	status->dl_total += written;
+
+    // Converte o total de bytes para megabytes
+    double mb_total = (double)status->dl_total / (1024.0 * 1024.0);
+
+    // Imprime o progresso formatado em MB, usando  para atualizar a linha
+	printf("\rDownload: %.2f MB        ", mb_total);
+	fflush(stdout);
+	return written;
+
+}
+
+//Função para fazer o download da função//
+bool download_file(char *url, char *filename) {
+	bool sucess = true;
+
+	CURL *curl_handle = curl_easy_init();
+
+	curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+	curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 0L);
+	curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
+	curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_data);
+	curl_easy_setopt(curl_handle, CURLOPT_FAILONERROR, 1L);
+
+	FILE *pagefile = fopen(filename, "wb");
+	
+	if (!pagefile) {
+		perror("Erro ao baixar o arquivo");
+		curl_easy_cleanup(curl_handle);
+		return false;
+	}
+
+	dl_status status;
+	status.dl_total = 0;
+	status.fp = pagefile;
+	
+curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &status);
+	
+	for (int i = 0; i < 5; i++) {
+		CURLcode res = curl_easy_perform(curl_handle);
+		if (res != CURLE_OK) {
+			sucess = false;
+			fprintf(stderr, "Falha na tentativa %d: %s\n", i + 1, curl_easy_strerror(res));
+		} else {
+			sucess = true;
+		}
+		if (sucess) {
+			break;
+		}
+		sleep(1);
+	}
+	fclose(pagefile);
+	
+	if (!sucess) {
+		remove(filename);
+	}
+	printf("\n");
+    return sucess;
+}
+
+//Função que faz copia entre arquvios de texto.
+// Converte o retorno de system() (ou de waitpid()) em um codigo de saida estilo shell.
+static int shell_status(int raw) {
+    if (raw == -1) return 127;
+    if (WIFEXITED(raw)) return WEXITSTATUS(raw);
+    if (WIFSIGNALED(raw)) return 128 + WTERMSIG(raw);
+    return 1;
+}
+
+int copy_f_t() {
+	FILE *fptr1, *fptr2;
+	char filename[100];
+	int c;
+	printf("Coloque o nome do arquivo para copiar\n");
+	if (scanf("%99s", filename) != 1) return 1;
+	fptr1 = fopen(filename, "r");
+	if (fptr1 == NULL) {
+		printf("Não foi possivel abrir o arquivo %s\n", filename);
+		return 1;
+	}
+	printf("Coloque o nome do arquivo para ser escrito\n");
+	if (scanf("%99s", filename) != 1) {
+		fclose(fptr1);
+		return 1;
+	}
+
+	fptr2 = fopen(filename, "w");
+	if (fptr2 == NULL) {
+		printf("Não foi possivel o arquivo %s\n", filename);
+		fclose(fptr1);
+		return 1;
+	}
+	while ((c = fgetc(fptr1)) != EOF) {
+		fputc(c, fptr2);
+	}
+	printf("Conteudo copiado para %s\n", filename);
+	fclose(fptr1);
+	fclose(fptr2);
+	return 0;
+}
+
+// Função para verificar segurança de comandos
+int is_safe_command(const char *cmd) {
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
+        if (strcasecmp(cmd, cmds[i].key) == 0) {
+            return 1; // Comando está na lista de permitidos
+        }
+    }
+    return 0; // Comando não reconhecido, não é seguro
+}
+
+// Funções para histórico de comandos
+void add_to_history(const char *cmd) {
+    if (bench_depth > 0 || history_private) return;
+    if (history_count < MAX_HISTORY) {
+        command_history[history_count] = strdup(cmd); // Aloca memoria
+        history_count++;
+    } else {
+        free(command_history[0]);
+        for (int i = 1; i < MAX_HISTORY; i++) {
+            command_history[i - 1] = command_history[i];
+        }
+        command_history[MAX_HISTORY - 1] = strdup(cmd);
+    }
+    router_mark_dirty();
+}
+
+void display_history() {
+    printf("Historico de comandos:\n");
+    for (int i = 0; i < history_count; i++) {
+        printf("  %d: %s\n", i + 1, command_history[i]);
+    }
+}
+
+int quiz_aleatorio() {
+    printf("Você deseja jogar o QUIZ? (s/n)\n");
+    char respostas[256];
+    if (fgets(respostas, sizeof(respostas), stdin) != NULL) {
+        respostas[strcspn(respostas, "\n")] = '\0'; // Remove newline character
+        if (strcasecmp(respostas, "s") == 0 || strcasecmp(respostas, "sim") == 0) {
+            char* linha_aleatoria = read_random_line();
+            if (linha_aleatoria != NULL) {
+                printf("Pergunta aleatória: %s\n", linha_aleatoria);
+                free(linha_aleatoria); // Libera a memória alocada por read_random_line
+            } else {
+                printf("Erro ao obter uma pergunta aleatória.\n");
+                return 1;
+            }
+        } else {
+            printf("Não foi possível identificar a resposta\n");
+        }
+    } else {
+        printf("Erro ao ler a resposta\n");
+        return 1;
+    }
+    return 0;
+}
+
+int timer() {
+	if (timer_running) {
+		printf("Um timer já está em execução! Cancele-o primeiro com 'timer cancel'.\n");
+		return 1;
+	}
+
+	printf("Um simples timer, que agora roda em segundo plano, qual a duração dele? (0 para cancelar)\n");
+	if (scanf("%d", &seconds) != 1) return 1;
+	if (seconds <= 0) {
+		printf("O Timer foi cancelado.\n");
+		return 0;
+	}
+	//Cria a thread para o timer//
+	#ifdef _WIN32
+	//No windows, criar thread com o CreateThread (precisa ser implementado se necessario)
+	printf("Thread no windows não implementado ainda, usando modo bloquante temporariamente.\n");
+	timer_background(&seconds);
+	#else
+	if (pthread_create(&timer_thread, NULL, timer_background, &seconds) != 0) {
+		perror("Erro ao criar thread do timer\n");
+		return 1;
+	}
+	//Opcional: desanexar a thread para não precisa de join//
+	pthread_detach(timer_thread);
+	#endif
+	return 0;
+}
+
+int quiz_timer() {
+	if (quiz_timer_running) {
+		printf("Um quiz timer já está em execução! Cancele-o primeiro com 'quizt cancel'.\n");
+		return 1;
+	}
+	printf("Qual o intervalo de tempo QUIZES em segundos? (Aperte enter para o padrão, 10[600s] min)\n");
+	char input[256];
+	if (fgets(input, sizeof(input), stdin) == NULL || input[0] == '\n') {
+		seconds = 600;
+	} else {
+		seconds = atoi(input);
+		if (seconds <= 0) seconds = 600;
+	}
+
+	#ifdef _WIN32
+	printf("Thread no windows não implementado ainda, usando o modo bloqueado temporariamente.\n");
+	quiz_timer_background(&seconds);//simulação roda na thread principal por agr
+	#else
+	if (pthread_create(&quiz_thread, NULL, quiz_timer_background, &seconds) != 0) {
+		perror("Erro ao criar thread do quiz_timer");
+		return 1;
+	}
+	pthread_detach(quiz_thread);
+	#endif
+	return 0;
+}
+
+//função para cancelar timers
+int cancel_timer(const char *type) {
+	if (strcmp(type, "timer") == 0) {
+		if (timer_running) {
+			timer_running = 0;
+			printf("Timer cancelado.\n");
+		} else {
+			printf("Nenhum timer em execução.\n");
+			return 1;
+		}
+	} else if (strcmp(type, "quizt") == 0) {
+		if (quiz_timer_running) {
+			quiz_timer_running = 0;
+			printf("Quiz timer cancelado.\n");
+			} else {
+				printf("Nenhum quiz timer em execução.\n");
+				return 1;
+		}
+	}
+	return 0;
+}
+
+void *timer_background(void *arg) {
+	int seconds = *(int*)arg;//Recebe o tempo em segundos
+	current_timer_seconds = seconds;
+	timer_running = 1;
+	printf("\rTimer iniciado em segundo plano: %d segundos\n", seconds);
+	while (current_timer_seconds > 0 && timer_running) {
+		// int horas = current_timer_seconds / 3600;
+		// int minutos = (current_timer_seconds % 3600) / 60;
+		// int segundos = current_timer_seconds % 60;
+		//printf("\rTimer: %02d:%02d:%02d\n", horas, minutos, segundos);
+		//fflush(stdout);
+		#ifdef _WIN32
+		sleep(1000);// 1 segundo no windows//
+		#else
+		sleep(1);
+		#endif
+		current_timer_seconds--;
+	}
+	if (timer_running) {
+		printf("\rO Tempo acabou!\n");
+		printf("Aperte enter para continuar\n");
+		return NULL;
+	} else {
+		printf("\rTimer cancelado!\n");
+	}
+	timer_running = 0;
+	return NULL;
+}
+
+void *quiz_timer_background(void *arg) {
+	int seconds = *(int*)arg; //Recebe o tempo em segudos//
+	quiz_timer_running = 1;
+	printf("Quiz Timer iniciado em segundo plano %d segundo\n", seconds);
+	while (quiz_timer_running) {
+		#ifdef _WIN32
+		Sleep(seconds * 1000);
+		#else
+		sleep(seconds);
+		#endif
+
+		if (quiz_timer_running) {
+			printf("\n[Quiz Timer] Tempo para uma pergunta!\n");
+			quiz_aleatorio();
+			printf("> "); //Reexibe o prompt para o usuario//
+			fflush(stdout);
+		}
+	}
+	printf("Quiz Timer encerrado.\n");
+	return NULL;
+}
+
+int func_quiz() {
+    printf("Lista de QUIZ's:\n");
+    printf("------------------------------------------------\n");
+    FILE *quiz_f = fopen("quiz.txt", "r");
+    if (quiz_f == NULL) {
+        perror("Erro ao abrir o arquivo quiz.txt");
+        printf("Não foi possível listar os QUIZ's. Arquivo não encontrado ou sem permissão.\n");
+        return 1;
+    }
+    while (fgets(quiz, sizeof(quiz), quiz_f) != NULL) {
+        quiz[strcspn(quiz, "\n")] = '\0'; // Remove nova linha do final
+        printf("%d: %s\n", ++countar, quiz);
+    }
+    fclose(quiz_f);
+    if (countar == 0) {
+	   printf("Nenhum QUIZ encontrado no arquivo.\n");
+    }
+    printf("------------------------------------------------\n");
+    return 0;
+}
+
+int contar_linhas() {
+	FILE *quizlin = fopen("quiz.txt", "r");
+	if (quizlin == NULL) {
+		perror("Erro ao abrir o arquivo quiz.txt");
+		printf("Não foi possível listar os QUIZ's. Arquivo não encontrado ou sem permissão.\n");
+		return 0;
+	}
+	int linhaslin = 0;
+	char buffin1[1024];
+	while (fgets(buffin1, sizeof(buffin1), quizlin) != NULL) {
+		linhaslin++;
+	}
+	fclose(quizlin);
+	return linhaslin;
+}
+
+int a2(const char *cmd_args) {
+	pid_t pid = fork();
+	int status;
+
+	if (pid == -1) {
+		perror("Erro com o FORK\n");
+		return 1;
+	}
+	if (pid == 0) {
+		char *argv[MAX_PROMPT_LEN / 2 + 2]; // Max tokens + program name + NULL
+		int i = 0;
+		argv[i++] = "./a2";
+
+		if (cmd_args && strlen(cmd_args) > 0) {
+			char args_copy[MAX_PROMPT_LEN];
+			strncpy(args_copy, cmd_args, sizeof(args_copy) - 1);
+			args_copy[sizeof(args_copy) - 1] = '\0';
+
+			char *arg_token = strtok(args_copy, " ");
+			while (arg_token != NULL && i < (MAX_PROMPT_LEN / 2 + 1)) {
+				argv[i++] = arg_token;
+				arg_token = strtok(NULL, " ");
+			}
+		}
+		argv[i] = NULL;
+
+		execvp("./a2", argv);
+		perror("Erro ao executar o a2\n");
+		exit(EXIT_FAILURE);
+	} else {
+		waitpid(pid, &status, 0);
+		if (WIFEXITED(status)) {
+			printf("Processo filho terminou com status: %d\n", WEXITSTATUS(status));
+		}
+		return shell_status(status);
+	}
+}
+
+
+int git() {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        // CORREÇÃO: Use apenas uma declaração de args
+        char *args[] = {"git", "log", "-1", "--pretty=%B", NULL};
+        execvp("git", args);
+        perror("Erro ao executar o execvp");
+        exit(EXIT_FAILURE);
+    } else {
+        int status;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status)) {
+            printf("O processo filho terminou com status: %d\n", WEXITSTATUS(status));
+        }
+        return shell_status(status);
+    }
+}
+
+char* read_speci_line(int line_number) {
+    FILE *quiz_f = fopen("quiz.txt", "r");
+    if (quiz_f == NULL) {
+        perror("Erro ao abrir o arquivo");
+        return NULL;
+    }
+
+    char buffer[1024];
+    char *result = NULL;
+    int linha_atual = 0;
+
+    while (fgets(buffer, sizeof(buffer), quiz_f) != NULL) {
+        linha_atual++;
+        if (linha_atual == line_number) {
+            buffer[strcspn(buffer, "\n")] = '\0'; // Remove o '\n' se presente
+            result = strdup(buffer);
+            if (result == NULL) {
+                fprintf(stderr, "Erro ao alocar memória para a linha\n");
+                fclose(quiz_f);
+                return NULL;
+            }
+            break; // Sai do loop após encontrar a linha
+        }
+    }
+    fclose(quiz_f);
+    if (result == NULL) {
+        fprintf(stderr, "Linha %d não encontrada. Total de linhas no arquivo: %d\n", line_number, linha_atual);
+        return NULL;
+    }
+    return result;
+}
+
+//Função para sugerir comandos com base em um texto parcial
+void suggest_commands(const char *partial) {
+	int found = 0;
+	printf("\nSugestão de Comandos:\n");
+	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+		if (strncmp(partial, cmds[i].key, strlen(partial)) == 0) {
+			printf("  -%s:  %s\n", cmds[i].key, cmds[i].descri);
+			found++;
+		}
+	}
+	if (!found) {
+		printf("  Nenhum comando encontrado com '%s'. Use 'help' para ver todos os comandos.\n", partial);
+	}
+	if (interactive) {
+		printf("> %s", partial); //reexibe oque o usuario já digitou
+		fflush(stdout);
+	}
+}
+
+//Função para ler uma linha aleatoria
+char* read_random_line() {
+    int total_lines = contar_linhas();
+    if (total_lines <= 0) {
+        fprintf(stderr, "Erro: Arquivo vazio ou falha ao contar linhas em '%s'\n", quiz_file);
+        return NULL;
+    }
+    // Gera um número aleatório entre 1 e total_lines
+    int random_line = (rand() % total_lines) + 1;
+    srand(time(NULL)); 
+    // Lê a linha correspondente ao número aleatório
+    char* result = read_speci_line(random_line);
+    if (result == NULL) {
+        fprintf(stderr, "Erro: Falha ao ler a linha %d do arquivo '%s'\n", random_line, quiz_file);
+        return NULL;
+    }
+    return result;
+}
+
+// Função para logging de ações
+// O arquivo fica aberto: no modo nao interativo podem passar milhares de
+// comandos por segundo e reabrir o log a cada um custaria mais que o comando.
+void log_action(const char *action, const char *details) {
+    static FILE *log_file = NULL;
+    if (bench_depth > 0 || history_private) return;
+    if (log_file == NULL) {
+        log_file = fopen("jntd_log.txt", "a");
+        if (log_file == NULL) {
+            perror("Erro ao abrir arquivo de log");
+            return;
+        }
+    }
+    time_t now = time(NULL);
+    char time_str[26];
+    ctime_r(&now, time_str);
+    time_str[24] = '\0'; // Remove newline
+    fprintf(log_file, "[%s] %s: %s\n", time_str, action, details);
+    fflush(log_file);
+}
+
+// Roteador local da 2B: antes de chamar o modelo, tenta responder prompts
+// triviais com um comando ja existente. O indice (BM25 sobre tokens
+// normalizados) cobre as chaves e descricoes de cmds[], os plugins, os aliases
+// e o historico; e reconstruido so quando alguma dessas fontes muda.
+#define ROUTER_STEM_LEN 5            // tokens sao truncados (stem simples para o portugues)
+#define ROUTER_MAX_QUERY_TOKENS 32
+#define ROUTER_DEFAULT_THRESHOLD 0.55
+#define ROUTER_BM25_K1 1.2
+#define ROUTER_BM25_B 0.75
+
+typedef enum { ROUTE_CMD, ROUTE_PLUGIN, ROUTE_ALIAS, ROUTE_HISTORY } RouteKind;
+
+typedef struct {
+	RouteKind kind;
+	char *command;   // o que sera passado para o dispatch()
+	int length;      // numero de tokens do documento
+} RouterDoc;
+
+typedef struct {
+	char token[ROUTER_STEM_LEN + 1];
+	int *docs;       // postings: indice do documento
+	int *tf;         // frequencia do token naquele documento
+	int count;
+	int cap;
+	double idf;
+} RouterTerm;
+
+typedef struct {
+	RouterDoc *docs;
+	int doc_count;
+	int doc_cap;
+	RouterTerm *terms;   // tabela hash com enderecamento aberto
+	int term_cap;        // sempre potencia de 2
+	int term_count;
+	double avg_len;
+	double max_idf;
+	bool dirty;
+} RouterIndex;
+
+static RouterIndex router = { .dirty = true };
+static double router_threshold = ROUTER_DEFAULT_THRESHOLD;
+static bool router_explain = false;
+
+// Comandos que nunca sao executados automaticamente pelo roteador
+static const char *router_never_auto[] = { "sudo", "rm", "mv", "cp", "cp_di", "2b", NULL };
+
+void router_mark_dirty() {
+	router.dirty = true;
+}
+
+// Converte as letras acentuadas mais comuns (UTF-8, bloco Latin-1) para ASCII.
+static char router_fold_utf8(unsigned char lead, unsigned char next) {
+	if (lead != 0xC3) return 0;
+	switch (next | 0x20) { // 0x20 junta maiusculas e minusculas
+		case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: return 'a';
+		case 0xA7: return 'c';
+		case 0xA8: case 0xA9: case 0xAA: case 0xAB: return 'e';
+		case 0xAC: case 0xAD: case 0xAE: case 0xAF: return 'i';
+		case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB6: return 'o';
+		case 0xB9: case 0xBA: case 0xBB: case 0xBC: return 'u';
+	}
+	return 0;
+}
+
+static bool router_is_stopword(const char *tok) {
+	static const char *stop[] = {
+		"o", "a", "os", "as", "um", "uma", "de", "do", "da", "dos", "das", "e", "em",
+		"no", "na", "nos", "nas", "para", "por", "com", "que", "se", "ao", "ou", "me",
+		"eu", "meu", "minha", "voce", "qual", "quais", "quero", "pode", "favor", "the",
+		"to", "of", "is", "use", "isso", "esse", "essa", NULL
+	};
+	for (int i = 0; stop[i]; i++) {
+		if (strcmp(tok, stop[i]) == 0) return true;
+	}
+	return false;
+}
+
+// Quebra o texto em tokens normalizados (minusculas, sem acento, truncados).
+// Retorna a quantidade de tokens escritos em out.
+static int router_tokenize(const char *text, char out[][ROUTER_STEM_LEN + 1], int max_tokens) {
+	int n = 0;
+	char word[64];
+	int wlen = 0;
+	const unsigned char *p = (const unsigned char *)text;
+
+	for (;; p++) {
+		char c = 0;
+		if (*p >= 0x80) {
+			c = router_fold_utf8(p[0], p[1]);
+			if (c) p++;
+		} else if (isalnum(*p) || *p == '?' || *p == ':' || *p == '_') {
+			c = (char)tolower(*p);
+		}
+		if (c && wlen < (int)sizeof(word) - 1) {
+			word[wlen++] = c;
+			continue;
+		}
+		if (c) continue; // palavra longa demais, ignora o resto
+		if (wlen > 0) {
+			word[wlen] = '\0';
+			// plural simples: "arquivos" -> "arquivo"
+			if (wlen > 3 && word[wlen - 1] == 's') word[--wlen] = '\0';
+			if (!router_is_stopword(word) && n < max_tokens) {
+				int keep = wlen < ROUTER_STEM_LEN ? wlen : ROUTER_STEM_LEN;
+				memcpy(out[n], word, keep);
+				out[n][keep] = '\0';
+				n++;
+			}
+			wlen = 0;
+		}
+		if (*p == '\0') break;
+	}
+	return n;
+}
+
+static uint32_t router_hash(const char *s) {
+	uint32_t h = 2166136261u; // FNV-1a
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static RouterTerm *router_find_term(const char *tok, bool create) {
+	if (router.term_cap == 0 || (create && (router.term_count + 1) * 2 > router.term_cap)) {
+		if (!create) return NULL;
+		int new_cap = router.term_cap ? router.term_cap * 2 : 256;
+		RouterTerm *new_terms = calloc(new_cap, sizeof(RouterTerm));
+		if (!new_terms) return NULL;
+		for (int i = 0; i < router.term_cap; i++) {
+			if (router.terms[i].token[0] == '\0') continue;
+			uint32_t j = router_hash(router.terms[i].token) & (new_cap - 1);
+			while (new_terms[j].token[0] != '\0') j = (j + 1) & (new_cap - 1);
+			new_terms[j] = router.terms[i];
+		}
+		free(router.terms);
+		router.terms = new_terms;
+		router.term_cap = new_cap;
+	}
+	uint32_t i = router_hash(tok) & (router.term_cap - 1);
+	while (router.terms[i].token[0] != '\0') {
+		if (strcmp(router.terms[i].token, tok) == 0) return &router.terms[i];
+		i = (i + 1) & (router.term_cap - 1);
+	}
+	if (!create) return NULL;
+	strcpy(router.terms[i].token, tok);
+	router.term_count++;
+	return &router.terms[i];
+}
+
+static void router_add_posting(RouterTerm *t, int doc) {
+	if (t->count > 0 && t->docs[t->count - 1] == doc) {
+		t->tf[t->count - 1]++;
+		return;
+	}
+	if (t->count == t->cap) {
+		int new_cap = t->cap ? t->cap * 2 : 4;
+		int *docs = realloc(t->docs, new_cap * sizeof(int));
+		if (!docs) return;
+		t->docs = docs;
+		int *tf = realloc(t->tf, new_cap * sizeof(int));
+		if (!tf) return;
+		t->tf = tf;
+		t->cap = new_cap;
+	}
+	t->docs[t->count] = doc;
+	t->tf[t->count] = 1;
+	t->count++;
+}
+
+// Adiciona um documento; key e repetida no texto indexado para pesar mais.
+static void router_add_doc(RouteKind kind, const char *command, const char *key, const char *text) {
+	if (router.doc_count == router.doc_cap) {
+		int new_cap = router.doc_cap ? router.doc_cap * 2 : 64;
+		RouterDoc *docs = realloc(router.docs, new_cap * sizeof(RouterDoc));
+		if (!docs) return;
+		router.docs = docs;
+		router.doc_cap = new_cap;
+	}
+	int id = router.doc_count;
+	char tokens[ROUTER_MAX_QUERY_TOKENS * 2][ROUTER_STEM_LEN + 1];
+	int n = router_tokenize(key, tokens, ROUTER_MAX_QUERY_TOKENS);
+	for (int i = 0; i < n && n + i < ROUTER_MAX_QUERY_TOKENS * 2; i++) strcpy(tokens[n + i], tokens[i]);
+	n *= 2;
+	if (text) n += router_tokenize(text, tokens + n, ROUTER_MAX_QUERY_TOKENS * 2 - n);
+	if (n == 0) return;
+
+	router.docs[id].kind = kind;
+	router.docs[id].command = strdup(command);
+	router.docs[id].length = n;
+	if (!router.docs[id].command) return;
+	for (int i = 0; i < n; i++) {
+		RouterTerm *t = router_find_term(tokens[i], true);
+		if (t) router_add_posting(t, id);
+	}
+	router.doc_count++;
+}
+
+static void router_clear() {
+	for (int i = 0; i < router.doc_count; i++) free(router.docs[i].command);
+	for (int i = 0; i < router.term_cap; i++) {
+		free(router.terms[i].docs);
+		free(router.terms[i].tf);
+	}
+	free(router.terms);
+	router.terms = NULL;
+	router.term_cap = 0;
+	router.term_count = 0;
+	router.doc_count = 0;
+}
+
+static bool router_is_auto_allowed(const char *key) {
+	for (int i = 0; router_never_auto[i]; i++) {
+		if (strcasecmp(key, router_never_auto[i]) == 0) return false;
+	}
+	return true;
+}
+
+// Primeira palavra do que o dispatch() rodaria para cmd, seguindo aliases
+// (que o dispatch expande antes de tudo). Falso para comandos de shell ('!')
+// e para cadeias de aliases que nao terminam.
+static bool router_resolve_target(const char *cmd, char first[64]) {
+	for (int depth = 0; depth < 8; depth++) {
+		if (cmd[0] == '!' || sscanf(cmd, "%63s", first) != 1) return false;
+		const char *expansion = NULL;
+		for (int i = 0; i < alias_count && !expansion; i++) {
+			if (alias_list[i].name && strcasecmp(first, alias_list[i].name) == 0) expansion = alias_list[i].command;
+		}
+		if (!expansion) return true;
+		cmd = expansion;
+	}
+	return false;
+}
+
+// Entra no indice: resolve para um builtin ou comando de plugin que o
+// roteador pode sugerir.
+static bool router_is_indexable(const char *cmd) {
+	char first[64];
+	if (!router_resolve_target(cmd, first) || !router_is_auto_allowed(first)) return false;
+	return is_safe_command(first) || find_plugin_command(first) != NULL;
+}
+
+// Roda sem perguntar: a mesma regra do caminho do Ollama (so builtins de
+// cmds[]), aplicada ao destino final dos aliases.
+static bool router_can_auto_run(const char *cmd) {
+	char first[64];
+	return router_resolve_target(cmd, first) && router_is_auto_allowed(first) && is_safe_command(first);
+}
+
+static void router_build() {
+	router_clear();
+	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+		if (!router_is_auto_allowed(cmds[i].key)) continue;
+		router_add_doc(ROUTE_CMD, cmds[i].key, cmds[i].key, cmds[i].descri);
+	}
+	for (int i = 0; i < plugin_command_count; i++) {
+		const char *name = plugin_commands[i].name;
+		router_add_doc(ROUTE_PLUGIN, name, name, plugin_commands[i].descri);
+	}
+	// Aliases valem pelo que expandem: um alias para '!...' ou 'rm ...' nao entra.
+	for (int i = 0; i < alias_count; i++) {
+		if (!alias_list[i].name || !router_is_indexable(alias_list[i].command)) continue;
+		router_add_doc(ROUTE_ALIAS, alias_list[i].name, alias_list[i].name, alias_list[i].command);
+	}
+	// O historico ajuda a achar o comando, mas a linha nunca e repetida com os
+	// argumentos: o documento aponta so para o comando ('todo remove 5' -> 'todo').
+	for (int i = 0; i < history_count; i++) {
+		const char *entry = command_history[i];
+		char first[64];
+		if (entry[0] == '!' || sscanf(entry, "%63s", first) != 1) continue;
+		if (router_is_indexable(first)) router_add_doc(ROUTE_HISTORY, first, first, entry);
+	}
+
+	double total_len = 0;
+	for (int i = 0; i < router.doc_count; i++) total_len += router.docs[i].length;
+	router.avg_len = router.doc_count ? total_len / router.doc_count : 1.0;
+	router.max_idf = 0;
+	for (int i = 0; i < router.term_cap; i++) {
+		RouterTerm *t = &router.terms[i];
+		if (t->token[0] == '\0') continue;
+		t->idf = log(1.0 + (router.doc_count - t->count + 0.5) / (t->count + 0.5));
+		if (t->idf > router.max_idf) router.max_idf = t->idf;
+	}
+	router.dirty = false;
+}
+
+typedef struct {
+	int doc;
+	double score;
+	double matched_idf;
+} RouterCandidate;
+
+// Procura o melhor comando para o prompt. Retorna o documento escolhido ou -1
+// quando a confianca fica abaixo do limiar (o prompt segue para o Ollama).
+int router_route(const char *prompt, double *confidence_out) {
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (router.dirty) router_build();
+
+	char tokens[ROUTER_MAX_QUERY_TOKENS][ROUTER_STEM_LEN + 1];
+	int n = router_tokenize(prompt, tokens, ROUTER_MAX_QUERY_TOKENS);
+
+	RouterCandidate *cand = calloc(router.doc_count ? router.doc_count : 1, sizeof(RouterCandidate));
+	if (!cand) return -1;
+	double query_weight = 0;
+	for (int q = 0; q < n; q++) {
+		bool repeated = false;
+		for (int r = 0; r < q && !repeated; r++) repeated = strcmp(tokens[q], tokens[r]) == 0;
+		if (repeated) continue;
+		RouterTerm *t = router_find_term(tokens[q], false);
+		if (!t) {
+			// palavra desconhecida: reduz a confianca, mas menos que um termo raro
+			query_weight += router.max_idf * 0.5;
+			continue;
+		}
+		query_weight += t->idf;
+		for (int k = 0; k < t->count; k++) {
+			RouterDoc *d = &router.docs[t->docs[k]];
+			double tf = t->tf[k];
+			double norm = ROUTER_BM25_K1 * (1 - ROUTER_BM25_B + ROUTER_BM25_B * d->length / router.avg_len);
+			cand[t->docs[k]].score += t->idf * tf * (ROUTER_BM25_K1 + 1) / (tf + norm);
+			cand[t->docs[k]].matched_idf += t->idf;
+		}
+	}
+
+	int best = -1, second = -1;
+	for (int i = 0; i < router.doc_count; i++) {
+		cand[i].doc = i;
+		if (cand[i].score <= 0) continue;
+		if (best < 0 || cand[i].score > cand[best].score) {
+			second = best;
+			best = i;
+		} else if (second < 0 || cand[i].score > cand[second].score) {
+			second = i;
+		}
+	}
+	// Um segundo candidato que executa o mesmo comando nao e ambiguidade
+	if (best >= 0 && second >= 0 && strcasecmp(router.docs[best].command, router.docs[second].command) == 0) {
+		second = -1;
+		for (int i = 0; i < router.doc_count; i++) {
+			if (i == best || cand[i].score <= 0) continue;
+			if (strcasecmp(router.docs[i].command, router.docs[best].command) == 0) continue;
+			if (second < 0 || cand[i].score > cand[second].score) second = i;
+		}
+	}
+
+	double confidence = 0;
+	if (best >= 0 && query_weight > 0) {
+		double coverage = cand[best].matched_idf / query_weight;
+		double margin = second >= 0 ? (cand[best].score - cand[second].score) / cand[best].score : 1.0;
+		confidence = coverage * (0.5 + 0.5 * margin);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (router_explain) {
+		static const char *kind_names[] = { "comando", "plugin", "alias", "historico" };
+		printf("[router] tokens:");
+		for (int q = 0; q < n; q++) printf(" %s", tokens[q]);
+		printf("\n");
+		// mostra os 3 melhores candidatos
+		for (int rank = 0; rank < 3; rank++) {
+			int top = -1;
+			for (int i = 0; i < router.doc_count; i++) {
+				if (cand[i].score <= 0) continue;
+				if (top < 0 || cand[i].score > cand[top].score) top = i;
+			}
+			if (top < 0) break;
+			printf("[router] #%d %-9s %-20s score=%.3f\n", rank + 1, kind_names[router.docs[top].kind],
+			       router.docs[top].command, cand[top].score);
+			cand[top].score = -cand[top].score;
+		}
+		printf("[router] confianca=%.2f limiar=%.2f decisao=%s (%ld us, %d documentos)\n",
+		       confidence, router_threshold, confidence >= router_threshold ? "local" : "ollama",
+		       (long)((t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000),
+		       router.doc_count);
+	}
+	free(cand);
+
+	if (confidence_out) *confidence_out = confidence;
+	return (best >= 0 && confidence >= router_threshold) ? best : -1;
+}
+
+// Função para interação com Ollama/2B
+// Uso: 2b [-x] [-t <limiar>] [prompt]
+// -x liga/desliga o modo explicativo do roteador local, -t muda o limiar de
+// confianca. Sem prompt nos argumentos, ele e lido do terminal.
+int handle_ollama_interaction(const char *args) {
+    char user_prompt[MAX_PROMPT_LEN] = {0};
+    char ollama_full_command[MAX_OLLAMA_CMD_LEN];
+    char ollama_output_line[OLLAMA_BUFFER_SIZE];
+    FILE *ollama_pipe;
+
+    while (args && *args == '-') {
+        if (strncmp(args, "-x", 2) == 0 && (args[2] == ' ' || args[2] == '\0')) {
+            router_explain = !router_explain;
+            printf("Modo explicativo do roteador: %s\n", router_explain ? "ligado" : "desligado");
+            args += 2;
+        } else if (strncmp(args, "-t ", 3) == 0) {
+            char *end;
+            double value = strtod(args + 3, &end);
+            if (end == args + 3 || value < 0 || value > 1) {
+                printf("Limiar invalido, use um valor entre 0 e 1.\n");
+                return 2;
+            }
+            router_threshold = value;
+            printf("Limiar de confianca do roteador: %.2f\n", router_threshold);
+            args = end;
+        } else {
+            break;
+        }
+        while (*args == ' ') args++;
+    }
+
+    if (args && *args) {
+        strncpy(user_prompt, args, sizeof(user_prompt) - 1);
+    } else {
+        if (args) return 0; // so foram passadas opcoes
+        if (!interactive) {
+            // o stdin e o proprio script: ler o prompt dali comeria os comandos seguintes
+            printf("Erro, Faltando argumento. Uso 2b [-x] [-t <limiar>] <prompt>\n");
+            return 2;
+        }
+        printf("Digite o seu prompt para a 2B, a saida sera processada como comandos\n");
+        printf("IA prompt> ");
+        fflush(stdout);
+
+        disable_raw_mode();
+        char *read_ok = fgets(user_prompt, sizeof(user_prompt), stdin);
+        enable_raw_mode();
+        if (read_ok == NULL) {
+            perror("falha ao ler o prompt do usuario para a 2B");
+            return 1;
+        }
+    }
+
+    user_prompt[strcspn(user_prompt, "\n")] = '\0';
+    log_action("User Prompt to 2B", user_prompt);
+
+    if (user_prompt[0] == '\0') {
+        printf("prompt vazio, nenhuma interação com o ollama\n");
+        return 2;
+    }
+
+    double confidence;
+    int routed = router_route(user_prompt, &confidence);
+    if (routed >= 0) {
+        const char *cmd = router.docs[routed].command;
+        if (!router_can_auto_run(cmd)) {
+            // plugins e aliases para plugins: o caminho do Ollama tambem nao os roda
+            printf(">>> Sugestão local (confianca %.2f): %s\n", confidence, cmd);
+            printf("    Não executado automaticamente; digite o comando para rodá-lo.\n");
+            log_action("2B Router (sugestao)", cmd);
+            return 0;
+        }
+        printf(">>> Resposta local (confianca %.2f): CMD:%s\n", confidence, cmd);
+        log_action("2B Router", cmd);
+        char routed_cmd[MAX_PROMPT_LEN];
+        strncpy(routed_cmd, cmd, sizeof(routed_cmd) - 1);
+        routed_cmd[sizeof(routed_cmd) - 1] = '\0';
+        return dispatch(routed_cmd);
+    }
+
+    snprintf(ollama_full_command, sizeof(ollama_full_command), "ollama run %s \"%s\"", OLLAMA_MODEL, user_prompt);
+
+    printf("executando ollama com: %s\n", ollama_full_command);
+    printf("aguardando resposta da 2B...\n");
+    printf("-------------- 2B output --------------\n");
+
+    ollama_pipe = popen(ollama_full_command, "r");
+    if (ollama_pipe == NULL) {
+        perror("falha ao executar o comando ollama com popen");
+        fprintf(stderr, "verifique se ollama está no path e se a 2B está disponivel\n");
+        return 1;
+    }
+
+    int result = 0;   // status do ultimo comando da 2B que falhou
+
+    while (fgets(ollama_output_line, sizeof(ollama_output_line), ollama_pipe) != NULL) {
+        printf("%s", ollama_output_line);
+        fflush(stdout);
+        log_action("2B Output", ollama_output_line);
+
+        ollama_output_line[strcspn(ollama_output_line, "\n")] = '\0';
+        if (ollama_output_line[0] != '\0') {
+            if (strncmp(ollama_output_line, "CMD:", 4) == 0) {
+                const char *cmd = ollama_output_line + 4;
+                if (is_safe_command(cmd)) {
+                    printf(">>> Executando comando seguro da 2B: '%s'\n", cmd);
+                    int cmd_status = dispatch(cmd);
+                    if (cmd_status != 0) result = cmd_status;
+                } else {
+                    printf(">>> AVISO: Comando '%s' da 2B não é seguro. Ignorado.\n", cmd);
+                    printf("    Digite 'help' para ver comandos permitidos.\n");
+                }
+            } else {
+                printf(">>> Texto da 2B (não comando): '%s'\n", ollama_output_line);
+            }
+        }
+    }
+    printf("---------------- Fim da fala da 2B --------------\n");
+
+    int status = pclose(ollama_pipe);
+    if (status == -1) {
+        perror("pclose falhou para o pipe do ollama");
+    }
+    else {
+        if (WIFEXITED(status)) {
+            printf("processo do ollama terminou com o status: %d\n", WEXITSTATUS(status));
+        } else if (WIFSIGNALED(status)) {
+            printf("Processo ollama terminou com %d\n", WTERMSIG(status));
+        }
+    }
+    // uma falha do proprio ollama vale mais que a de um comando dele
+    return status != 0 ? shell_status(status) : result;
+}
+
+// Função para buscar no google//
+int search_google(const char *query) {
+    if (query == NULL || query[0] == '\0') {
+        printf("Uso: buscar <termo de pesquisa>\n");
+        return 2;
+    }
+
+    int status = 1;
+    CURL *curl = curl_easy_init();
+    if (curl) {
+        // Codifica o texto da busca para ser seguro para uma URL
+        // (Ex: "como fazer café" vira "como%20fazer%20café")
+        char *encoded_query = curl_easy_escape(curl, query, 0);
+        if (encoded_query) {
+            char url[1024];
+            char command[2048];
+            // Monta a URL do Google
+            snprintf(url, sizeof(url), "https://www.google.com/search?q=%s", encoded_query);
+            
+            // Monta o comando para abrir o navegador no Linux
+            // As aspas duplas garantem que a URL seja tratada como um único argumento
+            snprintf(command, sizeof(command), "xdg-open \"%s\"", url);
+            
+            printf("Abrindo navegador para buscar por: '%s'\n", query);
+            
+            // Executa o comando
+            status = shell_status(system(command));
+
+            // Libera a memória usada pela URL codificada
+            curl_free(encoded_query);
+        }
+        curl_easy_cleanup(curl);
+    }
+    return status;
+}
+void display_help() {
+    printf("Comandos disponíveis:\n");
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
+        printf("  %-15s: %s\n", cmds[i].key, cmds[i].descri);
+    }
+    if (plugin_command_count > 0) printf("Comandos de plugins:\n");
+    for (int i = 0; i < plugin_command_count; i++) {
+        const PluginCommandEntry *c = &plugin_commands[i];
+        printf("  %-15s: %s [%s]\n", c->name, c->descri ? c->descri : "(sem descrição)",
+               loaded_plugins[c->plugin].name);
+    }
+}
+
+// Tira os escapes com '\' que o Tab insere em nomes com espaco e afins, e
+// os espacos finais nao escapados ("cd pasta\ nova " -> "pasta nova").
+static void unescape_path_arg(char *s) {
+    char *w = s;
+    char *end = s;   // logo depois do ultimo caractere que nao e espaco solto
+    for (char *r = s; *r; r++) {
+        bool escaped = *r == '\\' && r[1];
+        if (escaped) r++;
+        *w++ = *r;
+        if (escaped || (*r != ' ' && *r != '\t')) end = w;
+    }
+    *end = '\0';
+}
+
+int cd(const char *args) {
+    // Verifica se o argumento (caminho do diretório) foi fornecido
+    if (args && strlen(args) > 0) {
+        char old_dir[256];
+        char new_dir[256];
+        char args_copy[256];
+    // Obtém o diretório atual antes da mudança
+        if (getcwd(old_dir, sizeof(old_dir)) == NULL) {
+            perror("Erro ao obter o diretorio atual antes da mudança");
+            old_dir[0] = '\0';
+        }
+        // Faz uma cópia do argumento para evitar modificação direta
+        strncpy(args_copy, args, sizeof(args_copy) - 1);
+        args_copy[sizeof(args_copy) - 1] = '\0';
+        // Remove newline ou espaços extras, se houver
+        args_copy[strcspn(args_copy, "\n")] = '\0';
+        unescape_path_arg(args_copy);
+        // Tenta mudar de diretório
+        int result = chdir(args_copy);
+        if (result == 0) {
+            // Obtém o novo diretório atual após a mudança
+            if (getcwd(new_dir, sizeof(new_dir)) == NULL) {
+                perror("Erro ao obter o novo diretorio atual");
+                // Continua sem mostrar o novo caminho
+                new_dir[0] = '\0';
+            }
+            printf("Diretorio alterado com sucesso. Antes '%s', Agora '%s'\n",
+                   old_dir[0] ? old_dir : "desconhecido",
+                   new_dir[0] ? new_dir : "desconhecido");
+        } else {
+            perror("Erro ao mudar de diretorio");
+            printf("Permanece no diretorio atual: '%s'\n", 
+                   old_dir[0] ? old_dir : "desconhecido");
+            return 1;
+        }
+    } else {
+        printf("Erro: Caminho do diretorio não fornecido. Uso: cd <caminho>\n");
+        return 2;
+    }
+    return 0;
+}
+
+int jntd_mkdir(const char *args) {
+    // Verifica se o argumento (nome do diretório) foi fornecido
+    if (args && strlen(args) > 0) {
+        char current_dir[256];
+        char mkdir_command[256];
+        char full_path[512];
+        // Obtém o diretório de trabalho atual
+        if (getcwd(current_dir, sizeof(current_dir)) == NULL) {
+            perror("Erro obter o diretorio atual");
+            current_dir[0] = '\0';
+            snprintf(full_path, sizeof(full_path), "%s", args);
+        } else {
+            snprintf(full_path, sizeof(full_path), "%s/%s", current_dir, args);
+        }
+        // Verifica se o diretório já existe
+        struct stat st;
+        if (stat(args, &st) == 0) {
+            printf("Erro: O diretorio '%s' já existe em '%s'.\n", 
+                   args, current_dir[0] ? current_dir : "diretorio atual desconhecido");
+            return 1;
+        } else {
+            // Constrói o comando para criar o diretório
+            snprintf(mkdir_command, sizeof(mkdir_command), "mkdir \"%s\"", args);
+            printf("Criando diretorio '%s' em '%s'...\n", 
+                   args, current_dir[0] ? current_dir : "Diretorio atual desconhecido");
+            // Executa o comando mkdir via system
+            int status = system(mkdir_command);
+            if (status == -1) {
+                perror("Erro ao executar o comando mkdir");
+                return 1;
+            } else {
+                if (WIFEXITED(status)) {
+                    int exit_code = WEXITSTATUS(status);
+                    printf("Comando mkdir terminou com o status '%d'.\n", exit_code);
+                    if (exit_code != 0) return exit_code;
+                    if (exit_code == 0) {
+                        // Verifica novamente se o diretório foi criado
+                        if (stat(args, &st) == 0) {
+                            printf("Diretorio criado com sucesso em '%s'.\n", full_path);
+                        } else {
+                            printf("Erro: Diretorio não foi criado, mesmo com codigo de saida 0\n");
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Retorna o status do ultimo comando do script que falhou (0 se nenhum),
+// como o modo nao interativo.
+int rscript(const char *args) {
+    int result = 0;
+    // Verifica se o argumento (nome do arquivo de script) foi fornecido
+    if (args && strlen(args) > 0) {
+        FILE *script_file = fopen(args, "r");
+        if (script_file == NULL) {
+            perror("Erro ao abrir o arquivo de script");
+            printf("Verifique se o arquivo: '%s' se encontra no diretorio, e se você tem permissão para lê-lo\n", args);
+            result = 1;
+        } else {
+            char script_line[128];
+            printf("Executando comandos do script '%s':\n", args);
+            printf("-----------------------------------------------\n");
+            while (fgets(script_line, sizeof(script_line), script_file) != NULL) {
+                script_line[strcspn(script_line, "\n")] = '\0';
+                if (script_line[0] != '\0' && script_line[0] != '#') {
+                    printf("Executando %s\n", script_line);
+                    int status = dispatch(script_line);
+                    if (status != 0) result = status;
+                }
+            }
+            printf("------------------------------------------------\n");
+            printf("Fim da execução do script '%s'.\n", args);
+            fclose(script_file);
+        }
+    } else {
+        printf("Erro, Faltando argumento. Uso rscript <arquivo>\n");
+        result = 2;
+    }
+    return result;
+}
+
+
+void disable_raw_mode() {
+    if (!interactive) return;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+}
+
+void enable_raw_mode() {
+    static bool exit_hook = false;
+    if (!interactive) return;
+    tcgetattr(STDIN_FILENO, &orig_termios);
+    if (!exit_hook) {
+        atexit(disable_raw_mode);
+        exit_hook = true;
+    }
+
+    struct termios raw = orig_termios;
+    raw.c_lflag &= ~(ECHO | ICANON);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+}
+
+int calculate_sha256(const char *filepath, char *output_hex_string) {
+    FILE *file = fopen(filepath, "rb");
+    if (!file) {
+        perror("Erro ao abrir arquivo");
+        return -1;
+    }
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_CTX sha256_context;
+    SHA256_Init(&sha256_context);
+    
+    const int bufSize = 4096;
+    unsigned char buffer[bufSize];
+    size_t bytesRead = 0;
+    
+    while ((bytesRead = fread(buffer, 1, bufSize, file))) {
+        SHA256_Update(&sha256_context, buffer, bytesRead);
+    }
+    
+    SHA256_Final(hash, &sha256_context);
+    fclose(file);
+    
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        sprintf(output_hex_string + (i * 2), "%02x", hash[i]);
+    }
+    output_hex_string[64] = 0;
+    
+    return 0;
+}
+
+int handle_hash_command() {
+    char choice_str[5];
+    int choice;
+    int status = 0;
+
+    disable_raw_mode(); // Desativa o modo raw para entrada padrão
+
+    printf("\n--- Verificador De Hash SHA-256 ---\n");
+    printf("1. Gerar hash de um arquivo\n");
+    printf("2. Comparar arquivo com hash colado\n");
+    printf("3. Sair\n");
+    printf("Escolha uma opção: ");
+
+    if (fgets(choice_str, sizeof(choice_str), stdin) == NULL) {
+        enable_raw_mode(); // Reativa em caso de erro
+        return 1;
+    }
+    choice = atoi(choice_str);
+
+    char filepath[256];
+    char hash_to_compare[129];
+    char calculated_hash[65];
+
+    switch (choice) {
+        case 1:
+            printf("Digite o caminho do arquivo para gerar hash: ");
+            if (fgets(filepath, sizeof(filepath), stdin) == NULL) {
+                status = 1;
+                break;
+            }
+            filepath[strcspn(filepath, "\n")] = 0;
+            if (calculate_sha256(filepath, calculated_hash) == 0) {
+                printf("\nHash-256 Gerado:\n%s\n", calculated_hash);
+            } else {
+                status = 1;
+            }
+            break;
+
+        case 2:
+            printf("Cole o hash-256 para comparar: ");
+            status = 1;
+            if (fgets(hash_to_compare, sizeof(hash_to_compare), stdin) == NULL) break;
+            hash_to_compare[strcspn(hash_to_compare, "\n")] = 0;
+
+            printf("Digite o caminho do arquivo para verificar: ");
+            if (fgets(filepath, sizeof(filepath), stdin) == NULL) break;
+            filepath[strcspn(filepath, "\n")] = 0;
+
+            if (calculate_sha256(filepath, calculated_hash) == 0) {
+                printf("\nHash calculado: %s\n", calculated_hash);
+                printf("Hash esperado:  %s\n", hash_to_compare);
+                if (strncmp(calculated_hash, hash_to_compare, 64) == 0) {
+                    printf("\n>>> RESULTADO: Os hashes COINCIDEM!!!\n");
+                    status = 0;
+                } else {
+                    printf("\n>>> RESULTADO: Os hashes NÃO COINCIDEM!!!\n");
+                }
+            }
+            break;
+
+        case 3:
+            printf("Saindo do modo hash...\n");
+            break;
+
+        default:
+            printf("Opção inválida.\n");
+            status = 2;
+            break;
+    }
+
+    enable_raw_mode(); // Reativa o modo raw antes de voltar ao shell
+    return status;
+}
+
+// Editor de linha do modo raw. O estado da edicao (LineEditor) e separado do
+// que esta desenhado no terminal (LineView): a cada lote de teclas o LineView
+// compara a linha nova com a exibida e emite so a diferenca (inserir/apagar
+// caracteres, mover o cursor), tudo em um unico write().
+// Obs: assim como antes, linhas maiores que a largura do terminal nao sao
+// tratadas (o cursor nao volta para a linha de cima).
+#define LINE_PROMPT "> "
+#define LINE_PROMPT_WIDTH 2
+#define LINE_VIEW_OUT_SIZE 8192
+
+enum {
+    LE_KEY_UP = 1000,
+    LE_KEY_DOWN,
+    LE_KEY_RIGHT,
+    LE_KEY_LEFT,
+    LE_KEY_HOME,
+    LE_KEY_END,
+    LE_KEY_DELETE,
+    LE_KEY_ESC,
+    LE_KEY_PASTE,   // um bloco colado esta pronto no InputReader
+};
+
+enum { LE_CONTINUE, LE_ACCEPT, LE_EOF };
+
+typedef struct {
+    char *buf;
+    int size;
+    int len;
+    int pos;
+    int history_pos;
+} LineEditor;
+
+typedef struct {
+    char shown[COMMAND_LINE_MAX];  // texto exibido depois do prompt
+    int shown_len;
+    int shown_pos;                 // coluna do cursor, relativa ao prompt
+    char out[LINE_VIEW_OUT_SIZE];  // saida pendente do lote atual
+    size_t out_len;
+    size_t total_bytes;            // bytes escritos desde o inicio
+    int fd;                        // -1: modo sem terminal, so conta os bytes
+} LineView;
+
+static LineView line_view = { .fd = STDOUT_FILENO };
+
+static void line_view_flush(LineView *v) {
+    size_t done = 0;
+    while (v->fd >= 0 && done < v->out_len) {
+        ssize_t w = write(v->fd, v->out + done, v->out_len - done);
+        if (w <= 0) break;
+        done += (size_t)w;
+    }
+    v->total_bytes += v->out_len;
+    v->out_len = 0;
+}
+
+static void line_view_emit(LineView *v, const char *data, size_t n) {
+    if (v->out_len + n > sizeof(v->out)) line_view_flush(v);
+    if (n > sizeof(v->out)) { // maior que o buffer inteiro, escreve direto
+        if (v->fd >= 0 && write(v->fd, data, n) < 0) return;
+        v->total_bytes += n;
+        return;
+    }
+    memcpy(v->out + v->out_len, data, n);
+    v->out_len += n;
+}
+
+static void line_view_csi(LineView *v, int count, char cmd) {
+    char seq[16];
+    int n = count == 1 ? snprintf(seq, sizeof(seq), "\x1b[%c", cmd)
+                       : snprintf(seq, sizeof(seq), "\x1b[%d%c", count, cmd);
+    line_view_emit(v, seq, (size_t)n);
+}
+
+// Move o cursor ate a coluna 'to'. Para poucas colunas a direita, reescrever
+// os proprios caracteres (ja no terminal) sai mais barato que a sequencia CSI.
+static void line_view_move(LineView *v, const char *text, int to) {
+    int from = v->shown_pos;
+    if (to > from) {
+        if (to - from <= 3) line_view_emit(v, text + from, (size_t)(to - from));
+        else line_view_csi(v, to - from, 'C');
+    } else if (to < from) {
+        if (from - to <= 2) line_view_emit(v, "\b\b", (size_t)(from - to));
+        else line_view_csi(v, from - to, 'D');
+    }
+    v->shown_pos = to;
+}
+
+// Deve ser chamado logo depois que o prompt foi impresso.
+static void line_view_reset(LineView *v) {
+    v->shown_len = 0;
+    v->shown_pos = 0;
+}
+
+// Atualiza o terminal para exibir buf[0..len) com o cursor em pos.
+static void line_view_sync(LineView *v, const char *buf, int len, int pos) {
+    if (len > (int)sizeof(v->shown)) len = sizeof(v->shown);
+    int prefix = 0;
+    int max_common = len < v->shown_len ? len : v->shown_len;
+    while (prefix < max_common && buf[prefix] == v->shown[prefix]) prefix++;
+    int suffix = 0;
+    while (suffix < max_common - prefix &&
+           buf[len - 1 - suffix] == v->shown[v->shown_len - 1 - suffix]) suffix++;
+
+    int old_mid = v->shown_len - prefix - suffix;
+    int new_mid = len - prefix - suffix;
+    if (old_mid > 0 || new_mid > 0) {
+        // O cursor so anda sobre texto ja exibido, entao usa o buffer antigo
+        line_view_move(v, v->shown, prefix);
+        // Opcao 1: reescrever tudo a partir do prefixo e limpar o resto
+        int rewrite_cost = (len - prefix) + (v->shown_len > len ? 3 : 0);
+        // Opcao 2: sobrescrever o trecho do meio e inserir/apagar a diferenca
+        int common_mid = old_mid < new_mid ? old_mid : new_mid;
+        int edit_cost = new_mid + (old_mid != new_mid ? 5 : 0);
+        if (suffix == 0 || rewrite_cost <= edit_cost) {
+            line_view_emit(v, buf + prefix, (size_t)(len - prefix));
+            if (v->shown_len > len) line_view_emit(v, "\x1b[K", 3);
+            v->shown_pos = len;
+        } else {
+            line_view_emit(v, buf + prefix, (size_t)common_mid);
+            if (new_mid > old_mid) {
+                line_view_csi(v, new_mid - old_mid, '@');
+                line_view_emit(v, buf + prefix + common_mid, (size_t)(new_mid - old_mid));
+            } else if (old_mid > new_mid) {
+                line_view_csi(v, old_mid - new_mid, 'P');
+            }
+            v->shown_pos = prefix + new_mid;
+        }
+        memcpy(v->shown + prefix, buf + prefix, (size_t)(len - prefix));
+        v->shown_len = len;
+    }
+    line_view_move(v, v->shown, pos);
+}
+
+static void line_editor_set(LineEditor *e, const char *text) {
+    strncpy(e->buf, text, e->size - 1);
+    e->buf[e->size - 1] = '\0';
+    e->len = strlen(e->buf);
+    e->pos = e->len;
+}
+
+// Insere n bytes no cursor de uma vez (caracteres de controle sao
+// descartados e tabs viram espaco).
+static void line_editor_insert(LineEditor *e, const char *text, size_t n) {
+    size_t room = e->size - 1 - e->len;
+    char *tmp = malloc(n + 1);
+    if (!tmp) return;
+    size_t k = 0;
+    for (size_t i = 0; i < n && k < room; i++) {
+        unsigned char c = text[i];
+        if (c == '\t') c = ' ';
+        if (isprint(c)) tmp[k++] = c;
+    }
+    memmove(&e->buf[e->pos + k], &e->buf[e->pos], e->len - e->pos + 1);
+    memcpy(&e->buf[e->pos], tmp, k);
+    e->len += k;
+    e->pos += k;
+    free(tmp);
+}
+
+// Aplica uma tecla ao estado do editor, sem desenhar nada.
+static int line_editor_key(LineEditor *e, int c) {
+    if (c == EOF || c == 4) { // EOF ou Ctrl+D
+        return LE_EOF;
+    } else if (c == '\n' || c == '\r') { // Enter
+        e->buf[e->len] = '\0';
+        return LE_ACCEPT;
+    } else if (c == 127 || c == 8) { // Backspace
+        if (e->pos > 0) {
+            memmove(&e->buf[e->pos - 1], &e->buf[e->pos], e->len - e->pos);
+            e->pos--;
+            e->len--;
+            e->buf[e->len] = '\0';
+        }
+    } else if (c == LE_KEY_UP) {
+        if (e->history_pos > 0) {
+            e->history_pos--;
+            line_editor_set(e, command_history[e->history_pos]);
+        }
+    } else if (c == LE_KEY_DOWN) {
+        if (e->history_pos < history_count - 1) {
+            e->history_pos++;
+            line_editor_set(e, command_history[e->history_pos]);
+        } else {
+            e->history_pos = history_count;
+            line_editor_set(e, "");
+        }
+    } else if (c == LE_KEY_RIGHT) {
+        if (e->pos < e->len) e->pos++;
+    } else if (c == LE_KEY_LEFT) {
+        if (e->pos > 0) e->pos--;
+    } else if (c == LE_KEY_HOME) {
+        e->pos = 0;
+    } else if (c == LE_KEY_END) {
+        e->pos = e->len;
+    } else if (c == LE_KEY_DELETE) {
+        if (e->pos < e->len) {
+            memmove(&e->buf[e->pos], &e->buf[e->pos + 1], e->len - e->pos);
+            e->len--;
+        }
+    } else if (c < 256 && isprint(c) && e->len < e->size - 1) {
+        memmove(&e->buf[e->pos + 1], &e->buf[e->pos], e->len - e->pos + 1); // +1 para o terminador nulo
+        e->buf[e->pos] = c;
+        e->len++;
+        e->pos++;
+    }
+    return LE_CONTINUE;
+}
+
+// Completar com Tab. Nomes de comandos (cmds[], aliases, plugins e
+// executaveis do PATH) ficam numa trie; caminhos vem de um cache de listagens
+// por diretorio, ordenadas para busca binaria por prefixo. Cada diretorio do
+// cache tem um watch no inotify, que invalida a listagem quando algo muda.
+#define DIR_CACHE_MAX 32
+#define COMPLETION_LIST_MAX 100
+
+typedef struct {
+    char c;
+    bool terminal;
+    int child;     // primeiro filho (-1 se nenhum), irmaos em ordem crescente
+    int sibling;
+} TrieNode;
+
+typedef struct {
+    TrieNode *nodes;
+    int count;
+    int cap;
+} Trie;
+
+static int trie_new_node(Trie *t, char c) {
+    if (t->count == t->cap) {
+        int new_cap = t->cap ? t->cap * 2 : 1024;
+        TrieNode *nodes = realloc(t->nodes, new_cap * sizeof(TrieNode));
+        if (!nodes) return -1;
+        t->nodes = nodes;
+        t->cap = new_cap;
+    }
+    TrieNode *n = &t->nodes[t->count];
+    n->c = c;
+    n->terminal = false;
+    n->child = -1;
+    n->sibling = -1;
+    return t->count++;
+}
+
+static void trie_clear(Trie *t) {
+    t->count = 0;
+    trie_new_node(t, '\0'); // raiz
+}
+
+static void trie_insert(Trie *t, const char *word) {
+    if (t->count == 0) trie_clear(t);
+    int node = 0;
+    for (const char *p = word; *p; p++) {
+        int prev = -1;
+        int cur = t->nodes[node].child;
+        while (cur >= 0 && t->nodes[cur].c < *p) {
+            prev = cur;
+            cur = t->nodes[cur].sibling;
+        }
+        if (cur < 0 || t->nodes[cur].c != *p) {
+            int n = trie_new_node(t, *p);
+            if (n < 0) return;
+            t->nodes[n].sibling = cur;
+            if (prev >= 0) t->nodes[prev].sibling = n;
+            else t->nodes[node].child = n;
+            cur = n;
+        }
+        node = cur;
+    }
+    t->nodes[node].terminal = true;
+}
+
+static int trie_find(const Trie *t, const char *prefix) {
+    if (t->count == 0) return -1;
+    int node = 0;
+    for (const char *p = prefix; *p && node >= 0; p++) {
+        int cur = t->nodes[node].child;
+        while (cur >= 0 && t->nodes[cur].c < *p) cur = t->nodes[cur].sibling;
+        node = (cur >= 0 && t->nodes[cur].c == *p) ? cur : -1;
+    }
+    return node;
+}
+
+// Junta em out as palavras abaixo de node (no maximo max), em ordem.
+static void trie_collect(const Trie *t, int node, char *word, int depth, int max_depth,
+                         char **out, int *count, int max) {
+    if (*count >= max) return;
+    if (t->nodes[node].terminal) {
+        word[depth] = '\0';
+        out[(*count)++] = strdup(word);
+    }
+    for (int c = t->nodes[node].child; c >= 0 && *count < max; c = t->nodes[c].sibling) {
+        if (depth + 1 >= max_depth) break;
+        word[depth] = t->nodes[c].c;
+        trie_collect(t, c, word, depth + 1, max_depth, out, count, max);
+    }
+}
+
+// Numero de palavras abaixo de node, sem o limite de trie_collect.
+static int trie_count(const Trie *t, int node) {
+    int n = t->nodes[node].terminal ? 1 : 0;
+    for (int c = t->nodes[node].child; c >= 0; c = t->nodes[c].sibling) n += trie_count(t, c);
+    return n;
+}
+
+typedef struct {
+    char *path;          // caminho absoluto do diretorio
+    int wd;              // watch do inotify
+    char *pool;          // nomes, separados por '\0'
+    char **names;        // ordenados (strcmp); o byte anterior e o d_type
+    int count;
+    bool valid;
+    bool in_path;        // diretorio do PATH: seus nomes estao na trie
+    unsigned long last_used;
+} DirCacheEntry;
+
+static DirCacheEntry dir_cache[DIR_CACHE_MAX];
+static int dir_cache_count = 0;
+static unsigned long dir_cache_clock = 0;
+static int completion_inotify_fd = -1;
+
+static Trie command_trie;
+static bool command_trie_dirty = true;
+static char *command_trie_path = NULL;   // PATH usado na ultima construcao
+
+void completion_mark_dirty() {
+    command_trie_dirty = true;
+}
+
+static void dir_cache_free_listing(DirCacheEntry *d) {
+    free(d->pool);
+    free(d->names);
+    d->pool = NULL;
+    d->names = NULL;
+    d->count = 0;
+    d->valid = false;
+}
+
+// Le os eventos pendentes do inotify e invalida as listagens afetadas.
+static void dir_cache_drain_events() {
+    if (completion_inotify_fd < 0) return;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(completion_inotify_fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // eventos perdidos: nenhuma listagem e confiavel
+                for (int i = 0; i < dir_cache_count; i++) dir_cache_free_listing(&dir_cache[i]);
+                command_trie_dirty = true;
+            }
+            for (int i = 0; i < dir_cache_count; i++) {
+                if (dir_cache[i].wd != ev->wd) continue;
+                dir_cache_free_listing(&dir_cache[i]);
+                if (ev->mask & IN_IGNORED) dir_cache[i].wd = -1;
+                // um diretorio do PATH mudou: os executaveis na trie tambem
+                if (dir_cache[i].in_path) command_trie_dirty = true;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+static int dir_cache_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Le o diretorio para o pool. Cada nome e precedido por um byte com o d_type,
+// assim a ordenacao dos ponteiros leva o tipo junto (tipo = names[i][-1]).
+static bool dir_cache_load(DirCacheEntry *d) {
+    DIR *dir = opendir(d->path);
+    if (!dir) return false;
+    size_t pool_len = 0, pool_cap = 16384;
+    char *pool = malloc(pool_cap);
+    size_t *offsets = NULL;
+    int count = 0, cap = 0;
+    bool ok = pool != NULL;
+    struct dirent *ent;
+    while (ok && (ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        size_t len = strlen(ent->d_name) + 2;
+        if (pool_len + len > pool_cap) {
+            while (pool_len + len > pool_cap) pool_cap *= 2;
+            char *p = realloc(pool, pool_cap);
+            if (!p) {
+                ok = false;
+                break;
+            }
+            pool = p;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 256;
+            size_t *o = realloc(offsets, cap * sizeof(size_t));
+            if (!o) {
+                ok = false;
+                break;
+            }
+            offsets = o;
+        }
+        pool[pool_len] = (char)ent->d_type;
+        memcpy(pool + pool_len + 1, ent->d_name, len - 1);
+        offsets[count++] = pool_len + 1;
+        pool_len += len;
+    }
+    closedir(dir);
+
+    char **names = ok ? malloc((count ? count : 1) * sizeof(char *)) : NULL;
+    if (!names) {
+        free(pool);
+        free(offsets);
+        return false;
+    }
+    // o pool pode ter mudado de lugar no realloc, por isso os offsets
+    for (int i = 0; i < count; i++) names[i] = pool + offsets[i];
+    free(offsets);
+    qsort(names, count, sizeof(char *), dir_cache_cmp);
+
+    d->pool = pool;
+    d->names = names;
+    d->count = count;
+    d->valid = true;
+    return true;
+}
+
+// Retorna a listagem (ordenada) de um diretorio, usando o cache.
+static DirCacheEntry *dir_cache_get(const char *abs_path) {
+    if (completion_inotify_fd < 0) {
+        completion_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    dir_cache_drain_events();
+
+    DirCacheEntry *d = NULL;
+    for (int i = 0; i < dir_cache_count; i++) {
+        if (dir_cache[i].path && strcmp(dir_cache[i].path, abs_path) == 0) {
+            d = &dir_cache[i];
+            break;
+        }
+    }
+    if (!d) {
+        bool appended = dir_cache_count < DIR_CACHE_MAX;
+        if (appended) {
+            d = &dir_cache[dir_cache_count++];
+        } else {
+            d = &dir_cache[0]; // descarta o menos usado
+            for (int i = 1; i < DIR_CACHE_MAX; i++) {
+                if (dir_cache[i].last_used < d->last_used) d = &dir_cache[i];
+            }
+            if (d->wd >= 0 && completion_inotify_fd >= 0) inotify_rm_watch(completion_inotify_fd, d->wd);
+            // sem o watch, mudancas nesse diretorio do PATH nao chegariam a trie
+            if (d->in_path) command_trie_dirty = true;
+            dir_cache_free_listing(d);
+            free(d->path);
+        }
+        memset(d, 0, sizeof(*d));
+        d->path = strdup(abs_path);
+        d->wd = -1;
+        if (!d->path) {
+            // so a posicao recem-acrescentada pode sair do fim; uma descartada
+            // fica vazia (path NULL, last_used 0) e e a primeira a ser reusada
+            if (appended) dir_cache_count--;
+            return NULL;
+        }
+    }
+    d->last_used = ++dir_cache_clock;
+    if (!d->valid) {
+        if (d->wd < 0 && completion_inotify_fd >= 0) {
+            d->wd = inotify_add_watch(completion_inotify_fd, abs_path,
+                                      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+        }
+        if (!dir_cache_load(d)) return NULL;
+    }
+    return d;
+}
+
+// Intervalo [*lo, *hi) de nomes com o prefixo dado (busca binaria).
+static void dir_cache_range(const DirCacheEntry *d, const char *prefix, int *lo, int *hi) {
+    size_t plen = strlen(prefix);
+    int a = 0, b = d->count;
+    while (a < b) {
+        int m = (a + b) / 2;
+        if (strncmp(d->names[m], prefix, plen) < 0) a = m + 1;
+        else b = m;
+    }
+    *lo = a;
+    b = d->count;
+    while (a < b) {
+        int m = (a + b) / 2;
+        if (strncmp(d->names[m], prefix, plen) <= 0) a = m + 1;
+        else b = m;
+    }
+    *hi = a;
+}
+
+static bool dir_cache_is_dir(const DirCacheEntry *d, int i) {
+    unsigned char type = (unsigned char)d->names[i][-1];
+    if (type == DT_DIR) return true;
+    if (type != DT_LNK && type != DT_UNKNOWN) return false;
+    char full[PATH_MAX];
+    struct stat st;
+    snprintf(full, sizeof(full), "%s/%s", d->path, d->names[i]);
+    return stat(full, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void command_trie_build() {
+    trie_clear(&command_trie);
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) trie_insert(&command_trie, cmds[i].key);
+    for (int i = 0; i < alias_count; i++) trie_insert(&command_trie, alias_list[i].name);
+    for (int i = 0; i < plugin_command_count; i++) trie_insert(&command_trie, plugin_commands[i].name);
+
+    const char *path_env = getenv("PATH");
+    char *paths = strdup(path_env ? path_env : "");
+    free(command_trie_path);
+    command_trie_path = path_env ? strdup(path_env) : NULL;
+    command_trie_dirty = false;
+    for (int i = 0; i < dir_cache_count; i++) dir_cache[i].in_path = false;
+    if (!paths) return;
+    char *save = NULL;
+    for (char *dir = strtok_r(paths, ":", &save); dir; dir = strtok_r(NULL, ":", &save)) {
+        if (dir[0] != '/') continue;
+        DirCacheEntry *d = dir_cache_get(dir);
+        if (!d) continue;
+        d->in_path = true;
+        for (int i = 0; i < d->count; i++) {
+            if (d->names[i][0] != '.') trie_insert(&command_trie, d->names[i]);
+        }
+    }
+    free(paths);
+    // dir_cache_get pode ter lido eventos antigos e marcado a trie de novo
+    command_trie_dirty = false;
+}
+
+static int completion_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Caracteres que o shell (cp, rm, mv, '!') ou o tokenizador dos plugins
+// interpretariam; nos nomes completados eles entram escapados com '\'.
+#define COMPLETION_SPECIAL " \t\\'\"`$&;|<>()*?[]#"
+
+// true se buf[i] esta escapado (precedido por um numero impar de '\').
+static bool completion_escaped(const char *buf, int i) {
+    int n = 0;
+    while (i - n > 0 && buf[i - n - 1] == '\\') n++;
+    return n % 2 == 1;
+}
+
+// Copia src para dst escapando os caracteres especiais. Retorna o tamanho.
+static size_t completion_escape(char *dst, size_t size, const char *src) {
+    size_t n = 0;
+    for (; *src && n + 2 < size; src++) {
+        if (strchr(COMPLETION_SPECIAL, *src)) dst[n++] = '\\';
+        dst[n++] = *src;
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+// Completa a palavra antes do cursor. Com varias opcoes, estende ate o maior
+// prefixo comum; se nada mudou e show_list for true, lista as opcoes na tela.
+// Retorna o numero de candidatos encontrados.
+static int line_editor_complete(LineEditor *e, bool show_list, LineView *v) {
+    int start = e->pos;
+    while (start > 0 && (e->buf[start - 1] != ' ' || completion_escaped(e->buf, start - 1))) start--;
+    int first_word = 1;
+    for (int i = 0; i < start; i++) {
+        if (e->buf[i] != ' ') first_word = 0;
+    }
+    // a palavra sem os escapes, como o comando vai recebe-la
+    char word[PATH_MAX];
+    int wlen = 0;
+    if (e->pos - start >= (int)sizeof(word)) return 0;
+    for (int i = start; i < e->pos; i++) {
+        if (e->buf[i] == '\\' && i + 1 < e->pos) i++;
+        word[wlen++] = e->buf[i];
+    }
+    word[wlen] = '\0';
+
+    char *list[COMPLETION_LIST_MAX];
+    int listed = 0, total = 0;
+    const char *base = word;     // parte da palavra que sera completada
+    char common[PATH_MAX];
+    common[0] = '\0';
+    bool unique_is_dir = false;
+    bool escape = false;
+
+    if (first_word && !strchr(word, '/')) {
+        const char *path_env = getenv("PATH");
+        if (command_trie_dirty || !command_trie_path || !path_env || strcmp(path_env, command_trie_path) != 0) {
+            command_trie_build();
+        } else {
+            dir_cache_drain_events();
+            if (command_trie_dirty) command_trie_build();
+        }
+        int node = trie_find(&command_trie, word);
+        if (node < 0) return 0;
+        // maior prefixo comum: desce enquanto houver um unico caminho
+        int clen = 0;
+        int n = node;
+        while (!command_trie.nodes[n].terminal && command_trie.nodes[n].child >= 0 &&
+               command_trie.nodes[command_trie.nodes[n].child].sibling < 0 && clen < (int)sizeof(common) - 1) {
+            n = command_trie.nodes[n].child;
+            common[clen++] = command_trie.nodes[n].c;
+        }
+        common[clen] = '\0';
+        char scratch[PATH_MAX];
+        strcpy(scratch, word);
+        trie_collect(&command_trie, node, scratch, wlen, sizeof(scratch), list, &listed, COMPLETION_LIST_MAX);
+        total = trie_count(&command_trie, node);
+        if (listed == 1) {
+            strncpy(common, list[0] + wlen, sizeof(common) - 1);
+            common[sizeof(common) - 1] = '\0';
+        }
+    } else {
+        char dir_part[PATH_MAX];
+        char abs_dir[PATH_MAX * 2];
+        const char *slash = strrchr(word, '/');
+        base = slash ? slash + 1 : word;
+        size_t dlen = slash ? (size_t)(slash - word + 1) : 0;
+        memcpy(dir_part, word, dlen);
+        dir_part[dlen] = '\0';
+
+        const char *home = getenv("HOME");
+        if (dir_part[0] == '/') {
+            snprintf(abs_dir, sizeof(abs_dir), "%s", dir_part);
+        } else if (dir_part[0] == '~' && dir_part[1] == '/' && home) {
+            snprintf(abs_dir, sizeof(abs_dir), "%s/%s", home, dir_part + 2);
+        } else {
+            char cwd[PATH_MAX];
+            if (!getcwd(cwd, sizeof(cwd))) return 0;
+            snprintf(abs_dir, sizeof(abs_dir), "%s/%s", cwd, dir_part);
+        }
+        size_t alen = strlen(abs_dir);
+        while (alen > 1 && abs_dir[alen - 1] == '/') abs_dir[--alen] = '\0';
+
+        DirCacheEntry *d = dir_cache_get(abs_dir);
+        if (!d) return 0;
+        escape = true;
+        int lo, hi;
+        dir_cache_range(d, base, &lo, &hi);
+        // ocultos so aparecem se o prefixo comecar com '.'; nao estao
+        // necessariamente no inicio ('-' e outros vem antes de '.')
+        bool hidden = base[0] == '.';
+        int first = -1, last = -1;
+        for (int i = lo; i < hi; i++) {
+            if (!hidden && d->names[i][0] == '.') continue;
+            if (first < 0) first = i;
+            last = i;
+            total++;
+        }
+        if (total == 0) return 0;
+        // os nomes estao ordenados: o prefixo comum dos visiveis e o do
+        // primeiro com o ultimo
+        const char *a = d->names[first], *b = d->names[last];
+        size_t blen = strlen(base), clen = blen;
+        while (a[clen] && a[clen] == b[clen] && clen - blen < sizeof(common) - 1) clen++;
+        memcpy(common, a + blen, clen - blen);
+        common[clen - blen] = '\0';
+        if (total == 1) unique_is_dir = dir_cache_is_dir(d, first);
+        for (int i = first; i <= last && listed < COMPLETION_LIST_MAX; i++) {
+            if (!hidden && d->names[i][0] == '.') continue;
+            size_t nlen = strlen(d->names[i]);
+            char *item = malloc(nlen + 2);
+            if (!item) break;
+            memcpy(item, d->names[i], nlen);
+            bool is_dir = total <= COMPLETION_LIST_MAX && dir_cache_is_dir(d, i);
+            item[nlen] = is_dir ? '/' : '\0';
+            item[nlen + 1] = '\0';
+            list[listed++] = item;
+        }
+    }
+
+    if (common[0] && escape) {
+        char escaped[sizeof(common) * 2];
+        line_editor_insert(e, escaped, completion_escape(escaped, sizeof(escaped), common));
+    } else if (common[0]) {
+        line_editor_insert(e, common, strlen(common));
+    }
+    if (total == 1) {
+        if (unique_is_dir) line_editor_insert(e, "/", 1);
+        else line_editor_insert(e, " ", 1);
+    } else if (!common[0] && show_list && total > 1) {
+        qsort(list, listed, sizeof(char *), completion_cmp);
+        line_view_emit(v, "\n", 1);
+        for (int i = 0; i < listed; i++) {
+            line_view_emit(v, list[i], strlen(list[i]));
+            line_view_emit(v, (i % 4 == 3 || i == listed - 1) ? "\n" : "  ", (i % 4 == 3 || i == listed - 1) ? 1 : 2);
+        }
+        if (total > listed) {
+            char more[64];
+            int n = snprintf(more, sizeof(more), "... e mais %d\n", total - listed);
+            line_view_emit(v, more, n);
+        }
+        line_view_emit(v, LINE_PROMPT, LINE_PROMPT_WIDTH);
+        line_view_reset(v);
+    }
+    for (int i = 0; i < listed; i++) free(list[i]);
+    return total;
+}
+
+// Historico persistente com busca reversa (Ctrl-R). Cada comando distinto
+// vira uma entrada com contagem de uso e ultimo uso; um indice de trigramas
+// (3 bytes em minusculas) aponta para as entradas que os contem. A busca
+// intersecta as listas dos trigramas da consulta, a partir da mais rara, e
+// cai para uma votacao quando nenhuma entrada tem todos (erro de digitacao).
+// O arquivo fica em $XDG_STATE_HOME/jntd/history (ou ~/.local/state/...),
+// com no maximo HISTORY_FILE_MAX linhas.
+#define HISTORY_FILE_MAX 10000
+#define HISTORY_FILE_KEEP 9000      // linhas mantidas quando o arquivo passa do maximo
+#define HISTORY_SEARCH_RESULTS 16
+#define HISTORY_SHORT_SCAN 64       // consultas com menos de 3 letras
+#define HISTORY_VOTE_TRIGRAMS 8     // trigramas usados na votacao
+#define HISTORY_VOTE_BUDGET 50000   // maximo de ids visitados na votacao
+#define HISTORY_AND_BUDGET 4096     // candidatos (mais novos) avaliados por tecla
+#define HISTORY_RECENT_SCAN 256     // usados por ultimo, avaliados sempre
+
+typedef struct {
+    char *text;
+    char *lower;          // copia em minusculas, para as comparacoes
+    uint32_t count;       // quantas vezes foi usado
+    uint32_t last_seq;    // numero do ultimo uso
+    int newer;            // lista duplamente ligada por recencia
+    int older;
+} HistoryEntry;
+
+typedef struct {
+    uint32_t key;         // trigrama + 1 (0 marca posicao vazia)
+    int *ids;             // entradas em ordem crescente
+    int count;
+    int cap;
+} TrigramPosting;
+
+typedef struct {
+    HistoryEntry *entries;
+    int count;
+    int cap;
+    uint32_t seq;
+    int newest;           // cabeca da lista de recencia
+    int *dedup;           // tabela hash texto -> entrada (-1 vazio)
+    int dedup_cap;
+    TrigramPosting *trigrams;
+    int trigram_cap;
+    int trigram_count;
+    FILE *file;
+    char *path;
+    int file_lines;
+} HistoryStore;
+
+static HistoryStore history_store = { .newest = -1 };
+
+static uint32_t history_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static TrigramPosting *history_trigram(uint32_t trigram, bool create) {
+    HistoryStore *h = &history_store;
+    if (create && (h->trigram_count + 1) * 2 > h->trigram_cap) {
+        int new_cap = h->trigram_cap ? h->trigram_cap * 2 : 4096;
+        TrigramPosting *t = calloc(new_cap, sizeof(TrigramPosting));
+        if (!t) return NULL;
+        for (int i = 0; i < h->trigram_cap; i++) {
+            if (!h->trigrams[i].key) continue;
+            uint32_t j = (h->trigrams[i].key * 2654435761u) & (new_cap - 1);
+            while (t[j].key) j = (j + 1) & (new_cap - 1);
+            t[j] = h->trigrams[i];
+        }
+        free(h->trigrams);
+        h->trigrams = t;
+        h->trigram_cap = new_cap;
+    }
+    if (h->trigram_cap == 0) return NULL;
+    uint32_t key = trigram + 1;
+    uint32_t i = (key * 2654435761u) & (h->trigram_cap - 1);
+    while (h->trigrams[i].key) {
+        if (h->trigrams[i].key == key) return &h->trigrams[i];
+        i = (i + 1) & (h->trigram_cap - 1);
     }
+    if (!create) return NULL;
+    h->trigrams[i].key = key;
+    h->trigram_count++;
+    return &h->trigrams[i];
+}
 
-    char buffer[1024];
-    char *result = NULL;
-    int linha_atual = 0;
+static inline uint32_t trigram_at(const char *s) {
+    return ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
 
-    while (fgets(buffer, sizeof(buffer), quiz_f) != NULL) {
-        linha_atual++;
-        if (linha_atual == line_number) {
-            buffer[strcspn(buffer, "\n")] = '\0'; // Remove o '\n' se presente
-            result = strdup(buffer);
-            if (result == NULL) {
-                fprintf(stderr, "Erro ao alocar memória para a linha\n");
-                fclose(quiz_f);
-                return NULL;
-            }
-            break; // Sai do loop após encontrar a linha
+static void history_index_entry(int id) {
+    const char *s = history_store.entries[id].lower;
+    size_t len = strlen(s);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        TrigramPosting *p = history_trigram(trigram_at(s + i), true);
+        if (!p) return;
+        if (p->count > 0 && p->ids[p->count - 1] == id) continue; // repetido na mesma linha
+        if (p->count == p->cap) {
+            int new_cap = p->cap ? p->cap * 2 : 4;
+            int *ids = realloc(p->ids, new_cap * sizeof(int));
+            if (!ids) return;
+            p->ids = ids;
+            p->cap = new_cap;
         }
+        p->ids[p->count++] = id;
     }
-    fclose(quiz_f);
-    if (result == NULL) {
-        fprintf(stderr, "Linha %d não encontrada. Total de linhas no arquivo: %d\n", line_number, linha_atual);
-        return NULL;
-    }
-    return result;
 }
 
-//Função para sugerir comandos com base em um texto parcial
-void suggest_commands(const char *partial) {
-	int found = 0;
-	printf("\nSugestão de Comandos:\n");
-	for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
-		if (strncmp(partial, cmds[i].key, strlen(partial)) == 0) {
-			printf("  -%s:  %s\n", cmds[i].key, cmds[i].descri);
-			found++;
-		}
-	}
-	if (!found) {
-		printf("  Nenhum comando encontrado com '%s'. Use 'help' para ver todos os comandos.\n", partial);
-	}
-	printf("> %s", partial); //reexibe oque o usuario já digitou
-	fflush(stdout);
+// Move a entrada para o topo da lista de recencia.
+static void history_touch(int id) {
+    HistoryStore *h = &history_store;
+    HistoryEntry *e = &h->entries[id];
+    e->last_seq = ++h->seq;
+    e->count++;
+    if (h->newest == id) return;
+    if (e->newer >= 0) h->entries[e->newer].older = e->older;
+    if (e->older >= 0) h->entries[e->older].newer = e->newer;
+    e->newer = -1;
+    e->older = h->newest;
+    if (h->newest >= 0) h->entries[h->newest].newer = id;
+    h->newest = id;
 }
 
-//Função para ler uma linha aleatoria
-char* read_random_line() {
-    int total_lines = contar_linhas();
-    if (total_lines <= 0) {
-        fprintf(stderr, "Erro: Arquivo vazio ou falha ao contar linhas em '%s'\n", quiz_file);
-        return NULL;
+static int history_find(const char *text, uint32_t hash) {
+    HistoryStore *h = &history_store;
+    if (h->dedup_cap == 0) return -1;
+    for (uint32_t i = hash & (h->dedup_cap - 1);; i = (i + 1) & (h->dedup_cap - 1)) {
+        int id = h->dedup[i];
+        if (id < 0) return -1;
+        if (strcmp(h->entries[id].text, text) == 0) return id;
     }
-    // Gera um número aleatório entre 1 e total_lines
-    int random_line = (rand() % total_lines) + 1;
-    srand(time(NULL)); 
-    // Lê a linha correspondente ao número aleatório
-    char* result = read_speci_line(random_line);
-    if (result == NULL) {
-        fprintf(stderr, "Erro: Falha ao ler a linha %d do arquivo '%s'\n", random_line, quiz_file);
-        return NULL;
+}
+
+static void history_dedup_insert(int id) {
+    HistoryStore *h = &history_store;
+    if ((h->count + 1) * 2 > h->dedup_cap) {
+        int new_cap = h->dedup_cap ? h->dedup_cap * 2 : 1024;
+        int *t = malloc(new_cap * sizeof(int));
+        if (!t) return;
+        memset(t, -1, new_cap * sizeof(int));
+        for (int k = 0; k < h->count; k++) {
+            if (k == id) continue;
+            uint32_t i = history_hash(h->entries[k].text) & (new_cap - 1);
+            while (t[i] >= 0) i = (i + 1) & (new_cap - 1);
+            t[i] = k;
+        }
+        free(h->dedup);
+        h->dedup = t;
+        h->dedup_cap = new_cap;
     }
-    return result;
+    uint32_t i = history_hash(h->entries[id].text) & (h->dedup_cap - 1);
+    while (h->dedup[i] >= 0) i = (i + 1) & (h->dedup_cap - 1);
+    h->dedup[i] = id;
 }
 
-// Função para logging de ações
-void log_action(const char *action, const char *details) {
-    FILE *log_file = fopen("jntd_log.txt", "a");
-    if (log_file == NULL) {
-        perror("Erro ao abrir arquivo de log");
-        return;
+// Registra um uso do comando (sem gravar no arquivo).
+static void history_store_record(const char *text) {
+    HistoryStore *h = &history_store;
+    if (text[0] == '\0') return;
+    int id = history_find(text, history_hash(text));
+    if (id < 0) {
+        if (h->count == h->cap) {
+            int new_cap = h->cap ? h->cap * 2 : 1024;
+            HistoryEntry *entries = realloc(h->entries, new_cap * sizeof(HistoryEntry));
+            if (!entries) return;
+            h->entries = entries;
+            h->cap = new_cap;
+        }
+        HistoryEntry *e = &h->entries[h->count];
+        e->text = strdup(text);
+        e->lower = strdup(text);
+        if (!e->text || !e->lower) {
+            free(e->text);
+            free(e->lower);
+            return;
+        }
+        for (char *p = e->lower; *p; p++) *p = (char)tolower((unsigned char)*p);
+        e->count = 0;
+        e->newer = e->older = -1;
+        id = h->count++;
+        history_dedup_insert(id);
+        history_index_entry(id);
+        if (h->newest < 0) h->newest = id;
     }
-    time_t now = time(NULL);
-    char time_str[26];
-    ctime_r(&now, time_str);
-    time_str[24] = '\0'; // Remove newline
-    fprintf(log_file, "[%s] %s: %s\n", time_str, action, details);
-    fclose(log_file);
+    history_touch(id);
 }
 
-// Função para interação com Ollama/2B
-void handle_ollama_interaction() {
-    char user_prompt[MAX_PROMPT_LEN];
-    char ollama_full_command[MAX_OLLAMA_CMD_LEN];
-    char ollama_output_line[OLLAMA_BUFFER_SIZE];
-    FILE *ollama_pipe;
+// $XDG_STATE_HOME/jntd/history, ou ~/.local/state/jntd/history; cria as
+// pastas que faltam. false sem nenhuma das duas variaveis (sem historico).
+static bool history_file_path(char *out, size_t size) {
+    const char *state = getenv("XDG_STATE_HOME");
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+    if (state && state[0] == '/') snprintf(dir, sizeof(dir), "%s/jntd", state);
+    else if (home && home[0] == '/') snprintf(dir, sizeof(dir), "%s/.local/state/jntd", home);
+    else return false;
+    for (char *p = dir + 1;; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char c = *p;
+        *p = '\0';
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) return false;
+        *p = c;
+        if (!c) break;
+    }
+    return snprintf(out, size, "%s/history", dir) < (int)size;
+}
 
-    printf("Digite o seu prompt para a 2B, a saida sera processada como comandos\n");
-    printf("IA prompt> ");
-    fflush(stdout);
+// O historico pode ter senhas (comandos '!'): so o dono le.
+static FILE *history_file_open(const char *path) {
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    FILE *f = fd >= 0 ? fdopen(fd, "a") : NULL;
+    if (!f && fd >= 0) close(fd);
+    return f;
+}
 
-    if (fgets(user_prompt, sizeof(user_prompt), stdin) == NULL) {
-        perror("falha ao ler o prompt do usuario para a 2B");
-        return;
+// Reescreve o arquivo so com as keep linhas mais novas; retorna quantas
+// linhas ele tem agora.
+static int history_file_trim(const char *path, int lines, int keep) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *in = fopen(path, "r");
+    int fd = in ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) : -1;
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!out) {
+        if (fd >= 0) close(fd);
+        if (in) fclose(in);
+        return lines;
+    }
+    char line[COMMAND_LINE_MAX];
+    int skip = lines - keep, kept = 0;
+    while (fgets(line, sizeof(line), in)) {
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        fputs(line, out);
+        kept++;
     }
+    fclose(in);
+    if (fclose(out) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return lines;
+    }
+    return kept;
+}
 
-    user_prompt[strcspn(user_prompt, "\n")] = '\0';
-    log_action("User Prompt to 2B", user_prompt);
+void history_store_load() {
+    HistoryStore *h = &history_store;
+    char path[PATH_MAX];
+    if (!history_file_path(path, sizeof(path)) || !(h->path = strdup(path))) return;
+    FILE *file = fopen(path, "r");
+    if (file) {
+        char line[COMMAND_LINE_MAX];
+        while (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\n")] = '\0';
+            history_store_record(line);
+            h->file_lines++;
+        }
+        fclose(file);
+    }
+    if (h->file_lines > HISTORY_FILE_MAX) h->file_lines = history_file_trim(path, h->file_lines, HISTORY_FILE_KEEP);
+    h->file = history_file_open(path);
+}
 
-    if (user_prompt[0] == '\0') {
-        printf("prompt vazio, nenhuma interação com o ollama\n");
-        return;
+void history_store_add(const char *text) {
+    HistoryStore *h = &history_store;
+    history_store_record(text);
+    if (!h->file) return;
+    fprintf(h->file, "%s\n", text);
+    fflush(h->file);
+    if (++h->file_lines > HISTORY_FILE_MAX) {
+        fclose(h->file);
+        h->file_lines = history_file_trim(h->path, h->file_lines, HISTORY_FILE_KEEP);
+        h->file = history_file_open(h->path);
     }
-    
-    snprintf(ollama_full_command, sizeof(ollama_full_command), "ollama run %s \"%s\"", OLLAMA_MODEL, user_prompt);
+}
 
-    printf("executando ollama com: %s\n", ollama_full_command);
-    printf("aguardando resposta da 2B...\n");
-    printf("-------------- 2B output --------------\n");
+typedef struct {
+    int id;
+    double score;
+} HistoryMatch;
 
-    ollama_pipe = popen(ollama_full_command, "r");
-    if (ollama_pipe == NULL) {
-        perror("falha ao executar o comando ollama com popen");
-        fprintf(stderr, "verifique se ollama está no path e se a 2B está disponivel\n");
-        return;
+// Qualidade do casamento: substring > subsequencia > so trigramas em comum.
+static double history_match_quality(const HistoryEntry *e, const char *q, size_t qlen, double trigram_ratio) {
+    const char *hit = strstr(e->lower, q);
+    if (hit) return hit == e->lower ? 1.2 : 1.0;
+    size_t k = 0;
+    for (const char *p = e->lower; *p && k < qlen; p++) {
+        if (*p == q[k]) k++;
     }
+    if (k == qlen) return 0.6 + 0.2 * trigram_ratio;
+    return 0.5 * trigram_ratio;
+}
 
-    while (fgets(ollama_output_line, sizeof(ollama_output_line), ollama_pipe) != NULL) {
-        printf("%s", ollama_output_line);
-        fflush(stdout);
-        log_action("2B Output", ollama_output_line);
+// log2 aproximado (expoente + interpolacao linear da mantissa), suficiente
+// para pontuar e bem mais barato que a libm em cada candidato.
+static inline double fast_log2(uint32_t v) {
+    int e = 31 - __builtin_clz(v);
+    return e + (double)(v - (1u << e)) / (double)(1u << e);
+}
 
-        ollama_output_line[strcspn(ollama_output_line, "\n")] = '\0';
-        if (ollama_output_line[0] != '\0') {
-            if (strncmp(ollama_output_line, "CMD:", 4) == 0) {
-                const char *cmd = ollama_output_line + 4;
-                if (is_safe_command(cmd)) {
-                    printf(">>> Executando comando seguro da 2B: '%s'\n", cmd);
-                    dispatch(cmd);
-                } else {
-                    printf(">>> AVISO: Comando '%s' da 2B não é seguro. Ignorado.\n", cmd);
-                    printf("    Digite 'help' para ver comandos permitidos.\n");
-                }
-            } else {
-                printf(">>> Texto da 2B (não comando): '%s'\n", ollama_output_line);
-            }
-        }
+// Coloca a entrada no top-K (ordenado). A qualidade do casamento (strstr) so
+// e calculada se, com a melhor qualidade possivel, ela ainda entraria.
+static void history_consider(HistoryMatch *top, int *n, int id, const char *q, size_t qlen,
+                             double trigram_ratio) {
+    const HistoryEntry *e = &history_store.entries[id];
+    double age_log = fast_log2(history_store.seq - e->last_seq + 1);
+    double count_log = fast_log2(e->count + 1);
+    double recency = 1.0 / (1.0 + age_log);
+    double frequency = count_log / (1.0 + count_log);
+    double base = recency + 0.5 * frequency;
+    if (*n == HISTORY_SEARCH_RESULTS && base + 3.0 * 1.2 <= top[*n - 1].score) return;
+    for (int k = 0; k < *n; k++) {
+        if (top[k].id == id) return; // ja veio pela lista de recencia
     }
-    printf("---------------- Fim da fala da 2B --------------\n");
+    double score = base + 3.0 * history_match_quality(e, q, qlen, trigram_ratio);
+    if (*n == HISTORY_SEARCH_RESULTS && score <= top[*n - 1].score) return;
+    int i = *n < HISTORY_SEARCH_RESULTS ? (*n)++ : *n - 1;
+    while (i > 0 && top[i - 1].score < score) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i].id = id;
+    top[i].score = score;
+}
 
-    int status = pclose(ollama_pipe);
-    if (status == -1) {
-        perror("pclose falhou para o pipe do ollama");
+static int posting_cmp(const void *a, const void *b) {
+    return (*(TrigramPosting *const *)a)->count - (*(TrigramPosting *const *)b)->count;
+}
+
+// Busca com galope, de tras para frente: os ids consultados sao decrescentes
+// e *from guarda a ultima posicao <= id.
+static bool posting_contains_desc(const TrigramPosting *p, int id, int *from) {
+    int hi = *from, step = 1, lo;
+    if (hi < 0) return false;
+    while (hi - step >= 0 && p->ids[hi - step] > id) {
+        hi -= step;
+        step *= 2;
     }
-    else {
-        if (WIFEXITED(status)) {
-            printf("processo do ollama terminou com o status: %d\n", WEXITSTATUS(status));
-        } else if (WIFSIGNALED(status)) {
-            printf("Processo ollama terminou com %d\n", WTERMSIG(status));
-        }
+    lo = hi - step >= 0 ? hi - step : 0;
+    // procura a ultima posicao com ids[pos] <= id em [lo, hi]
+    while (lo < hi) {
+        int m = (lo + hi + 1) / 2;
+        if (p->ids[m] <= id) lo = m;
+        else hi = m - 1;
     }
+    if (p->ids[lo] > id) {
+        *from = -1;
+        return false;
+    }
+    *from = lo;
+    return p->ids[lo] == id;
 }
 
-// Função para buscar no google//
-void search_google(const char *query) {
-    if (query == NULL || query[0] == '\0') {
-        printf("Uso: buscar <termo de pesquisa>\n");
-        return;
-    }
+// Memoria entre teclas: os candidatos que tinham todos os trigramas da
+// consulta anterior. Se a nova consulta so acrescentou letras, o conjunto
+// novo esta contido nele e basta filtra-lo.
+static struct {
+    char q[256];
+    int *ids;
+    int n;
+    bool valid;
+    unsigned char *votes;  // rascunho da votacao, um byte por entrada
+    int votes_cap;
+    int *touched;
+} history_scratch;
 
-    CURL *curl = curl_easy_init();
-    if (curl) {
-        // Codifica o texto da busca para ser seguro para uma URL
-        // (Ex: "como fazer café" vira "como%20fazer%20café")
-        char *encoded_query = curl_easy_escape(curl, query, 0);
-        if (encoded_query) {
-            char url[1024];
-            char command[2048];
-            // Monta a URL do Google
-            snprintf(url, sizeof(url), "https://www.google.com/search?q=%s", encoded_query);
-            
-            // Monta o comando para abrir o navegador no Linux
-            // As aspas duplas garantem que a URL seja tratada como um único argumento
-            snprintf(command, sizeof(command), "xdg-open \"%s\"", url);
-            
-            printf("Abrindo navegador para buscar por: '%s'\n", query);
-            
-            // Executa o comando
-            system(command);
+// Preenche results com as melhores entradas para a consulta, da melhor para a
+// pior. Retorna quantas encontrou.
+int history_search(const char *query, HistoryMatch *results) {
+    HistoryStore *h = &history_store;
+    char q[256];
+    size_t qlen = 0;
+    for (; query[qlen] && qlen < sizeof(q) - 1; qlen++) q[qlen] = (char)tolower((unsigned char)query[qlen]);
+    q[qlen] = '\0';
+    int n = 0;
+    bool narrowing = history_scratch.valid && strncmp(q, history_scratch.q, strlen(history_scratch.q)) == 0;
+    history_scratch.valid = false;
+    if (h->count == 0) return 0;
 
-            // Libera a memória usada pela URL codificada
-            curl_free(encoded_query);
+    if (qlen < 3) {
+        // Poucas letras nao formam trigrama: percorre do mais recente e para
+        // depois de alguns acertos
+        int found = 0;
+        for (int id = h->newest; id >= 0 && found < HISTORY_SHORT_SCAN; id = h->entries[id].older) {
+            if (qlen == 0 || strstr(h->entries[id].lower, q)) {
+                history_consider(results, &n, id, q, qlen, 1.0);
+                found++;
+            }
         }
-        curl_easy_cleanup(curl);
+        return n;
     }
-}
-void display_help() {
-    printf("Comandos disponíveis:\n");
-    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
-        printf("  %-15s: %s\n", cmds[i].key, cmds[i].descri);
+
+    TrigramPosting *lists[256];
+    int nlists = 0, qtrigrams = 0;
+    for (size_t i = 0; i + 3 <= qlen; i++) {
+        bool repeated = false;
+        for (size_t j = 0; j < i && !repeated; j++) repeated = trigram_at(q + j) == trigram_at(q + i);
+        if (repeated) continue;
+        qtrigrams++;
+        TrigramPosting *p = history_trigram(trigram_at(q + i), false);
+        if (p && p->count > 0) lists[nlists++] = p;
     }
-}
+    qsort(lists, nlists, sizeof(lists[0]), posting_cmp);
 
-void cd(const char *args) {
-    // Verifica se o argumento (caminho do diretório) foi fornecido
-    if (args && strlen(args) > 0) {
-        char old_dir[256];
-        char new_dir[256];
-        char args_copy[256];
-    // Obtém o diretório atual antes da mudança
-        if (getcwd(old_dir, sizeof(old_dir)) == NULL) {
-            perror("Erro ao obter o diretorio atual antes da mudança");
-            old_dir[0] = '\0';
-        }
-        // Faz uma cópia do argumento para evitar modificação direta
-        strncpy(args_copy, args, sizeof(args_copy) - 1);
-        args_copy[sizeof(args_copy) - 1] = '\0';
-        // Remove newline ou espaços extras, se houver
-        args_copy[strcspn(args_copy, "\n")] = '\0';
-        // Tenta mudar de diretório
-        int result = chdir(args_copy);
-        if (result == 0) {
-            // Obtém o novo diretório atual após a mudança
-            if (getcwd(new_dir, sizeof(new_dir)) == NULL) {
-                perror("Erro ao obter o novo diretorio atual");
-                // Continua sem mostrar o novo caminho
-                new_dir[0] = '\0';
-            }
-            printf("Diretorio alterado com sucesso. Antes '%s', Agora '%s'\n",
-                   old_dir[0] ? old_dir : "desconhecido",
-                   new_dir[0] ? new_dir : "desconhecido");
-        } else {
-            perror("Erro ao mudar de diretorio");
-            printf("Permanece no diretorio atual: '%s'\n", 
-                   old_dir[0] ? old_dir : "desconhecido");
-        }
-    } else {
-        printf("Erro: Caminho do diretorio não fornecido. Uso: cd <caminho>\n");
+    // Os comandos usados por ultimo entram sempre, mesmo que sejam antigos
+    // (id baixo) e fiquem fora do orcamento abaixo.
+    int scanned = 0;
+    for (int id = h->newest; id >= 0 && scanned < HISTORY_RECENT_SCAN; id = h->entries[id].older, scanned++) {
+        if (strstr(h->entries[id].lower, q)) history_consider(results, &n, id, q, qlen, 1.0);
     }
-}
 
-int jntd_mkdir(const char *args) {
-    // Verifica se o argumento (nome do diretório) foi fornecido
-    if (args && strlen(args) > 0) {
-        char current_dir[256];
-        char mkdir_command[256];
-        char full_path[512];
-        // Obtém o diretório de trabalho atual
-        if (getcwd(current_dir, sizeof(current_dir)) == NULL) {
-            perror("Erro obter o diretorio atual");
-            current_dir[0] = '\0';
-            snprintf(full_path, sizeof(full_path), "%s", args);
-        } else {
-            snprintf(full_path, sizeof(full_path), "%s/%s", current_dir, args);
+    // 1) entradas com todos os trigramas: filtra os candidatos da tecla
+    //    anterior ou, se nao houver, a lista mais rara. As listas vao do mais
+    //    antigo para o mais novo, entao o percurso e de tras para frente e para
+    //    em HISTORY_AND_BUDGET candidatos.
+    if (nlists == qtrigrams && nlists > 0) {
+        const int *base = lists[0]->ids;
+        int base_n = lists[0]->count;
+        if (narrowing && history_scratch.n < base_n) {
+            base = history_scratch.ids;
+            base_n = history_scratch.n;
         }
-        // Verifica se o diretório já existe
-        struct stat st;
-        if (stat(args, &st) == 0) {
-            printf("Erro: O diretorio '%s' já existe em '%s'.\n", 
-                   args, current_dir[0] ? current_dir : "diretorio atual desconhecido");
-        } else {
-            // Constrói o comando para criar o diretório
-            snprintf(mkdir_command, sizeof(mkdir_command), "mkdir \"%s\"", args);
-            printf("Criando diretorio '%s' em '%s'...\n", 
-                   args, current_dir[0] ? current_dir : "Diretorio atual desconhecido");
-            // Executa o comando mkdir via system
-            int status = system(mkdir_command);
-            if (status == -1) {
-                perror("Erro ao executar o comando mkdir");
-            } else {
-                if (WIFEXITED(status)) {
-                    int exit_code = WEXITSTATUS(status);
-                    printf("Comando mkdir terminou com o status '%d'.\n", exit_code);
-                    if (exit_code == 0) {
-                        // Verifica novamente se o diretório foi criado
-                        if (stat(args, &st) == 0) {
-                            printf("Diretorio criado com sucesso em '%s'.\n", full_path);
-                        } else {
-                            printf("Erro: Diretorio não foi criado, mesmo com codigo de saida 0\n");
-                        }
-                    }
-                }
+        int *kept = malloc((base_n ? base_n : 1) * sizeof(int));
+        int kept_n = 0;
+        int cursors[256];
+        for (int l = 0; l < nlists; l++) cursors[l] = lists[l]->count - 1;
+        bool truncated = false;
+        for (int k = base_n - 1; k >= 0 && kept; k--) {
+            if (kept_n == HISTORY_AND_BUDGET) {
+                truncated = true;
+                break;
             }
+            int id = base[k];
+            bool all = true;
+            for (int l = 0; l < nlists && all; l++) all = posting_contains_desc(lists[l], id, &cursors[l]);
+            if (!all) continue;
+            kept[kept_n++] = id;
+            history_consider(results, &n, id, q, qlen, 1.0);
         }
+        if (kept && !truncated) {
+            // guarda em ordem crescente, como as listas
+            for (int a = 0, b = kept_n - 1; a < b; a++, b--) {
+                int t = kept[a];
+                kept[a] = kept[b];
+                kept[b] = t;
+            }
+            free(history_scratch.ids);
+            history_scratch.ids = kept;
+            history_scratch.n = kept_n;
+            strcpy(history_scratch.q, q);
+            history_scratch.valid = true;
+        } else {
+            free(kept);
+        }
+        if (n > 0) return n;
     }
-    return 0; // Adicionado retorno para evitar warnings
-}
 
-void rscript(const char *args) {
-    // Verifica se o argumento (nome do arquivo de script) foi fornecido
-    if (args && strlen(args) > 0) {
-        FILE *script_file = fopen(args, "r");
-        if (script_file == NULL) {
-            perror("Erro ao abrir o arquivo de script");
-            printf("Verifique se o arquivo: '%s' se encontra no diretorio, e se você tem permissão para lê-lo\n", args);
-        } else {
-            char script_line[128];
-            printf("Executando comandos do script '%s':\n", args);
-            printf("-----------------------------------------------\n");
-            while (fgets(script_line, sizeof(script_line), script_file) != NULL) {
-                script_line[strcspn(script_line, "\n")] = '\0';
-                if (script_line[0] != '\0' && script_line[0] != '#') {
-                    printf("Executando %s\n", script_line);
-                    dispatch(script_line);
-                }
-            }
-            printf("------------------------------------------------\n");
-            printf("Fim da execução do script '%s'.\n", args);
-            fclose(script_file);
+    // 2) votacao nos trigramas mais raros, aceitando quem tem metade deles
+    int used = nlists < HISTORY_VOTE_TRIGRAMS ? nlists : HISTORY_VOTE_TRIGRAMS;
+    if (used == 0) return 0;
+    if (history_scratch.votes_cap < h->count) {
+        unsigned char *votes = calloc(h->cap, 1);
+        int *touched = malloc(sizeof(int) * HISTORY_VOTE_BUDGET);
+        if (!votes || !touched) {
+            free(votes);
+            free(touched);
+            return 0;
+        }
+        free(history_scratch.votes);
+        free(history_scratch.touched);
+        history_scratch.votes = votes;
+        history_scratch.touched = touched;
+        history_scratch.votes_cap = h->cap;
+    }
+    unsigned char *votes = history_scratch.votes;
+    int *touched = history_scratch.touched;
+    int ntouched = 0, budget = HISTORY_VOTE_BUDGET;
+    for (int l = 0; l < used && budget > 0; l++) {
+        for (int k = 0; k < lists[l]->count && budget > 0; k++, budget--) {
+            int id = lists[l]->ids[k];
+            if (votes[id]++ == 0) touched[ntouched++] = id;
         }
     }
+    int needed = (qtrigrams + 1) / 2;
+    if (needed > used) needed = used;
+    for (int k = 0; k < ntouched; k++) {
+        int id = touched[k];
+        if (votes[id] >= needed) history_consider(results, &n, id, q, qlen, (double)votes[id] / qtrigrams);
+        votes[id] = 0;
+    }
+    return n;
 }
 
+// Estado da busca reversa dentro do editor de linha.
+typedef struct {
+    bool active;
+    char query[256];
+    int qlen;
+    HistoryMatch results[HISTORY_SEARCH_RESULTS];
+    int count;
+    int current;
+    char saved[COMMAND_LINE_MAX];  // linha antes da busca (Esc restaura)
+} HistorySearch;
 
-void disable_raw_mode() {
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+static void history_search_update(HistorySearch *s) {
+    s->count = history_search(s->query, s->results);
+    s->current = 0;
 }
 
-void enable_raw_mode() {
-    tcgetattr(STDIN_FILENO, &orig_termios);
-    atexit(disable_raw_mode);
-
-    struct termios raw = orig_termios;
-    raw.c_lflag &= ~(ECHO | ICANON);
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+// Monta o texto exibido durante a busca e onde fica o cursor.
+static int history_search_render(const HistorySearch *s, char *out, size_t size, int *cursor) {
+    const char *match = s->count > 0 ? history_store.entries[s->results[s->current].id].text : "";
+    const char *label = s->count > 0 || s->qlen == 0 ? "(busca-r)`" : "(busca-r falhou)`";
+    int n = snprintf(out, size, "%s%s': %s", label, s->query, match);
+    *cursor = (int)strlen(label) + s->qlen;
+    if (n >= (int)size) n = size - 1;
+    return n;
 }
 
-int calculate_sha256(const char *filepath, char *output_hex_string) {
-    FILE *file = fopen(filepath, "rb");
-    if (!file) {
-        perror("Erro ao abrir arquivo");
-        return -1;
+// Trata uma tecla no modo de busca. Retorna true se a tecla foi consumida;
+// false quando a busca terminou e a tecla deve seguir para o editor.
+static bool history_search_key(HistorySearch *s, LineEditor *e, int key, int *action) {
+    *action = LE_CONTINUE;
+    if (key == 0x12) { // Ctrl-R de novo: proximo resultado
+        if (s->count > 0) s->current = (s->current + 1) % s->count;
+        return true;
     }
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256_context;
-    SHA256_Init(&sha256_context);
-    
-    const int bufSize = 4096;
-    unsigned char buffer[bufSize];
-    size_t bytesRead = 0;
-    
-    while ((bytesRead = fread(buffer, 1, bufSize, file))) {
-        SHA256_Update(&sha256_context, buffer, bytesRead);
+    if (key == 0x07 || key == LE_KEY_ESC) { // Ctrl-G / Esc: cancela
+        line_editor_set(e, s->saved);
+        s->active = false;
+        return true;
     }
-    
-    SHA256_Final(hash, &sha256_context);
-    fclose(file);
-    
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        sprintf(output_hex_string + (i * 2), "%02x", hash[i]);
+    if (key == 127 || key == 8) {
+        if (s->qlen > 0) {
+            s->query[--s->qlen] = '\0';
+            history_search_update(s);
+        }
+        return true;
     }
-    output_hex_string[64] = 0;
-    
-    return 0;
+    if (key < 256 && isprint(key)) {
+        if (s->qlen < (int)sizeof(s->query) - 1) {
+            s->query[s->qlen++] = (char)key;
+            s->query[s->qlen] = '\0';
+            history_search_update(s);
+        }
+        return true;
+    }
+    // Qualquer outra tecla aceita o resultado; Enter tambem executa
+    line_editor_set(e, s->count > 0 ? history_store.entries[s->results[s->current].id].text : s->saved);
+    s->active = false;
+    if (key == '\n' || key == '\r') {
+        *action = LE_ACCEPT;
+        return true;
+    }
+    return false;
 }
 
-void handle_hash_command() {
-    char choice_str[5];
-    int choice;
+// Leitura do terminal em blocos. Os bytes vem de read() para um buffer e
+// passam por uma maquina de estados que reconhece as sequencias de escape
+// (CSI/SS3 de qualquer tamanho). Um ESC sozinho so vira tecla depois de
+// ESC_TIMEOUT_MS sem continuacao. Com o bracketed paste ligado, tudo entre
+// ESC[200~ e ESC[201~ chega como um bloco so (LE_KEY_PASTE).
+#define INPUT_BUFFER_SIZE 65536
+#define ESC_TIMEOUT_MS 50
+#define CSI_MAX_PARAMS 16
 
-    disable_raw_mode(); // Desativa o modo raw para entrada padrão
+enum { IN_GROUND, IN_ESC, IN_CSI, IN_SS3, IN_PASTE };
 
-    printf("\n--- Verificador De Hash SHA-256 ---\n");
-    printf("1. Gerar hash de um arquivo\n");
-    printf("2. Comparar arquivo com hash colado\n");
-    printf("3. Sair\n");
-    printf("Escolha uma opção: ");
+typedef struct {
+    unsigned char data[INPUT_BUFFER_SIZE];
+    size_t start;
+    size_t end;
+    int state;
+    char params[CSI_MAX_PARAMS];  // parametros da sequencia CSI atual
+    int params_len;
+    char *paste;                  // conteudo colado (sem os marcadores)
+    size_t paste_len;
+    size_t paste_cap;
+} InputReader;
 
-    if (fgets(choice_str, sizeof(choice_str), stdin) == NULL) {
-        enable_raw_mode(); // Reativa em caso de erro
+static InputReader input_reader;
+
+// Comandos vindos de um paste com varias linhas, executados um por vez.
+typedef struct QueuedLine {
+    char *text;
+    bool complete;                // false: ultima linha sem '\n', vai para edicao
+    struct QueuedLine *next;
+} QueuedLine;
+
+static QueuedLine *queued_head = NULL;
+static QueuedLine *queued_tail = NULL;
+
+static void queue_command_line(const char *text, size_t n, bool complete) {
+    QueuedLine *q = malloc(sizeof(QueuedLine));
+    if (!q) return;
+    q->text = strndup(text, n);
+    if (!q->text) {
+        free(q);
         return;
     }
-    choice = atoi(choice_str);
+    q->complete = complete;
+    q->next = NULL;
+    if (queued_tail) queued_tail->next = q;
+    else queued_head = q;
+    queued_tail = q;
+}
 
-    char filepath[256];
-    char hash_to_compare[129];
-    char calculated_hash[65];
+static bool paste_append(InputReader *r, unsigned char c) {
+    if (r->paste_len + 1 >= r->paste_cap) {
+        size_t new_cap = r->paste_cap ? r->paste_cap * 2 : 4096;
+        char *p = realloc(r->paste, new_cap);
+        if (!p) return false;
+        r->paste = p;
+        r->paste_cap = new_cap;
+    }
+    r->paste[r->paste_len++] = (char)c;
+    return true;
+}
 
-    switch (choice) {
-        case 1:
-            printf("Digite o caminho do arquivo para gerar hash: ");
-            fgets(filepath, sizeof(filepath), stdin);
-            filepath[strcspn(filepath, "\n")] = 0;
-            if (calculate_sha256(filepath, calculated_hash) == 0) {
-                printf("\nHash-256 Gerado:\n%s\n", calculated_hash);
+// Traduz o fim de uma sequencia CSI para uma tecla (ou -1 para ignorar).
+static int input_csi_key(InputReader *r, unsigned char final) {
+    r->params[r->params_len] = '\0';
+    switch (final) {
+        case 'A': return LE_KEY_UP;
+        case 'B': return LE_KEY_DOWN;
+        case 'C': return LE_KEY_RIGHT;
+        case 'D': return LE_KEY_LEFT;
+        case 'H': return LE_KEY_HOME;
+        case 'F': return LE_KEY_END;
+        case '~': {
+            int n = atoi(r->params);
+            if (n == 1 || n == 7) return LE_KEY_HOME;
+            if (n == 4 || n == 8) return LE_KEY_END;
+            if (n == 3) return LE_KEY_DELETE;
+            if (n == 200) {
+                r->state = IN_PASTE;
+                r->paste_len = 0;
+                return -1;
             }
-            break;
-
-        case 2:
-            printf("Cole o hash-256 para comparar: ");
-            if (fgets(hash_to_compare, sizeof(hash_to_compare), stdin) == NULL) break;
-            hash_to_compare[strcspn(hash_to_compare, "\n")] = 0;
-
-            printf("Digite o caminho do arquivo para verificar: ");
-            if (fgets(filepath, sizeof(filepath), stdin) == NULL) break;
-            filepath[strcspn(filepath, "\n")] = 0;
+            return -1;
+        }
+    }
+    return -1;
+}
 
-            if (calculate_sha256(filepath, calculated_hash) == 0) {
-                printf("\nHash calculado: %s\n", calculated_hash);
-                printf("Hash esperado:  %s\n", hash_to_compare);
-                if (strncmp(calculated_hash, hash_to_compare, 64) == 0) {
-                    printf("\n>>> RESULTADO: Os hashes COINCIDEM!!!\n");
+// Consome bytes do buffer ate produzir uma tecla. Retorna -1 quando os bytes
+// acabaram no meio de uma sequencia (ou nao ha bytes).
+static int input_next_key(InputReader *r) {
+    while (r->start < r->end) {
+        unsigned char c = r->data[r->start++];
+        switch (r->state) {
+            case IN_GROUND:
+                if (c == 0x1b) {
+                    r->state = IN_ESC;
+                    break;
+                }
+                return c;
+            case IN_ESC:
+                if (c == '[') {
+                    r->state = IN_CSI;
+                    r->params_len = 0;
+                } else if (c == 'O') {
+                    r->state = IN_SS3;
                 } else {
-                    printf("\n>>> RESULTADO: Os hashes NÃO COINCIDEM!!!\n");
+                    // ESC seguido de outra tecla (Alt+tecla): descarta o ESC
+                    r->state = IN_GROUND;
+                    r->start--;
+                    return LE_KEY_ESC;
+                }
+                break;
+            case IN_CSI:
+                if (c >= 0x40 && c <= 0x7e) {
+                    r->state = IN_GROUND;
+                    int key = input_csi_key(r, c);
+                    if (key >= 0) return key;
+                } else if (r->params_len < CSI_MAX_PARAMS - 1) {
+                    r->params[r->params_len++] = (char)c;
                 }
+                break;
+            case IN_SS3:
+                r->state = IN_GROUND;
+                switch (c) {
+                    case 'A': return LE_KEY_UP;
+                    case 'B': return LE_KEY_DOWN;
+                    case 'C': return LE_KEY_RIGHT;
+                    case 'D': return LE_KEY_LEFT;
+                    case 'H': return LE_KEY_HOME;
+                    case 'F': return LE_KEY_END;
+                }
+                break;
+            case IN_PASTE: {
+                // Copia em bloco ate o proximo ESC; o marcador final pode
+                // chegar dividido entre duas leituras.
+                r->start--;
+                unsigned char *esc = memchr(r->data + r->start, 0x1b, r->end - r->start);
+                size_t upto = esc ? (size_t)(esc - r->data) : r->end;
+                while (r->start < upto) {
+                    if (!paste_append(r, r->data[r->start])) break;
+                    r->start++;
+                }
+                if (r->start < upto) r->start = upto; // sem memoria: descarta
+                if (!esc) break;
+                if (r->end - r->start < 6) {
+                    // marcador possivelmente incompleto: espera mais bytes
+                    memmove(r->data, r->data + r->start, r->end - r->start);
+                    r->end -= r->start;
+                    r->start = 0;
+                    return -1;
+                }
+                if (memcmp(r->data + r->start, "\x1b[201~", 6) == 0) {
+                    r->start += 6;
+                    r->state = IN_GROUND;
+                    return LE_KEY_PASTE;
+                }
+                paste_append(r, r->data[r->start++]);
+                break;
             }
-            break;
+        }
+    }
+    r->start = r->end = 0;
+    return -1;
+}
 
-        case 3:
-            printf("Saindo do modo hash...\n");
-            break;
+// Le mais bytes do terminal. timeout_ms < 0 espera indefinidamente.
+// Retorna 1 se leu, 0 no timeout, 2 se um job em segundo plano terminou ou
+// um plugin mandou um aviso (sem bytes novos) e -1 em EOF/erro.
+static int input_fill(InputReader *r, int timeout_ms) {
+    // poll ignora as entradas com fd negativo (pool ou avisos desligados)
+    struct pollfd pfd[3] = { { .fd = STDIN_FILENO, .events = POLLIN }, { .fd = job_pool.notify_fd, .events = POLLIN },
+                             { .fd = plugin_notices.fd, .events = POLLIN } };
+    int ready;
+    do {
+        ready = poll(pfd, 3, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    if (ready == 0) return 0;
+    if (ready < 0) return -1;
+    if (!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR))) return 2;
+    if (r->end == sizeof(r->data)) return 1; // buffer cheio, processa antes
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, r->data + r->end, sizeof(r->data) - r->end);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+    r->end += (size_t)n;
+    return 1;
+}
 
-        default:
-            printf("Opção inválida.\n");
+// Insere um bloco colado: a primeira linha entra no cursor; as demais viram
+// comandos enfileirados. Retorna true se a linha atual deve ser aceita.
+static bool line_editor_paste(LineEditor *e, const char *text, size_t n) {
+    const char *nl = memchr(text, '\n', n);
+    const char *cr = memchr(text, '\r', nl ? (size_t)(nl - text) : n);
+    if (cr) nl = cr;
+    size_t first = nl ? (size_t)(nl - text) : n;
+    line_editor_insert(e, text, first);
+    if (!nl) return false;
+
+    const char *p = nl + 1;
+    const char *end = text + n;
+    if (*nl == '\r' && p < end && *p == '\n') p++;
+    while (p < end) {
+        const char *line_end = p;
+        while (line_end < end && *line_end != '\n' && *line_end != '\r') line_end++;
+        if (line_end == end) {
+            queue_command_line(p, line_end - p, false);
             break;
+        }
+        if (line_end > p) queue_command_line(p, line_end - p, true);
+        p = line_end + 1;
+        if (*line_end == '\r' && p < end && *p == '\n') p++;
     }
-
-    enable_raw_mode(); // Reativa o modo raw antes de voltar ao shell
+    return true;
 }
 
 int read_command_line(char *buf, int size) {
-    int pos = 0; 
-    int len = 0; 
-    int history_pos = history_count;
+    LineEditor e = { buf, size, 0, 0, history_count };
     buf[0] = '\0';
+    line_view_reset(&line_view);
 
-    while (1) {
-        int c = getchar();
+    // Linhas de um paste anterior: completas sao executadas direto, a ultima
+    // (sem '\n') vai para o editor.
+    if (queued_head) {
+        QueuedLine *q = queued_head;
+        queued_head = q->next;
+        if (!queued_head) queued_tail = NULL;
+        bool complete = q->complete;
+        if (complete) {
+            strncpy(buf, q->text, size - 1);
+            buf[size - 1] = '\0';
+            e.len = strlen(buf);
+        } else {
+            line_editor_set(&e, "");
+            line_editor_insert(&e, q->text, strlen(q->text));
+        }
+        free(q->text);
+        free(q);
+        if (complete) {
+            line_view_emit(&line_view, buf, e.len);
+            line_view_emit(&line_view, "\n", 1);
+            line_view_flush(&line_view);
+            return e.len;
+        }
+    }
 
-        if (c == EOF || c == 4) { // EOF ou Ctrl+D
-            return -1;
-        } else if (c == '\n') { // Enter
-            printf("\n");
-            buf[len] = '\0';
-            return len;
-        } else if (c == 127 || c == 8) { // Backspace
-            if (pos > 0) {
-                memmove(&buf[pos - 1], &buf[pos], len - pos);
-                pos--;
-                len--;
-                buf[len] = '\0';
-                
-                printf("\r> %s\033[K", buf);
-                if (pos < len + 2) {
-                     printf("\r\x1b[%dC", pos + 2);
-                }
-                fflush(stdout);
+    bool tty = isatty(STDIN_FILENO);
+    if (tty) line_view_emit(&line_view, "\x1b[?2004h", 8); // liga o bracketed paste
+    line_view_sync(&line_view, e.buf, e.len, e.pos);
+    line_view_flush(&line_view);
+
+    InputReader *r = &input_reader;
+    bool last_was_tab = false;
+    static HistorySearch search;
+    search.active = false;
+    int result = -2;
+    while (result == -2) {
+        int key = input_next_key(r);
+        if (key < 0) {
+            // Fim do lote: desenha uma vez so e espera mais bytes
+            if (!search.active) line_view_sync(&line_view, e.buf, e.len, e.pos);
+            line_view_flush(&line_view);
+            bool pending_esc = r->state == IN_ESC;
+            int got = input_fill(r, pending_esc ? ESC_TIMEOUT_MS : -1);
+            if (got == 0 && pending_esc) {
+                r->state = IN_GROUND;
+                key = LE_KEY_ESC;
+            } else if (got < 0) {
+                key = EOF;
+            } else if (got == 2) {
+                // Job terminou ou chegou um aviso enquanto o usuario
+                // digitava: imprime acima e redesenha o prompt com a linha atual
+                line_view_emit(&line_view, "\r\x1b[J", 4);
+                line_view_flush(&line_view);
+                jobs_report_finished();
+                plugin_notices_report();
+                line_view_emit(&line_view, LINE_PROMPT, LINE_PROMPT_WIDTH);
+                line_view_reset(&line_view);
+                continue;
+            } else {
+                continue;
             }
-        } else if (c == '\x1b') { // Sequência de escape (setas) 
-            int next1 = getchar();
-            int next2 = getchar();
-
-            if (next1 == '[') {
-                switch(next2) {
-                    case 'A': // Seta para Cima
-                        if (history_pos > 0) {
-                            history_pos--;
-                            strncpy(buf, command_history[history_pos], size - 1);
-                            len = strlen(buf);
-                            pos = len;
-                            printf("\r> %s\033[K", buf);
-                            fflush(stdout);
-                        }
-                        break;
-                    case 'B': // Seta para Baixo
-                        if (history_pos < history_count - 1) {
-                            history_pos++;
-                            strncpy(buf, command_history[history_pos], size - 1);
-                            len = strlen(buf);
-                            pos = len;
-                            printf("\r> %s\033[K", buf);
-                            fflush(stdout);
-                        } else {
-                            history_pos = history_count;
-                            pos = 0;
-                            len = 0;
-                            buf[0] = '\0';
-                            printf("\r> \033[K");
-                            fflush(stdout);
-                        }
-                        break;
-                    case 'C': // Seta para Direita
-                        if (pos < len) {
-                            pos++;
-                            printf("\x1b[C");
-                            fflush(stdout);
-                        }
-                        break;
-                    case 'D': // Seta para Esquerda
-                        if (pos > 0) {
-                            pos--;
-                            printf("\x1b[D");
-                            fflush(stdout);
-                        }
-                        break;
+        }
+
+        int action;
+        if (search.active) {
+            bool consumed = history_search_key(&search, &e, key, &action);
+            if (search.active) {
+                char shown[COMMAND_LINE_MAX];
+                int cursor;
+                int n = history_search_render(&search, shown, sizeof(shown), &cursor);
+                line_view_sync(&line_view, shown, n, cursor);
+                continue;
+            }
+            if (consumed) {
+                if (action == LE_ACCEPT) {
+                    line_view_sync(&line_view, e.buf, e.len, e.pos);
+                    line_view_emit(&line_view, "\n", 1);
+                    result = e.len;
                 }
+                continue;
             }
-        } else if (isprint(c) && len < size - 1) {
-            memmove(&buf[pos + 1], &buf[pos], len - pos + 1); // +1 para o terminador nulo
-            buf[pos] = c;
-            len++;
-            pos++;
-            
-            printf("\r> %s\033[K", buf);
-            printf("\r\x1b[%dC", pos + 2);
-            fflush(stdout);
+        } else if (key == 0x12) { // Ctrl-R: busca reversa no historico
+            memset(&search, 0, sizeof(search));
+            search.active = true;
+            strcpy(search.saved, e.buf);
+            history_search_update(&search);
+            char shown[COMMAND_LINE_MAX];
+            int cursor;
+            int n = history_search_render(&search, shown, sizeof(shown), &cursor);
+            line_view_sync(&line_view, shown, n, cursor);
+            continue;
+        }
+        if (key == '\t') {
+            // Tab duas vezes seguidas sem completar nada lista as opcoes
+            int before = e.len;
+            line_editor_complete(&e, last_was_tab, &line_view);
+            last_was_tab = e.len == before;
+            continue;
+        }
+        last_was_tab = false;
+        if (key == LE_KEY_PASTE) {
+            action = line_editor_paste(&e, r->paste, r->paste_len) ? LE_ACCEPT : LE_CONTINUE;
+            r->paste_len = 0;
+        } else {
+            action = line_editor_key(&e, key);
+        }
+        if (action == LE_EOF) {
+            result = -1;
+        } else if (action == LE_ACCEPT) {
+            line_view_sync(&line_view, e.buf, e.len, e.pos);
+            line_view_emit(&line_view, "\n", 1);
+            result = e.len;
         }
     }
+    if (tty) line_view_emit(&line_view, "\x1b[?2004l", 8);
+    line_view_flush(&line_view);
+    return result;
 }
 
-void dispatch(const char *user_in) {
-        
-        if (user_in[0] == '!') {
+// Quantos bytes o desenho antigo (reimprimir a linha inteira a cada tecla)
+// emitiria para a tecla c, usado como referencia no benchmark.
+static size_t legacy_render_bytes(const LineEditor *e, int c) {
+    char tmp[COMMAND_LINE_MAX + 32];
+    if (c == LE_KEY_LEFT || c == LE_KEY_RIGHT) return 3;
+    size_t n = snprintf(tmp, sizeof(tmp), "\r> %s\033[K", e->buf);
+    if (c != LE_KEY_UP && c != LE_KEY_DOWN) n += snprintf(tmp, sizeof(tmp), "\r\x1b[%dC", e->pos + 2);
+    return n;
+}
+
+// Benchmark sem terminal (jntd --bench-render): reproduz cenarios de edicao
+// e compara os bytes por tecla do desenho antigo com o diferencial.
+int line_render_benchmark() {
+    static LineView view = { .fd = -1 };
+    const char *scenarios[] = {
+        "digitar 200 caracteres no fim da linha",
+        "inserir 50 caracteres no meio de 200",
+        "apagar 50 caracteres no meio de 200",
+        "mover o cursor 100 vezes",
+        "navegar 20 vezes no historico",
+    };
+    char line[COMMAND_LINE_MAX];
+    char base[201];
+    for (int i = 0; i < 200; i++) base[i] = 'a' + (i * 7) % 26;
+    base[200] = '\0';
+    if (history_count == 0) {
+        add_to_history(base);
+        add_to_history("ls");
+    }
+
+    printf("%-42s %8s %14s %14s\n", "cenario", "teclas", "antigo (B/t)", "diferencial (B/t)");
+    for (int s = 0; s < 5; s++) {
+        LineEditor e = { line, sizeof(line), 0, 0, history_count };
+        line[0] = '\0';
+        line_view_reset(&view);
+        if (s == 1 || s == 2) { // parte de uma linha ja digitada com cursor no meio
+            line_editor_set(&e, base);
+            e.pos = 100;
+            line_view_sync(&view, e.buf, e.len, e.pos);
+            line_view_flush(&view);
+        }
+        size_t legacy = 0;
+        size_t before = view.total_bytes;
+        int keys = s == 0 ? 200 : s == 3 ? 100 : s == 4 ? 20 : 50;
+        for (int k = 0; k < keys; k++) {
+            int c;
+            switch (s) {
+                case 0: c = base[k]; break;
+                case 1: c = 'X'; break;
+                case 2: c = 127; break;
+                case 3: c = k < 50 ? LE_KEY_LEFT : LE_KEY_RIGHT; break;
+                default: c = (k % 2) ? LE_KEY_DOWN : LE_KEY_UP; break;
+            }
+            if (s == 3 && k == 0) {
+                line_editor_set(&e, base);
+                line_view_sync(&view, e.buf, e.len, e.pos);
+                line_view_flush(&view);
+                before = view.total_bytes;
+            }
+            line_editor_key(&e, c);
+            legacy += legacy_render_bytes(&e, c);
+            line_view_sync(&view, e.buf, e.len, e.pos);
+            line_view_flush(&view);
+        }
+        printf("%-42s %8d %14.1f %14.1f\n", scenarios[s], keys,
+               (double)legacy / keys, (double)(view.total_bytes - before) / keys);
+    }
+    return 0;
+}
+
+// Executa um comando do JNTD. Retorna 0 em caso de sucesso ou um codigo de
+// erro (127 para comando desconhecido), usado como codigo de saida no modo
+// nao interativo.
+int dispatch(const char *user_in) {
+    int status = 0;
+
+    if (user_in[0] == '!') {
         // Pega o comando, ignorando o '!' inicial
         const char *shell_cmd = user_in + 1;
         
         // Antes de executar, restauramos o terminal para o modo normal
         disable_raw_mode();
-        printf("Executando no shell: %s\n", shell_cmd);
+        if (interactive) printf("Executando no shell: %s\n", shell_cmd);
         
         // Executa o comando
-        system(shell_cmd);
+        status = shell_status(system(shell_cmd));
         
         // Reativa o nosso modo raw para continuar
         enable_raw_mode();
@@ -1189,15 +4895,15 @@ void dispatch(const char *user_in) {
         // Adiciona ao histórico e log
         add_to_history(user_in);
         log_action("Shell Command", shell_cmd);
-        return; // Termina a função aqui, não processa como comando interno
+        return status; // Termina a função aqui, não processa como comando interno
     }
 
-    char input_copy[128];
+    char input_copy[COMMAND_LINE_MAX];
     strncpy(input_copy, user_in, sizeof(input_copy) - 1);
     input_copy[sizeof(input_copy) - 1] = '\0';
 
     char *token = strtok(input_copy, " ");
-    if (token == NULL) return;
+    if (token == NULL) return 0;
     
     char *args = strtok(NULL, "");
 
@@ -1209,19 +4915,15 @@ void dispatch(const char *user_in) {
 	        } else {
 	            snprintf(new_command, sizeof(new_command), "%s", alias_list[i].command);
 	        }
-	        dispatch(new_command);
-	        return;
+	        return dispatch(new_command);
 	    }
     }
 
     add_to_history(user_in);
     log_action("User Input", user_in);
 
-    for (int i = 0; i < plugin_count; i++) {
-        if (strcasecmp(token, loaded_plugins[i].plugin->name) == 0) {
-            execute_plugin(token, args);
-            return;
-        }
+    if (find_plugin_command(token)) {
+        return execute_plugin(token, args);
     }
 
     int command_found = 0;
@@ -1231,57 +4933,64 @@ void dispatch(const char *user_in) {
             if (strcmp(cmds[i].key, "help") == 0) {
                 display_help();
             } else if (strcasecmp(cmds[i].key, "mkdir") == 0) {
-                jntd_mkdir(args);
+                status = jntd_mkdir(args);
             } else if (strcasecmp(cmds[i].key, "cp") == 0 || strcasecmp(cmds[i].key, "rm") == 0 || strcasecmp(cmds[i].key, "mv") == 0) {
                 if (args) {
                     char shell_command[512];
                     snprintf(shell_command, sizeof(shell_command), "%s %s", cmds[i].key, args);
                     disable_raw_mode();
-                    printf("Executando: %s\n", shell_command);
-                    system(shell_command);
+                    if (interactive) printf("Executando: %s\n", shell_command);
+                    status = shell_status(system(shell_command));
                     enable_raw_mode();
             }  else {
                     printf("Erro, Faltando argumento. Uso %s <argumento>\n", cmds[i].key);
+                    status = 2;
                     }
             } else if (strcasecmp(cmds[i].key, "2b") == 0) {
-                handle_ollama_interaction();
+                status = handle_ollama_interaction(args);
             } else if (strcasecmp(cmds[i].key, "cd") == 0) {
-                cd(args);
+                status = cd(args);
             } else if (strcasecmp(cmds[i].key, "buscar") == 0) {
-            	search_google(args);
+            	status = search_google(args);
             } else if (strcasecmp(cmds[i].key, "git") == 0) {
                 printf("O repostorio é: https://github.com/Lucasplaygaemes/JNTD\n");
 		        printf("Ultimo commit: ");
 		        fflush(stdout);
-		        git();
+		        status = git();
             } else if (strcasecmp(cmds[i].key, "his") == 0) {
                 display_history();
 	        } else if (strcasecmp(token, "alias") == 0) {
-		        handle_alias_command(args);
+		        status = handle_alias_command(args);
 	        } else if (strcasecmp(cmds[i].key, "quiz") == 0) {
-		        func_quiz();
+		        status = func_quiz();
 	        } else if (strcasecmp(cmds[i].key, "quizale") == 0) {
-		        quiz_aleatorio();
+		        status = quiz_aleatorio();
 	        } else if (strcasecmp(cmds[i].key, "quizt") == 0) {
 		        if(args && strcasecmp(args, "cancel") == 0) {
-			        cancel_timer("quizt");
+			        status = cancel_timer("quizt");
 		        } else {
-			        quiz_timer();
+			        status = quiz_timer();
 		        }
 	        } else if (strcasecmp(cmds[i].key, "rscript") == 0) {
-                rscript(args);
+                status = rscript(args);
 	        } else if (strcasecmp(cmds[i].key, "a2") == 0) {
-		        a2(args);
+		        status = a2(args);
 	        } else if (strcasecmp(cmds[i].key, "timer") == 0) {
 		        if (args && strcasecmp(args, "cancel") == 0) {
-			        cancel_timer("timer");
+			        status = cancel_timer("timer");
 		        } else {
-			        timer();
+			        status = timer();
 		        }
 	        } else if (strcasecmp(cmds[i]. key, "cp_di") == 0) {
-		        copy_f_t();
+		        status = copy_f_t();
             } else if (strcasecmp(cmds[i].key, "hash") == 0) {
-                handle_hash_command();
+                status = handle_hash_command();
+            } else if (strcasecmp(cmds[i].key, "plugin") == 0) {
+                status = handle_plugin_command(args);
+            } else if (strcasecmp(cmds[i].key, "jobs") == 0) {
+                status = handle_jobs_command(args);
+            } else if (strcasecmp(cmds[i].key, "bench") == 0) {
+                status = handle_bench_command(args);
 	        } else if (strcasecmp(cmds[i].key, "download") == 0) {
 		        char url[512];
 		        char nome[32];
@@ -1293,7 +5002,7 @@ void dispatch(const char *user_in) {
 		        if (fgets(url, sizeof(url), stdin) == NULL) {
                     printf("Erro ou entrada cancelada.\n");
                     enable_raw_mode();
-                    return;
+                    return 1;
                 }
                 url[strcspn(url, "\n")] = '\0';
 
@@ -1302,7 +5011,7 @@ void dispatch(const char *user_in) {
                 if (fgets(nome, sizeof(nome), stdin) == NULL) {
                     printf("Erro ou entrada cancelada.\n");
                     enable_raw_mode();
-                    return;
+                    return 1;
                 }
                 nome[strcspn(nome, "\n")] = '\0';
 
@@ -1311,13 +5020,15 @@ void dispatch(const char *user_in) {
                     printf("Baixando de '%s' para '%s'...", url, nome);
 		    bool dl = download_file(url, nome);
 		    printf("Download terminou com status: %d\n", dl);
+		    if (!dl) status = 1;
                 } else {
                     printf("URL ou nome do arquivo inválido.\n");
+                    status = 2;
                 }
 	        } else if (cmds[i].shell_command != NULL) {
-                        system(cmds[i].shell_command);
+                        status = shell_status(system(cmds[i].shell_command));
             }
-            return;
+            return status;
         }
     }
     
@@ -1325,11 +5036,379 @@ void dispatch(const char *user_in) {
         printf("Comando '%s' não reconhecido. Use 'help' para ver os comandos disponíveis.\n", token);
 	    suggest_commands(token);
     }
+    return 127;
+}
+
+// bench [-n N] [-w aquecimento] [-s] <comando...>: roda o comando pelo
+// dispatch() N vezes com a saida descartada e mede a latencia de cada
+// iteracao, as alocacoes (com o contador abaixo carregado) e as
+// syscalls de leitura/escrita (syscr + syscw de /proc/self/io). -s grava o
+// resultado como referencia em BENCH_BASELINE_FILE; as proximas execucoes
+// comparam com ela.
+#define BENCH_BASELINE_FILE "jntd_bench.txt"
+#define BENCH_DEFAULT_N 1000
+#define BENCH_DEFAULT_WARMUP 10
+
+// Contagem de alocacoes: so com o contador jntd_alloc_count.so carregado
+// por LD_PRELOAD. O bench acha os contadores dele por dlsym; sem o contador
+// o processo roda com o malloc da libc intocado e a contagem fica n/d.
+#define BENCH_ALLOC_SHIM "jntd_alloc_count.so"
+
+static _Atomic int *bench_alloc_counting(_Atomic unsigned long **count) {
+    *count = dlsym(RTLD_DEFAULT, "jntd_alloc_count");
+    _Atomic int *counting = dlsym(RTLD_DEFAULT, "jntd_alloc_counting");
+    return *count ? counting : NULL;
+}
+
+// Syscalls de leitura/escrita: syscr + syscw de /proc/self/io (-1 se
+// indisponivel). Nao conta as outras syscalls.
+static long long bench_rw_syscalls() {
+    int fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    long long r = -1, w = -1;
+    for (char *line = buf; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        sscanf(line, "syscr: %lld", &r);
+        sscanf(line, "syscw: %lld", &w);
+    }
+    return r < 0 || w < 0 ? -1 : r + w;
+}
+
+static int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    double min_us, median_us, p99_us, max_us;
+    double allocs;       // < 0 sem contagem de alocacoes (contador nao carregado)
+    double rw_syscalls;  // syscalls de leitura/escrita; < 0 se /proc/self/io nao existe
+} BenchResult;
+
+static bool bench_load_baseline(const char *command, BenchResult *out) {
+    FILE *f = fopen(BENCH_BASELINE_FILE, "r");
+    if (!f) return false;
+    char line[COMMAND_LINE_MAX + 128];
+    bool found = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        char *tab = strchr(line, '\t');
+        if (!tab) continue;
+        *tab = '\0';
+        char *cmd = tab + 1;
+        cmd[strcspn(cmd, "\n")] = '\0';
+        BenchResult r;
+        if (strcmp(cmd, command) == 0 &&
+            sscanf(line, "%lf %lf %lf %lf %lf %lf", &r.min_us, &r.median_us, &r.p99_us, &r.max_us,
+                   &r.allocs, &r.rw_syscalls) == 6) {
+            *out = r;
+            found = true; // a ultima linha do comando vale
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Reescreve o arquivo de referencia trocando a linha do comando.
+static void bench_save_baseline(const char *command, const BenchResult *r) {
+    FILE *in = fopen(BENCH_BASELINE_FILE, "r");
+    FILE *out = fopen(BENCH_BASELINE_FILE ".tmp", "w");
+    if (!out) {
+        perror("Erro ao gravar " BENCH_BASELINE_FILE);
+        if (in) fclose(in);
+        return;
+    }
+    fprintf(out, "# min_us mediana_us p99_us max_us alocacoes syscalls_leitura_escrita\tcomando (-1 = n/d)\n");
+    char line[COMMAND_LINE_MAX + 128];
+    while (in && fgets(line, sizeof(line), in)) {
+        if (line[0] == '#') continue; // o cabecalho e reescrito acima
+        char *tab = strchr(line, '\t');
+        if (tab) {
+            char cmd[COMMAND_LINE_MAX];
+            snprintf(cmd, sizeof(cmd), "%s", tab + 1);
+            cmd[strcspn(cmd, "\n")] = '\0';
+            if (strcmp(cmd, command) == 0) continue;
+        }
+        fputs(line, out);
+    }
+    if (in) fclose(in);
+    fprintf(out, "%.3f %.3f %.3f %.3f %.2f %.2f\t%s\n", r->min_us, r->median_us, r->p99_us, r->max_us,
+            r->allocs, r->rw_syscalls, command);
+    fclose(out);
+    if (rename(BENCH_BASELINE_FILE ".tmp", BENCH_BASELINE_FILE) != 0) perror("Erro ao gravar " BENCH_BASELINE_FILE);
+}
+
+static void bench_print_delta(const char *label, double now, double base, const char *unit) {
+    if (base <= 0) {
+        printf("  %-24s %10.2f %s (referencia %.2f)\n", label, now, unit, base);
+        return;
+    }
+    double pct = (now - base) / base * 100.0;
+    printf("  %-24s %10.2f %s (referencia %.2f, %+.1f%%)%s\n", label, now, unit, base, pct,
+           pct > 10.0 ? "  <-- regressao" : "");
+}
+
+int handle_bench_command(const char *args) {
+    int n = BENCH_DEFAULT_N, warmup = BENCH_DEFAULT_WARMUP;
+    bool save = false;
+    const char *p = args ? args : "";
+    for (;;) {
+        while (*p == ' ') p++;
+        int used = 0;
+        if (sscanf(p, "-n %d%n", &n, &used) == 1 || sscanf(p, "-w %d%n", &warmup, &used) == 1) {
+            p += used;
+        } else if (strncmp(p, "-s", 2) == 0 && (p[2] == ' ' || p[2] == '\0')) {
+            save = true;
+            p += 2;
+        } else {
+            break;
+        }
+    }
+    if (*p == '\0' || n <= 0 || warmup < 0) {
+        printf("Uso: bench [-n N] [-w aquecimento] [-s] <comando...>\n");
+        printf("  -n N  iteracoes medidas (padrao %d)\n", BENCH_DEFAULT_N);
+        printf("  -w W  iteracoes de aquecimento, fora da medicao (padrao %d)\n", BENCH_DEFAULT_WARMUP);
+        printf("  -s    grava o resultado como referencia em %s\n", BENCH_BASELINE_FILE);
+        return 2;
+    }
+    if (strncmp(p, "bench", 5) == 0 && (p[5] == ' ' || p[5] == '\0')) {
+        printf("bench nao mede a si mesmo.\n");
+        return 2;
+    }
+    char command[COMMAND_LINE_MAX];
+    snprintf(command, sizeof(command), "%s", p);
+
+    double *samples = malloc(n * sizeof(double));
+    if (!samples) return 1;
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (saved_stdout < 0 || devnull < 0) {
+        perror("bench");
+        free(samples);
+        return 1;
+    }
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    bench_depth++;
+    int status = 0;
+    for (int i = 0; i < warmup; i++) status = dispatch(command);
+    fflush(stdout);
+
+    // custo da propria leitura de /proc/self/io, descontado no fim
+    long long probe_a = bench_rw_syscalls();
+    long long probe_b = bench_rw_syscalls();
+    long long probe_cost = probe_a >= 0 && probe_b >= 0 ? probe_b - probe_a : 0;
+
+    _Atomic unsigned long *allocs_counter;
+    _Atomic int *counting = bench_alloc_counting(&allocs_counter);
+    unsigned long allocs = 0;
+    long long sys_before = bench_rw_syscalls();
+    if (counting) {
+        atomic_store_explicit(allocs_counter, 0, memory_order_relaxed);
+        atomic_store_explicit(counting, 1, memory_order_relaxed);
+    }
+    for (int i = 0; i < n; i++) {
+        struct timespec a, b;
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        status = dispatch(command);
+        fflush(stdout);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        samples[i] = (b.tv_sec - a.tv_sec) * 1e6 + (b.tv_nsec - a.tv_nsec) / 1e3;
+    }
+    if (counting) {
+        atomic_store_explicit(counting, 0, memory_order_relaxed);
+        allocs = atomic_load_explicit(allocs_counter, memory_order_relaxed);
+    }
+    long long sys_after = bench_rw_syscalls();
+    bench_depth--;
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    qsort(samples, n, sizeof(double), bench_cmp_double);
+    BenchResult r;
+    r.min_us = samples[0];
+    r.median_us = samples[n / 2];
+    r.p99_us = samples[(int)((n - 1) * 0.99)];
+    r.max_us = samples[n - 1];
+    r.allocs = counting ? (double)allocs / n : -1;
+    r.rw_syscalls = sys_before >= 0 && sys_after >= 0 ? (double)(sys_after - sys_before - probe_cost) / n : -1;
+    free(samples);
+
+    printf("bench: %s\n", command);
+    printf("  %d iteracoes (+%d de aquecimento), ultimo status %d\n", n, warmup, status);
+    printf("  latencia  min %.2f us | mediana %.2f us | p99 %.2f us | max %.2f us\n",
+           r.min_us, r.median_us, r.p99_us, r.max_us);
+    if (r.allocs >= 0) printf("  por iteracao: %.2f alocacoes", r.allocs);
+    else printf("  por iteracao: n/d alocacoes (LD_PRELOAD=./" BENCH_ALLOC_SHIM " conta)");
+    if (r.rw_syscalls >= 0) printf(", %.2f syscalls de leitura/escrita", r.rw_syscalls);
+    else printf(", n/d syscalls de leitura/escrita");
+    printf("\n");
+
+    BenchResult base;
+    if (bench_load_baseline(command, &base)) {
+        printf("Comparacao com a referencia (%s):\n", BENCH_BASELINE_FILE);
+        bench_print_delta("mediana", r.median_us, base.median_us, "us");
+        bench_print_delta("p99", r.p99_us, base.p99_us, "us");
+        if (r.allocs >= 0 && base.allocs >= 0) bench_print_delta("alocacoes", r.allocs, base.allocs, "");
+        if (r.rw_syscalls >= 0 && base.rw_syscalls >= 0)
+            bench_print_delta("syscalls leitura/escrita", r.rw_syscalls, base.rw_syscalls, "");
+    }
+    if (save) {
+        bench_save_baseline(command, &r);
+        printf("Referencia gravada em %s.\n", BENCH_BASELINE_FILE);
+    }
+    return status;
 }
 
-int main(void) {
+// Modo nao interativo: le comandos de fd em blocos grandes e despacha linha
+// por linha. Linhas vazias e comentarios (#) sao ignorados; 'exit' ou ':q'
+// encerram. Retorna 0 se tudo deu certo ou o codigo do ultimo comando que
+// falhou (com stop_on_error, para no primeiro).
+#define BATCH_BLOCK_SIZE (1 << 16)
+
+static bool batch_is_exit(const char *line) {
+    return strcmp(line, "exit") == 0 || strcmp(line, ":q") == 0 || strcmp(line, ":Q") == 0;
+}
+
+// Roda uma linha; retorna false quando o lote deve parar.
+static bool batch_run_line(char *line, bool stop_on_error, int *result) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ')) line[--len] = '\0';
+    while (*line == ' ' || *line == '\t') line++;
+    if (line[0] == '\0' || line[0] == '#') return true;
+    if (batch_is_exit(line)) return false;
+    int status = dispatch(line);
+    fflush(stdout);
+    if (status != 0) {
+        *result = status;
+        if (stop_on_error) return false;
+    }
+    return true;
+}
+
+int run_batch_fd(int fd, bool stop_on_error) {
+    char *block = malloc(BATCH_BLOCK_SIZE);
+    char line[COMMAND_LINE_MAX];
+    size_t line_len = 0;
+    bool truncated = false;
+    int result = 0;
+    bool running = block != NULL;
+
+    while (running) {
+        ssize_t n = read(fd, block, BATCH_BLOCK_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        char *p = block, *end = block + n;
+        while (running && p < end) {
+            char *nl = memchr(p, '\n', end - p);
+            size_t chunk = (nl ? nl : end) - p;
+            if (line_len + chunk >= sizeof(line)) {
+                chunk = sizeof(line) - 1 - line_len;
+                truncated = true;
+            }
+            memcpy(line + line_len, p, chunk);
+            line_len += chunk;
+            if (!nl) break;
+            line[line_len] = '\0';
+            if (truncated) fprintf(stderr, "jntd: linha truncada em %d bytes\n", COMMAND_LINE_MAX - 1);
+            running = batch_run_line(line, stop_on_error, &result);
+            line_len = 0;
+            truncated = false;
+            p = nl + 1;
+        }
+    }
+    if (running && line_len > 0) { // ultima linha sem '\n'
+        line[line_len] = '\0';
+        batch_run_line(line, stop_on_error, &result);
+    }
+    free(block);
+    return result;
+}
+
+int run_batch_string(const char *commands, bool stop_on_error) {
+    int result = 0;
+    const char *p = commands;
+    while (*p) {
+        const char *nl = strchr(p, '\n');
+        size_t n = nl ? (size_t)(nl - p) : strlen(p);
+        char line[COMMAND_LINE_MAX];
+        if (n >= sizeof(line)) n = sizeof(line) - 1;
+        memcpy(line, p, n);
+        line[n] = '\0';
+        if (!batch_run_line(line, stop_on_error, &result)) break;
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return result;
+}
+
+static void print_usage(const char *prog) {
+    printf("Uso: %s [-e] [-c \"comando\" | script.jntd]\n", prog);
+    printf("  -c <comando>  executa o comando (ou varias linhas) e sai\n");
+    printf("  -e            para no primeiro comando que falhar\n");
+    printf("  script.jntd   executa os comandos do arquivo, um por linha\n");
+    printf("Sem argumentos e com stdin fora de um terminal, os comandos sao lidos do stdin.\n");
+    printf("O codigo de saida e o do ultimo comando que falhou (0 se nenhum falhou).\n");
+}
+
+int line_render_benchmark();
+
+int main(int argc, char *argv[]) {
+    const char *batch_command = NULL;
+    const char *script = NULL;
+    bool stop_on_error = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-render") == 0) {
+            return line_render_benchmark();
+        } else if (strcmp(argv[i], "--plugin-host") == 0 && i + 1 < argc) {
+            return plugin_host_exec_main(argv[i + 1]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            batch_command = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0) {
+            stop_on_error = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && !script) {
+            script = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    interactive = !batch_command && !script && isatty(STDIN_FILENO);
+
     curl_global_init(CURL_GLOBAL_ALL);
 
+    if (!interactive) {
+        int script_fd = STDIN_FILENO;
+        if (script) {
+            script_fd = open(script, O_RDONLY | O_CLOEXEC);
+            if (script_fd < 0) {
+                fprintf(stderr, "jntd: nao foi possivel abrir '%s': %s\n", script, strerror(errno));
+                curl_global_cleanup();
+                return 127;
+            }
+        }
+        load_plugins();
+        load_aliases_from_file();
+        int status = batch_command ? run_batch_string(batch_command, stop_on_error)
+                                   : run_batch_fd(script_fd, stop_on_error);
+        if (script) close(script_fd);
+        fflush(stdout);
+        unload_plugins();
+        curl_global_cleanup();
+        return status;
+    }
+
     printf("Iniciando o JNTD...\n");
     printf("Bem vindo/a\n");
     //printf("Checado TODOs\n");
@@ -1337,11 +5416,16 @@ int main(void) {
     enable_raw_mode();
 
     load_plugins();
+    plugin_watch_start();
     load_aliases_from_file();
-    printf("Plugins carregados: %d\n", plugin_count);
+    history_store_load();
+    printf("Plugins disponíveis: %d\n", plugin_count);
+    plugin_load_notifiers();
     printf("Digite um comando. Use 'help' para ver as opções ou 'sair' para terminar.\n");
 
     while (1) {
+        jobs_report_finished();
+        plugin_notices_report();
         printf("> ");
         fflush(stdout);
 
@@ -1352,14 +5436,20 @@ int main(void) {
         if (buf[0] == '\0') {
             continue;
         }
+        // Espaco na frente: o comando roda, mas nao entra no historico nem no log
+        history_private = buf[0] == ' ';
+        char *line = buf + strspn(buf, " ");
         // Adiciona ao histórico apenas se não for vazio e não for um comando de shell (já é feito no dispatch)
-        if (buf[0] != '!') {
-            add_to_history(buf);
+        if (line[0] != '!') {
+            add_to_history(line);
         }
-        if (strcmp(buf, "exit") == 0 || strcmp(buf, ":q") == 0 || strcmp(buf, ":Q") == 0) {
+        if (!history_private) history_store_add(line);
+        if (strcmp(line, "exit") == 0 || strcmp(line, ":q") == 0 || strcmp(line, ":Q") == 0) {
             break;
         }
-        dispatch(buf);
+        plugin_watch_poll();
+        dispatch(line);
+        history_private = false;
     }
     
     for (int i = 0; i < history_count; i++) {
@@ -1369,6 +5459,8 @@ int main(void) {
     disable_raw_mode();
     printf("\nSaindo....\n");
 
+    job_pool_shutdown();
+    unload_plugins();
     curl_global_cleanup();
     return 0;
 }
@@ -0,0 +1,63 @@
+// Contador de alocacoes para o comando 'bench' do JNTD. So e carregado
+// quando se quer medir alocacoes:
+//
+//     LD_PRELOAD=./jntd_alloc_count.so ./jntd
+//
+// Sem ele o jntd usa o malloc da libc direto, sem nenhuma interceptacao.
+// Com ele, malloc & cia. daqui tem prioridade para todo o processo e
+// repassam para as implementacoes internas da glibc; o bench acha os dois
+// contadores abaixo por dlsym e liga jntd_alloc_counting so durante a
+// medicao. Depende da glibc (__libc_malloc e afins).
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+_Atomic int jntd_alloc_counting = 0;
+_Atomic unsigned long jntd_alloc_count = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static inline void count_alloc() {
+    if (__builtin_expect(atomic_load_explicit(&jntd_alloc_counting, memory_order_relaxed), 0))
+        atomic_fetch_add_explicit(&jntd_alloc_count, 1, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    count_alloc();
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_alloc();
+    return __libc_realloc(ptr, size);
+}
+
+// As variantes alinhadas (buffers de matriz do calc, por exemplo) nao passam
+// por malloc dentro da glibc; sem elas a contagem perderia essas alocacoes.
+void *memalign(size_t alignment, size_t size) {
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    count_alloc();
+    void *p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
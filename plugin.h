@@ -1,6 +1,12 @@
 #ifndef PLUGIN_H
 #define PLUGIN_H
 
+#include <stdio.h>
+
+/*
+ * ABI v1: um unico comando que recebe a linha de argumentos crua.
+ * Plugins antigos que exportam apenas register_plugin() continuam carregando.
+ */
 typedef void (*plugin_func)(const char*);
 
 typedef struct {
@@ -8,5 +14,62 @@ typedef struct {
     plugin_func execute;
 } Plugin;
 
+/*
+ * ABI v2: o plugin exporta register_plugin_v2() e pode declarar varios
+ * comandos. O nucleo separa os argumentos uma unica vez (respeitando aspas)
+ * e entrega argv/argc prontos; argv[0] e o nome do comando.
+ */
+#define JNTD_PLUGIN_ABI_VERSION 2
+
+// Capacidades declaradas por comando
+#define PLUGIN_CAP_THREAD_SAFE (1u << 0) // pode rodar fora da thread principal
+#define PLUGIN_CAP_ASYNC       (1u << 1) // pode terminar depois de o prompt voltar
+#define PLUGIN_CAP_NEEDS_TTY   (1u << 2) // le do terminal (prompts, editores)
+#define PLUGIN_CAP_NOTIFY      (1u << 3) // avisa o usuario sozinho: carregado ja na inicializacao
+
+typedef struct {
+    int argc;
+    char **argv;          // argv[argc] == NULL
+    const char *raw_args; // argumentos como digitados, sem o nome do comando ("" se vazio)
+    FILE *out;            // saida do comando; use no lugar de stdout
+} PluginCall;
+
+// Retorna 0 em sucesso ou um codigo de erro (vira o status do comando)
+typedef int (*plugin_command_func)(const PluginCall *call);
+
+typedef struct {
+    const char *name;
+    plugin_command_func run;
+    const char *descri;
+    unsigned caps;
+} PluginCommand;
+
+typedef struct {
+    int abi_version;                // sempre JNTD_PLUGIN_ABI_VERSION
+    const char *name;
+    const PluginCommand *commands;
+    int command_count;
+    int (*init)(void);              // opcional; != 0 recusa o carregamento
+    void (*shutdown)(void);         // opcional; chamado antes do dlclose
+} PluginV2;
+
+typedef PluginV2 *(*plugin_register_v2_func)(void);
+
+/*
+ * Sempre que a pasta plugins/ muda, o nucleo reconstroi o manifesto abrindo
+ * cada .so no proprio processo do shell: os construtores da biblioteca e a
+ * register_plugin(_v2) rodam nessa hora, mesmo que o plugin nunca seja
+ * usado. Deixe-os sem efeitos colaterais; recursos vao no init.
+ */
+
+/*
+ * Avisos: se o plugin exporta plugin_set_notifier(), o nucleo a chama antes
+ * do init com uma funcao que pode ser usada de qualquer thread para mostrar
+ * um aviso acima do prompt. So acontece no modo interativo e com o plugin
+ * no processo do shell; fora disso o plugin nao recebe a funcao.
+ */
+typedef void (*plugin_notify_func)(const char *plugin, const char *message);
+typedef void (*plugin_set_notifier_func)(plugin_notify_func notify);
+
 
 #endif
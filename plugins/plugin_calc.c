@@ -1,12 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
 #include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "plugin.h" 
 
 #define MAX_TERMS 10
-#define EPSILON 0.0001
-#define TRAPEZOID_STEPS 1000
 
 // Estrutura para representar um termo de um polinômio (ex.: 3x^2)
 typedef struct {
@@ -38,241 +46,3761 @@ double eval_trig(TrigTerm *trig_terms, int num_trig, double x) {
     return result;
 }
 
-void derive_polynomial(Term *terms, int num_terms, Term *result) {
-    int result_idx = 0;
+// --- Expressoes ---
+//
+// eval, integ e limit aceitam expressoes com + - * / ^, parenteses,
+// variaveis e as funcoes da libm. O texto vira uma arvore uma unica vez
+// (constantes ja dobradas) e a arvore e compilada para um bytecode de
+// registradores; avaliar e percorrer um vetor de instrucoes, sem strcmp nem
+// alocacao, entao um mesmo programa serve para milhoes de pontos.
+
+#define CALC_MAX_NODES 4096
+#define CALC_MAX_VARS 8
+#define CALC_MAX_REGS 256
+#define CALC_NAME_MAX 16
+
+typedef enum {
+    CALC_NUM, CALC_VAR, CALC_NEG, CALC_ADD, CALC_SUB, CALC_MUL, CALC_DIV, CALC_POW, CALC_CALL1, CALC_CALL2
+} CalcKind;
+
+typedef struct {
+    CalcKind kind;
+    int a, b;        // filhos (indices em CalcTree.nodes); -1 quando nao ha
+    int fn;          // CALC_CALL1/2: indice em calc_functions; CALC_VAR: indice da variavel
+    double value;    // CALC_NUM
+} CalcNode;
+
+typedef struct {
+    CalcNode *nodes;
+    int count;
+    int cap;
+    int *buckets;        // hash-consing: tabela aberta de indices de nos (-1 = vazio)
+    int bucket_cap;
+    char vars[CALC_MAX_VARS][CALC_NAME_MAX];
+    int var_count;
+    const char *error;   // primeiro erro encontrado
+    int error_pos;
+} CalcTree;
+
+typedef struct {
+    const char *name;
+    int arity;
+    double (*f1)(double);
+    double (*f2)(double, double);
+} CalcFunction;
+
+static double calc_sec(double x) { return 1.0 / cos(x); }
+static double calc_csc(double x) { return 1.0 / sin(x); }
+static double calc_cot(double x) { return 1.0 / tan(x); }
+static double calc_sign(double x) { return (x > 0) - (x < 0); }
+
+static const CalcFunction calc_functions[] = {
+    { "sin", 1, sin, NULL }, { "cos", 1, cos, NULL }, { "tan", 1, tan, NULL },
+    { "sec", 1, calc_sec, NULL }, { "csc", 1, calc_csc, NULL }, { "cot", 1, calc_cot, NULL },
+    { "asin", 1, asin, NULL }, { "acos", 1, acos, NULL }, { "atan", 1, atan, NULL },
+    { "sinh", 1, sinh, NULL }, { "cosh", 1, cosh, NULL }, { "tanh", 1, tanh, NULL },
+    { "asinh", 1, asinh, NULL }, { "acosh", 1, acosh, NULL }, { "atanh", 1, atanh, NULL },
+    { "exp", 1, exp, NULL }, { "exp2", 1, exp2, NULL }, { "expm1", 1, expm1, NULL },
+    { "log", 1, log, NULL }, { "ln", 1, log, NULL }, { "log2", 1, log2, NULL },
+    { "log10", 1, log10, NULL }, { "log1p", 1, log1p, NULL },
+    { "sqrt", 1, sqrt, NULL }, { "cbrt", 1, cbrt, NULL }, { "abs", 1, fabs, NULL },
+    { "floor", 1, floor, NULL }, { "ceil", 1, ceil, NULL }, { "round", 1, round, NULL },
+    { "trunc", 1, trunc, NULL }, { "sign", 1, calc_sign, NULL },
+    { "erf", 1, erf, NULL }, { "erfc", 1, erfc, NULL }, { "gamma", 1, tgamma, NULL }, { "lgamma", 1, lgamma, NULL },
+    { "pow", 2, NULL, pow }, { "atan2", 2, NULL, atan2 }, { "hypot", 2, NULL, hypot },
+    { "fmod", 2, NULL, fmod }, { "min", 2, NULL, fmin }, { "max", 2, NULL, fmax },
+};
+#define CALC_FUNCTION_COUNT ((int)(sizeof(calc_functions) / sizeof(calc_functions[0])))
+
+static int calc_find_function(const char *name) {
+    for (int i = 0; i < CALC_FUNCTION_COUNT; i++) {
+        if (strcmp(calc_functions[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static double calc_powi(double x, int n) {
+    unsigned m = n < 0 ? -(unsigned)n : (unsigned)n;
+    double r = 1.0;
+    while (m) {
+        if (m & 1) r *= x;
+        x *= x;
+        m >>= 1;
+    }
+    return n < 0 ? 1.0 / r : r;
+}
+
+static double calc_apply(CalcKind kind, int fn, double x, double y) {
+    switch (kind) {
+    case CALC_NEG: return -x;
+    case CALC_ADD: return x + y;
+    case CALC_SUB: return x - y;
+    case CALC_MUL: return x * y;
+    case CALC_DIV: return x / y;
+    case CALC_POW: return pow(x, y);
+    case CALC_CALL1: return calc_functions[fn].f1(x);
+    case CALC_CALL2: return calc_functions[fn].f2(x, y);
+    default: return NAN;
+    }
+}
+
+static void calc_tree_free(CalcTree *t) {
+    free(t->nodes);
+    free(t->buckets);
+    memset(t, 0, sizeof(*t));
+}
+
+static uint64_t calc_node_hash(const CalcNode *n) {
+    uint64_t bits;
+    memcpy(&bits, &n->value, sizeof(bits));
+    uint64_t h = (uint64_t)n->kind * 0x9E3779B97F4A7C15ull;
+    h = (h ^ (uint32_t)n->a) * 0xff51afd7ed558ccdull;
+    h = (h ^ (uint32_t)n->b) * 0xc4ceb9fe1a85ec53ull;
+    h = (h ^ (uint32_t)n->fn) * 0xff51afd7ed558ccdull;
+    h = (h ^ bits) * 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 29);
+}
+
+static bool calc_node_equal(const CalcNode *x, const CalcNode *y) {
+    return x->kind == y->kind && x->a == y->a && x->b == y->b && x->fn == y->fn &&
+           memcmp(&x->value, &y->value, sizeof(double)) == 0;
+}
+
+static bool calc_tree_rehash(CalcTree *t) {
+    int cap = t->bucket_cap ? t->bucket_cap * 2 : 128;
+    int *buckets = malloc(cap * sizeof(int));
+    if (!buckets) return false;
+    for (int i = 0; i < cap; i++) buckets[i] = -1;
+    for (int n = 0; n < t->count; n++) {
+        size_t i = calc_node_hash(&t->nodes[n]) & (cap - 1);
+        while (buckets[i] >= 0) i = (i + 1) & (cap - 1);
+        buckets[i] = n;
+    }
+    free(t->buckets);
+    t->buckets = buckets;
+    t->bucket_cap = cap;
+    return true;
+}
+
+// Cria um no. Operacoes sobre constantes ja viram constante aqui, e um no
+// igual a outro ja existente (mesmo tipo, filhos e valor) devolve o antigo:
+// a arvore e na verdade um DAG e cada subexpressao repetida aparece uma vez.
+static int calc_node(CalcTree *t, CalcKind kind, int a, int b, int fn, double value) {
+    bool binary = kind == CALC_ADD || kind == CALC_SUB || kind == CALC_MUL || kind == CALC_DIV ||
+                  kind == CALC_POW || kind == CALC_CALL2;
+    if ((a < 0 && kind != CALC_NUM && kind != CALC_VAR) || (binary && b < 0)) return -1;
+    if (kind != CALC_NUM && kind != CALC_VAR && t->nodes[a].kind == CALC_NUM &&
+        (b < 0 || t->nodes[b].kind == CALC_NUM)) {
+        value = calc_apply(kind, fn, t->nodes[a].value, b >= 0 ? t->nodes[b].value : 0.0);
+        kind = CALC_NUM;
+        a = b = fn = -1;
+    }
+    CalcNode node = { kind, a, b, fn, value };
+    if ((t->count + 1) * 2 > t->bucket_cap && !calc_tree_rehash(t)) {
+        if (!t->error) t->error = "sem memória";
+        return -1;
+    }
+    size_t slot = calc_node_hash(&node) & (t->bucket_cap - 1);
+    for (; t->buckets[slot] >= 0; slot = (slot + 1) & (t->bucket_cap - 1)) {
+        if (calc_node_equal(&t->nodes[t->buckets[slot]], &node)) return t->buckets[slot];
+    }
+    if (t->count == t->cap) {
+        int cap = t->cap ? t->cap * 2 : 64;
+        CalcNode *grown = cap <= CALC_MAX_NODES ? realloc(t->nodes, cap * sizeof(CalcNode)) : NULL;
+        if (!grown) {
+            if (!t->error) t->error = "expressão grande demais";
+            return -1;
+        }
+        t->nodes = grown;
+        t->cap = cap;
+    }
+    t->nodes[t->count] = node;
+    t->buckets[slot] = t->count;
+    return t->count++;
+}
+
+static int calc_var(CalcTree *t, const char *name) {
+    for (int i = 0; i < t->var_count; i++) {
+        if (strcmp(t->vars[i], name) == 0) return calc_node(t, CALC_VAR, -1, -1, i, 0);
+    }
+    if (t->var_count == CALC_MAX_VARS) {
+        if (!t->error) t->error = "variáveis demais";
+        return -1;
+    }
+    snprintf(t->vars[t->var_count], CALC_NAME_MAX, "%s", name);
+    return calc_node(t, CALC_VAR, -1, -1, t->var_count++, 0);
+}
+
+// Analisador descendente recursivo. Precedencia, da menor para a maior:
+// + -, * /, sinal, ^ (associa a direita, entao -x^2 = -(x^2) e 2^3^2 = 2^9).
+typedef struct {
+    const char *src;
+    const char *p;
+    CalcTree *t;
+} CalcParser;
+
+static int calc_parse_expr(CalcParser *ps);
+
+static int calc_fail(CalcParser *ps, const char *msg) {
+    if (!ps->t->error) {
+        ps->t->error = msg;
+        ps->t->error_pos = (int)(ps->p - ps->src);
+    }
+    return -1;
+}
+
+static void calc_skip_space(CalcParser *ps) {
+    while (isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static int calc_parse_primary(CalcParser *ps) {
+    calc_skip_space(ps);
+    const char *start = ps->p;
+    if (isdigit((unsigned char)*start) || (*start == '.' && isdigit((unsigned char)start[1]))) {
+        char *end;
+        double v = strtod(start, &end);
+        ps->p = end;
+        return calc_node(ps->t, CALC_NUM, -1, -1, -1, v);
+    }
+    if (*start == '(') {
+        ps->p++;
+        int n = calc_parse_expr(ps);
+        calc_skip_space(ps);
+        if (n < 0) return -1;
+        if (*ps->p != ')') return calc_fail(ps, "falta ')'");
+        ps->p++;
+        return n;
+    }
+    if (!isalpha((unsigned char)*start) && *start != '_') {
+        return calc_fail(ps, *start ? "esperado um número, variável ou '('" : "expressão incompleta");
+    }
+    char name[CALC_NAME_MAX];
+    size_t len = 0;
+    while (isalnum((unsigned char)*ps->p) || *ps->p == '_') {
+        if (len < sizeof(name) - 1) name[len++] = *ps->p;
+        ps->p++;
+    }
+    name[len] = '\0';
+    calc_skip_space(ps);
+    if (*ps->p != '(') {
+        if (strcmp(name, "pi") == 0) return calc_node(ps->t, CALC_NUM, -1, -1, -1, M_PI);
+        if (strcmp(name, "e") == 0) return calc_node(ps->t, CALC_NUM, -1, -1, -1, M_E);
+        if (strcmp(name, "inf") == 0) return calc_node(ps->t, CALC_NUM, -1, -1, -1, INFINITY);
+        if (calc_find_function(name) >= 0) return calc_fail(ps, "função sem '(': use f(x)");
+        return calc_var(ps->t, name);
+    }
+    int fn = calc_find_function(name);
+    if (fn < 0) {
+        ps->p = start;
+        return calc_fail(ps, "função desconhecida");
+    }
+    ps->p++;
+    int args[2] = { -1, -1 };
+    for (int i = 0; i < calc_functions[fn].arity; i++) {
+        if (i > 0) {
+            calc_skip_space(ps);
+            if (*ps->p != ',') return calc_fail(ps, "esperado ',' (a função recebe dois argumentos)");
+            ps->p++;
+        }
+        args[i] = calc_parse_expr(ps);
+        if (args[i] < 0) return -1;
+    }
+    calc_skip_space(ps);
+    if (*ps->p != ')') return calc_fail(ps, calc_functions[fn].arity == 1 && *ps->p == ',' ?
+                                                "a função recebe um argumento" : "falta ')'");
+    ps->p++;
+    return calc_node(ps->t, calc_functions[fn].arity == 1 ? CALC_CALL1 : CALC_CALL2, args[0], args[1], fn, 0);
+}
+
+static int calc_parse_unary(CalcParser *ps);
+
+static int calc_parse_power(CalcParser *ps) {
+    int base = calc_parse_primary(ps);
+    if (base < 0) return -1;
+    calc_skip_space(ps);
+    if (*ps->p == '^' || (ps->p[0] == '*' && ps->p[1] == '*')) {
+        ps->p += *ps->p == '^' ? 1 : 2;
+        int exp = calc_parse_unary(ps);
+        return calc_node(ps->t, CALC_POW, base, exp, -1, 0);
+    }
+    return base;
+}
+
+static int calc_parse_unary(CalcParser *ps) {
+    calc_skip_space(ps);
+    if (*ps->p == '-') {
+        ps->p++;
+        return calc_node(ps->t, CALC_NEG, calc_parse_unary(ps), -1, -1, 0);
+    }
+    if (*ps->p == '+') {
+        ps->p++;
+        return calc_parse_unary(ps);
+    }
+    return calc_parse_power(ps);
+}
+
+static int calc_parse_term(CalcParser *ps) {
+    int left = calc_parse_unary(ps);
+    for (;;) {
+        calc_skip_space(ps);
+        char op = *ps->p;
+        if ((op != '*' && op != '/') || ps->p[1] == '*' || left < 0) return left;
+        ps->p++;
+        left = calc_node(ps->t, op == '*' ? CALC_MUL : CALC_DIV, left, calc_parse_unary(ps), -1, 0);
+    }
+}
+
+static int calc_parse_expr(CalcParser *ps) {
+    int left = calc_parse_term(ps);
+    for (;;) {
+        calc_skip_space(ps);
+        char op = *ps->p;
+        if ((op != '+' && op != '-') || left < 0) return left;
+        ps->p++;
+        left = calc_node(ps->t, op == '+' ? CALC_ADD : CALC_SUB, left, calc_parse_term(ps), -1, 0);
+    }
+}
+
+// Analisa o texto inteiro; retorna a raiz ou -1 (t->error explica).
+static int calc_parse(const char *src, CalcTree *t) {
+    CalcParser ps = { src, src, t };
+    int root = calc_parse_expr(&ps);
+    calc_skip_space(&ps);
+    if (root >= 0 && *ps.p) return calc_fail(&ps, *ps.p == ')' ? "')' sobrando" : "operador esperado");
+    return root;
+}
+
+// --- Derivadas ---
+//
+// calc_diff deriva a arvore em relacao a uma variavel, regra a regra
+// (produto, quociente, cadeia e a derivada de cada funcao da tabela). Os nos
+// novos passam por calc_op, que simplifica o obvio (x + 0, 1 * x, x - x,
+// constantes juntas...), e por calc_node, que reaproveita nos iguais; a
+// derivada de um no compartilhado e calculada uma vez so. O resultado e uma
+// arvore comum: compila para bytecode, imprime como expressao e pode ser
+// derivada de novo.
+
+static bool calc_is_value(const CalcTree *t, int n, double v) {
+    return n >= 0 && t->nodes[n].kind == CALC_NUM && t->nodes[n].value == v;
+}
+
+static int calc_num(CalcTree *t, double v) {
+    return calc_node(t, CALC_NUM, -1, -1, -1, v);
+}
+
+// Expoente constante de n visto como potencia (u e u^1)
+static double calc_power_of(const CalcTree *t, int n) {
+    return t->nodes[n].kind == CALC_POW ? t->nodes[t->nodes[n].b].value : 1.0;
+}
+
+// Base comum de a e b quando os dois sao u ou u^constante; -1 se nao
+static int calc_same_base(const CalcTree *t, int a, int b) {
+    const CalcNode *na = &t->nodes[a], *nb = &t->nodes[b];
+    if (na->kind == CALC_NUM || nb->kind == CALC_NUM) return -1;
+    if (na->kind == CALC_POW && t->nodes[na->b].kind != CALC_NUM) return -1;
+    if (nb->kind == CALC_POW && t->nodes[nb->b].kind != CALC_NUM) return -1;
+    int base_a = na->kind == CALC_POW ? na->a : a, base_b = nb->kind == CALC_POW ? nb->a : b;
+    return base_a == base_b ? base_a : -1;
+}
+
+// Separa n em coeficiente * resto (2*u, -u, u)
+static double calc_split_coef(const CalcTree *t, int n, int *rest) {
+    const CalcNode *node = &t->nodes[n];
+    if (node->kind == CALC_MUL && t->nodes[node->a].kind == CALC_NUM) {
+        *rest = node->b;
+        return t->nodes[node->a].value;
+    }
+    if (node->kind == CALC_NEG) {
+        *rest = node->a;
+        return -1.0;
+    }
+    *rest = n;
+    return 1.0;
+}
+
+static int calc_op(CalcTree *t, CalcKind kind, int a, int b);
+
+// c1*u +- c2*u = (c1 +- c2)*u; -1 quando os termos nao sao semelhantes
+static int calc_combine_terms(CalcTree *t, int a, int b, double sign) {
+    int rest_a, rest_b;
+    double ca = calc_split_coef(t, a, &rest_a), cb = calc_split_coef(t, b, &rest_b);
+    if (rest_a != rest_b || t->nodes[rest_a].kind == CALC_NUM) return -1;
+    return calc_op(t, CALC_MUL, calc_num(t, ca + sign * cb), rest_a);
+}
+
+// calc_node com simplificacao algebrica
+static int calc_op(CalcTree *t, CalcKind kind, int a, int b) {
+    if (a < 0 || (kind != CALC_NEG && b < 0)) return -1;
+    // copias: criar nos pode realocar t->nodes
+    CalcNode na_copy = t->nodes[a], nb_copy = t->nodes[kind != CALC_NEG ? b : a];
+    const CalcNode *na = &na_copy, *nb = &nb_copy;
+    switch (kind) {
+    case CALC_NEG:
+        if (na->kind == CALC_NEG) return na->a;
+        if (na->kind == CALC_SUB) return calc_op(t, CALC_SUB, na->b, na->a);
+        if (na->kind == CALC_MUL && t->nodes[na->a].kind == CALC_NUM) {
+            double k = -t->nodes[na->a].value;
+            return calc_op(t, CALC_MUL, calc_num(t, k), na->b);
+        }
+        break;
+    case CALC_ADD:
+        if (calc_is_value(t, a, 0)) return b;
+        if (calc_is_value(t, b, 0)) return a;
+        if (nb->kind == CALC_NEG) return calc_op(t, CALC_SUB, a, nb->a);
+        if (na->kind == CALC_NEG) return calc_op(t, CALC_SUB, b, na->a);
+        {
+            int sum = calc_combine_terms(t, a, b, 1.0);
+            if (sum >= 0) return sum;
+        }
+        // a + (-2)*u = a - 2*u
+        if (nb->kind == CALC_NUM && nb->value < 0) return calc_op(t, CALC_SUB, a, calc_num(t, -nb->value));
+        if (nb->kind == CALC_MUL && t->nodes[nb->a].kind == CALC_NUM && t->nodes[nb->a].value < 0) {
+            return calc_op(t, CALC_SUB, a, calc_op(t, CALC_NEG, b, -1));
+        }
+        break;
+    case CALC_SUB:
+        if (calc_is_value(t, b, 0)) return a;
+        if (calc_is_value(t, a, 0)) return calc_op(t, CALC_NEG, b, -1);
+        if (a == b) return calc_num(t, 0);
+        if (nb->kind == CALC_NEG) return calc_op(t, CALC_ADD, a, nb->a);
+        {
+            int diff = calc_combine_terms(t, a, b, -1.0);
+            if (diff >= 0) return diff;
+        }
+        if (nb->kind == CALC_NUM && nb->value < 0) return calc_op(t, CALC_ADD, a, calc_num(t, -nb->value));
+        if (nb->kind == CALC_MUL && t->nodes[nb->a].kind == CALC_NUM && t->nodes[nb->a].value < 0) {
+            return calc_op(t, CALC_ADD, a, calc_op(t, CALC_NEG, b, -1));
+        }
+        break;
+    case CALC_MUL:
+        if (calc_is_value(t, a, 0) || calc_is_value(t, b, 0)) return calc_num(t, 0);
+        if (calc_is_value(t, a, 1)) return b;
+        if (calc_is_value(t, b, 1)) return a;
+        // forma normal: constante a esquerda, NEG e DIV por fora, fatores
+        // em ordem de indice (entao sin(x)*cos(x) e cos(x)*sin(x) sao o
+        // mesmo no) e potencias da mesma base somadas
+        if (nb->kind == CALC_NUM && na->kind != CALC_NUM) return calc_op(t, CALC_MUL, b, a);
+        if (na->kind == CALC_NUM) {
+            double c = na->value;
+            if (nb->kind == CALC_NEG) return calc_op(t, CALC_MUL, calc_num(t, -c), nb->a);
+            if (nb->kind == CALC_MUL && t->nodes[nb->a].kind == CALC_NUM) {
+                double k = c * t->nodes[nb->a].value;
+                return calc_op(t, CALC_MUL, calc_num(t, k), nb->b);
+            }
+            if (nb->kind == CALC_DIV) return calc_op(t, CALC_DIV, calc_op(t, CALC_MUL, a, nb->a), nb->b);
+            if (c == -1) return calc_op(t, CALC_NEG, b, -1);
+            break;
+        }
+        if (na->kind == CALC_MUL && t->nodes[na->a].kind == CALC_NUM) {
+            return calc_op(t, CALC_MUL, na->a, calc_op(t, CALC_MUL, na->b, b));
+        }
+        if (nb->kind == CALC_MUL && t->nodes[nb->a].kind == CALC_NUM) {
+            return calc_op(t, CALC_MUL, nb->a, calc_op(t, CALC_MUL, a, nb->b));
+        }
+        if (na->kind == CALC_NEG) return calc_op(t, CALC_NEG, calc_op(t, CALC_MUL, na->a, b), -1);
+        if (nb->kind == CALC_NEG) return calc_op(t, CALC_NEG, calc_op(t, CALC_MUL, a, nb->a), -1);
+        if (na->kind == CALC_DIV) return calc_op(t, CALC_DIV, calc_op(t, CALC_MUL, na->a, b), na->b);
+        if (nb->kind == CALC_DIV) return calc_op(t, CALC_DIV, calc_op(t, CALC_MUL, a, nb->a), nb->b);
+        if (a == b) return calc_op(t, CALC_POW, a, calc_num(t, 2));
+        {
+            // u^m * u^n = u^(m+n)
+            int base = calc_same_base(t, a, b);
+            if (base >= 0) return calc_op(t, CALC_POW, base, calc_num(t, calc_power_of(t, a) + calc_power_of(t, b)));
+        }
+        if (a > b) return calc_op(t, CALC_MUL, b, a);
+        break;
+    case CALC_DIV:
+        if (calc_is_value(t, a, 0)) return calc_num(t, 0);
+        if (calc_is_value(t, b, 1)) return a;
+        if (a == b) return calc_num(t, 1);
+        if (na->kind == CALC_NEG) return calc_op(t, CALC_NEG, calc_op(t, CALC_DIV, na->a, b), -1);
+        if (nb->kind == CALC_NEG) return calc_op(t, CALC_NEG, calc_op(t, CALC_DIV, a, nb->a), -1);
+        if (na->kind == CALC_DIV) return calc_op(t, CALC_DIV, na->a, calc_op(t, CALC_MUL, na->b, b));
+        if (nb->kind == CALC_DIV) return calc_op(t, CALC_DIV, calc_op(t, CALC_MUL, a, nb->b), nb->a);
+        {
+            // u^m / u^n = u^(m-n); no numerador, c*u^m tambem
+            int lead = na->kind == CALC_MUL && t->nodes[na->a].kind == CALC_NUM ? na->a : -1;
+            int top = lead >= 0 ? na->b : a;
+            int base = calc_same_base(t, top, b);
+            if (base >= 0) {
+                int q = calc_op(t, CALC_POW, base, calc_num(t, calc_power_of(t, top) - calc_power_of(t, b)));
+                return lead >= 0 ? calc_op(t, CALC_MUL, lead, q) : q;
+            }
+        }
+        break;
+    case CALC_POW:
+        if (calc_is_value(t, b, 1)) return a;
+        if (calc_is_value(t, b, 0) || calc_is_value(t, a, 1)) return calc_num(t, 1);
+        // (u^m)^n = u^(m*n) so vale sempre com expoentes inteiros
+        if (na->kind == CALC_POW && nb->kind == CALC_NUM && t->nodes[na->b].kind == CALC_NUM &&
+            nb->value == trunc(nb->value) && t->nodes[na->b].value == trunc(t->nodes[na->b].value)) {
+            double k = nb->value * t->nodes[na->b].value;
+            return calc_op(t, CALC_POW, na->a, calc_num(t, k));
+        }
+        break;
+    default:
+        break;
+    }
+    return calc_node(t, kind, a, b, -1, 0);
+}
+
+static int calc_call(CalcTree *t, const char *name, int a) {
+    return a < 0 ? -1 : calc_node(t, CALC_CALL1, a, -1, calc_find_function(name), 0);
+}
+
+// f'(u) para as funcoes de um argumento; self e o no f(u), reaproveitado
+// quando a derivada o contem (exp, tan, sqrt...)
+static int calc_diff_call1(CalcTree *t, const char *name, int u, int self) {
+    int one = calc_num(t, 1);
+    int u2 = calc_op(t, CALC_POW, u, calc_num(t, 2));
+    if (strcmp(name, "sin") == 0) return calc_call(t, "cos", u);
+    if (strcmp(name, "cos") == 0) return calc_op(t, CALC_NEG, calc_call(t, "sin", u), -1);
+    if (strcmp(name, "tan") == 0) return calc_op(t, CALC_ADD, one, calc_op(t, CALC_POW, self, calc_num(t, 2)));
+    if (strcmp(name, "sec") == 0) return calc_op(t, CALC_MUL, self, calc_call(t, "tan", u));
+    if (strcmp(name, "csc") == 0) return calc_op(t, CALC_NEG, calc_op(t, CALC_MUL, self, calc_call(t, "cot", u)), -1);
+    if (strcmp(name, "cot") == 0) {
+        return calc_op(t, CALC_NEG, calc_op(t, CALC_ADD, one, calc_op(t, CALC_POW, self, calc_num(t, 2))), -1);
+    }
+    if (strcmp(name, "asin") == 0) return calc_op(t, CALC_DIV, one, calc_call(t, "sqrt", calc_op(t, CALC_SUB, one, u2)));
+    if (strcmp(name, "acos") == 0) {
+        return calc_op(t, CALC_NEG, calc_op(t, CALC_DIV, one, calc_call(t, "sqrt", calc_op(t, CALC_SUB, one, u2))), -1);
+    }
+    if (strcmp(name, "atan") == 0) return calc_op(t, CALC_DIV, one, calc_op(t, CALC_ADD, one, u2));
+    if (strcmp(name, "sinh") == 0) return calc_call(t, "cosh", u);
+    if (strcmp(name, "cosh") == 0) return calc_call(t, "sinh", u);
+    if (strcmp(name, "tanh") == 0) return calc_op(t, CALC_SUB, one, calc_op(t, CALC_POW, self, calc_num(t, 2)));
+    if (strcmp(name, "asinh") == 0) return calc_op(t, CALC_DIV, one, calc_call(t, "sqrt", calc_op(t, CALC_ADD, u2, one)));
+    if (strcmp(name, "acosh") == 0) return calc_op(t, CALC_DIV, one, calc_call(t, "sqrt", calc_op(t, CALC_SUB, u2, one)));
+    if (strcmp(name, "atanh") == 0) return calc_op(t, CALC_DIV, one, calc_op(t, CALC_SUB, one, u2));
+    if (strcmp(name, "exp") == 0) return self;
+    if (strcmp(name, "exp2") == 0) return calc_op(t, CALC_MUL, calc_num(t, M_LN2), self);
+    if (strcmp(name, "expm1") == 0) return calc_call(t, "exp", u);
+    if (strcmp(name, "log") == 0 || strcmp(name, "ln") == 0) return calc_op(t, CALC_DIV, one, u);
+    if (strcmp(name, "log2") == 0) return calc_op(t, CALC_DIV, one, calc_op(t, CALC_MUL, calc_num(t, M_LN2), u));
+    if (strcmp(name, "log10") == 0) return calc_op(t, CALC_DIV, one, calc_op(t, CALC_MUL, calc_num(t, M_LN10), u));
+    if (strcmp(name, "log1p") == 0) return calc_op(t, CALC_DIV, one, calc_op(t, CALC_ADD, one, u));
+    if (strcmp(name, "sqrt") == 0) return calc_op(t, CALC_DIV, calc_num(t, 0.5), self);
+    if (strcmp(name, "cbrt") == 0) {
+        return calc_op(t, CALC_DIV, one, calc_op(t, CALC_MUL, calc_num(t, 3), calc_op(t, CALC_POW, self, calc_num(t, 2))));
+    }
+    if (strcmp(name, "abs") == 0) return calc_call(t, "sign", u);
+    if (strcmp(name, "erf") == 0 || strcmp(name, "erfc") == 0) {
+        int d = calc_op(t, CALC_MUL, calc_num(t, M_2_SQRTPI), calc_call(t, "exp", calc_op(t, CALC_NEG, u2, -1)));
+        return name[3] == 'c' ? calc_op(t, CALC_NEG, d, -1) : d;
+    }
+    if (strcmp(name, "floor") == 0 || strcmp(name, "ceil") == 0 || strcmp(name, "round") == 0 ||
+        strcmp(name, "trunc") == 0 || strcmp(name, "sign") == 0) {
+        return calc_num(t, 0); // constantes por partes
+    }
+    if (!t->error) t->error = "a derivada de gamma e lgamma não está disponível";
+    return -1;
+}
+
+// d(u^v) = u^v * (v' * ln(u) + v * u' / u), com os casos comuns a parte
+static int calc_diff_pow(CalcTree *t, int self, int u, int v, int du, int dv) {
+    if (calc_is_value(t, dv, 0)) {
+        if (calc_is_value(t, du, 0)) return calc_num(t, 0);
+        int pred = calc_op(t, CALC_SUB, v, calc_num(t, 1));
+        return calc_op(t, CALC_MUL, calc_op(t, CALC_MUL, v, calc_op(t, CALC_POW, u, pred)), du);
+    }
+    int ln_u = calc_call(t, "log", u);
+    if (calc_is_value(t, du, 0)) return calc_op(t, CALC_MUL, calc_op(t, CALC_MUL, self, ln_u), dv);
+    int inner = calc_op(t, CALC_ADD, calc_op(t, CALC_MUL, dv, ln_u),
+                        calc_op(t, CALC_DIV, calc_op(t, CALC_MUL, v, du), u));
+    return calc_op(t, CALC_MUL, self, inner);
+}
+
+// memo[n] guarda a derivada ja calculada de n (-2 = ainda nao); so cobre os
+// nos que existiam antes da derivacao comecar.
+static int calc_diff_node(CalcTree *t, int n, int var, int *memo) {
+    if (n < 0 || t->error) return -1;
+    if (memo[n] != -2) return memo[n];
+    CalcNode node = t->nodes[n]; // copia: t->nodes pode ser realocado
+    int u = node.a, v = node.b;
+    int du = u >= 0 ? calc_diff_node(t, u, var, memo) : -1;
+    int dv = v >= 0 ? calc_diff_node(t, v, var, memo) : -1;
+    if (t->error) return -1;
+    int d = -1;
+    switch (node.kind) {
+    case CALC_NUM: d = calc_num(t, 0); break;
+    case CALC_VAR: d = calc_num(t, node.fn == var ? 1 : 0); break;
+    case CALC_NEG: d = calc_op(t, CALC_NEG, du, -1); break;
+    case CALC_ADD: d = calc_op(t, CALC_ADD, du, dv); break;
+    case CALC_SUB: d = calc_op(t, CALC_SUB, du, dv); break;
+    case CALC_MUL:
+        d = calc_op(t, CALC_ADD, calc_op(t, CALC_MUL, du, v), calc_op(t, CALC_MUL, u, dv));
+        break;
+    case CALC_DIV:
+        if (calc_is_value(t, dv, 0)) {
+            d = calc_op(t, CALC_DIV, du, v);
+        } else {
+            int top = calc_op(t, CALC_SUB, calc_op(t, CALC_MUL, du, v), calc_op(t, CALC_MUL, u, dv));
+            d = calc_op(t, CALC_DIV, top, calc_op(t, CALC_POW, v, calc_num(t, 2)));
+        }
+        break;
+    case CALC_POW:
+        d = calc_diff_pow(t, n, u, v, du, dv);
+        break;
+    case CALC_CALL1:
+        d = calc_is_value(t, du, 0) ? du
+            : calc_op(t, CALC_MUL, calc_diff_call1(t, calc_functions[node.fn].name, u, n), du);
+        break;
+    case CALC_CALL2: {
+        const char *name = calc_functions[node.fn].name;
+        if (strcmp(name, "pow") == 0) {
+            d = calc_diff_pow(t, n, u, v, du, dv);
+        } else if (strcmp(name, "atan2") == 0) {
+            // (x * dy - y * dx) / (x^2 + y^2), com atan2(y, x)
+            int top = calc_op(t, CALC_SUB, calc_op(t, CALC_MUL, v, du), calc_op(t, CALC_MUL, u, dv));
+            int bottom = calc_op(t, CALC_ADD, calc_op(t, CALC_POW, u, calc_num(t, 2)), calc_op(t, CALC_POW, v, calc_num(t, 2)));
+            d = calc_op(t, CALC_DIV, top, bottom);
+        } else if (strcmp(name, "hypot") == 0) {
+            int top = calc_op(t, CALC_ADD, calc_op(t, CALC_MUL, u, du), calc_op(t, CALC_MUL, v, dv));
+            d = calc_op(t, CALC_DIV, top, n);
+        } else if (strcmp(name, "fmod") == 0) {
+            d = calc_op(t, CALC_SUB, du, calc_op(t, CALC_MUL, calc_call(t, "trunc", calc_op(t, CALC_DIV, u, v)), dv));
+        } else {
+            // min/max(u, v) = (u + v)/2 -+ |u - v|/2
+            int mean = calc_op(t, CALC_MUL, calc_num(t, 0.5), calc_op(t, CALC_ADD, du, dv));
+            int half = calc_op(t, CALC_MUL, calc_num(t, 0.5),
+                               calc_op(t, CALC_MUL, calc_call(t, "sign", calc_op(t, CALC_SUB, u, v)),
+                                       calc_op(t, CALC_SUB, du, dv)));
+            d = calc_op(t, strcmp(name, "min") == 0 ? CALC_SUB : CALC_ADD, mean, half);
+        }
+        break;
+    }
+    }
+    if (d < 0 && !t->error) t->error = "expressão grande demais";
+    memo[n] = d;
+    return d;
+}
+
+// Reconstroi a subarvore passando cada no por calc_op
+static int calc_simplify_node(CalcTree *t, int n, int *memo) {
+    if (n < 0 || t->error) return -1;
+    if (memo[n] != -2) return memo[n];
+    CalcNode node = t->nodes[n];
+    int a = node.a >= 0 ? calc_simplify_node(t, node.a, memo) : -1;
+    int b = node.b >= 0 ? calc_simplify_node(t, node.b, memo) : -1;
+    int r;
+    switch (node.kind) {
+    case CALC_NUM: case CALC_VAR: r = n; break;
+    case CALC_CALL1: case CALC_CALL2: r = calc_node(t, node.kind, a, b, node.fn, 0); break;
+    default: r = calc_op(t, node.kind, a, b); break;
+    }
+    memo[n] = r;
+    return r;
+}
+
+static int calc_simplify(CalcTree *t, int root) {
+    int *memo = malloc(t->count * sizeof(int));
+    if (!memo) {
+        if (!t->error) t->error = "sem memória";
+        return -1;
+    }
+    for (int i = 0; i < t->count; i++) memo[i] = -2;
+    int r = calc_simplify_node(t, root, memo);
+    free(memo);
+    return r;
+}
+
+// Derivada de root em relacao a variavel var (indice em t->vars)
+static int calc_diff(CalcTree *t, int root, int var) {
+    int *memo = malloc(t->count * sizeof(int));
+    if (!memo) {
+        if (!t->error) t->error = "sem memória";
+        return -1;
+    }
+    for (int i = 0; i < t->count; i++) memo[i] = -2;
+    int d = calc_diff_node(t, root, var, memo);
+    free(memo);
+    return d;
+}
+
+// Imprime a subarvore como uma expressao que calc_parse le de volta. Um no
+// compartilhado aparece por extenso em cada lugar; depois de max_len
+// caracteres a saida e cortada com "...".
+typedef struct {
+    FILE *out;
+    long len;
+    long max_len;
+} CalcPrinter;
+
+static int calc_precedence(const CalcTree *t, int n) {
+    const CalcNode *node = &t->nodes[n];
+    switch (node->kind) {
+    case CALC_ADD: case CALC_SUB: return 1;
+    case CALC_MUL: case CALC_DIV: return 2;
+    case CALC_NEG: return 3;
+    case CALC_POW: return 4;
+    case CALC_NUM: return node->value < 0 ? 3 : 5;
+    default: return 5;
+    }
+}
+
+static void calc_print_node(CalcPrinter *pr, const CalcTree *t, int n, int min_prec) {
+    if (pr->len > pr->max_len) return;
+    const CalcNode *node = &t->nodes[n];
+    bool parens = calc_precedence(t, n) < min_prec;
+    if (parens) pr->len += fprintf(pr->out, "(");
+    switch (node->kind) {
+    case CALC_NUM: {
+        // o menor numero de digitos que le de volta o mesmo double
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.15g", node->value);
+        if (strtod(buf, NULL) != node->value) snprintf(buf, sizeof(buf), "%.17g", node->value);
+        pr->len += fprintf(pr->out, "%s", buf);
+        break;
+    }
+    case CALC_VAR:
+        pr->len += fprintf(pr->out, "%s", t->vars[node->fn]);
+        break;
+    case CALC_NEG:
+        pr->len += fprintf(pr->out, "-");
+        calc_print_node(pr, t, node->a, 3);
+        break;
+    case CALC_ADD: case CALC_SUB: case CALC_MUL: case CALC_DIV: {
+        static const char *ops[] = { [CALC_ADD] = " + ", [CALC_SUB] = " - ", [CALC_MUL] = "*", [CALC_DIV] = "/" };
+        int prec = calc_precedence(t, n);
+        // o lado direito de - e / precisa de parenteses ate no mesmo nivel
+        bool strict = node->kind == CALC_SUB || node->kind == CALC_DIV;
+        calc_print_node(pr, t, node->a, prec);
+        pr->len += fprintf(pr->out, "%s", ops[node->kind]);
+        calc_print_node(pr, t, node->b, strict ? prec + 1 : prec);
+        break;
+    }
+    case CALC_POW:
+        // associa a direita: (a^b)^c precisa de parenteses, a^(b^c) nao
+        calc_print_node(pr, t, node->a, 5);
+        pr->len += fprintf(pr->out, "^");
+        calc_print_node(pr, t, node->b, 3);
+        break;
+    case CALC_CALL1: case CALC_CALL2:
+        pr->len += fprintf(pr->out, "%s(", calc_functions[node->fn].name);
+        calc_print_node(pr, t, node->a, 0);
+        if (node->kind == CALC_CALL2) {
+            pr->len += fprintf(pr->out, ", ");
+            calc_print_node(pr, t, node->b, 0);
+        }
+        pr->len += fprintf(pr->out, ")");
+        break;
+    }
+    if (parens) pr->len += fprintf(pr->out, ")");
+}
+
+static void calc_print(FILE *out, const CalcTree *t, int root, long max_len) {
+    CalcPrinter pr = { out, 0, max_len };
+    calc_print_node(&pr, t, root, 0);
+    if (pr.len > max_len) fprintf(out, " ...");
+}
+
+// Bytecode: cada instrucao le registradores a/b e escreve dst. Os
+// registradores [0, nconst) guardam as constantes, os seguintes as
+// variaveis e o resto e temporario, reaproveitado quando o valor morre.
+typedef enum {
+    CALC_OP_ADD, CALC_OP_SUB, CALC_OP_MUL, CALC_OP_DIV, CALC_OP_POW, CALC_OP_POWI,
+    CALC_OP_NEG, CALC_OP_CALL1, CALC_OP_CALL2
+} CalcOp;
+
+typedef struct {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    int32_t imm;     // POWI: expoente; CALL1/2: indice em calc_functions
+} CalcInsn;
+
+typedef struct {
+    CalcInsn *code;
+    int len;
+    double consts[CALC_MAX_REGS];
+    int nconst;
+    int nvars;
+    int nregs;
+    int result;
+    char vars[CALC_MAX_VARS][CALC_NAME_MAX];
+    double (*jit)(const double *vars);  // codigo nativo, ou NULL (interpretador)
+    void *jit_mem;
+    size_t jit_size;
+} CalcProgram;
+
+typedef struct {
+    const CalcTree *t;
+    CalcProgram *p;
+    int *reg;        // no -> registrador (-1 = ainda nao emitido)
+    int *uses;       // usos restantes de cada no
+    uint8_t free_regs[CALC_MAX_REGS];
+    int free_count;
+    int next_temp;
+    int cap;
+    const char *error;
+} CalcCompiler;
+
+static void calc_count_uses(CalcCompiler *c, int n) {
+    if (n < 0 || c->uses[n]++ > 0) return; // filhos ja contados na primeira visita
+    calc_count_uses(c, c->t->nodes[n].a);
+    calc_count_uses(c, c->t->nodes[n].b);
+}
+
+static void calc_release(CalcCompiler *c, int n) {
+    if (n < 0 || --c->uses[n] > 0) return;
+    int r = c->reg[n];
+    if (r >= c->p->nconst + c->p->nvars) c->free_regs[c->free_count++] = (uint8_t)r;
+}
+
+static int calc_emit_insn(CalcCompiler *c, CalcOp op, int a, int b, int32_t imm) {
+    int dst;
+    if (c->free_count) {
+        dst = c->free_regs[--c->free_count];
+    } else if (c->next_temp < CALC_MAX_REGS) {
+        dst = c->next_temp++;
+    } else {
+        c->error = "expressão complexa demais";
+        return -1;
+    }
+    if (c->p->len == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 32;
+        CalcInsn *grown = realloc(c->p->code, cap * sizeof(CalcInsn));
+        if (!grown) {
+            c->error = "sem memória";
+            return -1;
+        }
+        c->p->code = grown;
+        c->cap = cap;
+    }
+    c->p->code[c->p->len++] = (CalcInsn){ (uint8_t)op, (uint8_t)dst, (uint8_t)(a < 0 ? 0 : a), (uint8_t)(b < 0 ? 0 : b), imm };
+    return dst;
+}
+
+static int calc_const_reg(CalcCompiler *c, double v) {
+    for (int i = 0; i < c->p->nconst; i++) {
+        if (memcmp(&c->p->consts[i], &v, sizeof(v)) == 0) return i;
+    }
+    return -1;
+}
+
+// Emite o no em pos-ordem; nos compartilhados saem uma vez so.
+static int calc_emit(CalcCompiler *c, int n) {
+    if (c->reg[n] >= 0 || c->error) return c->reg[n];
+    const CalcNode *node = &c->t->nodes[n];
+    int r = -1;
+    switch (node->kind) {
+    case CALC_NUM:
+        r = calc_const_reg(c, node->value);
+        break;
+    case CALC_VAR:
+        r = c->p->nconst + node->fn;
+        break;
+    case CALC_POW: {
+        const CalcNode *e = &c->t->nodes[node->b];
+        if (e->kind == CALC_NUM && e->value == (int)e->value && fabs(e->value) <= 64) {
+            // potencia inteira: multiplicacoes em vez de pow()
+            int a = calc_emit(c, node->a);
+            calc_release(c, node->a);
+            calc_release(c, node->b);
+            r = a < 0 ? -1 : e->value == 2 ? calc_emit_insn(c, CALC_OP_MUL, a, a, 0)
+                                           : calc_emit_insn(c, CALC_OP_POWI, a, -1, (int32_t)e->value);
+            break;
+        }
+    }
+        // fallthrough
+    default: {
+        static const CalcOp ops[] = {
+            [CALC_NEG] = CALC_OP_NEG, [CALC_ADD] = CALC_OP_ADD, [CALC_SUB] = CALC_OP_SUB, [CALC_MUL] = CALC_OP_MUL,
+            [CALC_DIV] = CALC_OP_DIV, [CALC_POW] = CALC_OP_POW, [CALC_CALL1] = CALC_OP_CALL1, [CALC_CALL2] = CALC_OP_CALL2,
+        };
+        int a = calc_emit(c, node->a);
+        int b = node->b >= 0 ? calc_emit(c, node->b) : -1;
+        if (c->error) return -1;
+        calc_release(c, node->a);
+        calc_release(c, node->b);
+        r = calc_emit_insn(c, ops[node->kind], a, b, node->fn);
+        break;
+    }
+    }
+    c->reg[n] = r;
+    return r;
+}
+
+static void calc_collect_consts(CalcCompiler *c, int n, bool *seen) {
+    if (n < 0 || seen[n]) return;
+    seen[n] = true;
+    const CalcNode *node = &c->t->nodes[n];
+    if (node->kind == CALC_NUM && calc_const_reg(c, node->value) < 0) {
+        if (c->p->nconst == CALC_MAX_REGS / 2) {
+            c->error = "constantes demais";
+            return;
+        }
+        c->p->consts[c->p->nconst++] = node->value;
+    }
+    calc_collect_consts(c, node->a, seen);
+    calc_collect_consts(c, node->b, seen);
+}
+
+// --- JIT ---
+//
+// Em x86-64 o programa tambem vira codigo de maquina, double f(const double
+// *vars), numa pagina mmap'ada: cada instrucao do bytecode vira SSE2
+// escalar (addsd, mulsd...) com os operandos na memoria, e as chamadas vao
+// direto para a libm. Os registradores do bytecode sao as constantes (no
+// comeco da pagina, enderecadas relativas a rip), as variaveis ([rbx], o
+// vars recebido) e os temporarios (na pilha, [rsp]). xmm0 guarda o ultimo
+// resultado, entao a leitura de um operando que acabou de ser calculado some.
+// A pagina e escrita e so depois marcada executavel (nunca as duas coisas).
+// Fora do x86-64, ou se o mmap falhar, jit fica NULL e calc_run interpreta.
+#define CALC_JIT_INSN_MAX 96   // bytes de codigo por instrucao, no pior caso
+#define CALC_JIT_POOL 32       // mascara de sinal (16 bytes), 1.0 e alinhamento
+
+typedef struct {
+    uint8_t *mem;
+    size_t pos;
+    const CalcProgram *p;
+    int cached;      // registrador do bytecode que esta em xmm0 (-1 = nenhum)
+} CalcJit;
+
+static void calc_jit_bytes(CalcJit *j, const uint8_t *bytes, size_t n) {
+    memcpy(j->mem + j->pos, bytes, n);
+    j->pos += n;
+}
+
+static void calc_jit_u32(CalcJit *j, uint32_t v) {
+    calc_jit_bytes(j, (const uint8_t *)&v, 4);
+}
+
+// ModRM (+SIB e deslocamento) de xmm<reg> com o registrador r do bytecode;
+// pool_disp e a posicao de um valor do pool quando r < 0
+static void calc_jit_operand(CalcJit *j, int reg, int r, size_t pool_disp) {
+    const CalcProgram *p = j->p;
+    if (r < p->nconst) {
+        size_t target = r < 0 ? pool_disp : CALC_JIT_POOL + (size_t)r * sizeof(double);
+        j->mem[j->pos++] = (uint8_t)(reg << 3 | 5);   // [rip + disp32]
+        calc_jit_u32(j, (uint32_t)(int32_t)((int64_t)target - (int64_t)(j->pos + 4)));
+        return;
+    }
+    bool is_var = r < p->nconst + p->nvars;
+    int32_t disp = (int32_t)((is_var ? r - p->nconst : r - p->nconst - p->nvars) * sizeof(double));
+    int base = is_var ? 3 : 4;                          // rbx ou rsp
+    bool short_disp = disp < 128;
+    j->mem[j->pos++] = (uint8_t)((short_disp ? 0x40 : 0x80) | reg << 3 | base);
+    if (base == 4) j->mem[j->pos++] = 0x24;             // SIB de [rsp]
+    if (short_disp) j->mem[j->pos++] = (uint8_t)disp;
+    else calc_jit_u32(j, (uint32_t)disp);
+}
+
+// <prefixo> 0F <opcode> xmm<reg>, registrador r (movsd = F2 0F 10, addsd =
+// F2 0F 58...); r < 0 e a mascara de sinal do pool
+static void calc_jit_sse(CalcJit *j, uint8_t prefix, uint8_t opcode, int reg, int r) {
+    uint8_t head[3] = { prefix, 0x0F, opcode };
+    calc_jit_bytes(j, head, 3);
+    calc_jit_operand(j, reg, r, 0);
+}
+
+static void calc_jit_load(CalcJit *j, int reg, int r) {
+    if (reg == 0 && r == j->cached) return;
+    calc_jit_sse(j, 0xF2, 0x10, reg, r);
+    if (reg == 0) j->cached = r;
+}
+
+static void calc_jit_call(CalcJit *j, const void *fn) {
+    uint8_t mov[2] = { 0x48, 0xB8 };                    // mov rax, imm64
+    uint64_t addr = (uint64_t)(uintptr_t)fn;
+    calc_jit_bytes(j, mov, 2);
+    calc_jit_bytes(j, (const uint8_t *)&addr, 8);
+    static const uint8_t call[2] = { 0xFF, 0xD0 };      // call rax
+    calc_jit_bytes(j, call, 2);
+}
+
+// xmm0 = a^n pela mesma sequencia de multiplicacoes de calc_powi
+static void calc_jit_powi(CalcJit *j, int n) {
+    static const uint8_t acc_init[4] = { 0x66, 0x0F, 0x28, 0xC8 };   // movapd xmm1, xmm0
+    static const uint8_t acc_mul[4] = { 0xF2, 0x0F, 0x59, 0xC8 };    // mulsd xmm1, xmm0
+    static const uint8_t square[4] = { 0xF2, 0x0F, 0x59, 0xC0 };     // mulsd xmm0, xmm0
+    static const uint8_t result[4] = { 0x66, 0x0F, 0x28, 0xC1 };     // movapd xmm0, xmm1
+    static const uint8_t invert[4] = { 0xF2, 0x0F, 0x5E, 0xC1 };     // divsd xmm0, xmm1
+    unsigned m = n < 0 ? -(unsigned)n : (unsigned)n;
+    bool have_acc = false;
+    for (; m; m >>= 1) {
+        if (m & 1) {
+            calc_jit_bytes(j, have_acc ? acc_mul : acc_init, 4);
+            have_acc = true;
+        }
+        if (m > 1) calc_jit_bytes(j, square, 4);
+    }
+    if (!have_acc || n < 0) {
+        uint8_t one[3] = { 0xF2, 0x0F, 0x10 };         // movsd xmm0, [1.0]
+        calc_jit_bytes(j, one, 3);
+        calc_jit_operand(j, 0, -1, 16);
+        if (have_acc) calc_jit_bytes(j, invert, 4);
+    } else {
+        calc_jit_bytes(j, result, 4);
+    }
+}
+
+static void calc_jit_insn(CalcJit *j, const CalcInsn *i) {
+    static const uint8_t arith[] = { [CALC_OP_ADD] = 0x58, [CALC_OP_SUB] = 0x5C, [CALC_OP_MUL] = 0x59, [CALC_OP_DIV] = 0x5E };
+    switch (i->op) {
+    case CALC_OP_ADD: case CALC_OP_MUL: case CALC_OP_SUB: case CALC_OP_DIV: {
+        int a = i->a, b = i->b;
+        bool commutes = i->op == CALC_OP_ADD || i->op == CALC_OP_MUL;
+        if (commutes && b == j->cached && a != j->cached) {
+            a = i->b;
+            b = i->a;
+        } else if (!commutes && b == j->cached && a != b) {
+            static const uint8_t save[4] = { 0x66, 0x0F, 0x28, 0xC8 };   // movapd xmm1, xmm0
+            uint8_t op[4] = { 0xF2, 0x0F, arith[i->op], 0xC1 };          // <op>sd xmm0, xmm1
+            calc_jit_bytes(j, save, 4);
+            calc_jit_load(j, 0, a);
+            calc_jit_bytes(j, op, 4);
+            break;
+        }
+        calc_jit_load(j, 0, a);
+        calc_jit_sse(j, 0xF2, arith[i->op], 0, b);
+        break;
+    }
+    case CALC_OP_NEG:
+        calc_jit_load(j, 0, i->a);
+        calc_jit_sse(j, 0x66, 0x57, 0, -1);             // xorpd xmm0, [mascara de sinal]
+        break;
+    case CALC_OP_POWI:
+        calc_jit_load(j, 0, i->a);
+        calc_jit_powi(j, i->imm);
+        break;
+    case CALC_OP_POW:
+    case CALC_OP_CALL2:
+        calc_jit_load(j, 0, i->a);
+        calc_jit_load(j, 1, i->b);
+        calc_jit_call(j, i->op == CALC_OP_POW ? (const void *)pow : (const void *)calc_functions[i->imm].f2);
+        break;
+    case CALC_OP_CALL1:
+        calc_jit_load(j, 0, i->a);
+        calc_jit_call(j, (const void *)calc_functions[i->imm].f1);
+        break;
+    }
+    calc_jit_sse(j, 0xF2, 0x11, 0, i->dst);             // movsd [dst], xmm0
+    j->cached = i->dst;
+}
+
+static void calc_jit_compile(CalcProgram *p) {
+#if defined(__x86_64__) && defined(__linux__)
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t code_start = CALC_JIT_POOL + (size_t)p->nconst * sizeof(double);
+    size_t size = (code_start + 64 + (size_t)p->len * CALC_JIT_INSN_MAX + page - 1) / page * page;
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return;
+    CalcJit j = { mem, code_start, p, -1 };
+    static const double pool[4] = { -0.0, 0.0, 1.0, 0.0 };
+    memcpy(j.mem, pool, sizeof(pool));
+    memcpy(j.mem + CALC_JIT_POOL, p->consts, p->nconst * sizeof(double));
+
+    // push rbx; mov rbx, rdi; sub rsp, frame (rsp fica alinhado em 16 nas chamadas)
+    uint32_t frame = (uint32_t)((p->nregs - p->nconst - p->nvars) * sizeof(double) + 15) & ~15u;
+    static const uint8_t prologue[4] = { 0x53, 0x48, 0x89, 0xFB };
+    static const uint8_t sub_rsp[3] = { 0x48, 0x81, 0xEC }, add_rsp[3] = { 0x48, 0x81, 0xC4 };
+    calc_jit_bytes(&j, prologue, 4);
+    if (frame) {
+        calc_jit_bytes(&j, sub_rsp, 3);
+        calc_jit_u32(&j, frame);
+    }
+    for (int k = 0; k < p->len; k++) calc_jit_insn(&j, &p->code[k]);
+    calc_jit_load(&j, 0, p->result);
+    if (frame) {
+        calc_jit_bytes(&j, add_rsp, 3);
+        calc_jit_u32(&j, frame);
+    }
+    static const uint8_t epilogue[2] = { 0x5B, 0xC3 };   // pop rbx; ret
+    calc_jit_bytes(&j, epilogue, 2);
+
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return;
+    }
+    p->jit_mem = mem;
+    p->jit_size = size;
+    p->jit = (double (*)(const double *))(void *)(j.mem + code_start);
+#else
+    (void)p;
+#endif
+}
+
+static void calc_program_free(CalcProgram *p) {
+    if (!p) return;
+    if (p->jit_mem) munmap(p->jit_mem, p->jit_size);
+    free(p->code);
+    free(p);
+}
+
+// Compila a subarvore de root. Retorna NULL e preenche err em caso de erro.
+static CalcProgram *calc_compile_tree(const CalcTree *t, int root, char *err, size_t err_size) {
+    CalcProgram *p = calloc(1, sizeof(CalcProgram));
+    CalcCompiler c = { .t = t, .p = p };
+    c.reg = malloc(t->count * sizeof(int));
+    c.uses = calloc(t->count, sizeof(int));
+    bool *seen = calloc(t->count, sizeof(bool));
+    if (!p || !c.reg || !c.uses || !seen) {
+        c.error = "sem memória";
+    } else {
+        for (int i = 0; i < t->count; i++) c.reg[i] = -1;
+        p->nvars = t->var_count;
+        memcpy(p->vars, t->vars, sizeof(p->vars));
+        calc_collect_consts(&c, root, seen);
+        c.next_temp = p->nconst + p->nvars;
+        calc_count_uses(&c, root);
+        if (!c.error) p->result = calc_emit(&c, root);
+        p->nregs = c.next_temp;
+    }
+    free(c.reg);
+    free(c.uses);
+    free(seen);
+    if (c.error) {
+        snprintf(err, err_size, "%s", c.error);
+        calc_program_free(p);
+        return NULL;
+    }
+    calc_jit_compile(p);
+    return p;
+}
+
+static CalcProgram *calc_compile(const char *src, char *err, size_t err_size) {
+    CalcTree t = {0};
+    int root = calc_parse(src, &t);
+    CalcProgram *p = NULL;
+    if (root < 0) {
+        snprintf(err, err_size, "%s (posição %d)", t.error ? t.error : "expressão inválida", t.error_pos + 1);
+    } else {
+        p = calc_compile_tree(&t, root, err, err_size);
+    }
+    calc_tree_free(&t);
+    return p;
+}
+
+// O interpretador. vars segue a ordem de p->vars.
+static double calc_interpret(const CalcProgram *p, const double *vars) {
+    double r[CALC_MAX_REGS];
+    memcpy(r, p->consts, p->nconst * sizeof(double));
+    memcpy(r + p->nconst, vars, p->nvars * sizeof(double));
+    for (const CalcInsn *i = p->code, *end = p->code + p->len; i < end; i++) {
+        switch (i->op) {
+        case CALC_OP_ADD: r[i->dst] = r[i->a] + r[i->b]; break;
+        case CALC_OP_SUB: r[i->dst] = r[i->a] - r[i->b]; break;
+        case CALC_OP_MUL: r[i->dst] = r[i->a] * r[i->b]; break;
+        case CALC_OP_DIV: r[i->dst] = r[i->a] / r[i->b]; break;
+        case CALC_OP_POW: r[i->dst] = pow(r[i->a], r[i->b]); break;
+        case CALC_OP_POWI: r[i->dst] = calc_powi(r[i->a], i->imm); break;
+        case CALC_OP_NEG: r[i->dst] = -r[i->a]; break;
+        case CALC_OP_CALL1: r[i->dst] = calc_functions[i->imm].f1(r[i->a]); break;
+        case CALC_OP_CALL2: r[i->dst] = calc_functions[i->imm].f2(r[i->a], r[i->b]); break;
+        }
+    }
+    return r[p->result];
+}
+
+static double calc_run(const CalcProgram *p, const double *vars) {
+    return p->jit ? p->jit(vars) : calc_interpret(p, vars);
+}
+
+// Funcao de uma variavel (ou constante), como integ e limit esperam.
+static double calc_run1(const CalcProgram *p, double x) {
+    return calc_run(p, &x);
+}
+
+// --- Avaliacao em lote ---
+//
+// calc_run_batch roda o programa sobre CALC_BATCH pontos de cada vez: cada
+// registrador vira um bloco de vetores de 8 doubles (extensao de vetores do
+// GCC) e cada instrucao um laco curto sobre o bloco. sin, cos e tan (e
+// sec, csc, cot) tem um nucleo vetorial proprio: reducao de Cody-Waite por
+// pi/2 e os polinomios do fdlibm em [-pi/4, pi/4]; acima de 1e5 a reducao
+// perde precisao e a libm assume. O interpretador inteiro (e o nucleo da
+// multiplicacao de matrizes) e compilado para AVX-512, AVX2+FMA e a base
+// (SSE2, ou escalar fora do x86-64), e calc_batch_init escolhe o mais largo
+// que a CPU suporta.
+#define CALC_LANES 8
+#define CALC_BATCH 64
+#define CALC_BATCH_VECS (CALC_BATCH / CALC_LANES)
+#define CALC_VTRIG_MAX 1e5
+
+typedef double CalcVec __attribute__((vector_size(CALC_LANES * sizeof(double))));
+typedef int64_t CalcVecI __attribute__((vector_size(CALC_LANES * sizeof(double))));
+
+// Indices em calc_functions das funcoes com nucleo vetorial
+enum { CALC_FN_SIN, CALC_FN_COS, CALC_FN_TAN, CALC_FN_SEC, CALC_FN_CSC, CALC_FN_COT };
+
+static inline __attribute__((always_inline)) void calc_vtrig(const CalcVec *x, CalcVec *y, int fn) {
+    for (int j = 0; j < CALC_BATCH_VECS; j++) {
+        // q = round(x * 2/pi) pelo truque do 1.5 * 2^52: os bits baixos de t
+        // sao o proprio q, entao o quadrante sai de qi & 3
+        CalcVec t = x[j] * 0.63661977236758134308 + 0x1.8p52;
+        CalcVecI qi = (CalcVecI)t;
+        CalcVec q = t - 0x1.8p52;
+        CalcVec r = x[j] - q * 1.57079632673412561417e+00;
+        r = r - q * 6.07710050650619224932e-11;
+        r = r - q * 2.02226624871116645580e-21;
+        CalcVec z = r * r;
+        CalcVec s = r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03 +
+                    z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06 +
+                    z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+        CalcVec c = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 +
+                    z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07 +
+                    z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+        CalcVecI odd = (CalcVecI)((qi & 1) != 0);
+        CalcVecI si = (CalcVecI)s, ci = (CalcVecI)c;
+        CalcVecI sin_bits = ((odd & ci) | (~odd & si)) ^ ((qi & 2) << 62);
+        CalcVecI cos_bits = ((odd & si) | (~odd & ci)) ^ (((qi + 1) & 2) << 62);
+        switch (fn) {
+        case CALC_FN_SIN: y[j] = (CalcVec)sin_bits; break;
+        case CALC_FN_COS: y[j] = (CalcVec)cos_bits; break;
+        case CALC_FN_TAN: y[j] = (CalcVec)sin_bits / (CalcVec)cos_bits; break;
+        case CALC_FN_SEC: y[j] = 1.0 / (CalcVec)cos_bits; break;
+        case CALC_FN_CSC: y[j] = 1.0 / (CalcVec)sin_bits; break;
+        case CALC_FN_COT: y[j] = (CalcVec)cos_bits / (CalcVec)sin_bits; break;
+        }
+        for (int l = 0; l < CALC_LANES; l++) {
+            if (!(fabs(x[j][l]) <= CALC_VTRIG_MAX)) y[j][l] = calc_functions[fn].f1(x[j][l]);
+        }
+    }
+}
+
+// ys[i] = f(xs[i]) para um programa de uma variavel (ou constante)
+static inline __attribute__((always_inline)) void calc_run_batch_body(const CalcProgram *p, const double *xs,
+                                                                      double *ys, int n) {
+    CalcVec r[p->nregs][CALC_BATCH_VECS];
+    for (int c = 0; c < p->nconst; c++) {
+        for (int j = 0; j < CALC_BATCH_VECS; j++) r[c][j] = p->consts[c] + (CalcVec){0};
+    }
+    for (int base = 0; base < n; base += CALC_BATCH) {
+        int m = n - base < CALC_BATCH ? n - base : CALC_BATCH;
+        if (p->nvars > 0) {
+            // o fim do ultimo bloco e completado com o primeiro ponto
+            for (int k = 0; k < CALC_BATCH; k++) r[p->nconst][k / CALC_LANES][k % CALC_LANES] = xs[base + (k < m ? k : 0)];
+        }
+        for (const CalcInsn *i = p->code, *end = p->code + p->len; i < end; i++) {
+            CalcVec *d = r[i->dst];
+            const CalcVec *a = r[i->a], *b = r[i->b];
+            switch (i->op) {
+            case CALC_OP_ADD: for (int j = 0; j < CALC_BATCH_VECS; j++) d[j] = a[j] + b[j]; break;
+            case CALC_OP_SUB: for (int j = 0; j < CALC_BATCH_VECS; j++) d[j] = a[j] - b[j]; break;
+            case CALC_OP_MUL: for (int j = 0; j < CALC_BATCH_VECS; j++) d[j] = a[j] * b[j]; break;
+            case CALC_OP_DIV: for (int j = 0; j < CALC_BATCH_VECS; j++) d[j] = a[j] / b[j]; break;
+            case CALC_OP_NEG: for (int j = 0; j < CALC_BATCH_VECS; j++) d[j] = -a[j]; break;
+            case CALC_OP_POWI: {
+                // mesma sequencia de multiplicacoes de calc_powi
+                unsigned e0 = i->imm < 0 ? -(unsigned)i->imm : (unsigned)i->imm;
+                for (int j = 0; j < CALC_BATCH_VECS; j++) {
+                    CalcVec x = a[j], acc = 1.0 + (CalcVec){0};
+                    for (unsigned e = e0; e; e >>= 1) {
+                        if (e & 1) acc *= x;
+                        x *= x;
+                    }
+                    d[j] = i->imm < 0 ? 1.0 / acc : acc;
+                }
+                break;
+            }
+            case CALC_OP_POW:
+                for (int j = 0; j < CALC_BATCH_VECS; j++) {
+                    for (int l = 0; l < CALC_LANES; l++) d[j][l] = pow(a[j][l], b[j][l]);
+                }
+                break;
+            case CALC_OP_CALL1:
+                if (i->imm <= CALC_FN_COT) {
+                    CalcVec tmp[CALC_BATCH_VECS];
+                    calc_vtrig(a, tmp, i->imm);
+                    memcpy(d, tmp, sizeof(tmp));
+                    break;
+                }
+                for (int j = 0; j < CALC_BATCH_VECS; j++) {
+                    for (int l = 0; l < CALC_LANES; l++) d[j][l] = calc_functions[i->imm].f1(a[j][l]);
+                }
+                break;
+            case CALC_OP_CALL2:
+                for (int j = 0; j < CALC_BATCH_VECS; j++) {
+                    for (int l = 0; l < CALC_LANES; l++) d[j][l] = calc_functions[i->imm].f2(a[j][l], b[j][l]);
+                }
+                break;
+            }
+        }
+        for (int k = 0; k < m; k++) ys[base + k] = r[p->result][k / CALC_LANES][k % CALC_LANES];
+    }
+}
+
+typedef void (*CalcBatchFunc)(const CalcProgram *p, const double *xs, double *ys, int n);
+
+static void calc_run_batch_generic(const CalcProgram *p, const double *xs, double *ys, int n) {
+    calc_run_batch_body(p, xs, ys, n);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2,fma")))
+static void calc_run_batch_avx2(const CalcProgram *p, const double *xs, double *ys, int n) {
+    calc_run_batch_body(p, xs, ys, n);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+static void calc_run_batch_avx512(const CalcProgram *p, const double *xs, double *ys, int n) {
+    calc_run_batch_body(p, xs, ys, n);
+}
+#endif
+
+// Nucleo da multiplicacao de matrizes: C[0:mc, 0:nc] += A * B com A e B
+// ja empacotados (veja calc_mat_mul). A vem em paineis de CALC_GEMM_MR linhas
+// ([k][linha] dentro do painel) e B em paineis de CALC_GEMM_NR colunas
+// ([k][coluna]). Cada microbloco MR x NR fica em MR vetores acumuladores
+// durante todo o kc, e o painel de B (kc x NR) cabe na L1.
+#define CALC_GEMM_MR 8
+#define CALC_GEMM_NR CALC_LANES
+
+static inline __attribute__((always_inline)) void calc_gemm_block_body(int mc, int nc, int kc, const double *apack,
+                                                                       const double *bpack, double *c, long ldc) {
+    for (int jr = 0; jr < nc; jr += CALC_GEMM_NR) {
+        const double *bp = bpack + (long)jr * kc;
+        int nr = nc - jr < CALC_GEMM_NR ? nc - jr : CALC_GEMM_NR;
+        for (int ir = 0; ir < mc; ir += CALC_GEMM_MR) {
+            const double *ap = apack + (long)ir * kc;
+            int mr = mc - ir < CALC_GEMM_MR ? mc - ir : CALC_GEMM_MR;
+            CalcVec acc[CALC_GEMM_MR] = {0};
+            for (int k = 0; k < kc; k++) {
+                CalcVec b = *(const CalcVec *)(bp + (long)k * CALC_GEMM_NR);
+                // desenrolado: os acumuladores precisam ficar em registradores
+#pragma GCC unroll 8
+                for (int r = 0; r < CALC_GEMM_MR; r++) acc[r] += ap[k * CALC_GEMM_MR + r] * b;
+            }
+            double *cp = c + ir * ldc + jr;
+            if (mr == CALC_GEMM_MR && nr == CALC_GEMM_NR) {
+#pragma GCC unroll 8
+                for (int r = 0; r < CALC_GEMM_MR; r++) {
+                    CalcVec row;
+                    memcpy(&row, cp + r * ldc, sizeof(row));
+                    row += acc[r];
+                    memcpy(cp + r * ldc, &row, sizeof(row));
+                }
+            } else {
+                // borda: o empacotamento completou com zeros, so a parte valida e escrita
+                for (int r = 0; r < mr; r++) {
+                    for (int l = 0; l < nr; l++) cp[r * ldc + l] += acc[r][l];
+                }
+            }
+        }
+    }
+}
+
+typedef void (*CalcGemmFunc)(int mc, int nc, int kc, const double *apack, const double *bpack, double *c, long ldc);
+
+static void calc_gemm_block_generic(int mc, int nc, int kc, const double *apack, const double *bpack, double *c, long ldc) {
+    calc_gemm_block_body(mc, nc, kc, apack, bpack, c, ldc);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2,fma")))
+static void calc_gemm_block_avx2(int mc, int nc, int kc, const double *apack, const double *bpack, double *c, long ldc) {
+    calc_gemm_block_body(mc, nc, kc, apack, bpack, c, ldc);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+static void calc_gemm_block_avx512(int mc, int nc, int kc, const double *apack, const double *bpack, double *c, long ldc) {
+    calc_gemm_block_body(mc, nc, kc, apack, bpack, c, ldc);
+}
+#endif
+
+static CalcBatchFunc calc_run_batch = calc_run_batch_generic;
+static CalcGemmFunc calc_gemm_block = calc_gemm_block_generic;
+static const char *calc_batch_isa = "base";
+
+static int calc_batch_init(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        calc_run_batch = calc_run_batch_avx512;
+        calc_gemm_block = calc_gemm_block_avx512;
+        calc_batch_isa = "AVX-512";
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        calc_run_batch = calc_run_batch_avx2;
+        calc_gemm_block = calc_gemm_block_avx2;
+        calc_batch_isa = "AVX2";
+    } else {
+        calc_batch_isa = "SSE2";
+    }
+#endif
+    return 0;
+}
+
+static int calc_term_cmp(const void *a, const void *b) {
+    const Term *x = a, *y = b;
+    return (y->exp > x->exp) - (y->exp < x->exp);
+}
+
+// A forma antiga (pares coeficiente/expoente e coeficiente/tipo) vira uma
+// arvore: o polinomio no esquema de Horner, ((c3*x + c2)*x^2 + c0)*x^emin,
+// com os termos de mesmo expoente somados, mais um termo por funcao.
+static CalcProgram *calc_compile_terms(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig,
+                                       char *err, size_t err_size) {
+    CalcTree t = {0};
+    int x = calc_var(&t, "x");
+    Term sorted[MAX_TERMS];
+    int count = 0;
+    memcpy(sorted, terms, num_terms * sizeof(Term));
+    qsort(sorted, num_terms, sizeof(Term), calc_term_cmp);
+    for (int i = 0; i < num_terms; i++) {
+        if (count > 0 && sorted[count - 1].exp == sorted[i].exp) sorted[count - 1].coef += sorted[i].coef;
+        else sorted[count++] = sorted[i];
+    }
+    int sum = -1, last_exp = 0;
+    for (int i = 0; i < count; i++) {
+        if (sorted[i].coef == 0.0) continue;
+        int coef = calc_node(&t, CALC_NUM, -1, -1, -1, sorted[i].coef);
+        if (sum >= 0) {
+            int gap = last_exp - sorted[i].exp;
+            int power = gap == 1 ? x : calc_node(&t, CALC_POW, x, calc_node(&t, CALC_NUM, -1, -1, -1, gap), -1, 0);
+            sum = calc_node(&t, CALC_ADD, calc_node(&t, CALC_MUL, sum, power, -1, 0), coef, -1, 0);
+        } else {
+            sum = coef;
+        }
+        last_exp = sorted[i].exp;
+    }
+    if (sum >= 0 && last_exp != 0) {
+        int power = last_exp == 1 ? x : calc_node(&t, CALC_POW, x, calc_node(&t, CALC_NUM, -1, -1, -1, last_exp), -1, 0);
+        sum = calc_node(&t, CALC_MUL, sum, power, -1, 0);
+    }
+    for (int i = 0; i < num_trig; i++) {
+        int fn = calc_find_function(trig_terms[i].type);
+        if (fn < 0 || calc_functions[fn].arity != 1) {
+            snprintf(err, err_size, "tipo desconhecido: '%s' (use sin, cos, tan...)", trig_terms[i].type);
+            calc_tree_free(&t);
+            return NULL;
+        }
+        int call = calc_node(&t, CALC_CALL1, x, -1, fn, 0);
+        int term = calc_node(&t, CALC_MUL, calc_node(&t, CALC_NUM, -1, -1, -1, trig_terms[i].coef), call, -1, 0);
+        sum = sum < 0 ? term : calc_node(&t, CALC_ADD, sum, term, -1, 0);
+    }
+    if (sum < 0 && !t.error) sum = calc_node(&t, CALC_NUM, -1, -1, -1, 0.0);
+    CalcProgram *p = sum < 0 ? NULL : calc_compile_tree(&t, sum, err, err_size);
+    if (sum < 0) snprintf(err, err_size, "%s", t.error ? t.error : "expressão inválida");
+    calc_tree_free(&t);
+    return p;
+}
+
+// A forma antiga como soma de termos (c*x^e e c*f(x)), montada com calc_op
+// para sair simplificada; e o que deriv_poly e deriv_trig derivam e mostram.
+// Para avaliar, calc_compile_terms (Horner) e melhor.
+static int calc_terms_expr(CalcTree *t, Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig,
+                           char *err, size_t err_size) {
+    int x = calc_var(t, "x");
+    int sum = calc_num(t, 0);
     for (int i = 0; i < num_terms; i++) {
-        if (terms[i].exp > 0) {
-            result[result_idx].coef = terms[i].coef * terms[i].exp;
-            result[result_idx].exp = terms[i].exp - 1;
-            result_idx++;
+        int power = calc_op(t, CALC_POW, x, calc_num(t, terms[i].exp));
+        sum = calc_op(t, CALC_ADD, sum, calc_op(t, CALC_MUL, calc_num(t, terms[i].coef), power));
+    }
+    for (int i = 0; i < num_trig; i++) {
+        int fn = calc_find_function(trig_terms[i].type);
+        if (fn < 0 || calc_functions[fn].arity != 1) {
+            snprintf(err, err_size, "tipo desconhecido: '%s' (use sin, cos, tan...)", trig_terms[i].type);
+            return -1;
+        }
+        int call = calc_node(t, CALC_CALL1, x, -1, fn, 0);
+        sum = calc_op(t, CALC_ADD, sum, calc_op(t, CALC_MUL, calc_num(t, trig_terms[i].coef), call));
+    }
+    if (sum < 0) snprintf(err, err_size, "%s", t->error ? t->error : "expressão inválida");
+    return sum;
+}
+
+// --- Limites ---
+//
+// Cada lado e a sequencia f(a -+ h) com h = h0, h0/2, h0/4... Ela passa por
+// dois extrapoladores: Richardson, que elimina os termos c1*h, c2*h^2... da
+// expansao de f perto de a (sin(x)/x em 0 fecha com poucos pontos), e o
+// epsilon de Wynn, que acelera sequencias de convergencia geometrica mesmo
+// com potencias fracionarias (sqrt(x) em 0). Vale a estimativa com o menor
+// erro, e a sequencia para quando o erro fica abaixo da tolerancia ou volta
+// a crescer (h pequeno demais, so arredondamento). Sem convergencia, uma
+// sequencia monotona conta como divergencia e o resto como oscilacao.
+// Limites em +-inf usam x = +-1/h.
+#define CALC_LIMIT_STEPS 24
+#define CALC_LIMIT_H0 0.5
+#define CALC_LIMIT_TOL 1e-13
+#define CALC_LIMIT_LOOSE 1e-6
+#define CALC_LIMIT_BATCH 4
+
+typedef enum {
+    CALC_LIMIT_FINITE, CALC_LIMIT_PLUS_INF, CALC_LIMIT_MINUS_INF, CALC_LIMIT_UNDEFINED, CALC_LIMIT_OSCILLATES
+} CalcLimitKind;
+
+typedef struct {
+    CalcLimitKind kind;
+    double value;
+    double error;
+} CalcLimitSide;
+
+// Melhor estimativa do epsilon de Wynn para s[0..n): as colunas pares da
+// tabela sao as estimativas, e o erro e a diferenca para a anterior.
+static double calc_wynn(const double *s, int n, double *error) {
+    double prev[CALC_LIMIT_STEPS] = {0}, cur[CALC_LIMIT_STEPS], next[CALC_LIMIT_STEPS];
+    double best = s[n - 1];
+    *error = n > 1 ? fabs(s[n - 1] - s[n - 2]) : INFINITY;
+    double last_est = s[n - 1];
+    memcpy(cur, s, n * sizeof(double));
+    for (int j = 1; j < n; j++) {
+        for (int k = 0; k < n - j; k++) {
+            double d = cur[k + 1] - cur[k];
+            if (d == 0) return best; // a coluna ja convergiu exatamente
+            next[k] = prev[k + 1] + 1.0 / d;
+        }
+        if (j % 2 == 0 && n - j >= 2) {
+            // o erro compara com o vizinho na coluna e com a coluna par
+            // anterior: so um dos dois subestima quando ha ruido de cancelamento
+            double est = next[n - j - 1];
+            double err = fmax(fabs(est - next[n - j - 2]), fabs(est - last_est));
+            if (isfinite(est) && err < *error) {
+                best = est;
+                *error = err;
+            }
+            last_est = est;
+        }
+        memcpy(prev, cur, (n - j + 1) * sizeof(double));
+        memcpy(cur, next, (n - j) * sizeof(double));
+    }
+    return best;
+}
+
+// Limite de um lado: dir = -1 (esquerda) ou +1 (direita); em a = +-inf so
+// existe o lado de dentro
+static CalcLimitSide calc_limit_side(const CalcProgram *f, double a, double dir, long *evals) {
+    double s[CALC_LIMIT_STEPS], rich[CALC_LIMIT_STEPS][CALC_LIMIT_STEPS];
+    double h0 = isinf(a) ? CALC_LIMIT_H0 : CALC_LIMIT_H0 * fmax(1.0, fabs(a));
+    double best = NAN, best_error = INFINITY, last_diag_error = INFINITY, last_bad = NAN;
+    int n = 0;       // pontos validos da sequencia atual
+    int step = 0;    // pontos ja avaliados
+    bool done = false;
+    while (!done && step < CALC_LIMIT_STEPS) {
+        double x[CALC_LIMIT_BATCH], y[CALC_LIMIT_BATCH];
+        int m = CALC_LIMIT_STEPS - step < CALC_LIMIT_BATCH ? CALC_LIMIT_STEPS - step : CALC_LIMIT_BATCH;
+        for (int i = 0; i < m; i++) {
+            double h = ldexp(h0, -(step + i));
+            x[i] = isinf(a) ? copysign(1.0 / h, a) : a + dir * h;
+        }
+        calc_run_batch(f, x, y, m);
+        *evals += m;
+        for (int i = 0; i < m && !done; i++, step++) {
+            if (!isfinite(y[i])) {
+                // fora do dominio ou em cima de uma singularidade (log(x) em
+                // 0.05 pela esquerda com h grande): recomeca com h menor
+                last_bad = y[i];
+                n = 0;
+                best = NAN;
+                best_error = last_diag_error = INFINITY;
+                continue;
+            }
+            s[n] = y[i];
+            // linha n da tabela de Richardson; com h caindo pela metade,
+            // a coluna j cancela o termo em h^j
+            rich[n][0] = y[i];
+            double row = NAN, row_error = INFINITY;
+            for (int j = 1; j <= n; j++) {
+                double scale = ldexp(1.0, j) - 1.0;
+                rich[n][j] = rich[n][j - 1] + (rich[n][j - 1] - rich[n - 1][j - 1]) / scale;
+                double err = fmax(fabs(rich[n][j] - rich[n][j - 1]), fabs(rich[n][j] - rich[n - 1][j - 1]));
+                if (err <= row_error) {
+                    row_error = err;
+                    row = rich[n][j];
+                }
+            }
+            // Wynn so para sequencias que estao convergindo: numa divergente
+            // geometrica (1/x em 0) ele acharia o "antilimite" 0
+            if (n >= 2 && fabs(s[n] - s[n - 1]) < fabs(s[n - 1] - s[n - 2])) {
+                double wynn_error, wynn = calc_wynn(s, n + 1, &wynn_error);
+                if (wynn_error < row_error) {
+                    row_error = wynn_error;
+                    row = wynn;
+                }
+            }
+            if (n > 0) {
+                // quando a diagonal volta a crescer o ruido de arredondamento
+                // ja domina: essa linha nao entra e a sequencia para
+                double diag_error = fabs(rich[n][n] - rich[n - 1][n - 1]);
+                if (n >= 4 && diag_error > 2.0 * last_diag_error && diag_error > 2.0 * best_error) {
+                    done = true;
+                    break;
+                }
+                last_diag_error = diag_error;
+            }
+            if (row_error <= best_error) {
+                best_error = row_error;
+                best = row;
+            }
+            done = best_error <= CALC_LIMIT_TOL * fmax(1.0, fabs(best));
+            n++;
+        }
+    }
+    if (n == 0) {
+        // so pontos invalidos ate o fim: overflow (exp(x) em +inf) ou fora do dominio
+        if (isinf(last_bad)) return (CalcLimitSide){ last_bad > 0 ? CALC_LIMIT_PLUS_INF : CALC_LIMIT_MINUS_INF, last_bad, 0 };
+        return (CalcLimitSide){ CALC_LIMIT_UNDEFINED, NAN, NAN };
+    }
+    if (best_error <= CALC_LIMIT_LOOSE * fmax(1.0, fabs(best))) {
+        // um valor menor que o proprio erro e zero
+        return (CalcLimitSide){ CALC_LIMIT_FINITE, fabs(best) <= best_error ? 0.0 : best, best_error };
+    }
+    // sem convergencia: monotona nos ultimos pontos e divergente, senao oscila
+    bool up = true, down = true;
+    for (int k = n - 6 < 1 ? 1 : n - 6; k < n; k++) {
+        up = up && s[k] > s[k - 1];
+        down = down && s[k] < s[k - 1];
+    }
+    if (up || down) return (CalcLimitSide){ up ? CALC_LIMIT_PLUS_INF : CALC_LIMIT_MINUS_INF, up ? INFINITY : -INFINITY, 0 };
+    return (CalcLimitSide){ CALC_LIMIT_OSCILLATES, best, best_error };
+}
+
+// --- Threads ---
+//
+// Um pool por comando (-j N): calc_pool_run(pool, n, fn, ctx) chama
+// fn(ctx, i) para cada i em [0, n), repartindo os indices entre as threads e
+// a propria thread chamadora, e so volta quando todos terminaram. Quem chama
+// decide a divisao do trabalho, e cada tarefa escreve so na sua posicao,
+// entao o resultado nao depende do numero de threads.
+#define CALC_MAX_THREADS 64
+
+typedef void (*CalcTaskFunc)(void *ctx, int index);
+
+typedef struct {
+    pthread_t threads[CALC_MAX_THREADS];
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    CalcTaskFunc fn;
+    void *ctx;
+    int count;       // tarefas da rodada
+    int next;        // proxima tarefa livre
+    int finished;
+    unsigned round;
+    bool stopping;
+} CalcPool;
+
+// Pega tarefas da rodada ate acabarem. Chamado com o lock.
+static void calc_pool_drain(CalcPool *pool) {
+    while (pool->next < pool->count) {
+        int index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->ctx, index);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->count) pthread_cond_signal(&pool->done);
+    }
+}
+
+static void *calc_pool_worker(void *arg) {
+    CalcPool *pool = arg;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->round == seen && !pool->stopping) pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->stopping) break;
+        seen = pool->round;
+        calc_pool_drain(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Pool com threads - 1 threads extras; NULL quando threads <= 1 (ou se a
+// criacao falhar), e calc_pool_run entao roda tudo na thread atual.
+static CalcPool *calc_pool_create(int threads) {
+    if (threads <= 1) return NULL;
+    CalcPool *pool = calloc(1, sizeof(CalcPool));
+    if (!pool) return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    if (threads > CALC_MAX_THREADS) threads = CALC_MAX_THREADS;
+    while (pool->nthreads < threads - 1 &&
+           pthread_create(&pool->threads[pool->nthreads], NULL, calc_pool_worker, pool) == 0) {
+        pool->nthreads++;
+    }
+    return pool;
+}
+
+static void calc_pool_destroy(CalcPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; i++) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool);
+}
+
+static void calc_pool_run(CalcPool *pool, int count, CalcTaskFunc fn, void *ctx) {
+    if (!pool || count <= 1) {
+        for (int i = 0; i < count; i++) fn(ctx, i);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->round++;
+    pthread_cond_broadcast(&pool->work);
+    calc_pool_drain(pool);
+    while (pool->finished < pool->count) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Soma compensada de Neumaier: o erro de arredondamento de cada parcela vai
+// para c, e a soma nao perde parcelas pequenas ao lado de grandes.
+typedef struct {
+    double sum;
+    double c;
+} CalcSum;
+
+static void calc_sum_add(CalcSum *s, double x) {
+    double t = s->sum + x;
+    if (fabs(s->sum) >= fabs(x)) s->c += (s->sum - t) + x;
+    else s->c += (x - t) + s->sum;
+    s->sum = t;
+}
+
+static double calc_sum_value(const CalcSum *s) {
+    return s->sum + s->c;
+}
+
+// --- Integracao ---
+//
+// Gauss-Kronrod 7/15 adaptativo: cada intervalo e avaliado em 15 pontos; a
+// regra de Gauss de 7 pontos usa um subconjunto deles e a diferenca entre as
+// duas estima o erro. O intervalo com o maior erro (topo de um heap) e
+// dividido ao meio ate o erro total ficar abaixo da tolerancia. Funcoes
+// suaves fecham com 15 ou 45 avaliacoes; limites infinitos viram um
+// intervalo finito por troca de variavel.
+//
+// Cada rodada divide ate CALC_INTEG_WAVE intervalos de uma vez (o pior e os
+// que sozinhos passam da sua fatia da tolerancia), e as 2 * W regras de
+// Kronrod da rodada rodam no pool. A escolha dos intervalos nao depende do
+// numero de threads, entao -j 1 e -j 8 dao exatamente o mesmo resultado.
+#define CALC_INTEG_TOL 1e-10
+#define CALC_INTEG_MAX_INTERVALS 5000
+#define CALC_GK_POINTS 15
+#define CALC_INTEG_WAVE 16
+
+// Nos de Kronrod em [0, 1] (os de indice impar sao os de Gauss) e pesos
+static const double calc_gk_nodes[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000,
+};
+static const double calc_gk_weights[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+static const double calc_gauss_weights[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+typedef enum { CALC_RANGE_FINITE, CALC_RANGE_UPPER_INF, CALC_RANGE_LOWER_INF, CALC_RANGE_BOTH_INF } CalcRange;
+
+typedef struct {
+    const CalcProgram *f;
+    CalcRange range;
+    double a, b;
+} CalcIntegrand;
+
+typedef struct {
+    double a, b;
+    double value;
+    double error;
+} CalcInterval;
+
+typedef struct {
+    double value;
+    double error;
+    long evals;
+    int intervals;
+    bool converged;
+} CalcQuadResult;
+
+// f nos pontos t do intervalo de integracao ja transformado:
+// [a, inf) usa x = a + t/(1-t), (-inf, b] usa x = b - t/(1-t), ambos com
+// t em [0, 1); (-inf, inf) usa x = t/(1-t^2) com t em (-1, 1).
+static void calc_integrand(const CalcIntegrand *g, const double *t, double *y, int n) {
+    double x[CALC_GK_POINTS], jac[CALC_GK_POINTS];
+    for (int k = 0; k < n; k++) {
+        double u = g->range == CALC_RANGE_BOTH_INF ? 1.0 - t[k] * t[k] : 1.0 - t[k];
+        switch (g->range) {
+        case CALC_RANGE_UPPER_INF: x[k] = g->a + t[k] / u; jac[k] = 1.0 / (u * u); break;
+        case CALC_RANGE_LOWER_INF: x[k] = g->b - t[k] / u; jac[k] = 1.0 / (u * u); break;
+        case CALC_RANGE_BOTH_INF: x[k] = t[k] / u; jac[k] = (1.0 + t[k] * t[k]) / (u * u); break;
+        default: x[k] = t[k]; jac[k] = 1.0; break;
+        }
+    }
+    calc_run_batch(g->f, x, y, n);
+    for (int k = 0; k < n; k++) y[k] *= jac[k];
+}
+
+static CalcInterval calc_gk15(const CalcIntegrand *g, double a, double b) {
+    double c = 0.5 * (a + b);
+    double h = 0.5 * (b - a);
+    double t[CALC_GK_POINTS], f[CALC_GK_POINTS];
+    t[0] = c;
+    for (int j = 0; j < 7; j++) {
+        t[1 + 2 * j] = c - h * calc_gk_nodes[j];
+        t[2 + 2 * j] = c + h * calc_gk_nodes[j];
+    }
+    calc_integrand(g, t, f, CALC_GK_POINTS);
+    double kronrod = f[0] * calc_gk_weights[7];
+    double gauss = f[0] * calc_gauss_weights[3];
+    for (int j = 0; j < 7; j++) {
+        double pair = f[1 + 2 * j] + f[2 + 2 * j];
+        kronrod += calc_gk_weights[j] * pair;
+        if (j & 1) gauss += calc_gauss_weights[j / 2] * pair;
+    }
+    return (CalcInterval){ a, b, kronrod * h, fabs((kronrod - gauss) * h) };
+}
+
+// Heap de maximo pelo erro estimado.
+static void calc_interval_push(CalcInterval *heap, int *count, CalcInterval iv) {
+    int i = (*count)++;
+    while (i > 0 && heap[(i - 1) / 2].error < iv.error) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = iv;
+}
+
+static CalcInterval calc_interval_pop(CalcInterval *heap, int *count) {
+    CalcInterval top = heap[0];
+    CalcInterval last = heap[--(*count)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *count) break;
+        if (child + 1 < *count && heap[child + 1].error > heap[child].error) child++;
+        if (heap[child].error <= last.error) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*count > 0) heap[i] = last;
+    return top;
+}
+
+typedef struct {
+    const CalcIntegrand *g;
+    CalcInterval *iv;    // a e b preenchidos; a tarefa calcula o resto
+} CalcGkWave;
+
+static void calc_gk_task(void *ctx, int index) {
+    CalcGkWave *wave = ctx;
+    wave->iv[index] = calc_gk15(wave->g, wave->iv[index].a, wave->iv[index].b);
+}
+
+// Integral de f em [a, b] (a e b podem ser +-inf) com erro estimado
+// <= max(tol, tol * |integral|), ou o melhor resultado possivel.
+static CalcQuadResult integrate_adaptive(const CalcProgram *f, double a, double b, double tol, CalcPool *pool) {
+    CalcQuadResult res = { 0 };
+    if (a == b) {
+        res.converged = true;
+        return res;
+    }
+    double sign = 1.0;
+    if (a > b) {
+        double t = a;
+        a = b;
+        b = t;
+        sign = -1.0;
+    }
+    CalcIntegrand g = { f, CALC_RANGE_FINITE, a, b };
+    double lo = a, hi = b;
+    if (isinf(a) && isinf(b)) {
+        g.range = CALC_RANGE_BOTH_INF;
+        lo = -1.0;
+        hi = 1.0;
+    } else if (isinf(b)) {
+        g.range = CALC_RANGE_UPPER_INF;
+        lo = 0.0;
+        hi = 1.0;
+    } else if (isinf(a)) {
+        g.range = CALC_RANGE_LOWER_INF;
+        lo = 0.0;
+        hi = 1.0;
+    }
+
+    CalcInterval *heap = malloc(CALC_INTEG_MAX_INTERVALS * sizeof(CalcInterval));
+    if (!heap) {
+        res.value = NAN;
+        return res;
+    }
+    int count = 0;
+    CalcInterval first = calc_gk15(&g, lo, hi);
+    calc_interval_push(heap, &count, first);
+    res.evals = CALC_GK_POINTS;
+    double value = first.value, error = first.error;
+    bool stuck = false;
+    while (!stuck && isfinite(value) && error > fmax(tol, tol * fabs(value)) &&
+           count + CALC_INTEG_WAVE < CALC_INTEG_MAX_INTERVALS) {
+        CalcInterval parts[2 * CALC_INTEG_WAVE];
+        double budget = fmax(tol, tol * fabs(value)) / CALC_INTEG_WAVE;
+        int w = 0;
+        while (w < CALC_INTEG_WAVE && count > 0 && (w == 0 || heap[0].error > budget)) {
+            CalcInterval worst = calc_interval_pop(heap, &count);
+            double mid = 0.5 * (worst.a + worst.b);
+            if (mid <= worst.a || mid >= worst.b) {
+                // intervalo no limite da precisao: nao da para dividir mais
+                calc_interval_push(heap, &count, worst);
+                stuck = true;
+                break;
+            }
+            value -= worst.value;
+            error -= worst.error;
+            parts[2 * w] = (CalcInterval){ worst.a, mid, 0, 0 };
+            parts[2 * w + 1] = (CalcInterval){ mid, worst.b, 0, 0 };
+            w++;
+        }
+        CalcGkWave wave = { &g, parts };
+        calc_pool_run(pool, 2 * w, calc_gk_task, &wave);
+        for (int i = 0; i < 2 * w; i++) {
+            calc_interval_push(heap, &count, parts[i]);
+            value += parts[i].value;
+            error += parts[i].error;
+        }
+        res.evals += 2 * w * CALC_GK_POINTS;
+    }
+    // soma final refeita do zero, compensada: a soma corrida acumula
+    // arredondamento a cada rodada
+    CalcSum total = { 0 }, total_error = { 0 };
+    for (int i = 0; i < count; i++) {
+        calc_sum_add(&total, heap[i].value);
+        calc_sum_add(&total_error, heap[i].error);
+    }
+    free(heap);
+    value = calc_sum_value(&total);
+    error = calc_sum_value(&total_error);
+    res.value = sign * value;
+    res.error = error;
+    res.intervals = count;
+    res.converged = isfinite(value) && error <= fmax(tol, tol * fabs(value));
+    return res;
+}
+
+static bool calc_is_number(const char *s) {
+    char *end;
+    strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+// Junta argv[from..argc) com espacos: 'calc integ 0 1 x^2 + 1' sem aspas.
+// Falso quando o texto nao coube em buf (cortado).
+static bool calc_join_args(int argc, char **argv, int from, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = from; i < argc && len < size; i++) {
+        len += snprintf(buf + len, size - len, "%s%s", i > from ? " " : "", argv[i]);
+    }
+    return len < size;
+}
+
+static bool calc_is_integer(const char *s) {
+    char *end;
+    strtol(s, &end, 10);
+    return end != s && *end == '\0';
+}
+
+static bool calc_is_name(const char *s) {
+    if (!isalpha((unsigned char)*s)) return false;
+    while (isalnum((unsigned char)*s) || *s == '_') s++;
+    return *s == '\0';
+}
+
+// Le a forma antiga (<coef> <exp> ... / <coef> <tipo> ...) de argv[from..].
+// So e a forma antiga quando todos os argumentos formam esses pares (numero
+// e expoente inteiro; depois da '/', numero e nome de funcao): 'integ 0 1 1
+// + x^2' e uma expressao, nao o par (1, +). Devolve 1 com os termos lidos, 0
+// se os argumentos sao uma expressao e -1 (com err) se ha termos demais.
+static int calc_parse_terms(int argc, char **argv, int from, Term *terms, int *num_terms_out,
+                            TrigTerm *trig_terms, int *num_trig_out, char *err, size_t err_size) {
+    int slash = argc;
+    for (int i = from; i < argc; i++) {
+        if (strcmp(argv[i], "/") == 0) {
+            if (slash < argc) return 0;
+            slash = i;
+        }
+    }
+    int polys = (slash - from) / 2, trigs = slash < argc ? (argc - slash - 1) / 2 : 0;
+    if ((slash - from) % 2 != 0 || (slash < argc && (argc - slash - 1) % 2 != 0) || polys + trigs == 0) return 0;
+    for (int i = from; i < slash; i += 2) {
+        if (!calc_is_number(argv[i]) || !calc_is_integer(argv[i + 1])) return 0;
+    }
+    for (int i = slash + 1; i < argc; i += 2) {
+        if (!calc_is_number(argv[i]) || !calc_is_name(argv[i + 1])) return 0;
+    }
+    if (polys > MAX_TERMS || trigs > MAX_TERMS) {
+        snprintf(err, err_size, "a forma antiga aceita até %d termos de cada tipo; use uma expressão", MAX_TERMS);
+        return -1;
+    }
+    for (int k = 0; k < polys; k++) {
+        terms[k].coef = atof(argv[from + 2 * k]);
+        terms[k].exp = atoi(argv[from + 2 * k + 1]);
+    }
+    for (int k = 0; k < trigs; k++) {
+        trig_terms[k].coef = atof(argv[slash + 1 + 2 * k]);
+        snprintf(trig_terms[k].type, sizeof(trig_terms[k].type), "%s", argv[slash + 2 + 2 * k]);
+    }
+    *num_terms_out = polys;
+    *num_trig_out = trigs;
+    return 1;
+}
+
+// Programa da funcao de x dos comandos integ/limit: a forma antiga
+// (<coef> <exp> ... / <coef> <tipo>) ou uma expressao de uma variavel.
+static CalcProgram *calc_function_arg(int argc, char **argv, int from, char *err, size_t err_size) {
+    Term terms[MAX_TERMS] = {0};
+    TrigTerm trig_terms[MAX_TERMS] = {0};
+    int num_terms, num_trig;
+    int form = calc_parse_terms(argc, argv, from, terms, &num_terms, trig_terms, &num_trig, err, err_size);
+    if (form < 0) return NULL;
+    if (form > 0) return calc_compile_terms(terms, num_terms, trig_terms, num_trig, err, err_size);
+    char expr[1024];
+    if (!calc_join_args(argc, argv, from, expr, sizeof(expr))) {
+        snprintf(err, err_size, "expressão longa demais (máximo %zu caracteres)", sizeof(expr) - 1);
+        return NULL;
+    }
+    CalcProgram *p = calc_compile(expr, err, err_size);
+    if (p && p->nvars > 1) {
+        snprintf(err, err_size, "a função deve ter uma só variável (tem %s e %s)", p->vars[0], p->vars[1]);
+        calc_program_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+// Tira "--opcao valor" de argv (a partir de from) e devolve o valor, ou NULL
+static const char *calc_take_option(int *argc, char **argv, int from, const char *name) {
+    for (int i = from; i + 1 < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char *value = argv[i + 1];
+            memmove(argv + i, argv + i + 2, (*argc - i - 2) * sizeof(char *));
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// Tira "-j N" de argv; 1 quando nao ha, -1 quando N e invalido
+static int calc_take_threads(int *argc, char **argv, int from) {
+    const char *value = calc_take_option(argc, argv, from, "-j");
+    if (!value) return 1;
+    int threads = atoi(value);
+    return threads >= 1 && threads <= CALC_MAX_THREADS ? threads : -1;
+}
+
+#define CALC_TABLE_MAX_POINTS 10000000
+#define CALC_TABLE_CHUNK 4096
+#define CALC_TABLE_WAVE 64
+
+// Uma leva de CALC_TABLE_WAVE blocos da tabela; cada tarefa calcula um bloco
+typedef struct {
+    const CalcProgram *f;
+    double a, step;
+    long first;      // indice do primeiro ponto da leva
+    long total;
+    double *x, *y;
+} CalcTableWave;
+
+static void calc_table_task(void *ctx, int index) {
+    CalcTableWave *wave = ctx;
+    long start = wave->first + (long)index * CALC_TABLE_CHUNK;
+    if (start >= wave->total) return;
+    int n = wave->total - start < CALC_TABLE_CHUNK ? (int)(wave->total - start) : CALC_TABLE_CHUNK;
+    double *x = wave->x + (long)index * CALC_TABLE_CHUNK, *y = wave->y + (long)index * CALC_TABLE_CHUNK;
+    // a + i*passo em vez de somar o passo: sem erro acumulado
+    for (int k = 0; k < n; k++) x[k] = wave->a + (double)(start + k) * wave->step;
+    calc_run_batch(wave->f, x, y, n);
+}
+
+// calc table <a> <b> <passo> <func> [-j N]: f em a, a+passo, ..., ate b
+static int calc_table_command(FILE *out, int argc, char **argv) {
+    int threads = calc_take_threads(&argc, argv, 5);
+    double a = atof(argv[2]), b = atof(argv[3]), step = atof(argv[4]);
+    double span = (b - a) / step;
+    if (argc < 6 || threads < 0 || !(step > 0) || !(span >= 0) || span > CALC_TABLE_MAX_POINTS) {
+        fprintf(out, "Uso: calc table <a> <b> <passo> <func> [-j N] (passo > 0, a <= b, até %d pontos)\n",
+                CALC_TABLE_MAX_POINTS);
+        return 2;
+    }
+    char err[128];
+    CalcProgram *f = calc_function_arg(argc, argv, 5, err, sizeof(err));
+    if (!f) {
+        fprintf(out, "Erro na função: %s\n", err);
+        return 2;
+    }
+    CalcTableWave wave = { f, a, step, 0, (long)floor(span + 1e-9) + 1, NULL, NULL };
+    long wave_points = (long)CALC_TABLE_WAVE * CALC_TABLE_CHUNK;
+    long buffer = wave.total < wave_points ? wave.total : wave_points;
+    wave.x = malloc(buffer * sizeof(double));
+    wave.y = malloc(buffer * sizeof(double));
+    if (!wave.x || !wave.y) {
+        free(wave.x);
+        free(wave.y);
+        calc_program_free(f);
+        fprintf(out, "Erro: sem memória para a tabela.\n");
+        return 1;
+    }
+    CalcPool *pool = calc_pool_create(threads);
+    for (; wave.first < wave.total; wave.first += wave_points) {
+        long n = wave.total - wave.first < wave_points ? wave.total - wave.first : wave_points;
+        calc_pool_run(pool, (int)((n + CALC_TABLE_CHUNK - 1) / CALC_TABLE_CHUNK), calc_table_task, &wave);
+        for (long k = 0; k < n; k++) fprintf(out, "%.10g\t%.12g\n", wave.x[k], wave.y[k]);
+    }
+    calc_pool_destroy(pool);
+    free(wave.x);
+    free(wave.y);
+    calc_program_free(f);
+    return 0;
+}
+
+static double calc_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define CALC_BENCH_POINTS 4000000
+
+typedef struct {
+    const CalcProgram *f;
+    const double *x;
+    double *sinks;
+} CalcBenchWave;
+
+static void calc_bench_task(void *ctx, int index) {
+    CalcBenchWave *wave = ctx;
+    double y[CALC_TABLE_CHUNK];
+    calc_run_batch(wave->f, wave->x, y, CALC_TABLE_CHUNK);
+    wave->sinks[index] = y[index % CALC_TABLE_CHUNK];
+}
+
+// Maior diferenca relativa de y para ref (NaN de um lado so conta como infinita)
+static double calc_max_diff(const double *y, const double *ref, int n) {
+    double diff = 0.0;
+    for (int k = 0; k < n; k++) {
+        double scale = fabs(ref[k]) > 1.0 ? fabs(ref[k]) : 1.0;
+        double d = isnan(y[k]) != isnan(ref[k]) ? INFINITY : fabs(y[k] - ref[k]) / scale;
+        if (d > diff) diff = d;
+    }
+    return diff;
+}
+
+// calc bench <func> [--pontos N] [-j N]: avaliacoes por segundo do
+// interpretador e do JIT (um ponto por vez), do lote e, na forma antiga, de
+// eval_polynomial/eval_trig, com os pontos espalhados em [-10, 10). Com -j,
+// o lote e uma integral em [-10, 10] tambem rodam em N threads.
+static int calc_bench_command(FILE *out, int argc, char **argv) {
+    const char *points_arg = calc_take_option(&argc, argv, 2, "--pontos");
+    long points = points_arg ? atol(points_arg) : CALC_BENCH_POINTS;
+    int threads = calc_take_threads(&argc, argv, 2);
+    char err[128];
+    CalcProgram *f = argc > 2 && points > 0 && threads > 0 ? calc_function_arg(argc, argv, 2, err, sizeof(err)) : NULL;
+    if (!f) {
+        if (argc > 2 && points > 0 && threads > 0) fprintf(out, "Erro na função: %s\n", err);
+        else fprintf(out, "Uso: calc bench <func> [--pontos N] [-j N]\n");
+        return 2;
+    }
+    Term terms[MAX_TERMS] = {0};
+    TrigTerm trig_terms[MAX_TERMS] = {0};
+    int num_terms, num_trig;
+    bool old_form = calc_parse_terms(argc, argv, 2, terms, &num_terms, trig_terms, &num_trig, err, sizeof(err)) > 0;
+    double x[CALC_TABLE_CHUNK], y[CALC_TABLE_CHUNK], ys[CALC_TABLE_CHUNK], yj[CALC_TABLE_CHUNK];
+    for (int k = 0; k < CALC_TABLE_CHUNK; k++) x[k] = -10.0 + 20.0 * k / CALC_TABLE_CHUNK;
+    long rounds = (points + CALC_TABLE_CHUNK - 1) / CALC_TABLE_CHUNK;
+    double sink = 0.0;
+
+    double t0 = calc_now();
+    for (long r = 0; r < rounds; r++) {
+        for (int k = 0; k < CALC_TABLE_CHUNK; k++) ys[k] = calc_interpret(f, &x[k]);
+        sink += ys[r % CALC_TABLE_CHUNK];
+    }
+    double t_scalar = calc_now() - t0;
+
+    double t_jit = 0.0;
+    if (f->jit) {
+        t0 = calc_now();
+        for (long r = 0; r < rounds; r++) {
+            for (int k = 0; k < CALC_TABLE_CHUNK; k++) yj[k] = f->jit(&x[k]);
+            sink += yj[r % CALC_TABLE_CHUNK];
+        }
+        t_jit = calc_now() - t0;
+    }
+
+    t0 = calc_now();
+    for (long r = 0; r < rounds; r++) {
+        calc_run_batch(f, x, y, CALC_TABLE_CHUNK);
+        sink += y[r % CALC_TABLE_CHUNK];
+    }
+    double t_batch = calc_now() - t0;
+
+    double t_old = 0.0;
+    if (old_form) {
+        t0 = calc_now();
+        for (long r = 0; r < rounds; r++) {
+            for (int k = 0; k < CALC_TABLE_CHUNK; k++) {
+                yj[k] = eval_polynomial(terms, num_terms, x[k]) + eval_trig(trig_terms, num_trig, x[k]);
+            }
+            sink += yj[r % CALC_TABLE_CHUNK];
+        }
+        t_old = calc_now() - t0;
+    }
+
+    double evals = (double)rounds * CALC_TABLE_CHUNK;
+    fprintf(out, "%.0f avaliações por modo (soma de controle %g):\n", evals, sink);
+    fprintf(out, "  interpretador, um ponto por vez: %8.1f M aval/s\n", evals / t_scalar / 1e6);
+    if (f->jit) {
+        for (int k = 0; k < CALC_TABLE_CHUNK; k++) yj[k] = f->jit(&x[k]);
+        fprintf(out, "  JIT x86-64, um ponto por vez:    %8.1f M aval/s (%.1fx, diferença %.2g)\n",
+                evals / t_jit / 1e6, t_scalar / t_jit, calc_max_diff(yj, ys, CALC_TABLE_CHUNK));
+    } else {
+        fprintf(out, "  JIT: indisponível nesta arquitetura\n");
+    }
+    fprintf(out, "  lote (%s):%*s%8.1f M aval/s (%.1fx, diferença %.2g)\n", calc_batch_isa,
+            (int)(24 - strlen(calc_batch_isa)), "", evals / t_batch / 1e6, t_scalar / t_batch,
+            calc_max_diff(y, ys, CALC_TABLE_CHUNK));
+    if (old_form) {
+        for (int k = 0; k < CALC_TABLE_CHUNK; k++) {
+            yj[k] = eval_polynomial(terms, num_terms, x[k]) + eval_trig(trig_terms, num_trig, x[k]);
+        }
+        fprintf(out, "  eval_polynomial/eval_trig:       %8.1f M aval/s (%.1fx, diferença %.2g)\n",
+                evals / t_old / 1e6, t_scalar / t_old, calc_max_diff(yj, ys, CALC_TABLE_CHUNK));
+    }
+    if (threads > 1) {
+        CalcPool *pool = calc_pool_create(threads);
+        double *sinks = malloc(rounds * sizeof(double));
+        if (sinks && rounds <= INT32_MAX) {
+            CalcBenchWave wave = { f, x, sinks };
+            t0 = calc_now();
+            calc_pool_run(pool, (int)rounds, calc_bench_task, &wave);
+            double t_par = calc_now() - t0;
+            fprintf(out, "  lote em %d threads: %8.1f M aval/s (%.1fx sobre o lote)\n", threads,
+                    evals / t_par / 1e6, t_batch / t_par);
+        }
+        free(sinks);
+        t0 = calc_now();
+        CalcQuadResult serial = integrate_adaptive(f, -10.0, 10.0, CALC_INTEG_TOL, NULL);
+        double t_serial = calc_now() - t0;
+        t0 = calc_now();
+        CalcQuadResult par = integrate_adaptive(f, -10.0, 10.0, CALC_INTEG_TOL, pool);
+        double t_par = calc_now() - t0;
+        bool same = memcmp(&serial.value, &par.value, sizeof(double)) == 0;
+        fprintf(out, "  integ -10 10 (%ld avaliações): %.1f ms com 1 thread, %.1f ms com %d (%.1fx), resultados %s\n",
+                serial.evals, t_serial * 1e3, t_par * 1e3, threads, t_serial / t_par,
+                same ? "idênticos" : "DIFERENTES");
+        calc_pool_destroy(pool);
+    }
+    calc_program_free(f);
+    return 0;
+}
+
+// Atribuicoes nome=valor do fim da linha de comando
+typedef struct {
+    char names[CALC_MAX_VARS][CALC_NAME_MAX];
+    double values[CALC_MAX_VARS];
+    int count;
+} CalcBindings;
+
+// Tira as atribuicoes do fim de argv (x=2 y=-1), deixando ao menos min_argc
+static void calc_take_bindings(int *argc, char **argv, int min_argc, CalcBindings *b) {
+    b->count = 0;
+    while (*argc > min_argc && b->count < CALC_MAX_VARS) {
+        const char *arg = argv[*argc - 1];
+        const char *eq = strchr(arg, '=');
+        size_t len = eq ? (size_t)(eq - arg) : 0;
+        if (!eq || len == 0 || len >= CALC_NAME_MAX || !calc_is_number(eq + 1)) break;
+        snprintf(b->names[b->count], CALC_NAME_MAX, "%.*s", (int)len, arg);
+        b->values[b->count++] = atof(eq + 1);
+        (*argc)--;
+    }
+}
+
+// Valores das variaveis na ordem de names; devolve a primeira sem valor, ou NULL
+static const char *calc_bind(const CalcBindings *b, const char (*names)[CALC_NAME_MAX], int nvars, double *vars) {
+    for (int v = 0; v < nvars; v++) {
+        int k = b->count - 1;
+        while (k >= 0 && strcmp(b->names[k], names[v]) != 0) k--;
+        if (k < 0) return names[v];
+        vars[v] = b->values[k];
+    }
+    return NULL;
+}
+
+// calc eval <expressao> [nome=valor ...]
+static int calc_eval_command(FILE *out, int argc, char **argv) {
+    CalcBindings bindings;
+    calc_take_bindings(&argc, argv, 3, &bindings);
+    char expr[1024], err[128];
+    calc_join_args(argc, argv, 2, expr, sizeof(expr));
+    CalcProgram *p = calc_compile(expr, err, sizeof(err));
+    if (!p) {
+        fprintf(out, "Erro na expressão: %s\n", err);
+        return 2;
+    }
+    double vars[CALC_MAX_VARS];
+    const char *missing = calc_bind(&bindings, (const char (*)[CALC_NAME_MAX])p->vars, p->nvars, vars);
+    if (missing) {
+        fprintf(out, "Erro: variável '%s' sem valor (ex.: calc eval \"%s\" %s=1)\n", missing, expr, missing);
+        calc_program_free(p);
+        return 2;
+    }
+    fprintf(out, "Resultado: %.15g\n", calc_run(p, vars));
+    calc_program_free(p);
+    return 0;
+}
+
+static void calc_print_limit_side(FILE *out, const char *label, CalcLimitSide side) {
+    switch (side.kind) {
+    case CALC_LIMIT_FINITE: fprintf(out, "%s: %.12g (erro estimado %.1g)\n", label, side.value, side.error); break;
+    case CALC_LIMIT_PLUS_INF: fprintf(out, "%s: +inf\n", label); break;
+    case CALC_LIMIT_MINUS_INF: fprintf(out, "%s: -inf\n", label); break;
+    case CALC_LIMIT_UNDEFINED: fprintf(out, "%s: a função não está definida desse lado\n", label); break;
+    case CALC_LIMIT_OSCILLATES: fprintf(out, "%s: não existe (a função oscila)\n", label); break;
+    }
+}
+
+// calc limit <a> <func>: a pode ser inf ou -inf
+static int calc_limit_command(FILE *out, int argc, char **argv) {
+    double a = atof(argv[2]);
+    char err[128];
+    CalcProgram *f = calc_function_arg(argc, argv, 3, err, sizeof(err));
+    if (!f) {
+        fprintf(out, "Erro na função: %s\n", err);
+        return 2;
+    }
+    long evals = 0;
+    if (isinf(a)) {
+        CalcLimitSide side = calc_limit_side(f, a, a > 0 ? -1.0 : 1.0, &evals);
+        calc_program_free(f);
+        char label[64];
+        snprintf(label, sizeof(label), "Limite em x -> %s", a > 0 ? "+inf" : "-inf");
+        calc_print_limit_side(out, label, side);
+        fprintf(out, "Avaliações da função: %ld\n", evals);
+        return 0;
+    }
+    CalcLimitSide left = calc_limit_side(f, a, -1.0, &evals);
+    CalcLimitSide right = calc_limit_side(f, a, 1.0, &evals);
+    calc_program_free(f);
+    calc_print_limit_side(out, "Pela esquerda", left);
+    calc_print_limit_side(out, "Pela direita", right);
+    if (left.kind == CALC_LIMIT_FINITE && right.kind == CALC_LIMIT_FINITE) {
+        double gap = fabs(left.value - right.value);
+        double slack = fmax(10.0 * (left.error + right.error), CALC_LIMIT_TOL * fmax(1.0, fabs(left.value)));
+        if (gap <= slack) {
+            fprintf(out, "Limite em x = %g: %.12g (erro estimado %.1g, %ld avaliações)\n", a,
+                    0.5 * (left.value + right.value), fmax(left.error, right.error) + 0.5 * gap, evals);
+        } else {
+            fprintf(out, "Os limites laterais são diferentes: o limite em x = %g não existe (%ld avaliações)\n", a, evals);
+        }
+    } else if (left.kind == right.kind && (left.kind == CALC_LIMIT_PLUS_INF || left.kind == CALC_LIMIT_MINUS_INF)) {
+        fprintf(out, "Limite em x = %g: %s (%ld avaliações)\n", a, left.kind == CALC_LIMIT_PLUS_INF ? "+inf" : "-inf", evals);
+    } else if (left.kind == CALC_LIMIT_UNDEFINED || right.kind == CALC_LIMIT_UNDEFINED) {
+        fprintf(out, "Só existe o limite lateral (%ld avaliações)\n", evals);
+    } else {
+        fprintf(out, "O limite em x = %g não existe (%ld avaliações)\n", a, evals);
+    }
+    return 0;
+}
+
+#define CALC_DERIV_MAX_ORDER 10
+#define CALC_DERIV_PRINT_MAX 2000
+
+// calc deriv <expressao> [--var x] [--ordem n] [nome=valor ...]
+static int calc_deriv_command(FILE *out, int argc, char **argv) {
+    const char *var_arg = calc_take_option(&argc, argv, 2, "--var");
+    const char *order_arg = calc_take_option(&argc, argv, 2, "--ordem");
+    int order = order_arg ? atoi(order_arg) : 1;
+    CalcBindings bindings;
+    calc_take_bindings(&argc, argv, 3, &bindings);
+    if (argc < 3 || order < 1 || order > CALC_DERIV_MAX_ORDER) {
+        fprintf(out, "Uso: calc deriv <expr> [--var x] [--ordem 1..%d] [var=valor ...]\n", CALC_DERIV_MAX_ORDER);
+        return 2;
+    }
+    char expr[1024], err[128];
+    calc_join_args(argc, argv, 2, expr, sizeof(expr));
+    CalcTree t = {0};
+    int root = calc_parse(expr, &t);
+    if (root < 0) {
+        fprintf(out, "Erro na expressão: %s (posição %d)\n", t.error ? t.error : "expressão inválida", t.error_pos + 1);
+        calc_tree_free(&t);
+        return 2;
+    }
+    // sem --var, a unica variavel da expressao (ou x, se for constante)
+    const char *var_name = var_arg ? var_arg : t.var_count == 1 ? t.vars[0] : "x";
+    if (!var_arg && t.var_count > 1) {
+        fprintf(out, "Erro: a expressão tem várias variáveis; escolha uma com --var %s\n", t.vars[0]);
+        calc_tree_free(&t);
+        return 2;
+    }
+    int var = -1;
+    for (int v = 0; v < t.var_count; v++) {
+        if (strcmp(t.vars[v], var_name) == 0) var = v;
+    }
+    int status = 0;
+    int d = calc_simplify(&t, root);
+    for (int k = 1; k <= order; k++) {
+        d = var < 0 ? calc_num(&t, 0) : calc_diff(&t, d, var);
+        if (d < 0) {
+            fprintf(out, "Erro: %s\n", t.error ? t.error : "expressão inválida");
+            status = 1;
+            break;
+        }
+        CalcProgram *p = calc_compile_tree(&t, d, err, sizeof(err));
+        if (!p) {
+            fprintf(out, "Erro: %s\n", err);
+            status = 1;
+            break;
         }
+        if (k == 1) fprintf(out, "d/d%s: ", var_name);
+        else fprintf(out, "d^%d/d%s^%d: ", k, var_name, k);
+        calc_print(out, &t, d, CALC_DERIV_PRINT_MAX);
+        fprintf(out, "\n");
+        if (bindings.count > 0) {
+            double vars[CALC_MAX_VARS];
+            const char *missing = calc_bind(&bindings, (const char (*)[CALC_NAME_MAX])p->vars, p->nvars, vars);
+            if (missing) fprintf(out, "  (sem valor para '%s')\n", missing);
+            else fprintf(out, "  = %.15g\n", calc_run(p, vars));
+        }
+        calc_program_free(p);
+    }
+    calc_tree_free(&t);
+    return status;
+}
+
+// deriv_poly e deriv_trig: a derivada sai de calc_diff e e impressa como
+// expressao, entao pode ser colada em eval, deriv, solve...
+static int calc_deriv_terms_command(FILE *out, const char *label, Term *terms, int num_terms,
+                                    TrigTerm *trig_terms, int num_trig) {
+    char err[128];
+    CalcTree t = {0};
+    int f = calc_terms_expr(&t, terms, num_terms, trig_terms, num_trig, err, sizeof(err));
+    if (f < 0) {
+        fprintf(out, "Erro: %s\n", err);
+        calc_tree_free(&t);
+        return 2;
     }
-    for (int i = result_idx; i < num_terms; i++) {
-        result[i].coef = 0;
-        result[i].exp = 0;
+    int d = calc_diff(&t, f, 0);
+    if (d < 0) {
+        fprintf(out, "Erro: %s\n", t.error ? t.error : "expressão inválida");
+        calc_tree_free(&t);
+        return 1;
     }
+    fprintf(out, "%s: ", label);
+    calc_print(out, &t, f, CALC_DERIV_PRINT_MAX);
+    fprintf(out, "\nDerivada: ");
+    calc_print(out, &t, d, CALC_DERIV_PRINT_MAX);
+    fprintf(out, "\n");
+    calc_tree_free(&t);
+    return 0;
 }
 
-void derive_trig(TrigTerm *trig_terms, int num_trig, TrigTerm *result) {
-    for (int i = 0; i < num_trig; i++) {
-        result[i].coef = trig_terms[i].coef;
-        if (strcmp(trig_terms[i].type, "sin") == 0) {
-            strcpy(result[i].type, "cos");
-        } else if (strcmp(trig_terms[i].type, "cos") == 0) {
-            result[i].coef = -trig_terms[i].coef;
-            strcpy(result[i].type, "sin");
-        } else if (strcmp(trig_terms[i].type, "tan") == 0) {
-            result[i].coef = trig_terms[i].coef;
-            strcpy(result[i].type, "sec^2");
+#define CALC_NEWTON_MAX_ITER 100
+
+// calc solve <expressao> [--x0 v]: raiz pelo metodo de Newton, com a
+// derivada simbolica compilada junto com a funcao
+static int calc_solve_command(FILE *out, int argc, char **argv) {
+    const char *x0_arg = calc_take_option(&argc, argv, 2, "--x0");
+    if (argc < 3) {
+        fprintf(out, "Uso: calc solve <expr> [--x0 v] (resolve expr = 0)\n");
+        return 2;
+    }
+    char expr[1024], err[128];
+    calc_join_args(argc, argv, 2, expr, sizeof(expr));
+    CalcTree t = {0};
+    int root = calc_parse(expr, &t);
+    if (root < 0 || t.var_count > 1) {
+        if (root < 0) fprintf(out, "Erro na expressão: %s (posição %d)\n", t.error ? t.error : "expressão inválida", t.error_pos + 1);
+        else fprintf(out, "Erro: a equação deve ter uma só variável (tem %s e %s)\n", t.vars[0], t.vars[1]);
+        calc_tree_free(&t);
+        return 2;
+    }
+    int d = t.var_count == 0 ? calc_num(&t, 0) : calc_diff(&t, root, 0);
+    CalcProgram *f = calc_compile_tree(&t, root, err, sizeof(err));
+    CalcProgram *df = d >= 0 && f ? calc_compile_tree(&t, d, err, sizeof(err)) : NULL;
+    if (!df) {
+        fprintf(out, "Erro: %s\n", d < 0 && t.error ? t.error : err);
+        calc_program_free(f);
+        calc_tree_free(&t);
+        return 1;
+    }
+    char name[CALC_NAME_MAX];
+    snprintf(name, sizeof(name), "%s", t.var_count ? t.vars[0] : "x");
+    double x = x0_arg ? atof(x0_arg) : 1.0, fx = calc_run1(f, x);
+    int iter = 0;
+    bool converged = fx == 0;
+    while (!converged && iter < CALC_NEWTON_MAX_ITER && isfinite(x)) {
+        double slope = calc_run1(df, x);
+        if (slope == 0 || !isfinite(slope)) break;
+        double step = fx / slope;
+        x -= step;
+        fx = calc_run1(f, x);
+        iter++;
+        converged = fx == 0 || fabs(step) <= 4 * DBL_EPSILON * fmax(fabs(x), 1.0);
+    }
+    calc_program_free(f);
+    calc_program_free(df);
+    calc_tree_free(&t);
+    if (!converged || !isfinite(x)) {
+        fprintf(out, "Newton não convergiu (%d iterações, %s = %.15g, f = %.3g); tente outro --x0.\n", iter, name, x, fx);
+        return 1;
+    }
+    fprintf(out, "Raiz: %s = %.15g (%d iterações, f = %.3g)\n", name, x, iter, fx);
+    return 0;
+}
+
+// --- Matrizes ---
+//
+// calc mat: matrizes de arquivos (uma linha por linha da matriz, valores
+// separados por espaco, tab, virgula ou ponto e virgula) ou literais
+// ("[1 2; 3 4]"). Os dados ficam alinhados em 64 bytes, com cada linha
+// completada ate um multiplo de 8 doubles.
+//
+// A multiplicacao segue o esquema em blocos do GotoBLAS: para cada fatia
+// de CALC_GEMM_KC colunas de A (e linhas de B), A e empacotada em paineis
+// de MR linhas; para cada fatia de CALC_GEMM_NC colunas de B, B e
+// empacotada em paineis de NR colunas (kc x nc, na L3), e os blocos de
+// CALC_GEMM_MC linhas de A (mc x kc, na L2) viram tarefas do pool. Cada
+// elemento de C e escrito por uma so tarefa, na mesma ordem de k, entao o
+// resultado nao depende do numero de threads.
+//
+// LU (pivotamento parcial) e QR (Householder) percorrem as matrizes por
+// linha, o que deixa os lacos internos contiguos e vetorizaveis.
+#define CALC_MAT_ALIGN 64
+#define CALC_MAT_MAX_ELEMS (1L << 28)   // 2 GiB de doubles
+#define CALC_GEMM_KC 256
+#define CALC_GEMM_MC 96                  // multiplo de CALC_GEMM_MR
+#define CALC_GEMM_NC 2048                // multiplo de CALC_GEMM_NR
+#define CALC_MAT_PRINT_MAX 100000        // elementos impressos sem --saida
+
+typedef struct {
+    int rows, cols;
+    long stride;     // doubles por linha, multiplo de CALC_LANES
+    double *data;
+} CalcMatrix;
+
+#define CALC_MAT_AT(m, i, j) ((m)->data[(long)(i) * (m)->stride + (j)])
+
+static void *calc_aligned_alloc(size_t bytes) {
+    return aligned_alloc(CALC_MAT_ALIGN, (bytes + CALC_MAT_ALIGN - 1) / CALC_MAT_ALIGN * CALC_MAT_ALIGN);
+}
+
+// Matriz zerada, ou NULL se nao couber
+static CalcMatrix *calc_mat_new(int rows, int cols) {
+    if (rows < 1 || cols < 1 || (long)rows * cols > CALC_MAT_MAX_ELEMS) return NULL;
+    CalcMatrix *m = malloc(sizeof(CalcMatrix));
+    if (!m) return NULL;
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = (cols + CALC_LANES - 1) / CALC_LANES * CALC_LANES;
+    m->data = calc_aligned_alloc((size_t)rows * m->stride * sizeof(double));
+    if (!m->data) {
+        free(m);
+        return NULL;
+    }
+    memset(m->data, 0, (size_t)rows * m->stride * sizeof(double));
+    return m;
+}
+
+static void calc_mat_free(CalcMatrix *m) {
+    if (!m) return;
+    free(m->data);
+    free(m);
+}
+
+static CalcMatrix *calc_mat_copy(const CalcMatrix *a) {
+    CalcMatrix *m = calc_mat_new(a->rows, a->cols);
+    if (m) memcpy(m->data, a->data, (size_t)a->rows * a->stride * sizeof(double));
+    return m;
+}
+
+// Le o texto de uma matriz: linhas separadas por '\n' ou ';', valores por
+// espaco, tab ou virgula; '[' e ']' sao ignorados e '#' comenta ate o fim
+// da linha. Linhas vazias nao contam.
+static CalcMatrix *calc_mat_parse(const char *text, char *err, size_t err_size) {
+    size_t cap = 1024, count = 0;
+    double *values = malloc(cap * sizeof(double));
+    int rows = 0, cols = 0, row_len = 0;
+    const char *p = text;
+    bool ok = values != NULL;
+    if (!ok) snprintf(err, err_size, "sem memória");
+    while (ok) {
+        while (*p == ' ' || *p == '\t' || *p == ',' || *p == '[' || *p == ']' || *p == '\r') p++;
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+        }
+        if (*p == '\n' || *p == ';' || *p == '\0') {
+            if (row_len > 0) {
+                if (rows > 0 && row_len != cols) {
+                    snprintf(err, err_size, "a linha %d tem %d valores, as anteriores têm %d", rows + 1, row_len, cols);
+                    ok = false;
+                    break;
+                }
+                cols = row_len;
+                rows++;
+                row_len = 0;
+            }
+            if (*p == '\0') break;
+            p++;
+            continue;
+        }
+        char *end;
+        double v = strtod(p, &end);
+        if (end == p) {
+            snprintf(err, err_size, "valor inválido na linha %d: '%.10s'", rows + 1, p);
+            ok = false;
+            break;
+        }
+        if (count == cap) {
+            cap *= 2;
+            double *grown = (long)cap <= CALC_MAT_MAX_ELEMS ? realloc(values, cap * sizeof(double)) : NULL;
+            if (!grown) {
+                snprintf(err, err_size, "matriz grande demais");
+                ok = false;
+                break;
+            }
+            values = grown;
         }
+        values[count++] = v;
+        row_len++;
+        p = end;
+    }
+    CalcMatrix *m = NULL;
+    if (ok && rows == 0) {
+        snprintf(err, err_size, "matriz vazia");
+    } else if (ok && !(m = calc_mat_new(rows, cols))) {
+        snprintf(err, err_size, "matriz grande demais");
+    } else if (ok) {
+        for (int i = 0; i < rows; i++) memcpy(&CALC_MAT_AT(m, i, 0), values + (size_t)i * cols, cols * sizeof(double));
     }
+    free(values);
+    return m;
 }
 
-void print_polynomial(Term *terms, int num_terms) {
-    int first = 1;
-    for (int i = 0; i < num_terms; i++) {
-        if (terms[i].coef == 0) continue;
-        if (!first && terms[i].coef > 0) printf(" + ");
-        else if (terms[i].coef < 0) printf(" - ");
-        if (first && terms[i].coef < 0) printf("-");
-        
-        double abs_coef = fabs(terms[i].coef);
-        if (abs_coef != 1 || terms[i].exp == 0) printf("%.2f", abs_coef);
-        
-        if (terms[i].exp > 0) {
-            printf("x");
-            if (terms[i].exp > 1) printf("^%d", terms[i].exp);
+// Um argumento de matriz: literal ("[1 2; 3 4]", ou qualquer coisa com ';')
+// ou o nome de um arquivo
+static CalcMatrix *calc_mat_arg(const char *arg, char *err, size_t err_size) {
+    if (arg[0] == '[' || strchr(arg, ';')) return calc_mat_parse(arg, err, err_size);
+    FILE *f = fopen(arg, "rb");
+    if (!f) {
+        snprintf(err, err_size, "não foi possível abrir '%s'", arg);
+        return NULL;
+    }
+    char *text = NULL;
+    long size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    if (size >= 0 && fseek(f, 0, SEEK_SET) == 0 && (text = malloc(size + 1))) {
+        size = (long)fread(text, 1, size, f);
+        text[size] = '\0';
+    }
+    fclose(f);
+    if (!text) {
+        snprintf(err, err_size, "não foi possível ler '%s'", arg);
+        return NULL;
+    }
+    CalcMatrix *m = calc_mat_parse(text, err, err_size);
+    free(text);
+    return m;
+}
+
+// digits = 17 no arquivo, para que ele seja lido de volta sem perda
+static void calc_mat_print(FILE *out, const CalcMatrix *m, int digits) {
+    for (int i = 0; i < m->rows; i++) {
+        for (int j = 0; j < m->cols; j++) fprintf(out, j ? " %.*g" : "%.*g", digits, CALC_MAT_AT(m, i, j));
+        fputc('\n', out);
+    }
+}
+
+// Mostra o resultado, ou grava em path (--saida). Matrizes enormes so vao
+// para arquivo.
+static int calc_mat_output(FILE *out, const CalcMatrix *m, const char *path) {
+    if (!path) {
+        if ((long)m->rows * m->cols > CALC_MAT_PRINT_MAX) {
+            fprintf(out, "Resultado %dx%d grande demais para a tela; use --saida <arquivo>.\n", m->rows, m->cols);
+            return 1;
         }
-        first = 0;
+        calc_mat_print(out, m, 12);
+        return 0;
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(out, "Erro: não foi possível criar '%s'.\n", path);
+        return 1;
     }
-    if (first) printf("0");
+    calc_mat_print(f, m, 17);
+    bool failed = ferror(f) != 0;
+    failed = fclose(f) != 0 || failed;
+    if (failed) {
+        fprintf(out, "Erro ao gravar '%s'.\n", path);
+        return 1;
+    }
+    fprintf(out, "Resultado %dx%d gravado em %s\n", m->rows, m->cols, path);
+    return 0;
 }
 
-void print_trig(TrigTerm *trig_terms, int num_trig) {
-    int first = 1;
-    for (int i = 0; i < num_trig; i++) {
-        if (trig_terms[i].coef == 0) continue;
-        if (!first && trig_terms[i].coef > 0) printf(" + ");
-        else if (trig_terms[i].coef < 0) printf(" - ");
-        if (first && trig_terms[i].coef < 0) printf("-");
-        
-        double abs_coef = fabs(trig_terms[i].coef);
-        if (abs_coef != 1) printf("%.2f", abs_coef);
-        
-        printf("%s(x)", trig_terms[i].type);
-        first = 0;
+static CalcMatrix *calc_mat_transpose(const CalcMatrix *a) {
+    CalcMatrix *t = calc_mat_new(a->cols, a->rows);
+    if (!t) return NULL;
+    // em blocos de 32x32 para nao pular de linha em linha nos dois lados
+    for (int i0 = 0; i0 < a->rows; i0 += 32) {
+        for (int j0 = 0; j0 < a->cols; j0 += 32) {
+            int i1 = i0 + 32 < a->rows ? i0 + 32 : a->rows, j1 = j0 + 32 < a->cols ? j0 + 32 : a->cols;
+            for (int i = i0; i < i1; i++) {
+                for (int j = j0; j < j1; j++) CALC_MAT_AT(t, j, i) = CALC_MAT_AT(a, i, j);
+            }
+        }
+    }
+    return t;
+}
+
+// Estado de uma multiplicacao: a fatia [pc, pc+kc) de k e [jc, jc+nc) de colunas
+typedef struct {
+    const CalcMatrix *a, *b;
+    CalcMatrix *c;
+    int pc, kc, jc, nc;
+    double *apack, *bpack;
+} CalcGemm;
+
+// Tarefa i: empacota as linhas [i*MC, (i+1)*MC) de A[:, pc:pc+kc]
+static void calc_gemm_pack_a(void *ctx, int index) {
+    CalcGemm *g = ctx;
+    int i0 = index * CALC_GEMM_MC;
+    int i1 = i0 + CALC_GEMM_MC < g->a->rows ? i0 + CALC_GEMM_MC : g->a->rows;
+    double *dst = g->apack + (long)i0 * g->kc;
+    for (int ip = i0; ip < i1; ip += CALC_GEMM_MR) {
+        for (int k = 0; k < g->kc; k++) {
+            for (int r = 0; r < CALC_GEMM_MR; r++) {
+                *dst++ = ip + r < i1 ? CALC_MAT_AT(g->a, ip + r, g->pc + k) : 0.0;
+            }
+        }
+    }
+}
+
+static void calc_gemm_pack_b(CalcGemm *g) {
+    double *dst = g->bpack;
+    for (int jp = 0; jp < g->nc; jp += CALC_GEMM_NR) {
+        int nr = g->nc - jp < CALC_GEMM_NR ? g->nc - jp : CALC_GEMM_NR;
+        for (int k = 0; k < g->kc; k++, dst += CALC_GEMM_NR) {
+            memcpy(dst, &CALC_MAT_AT(g->b, g->pc + k, g->jc + jp), nr * sizeof(double));
+            memset(dst + nr, 0, (CALC_GEMM_NR - nr) * sizeof(double));
+        }
     }
-    if (first) printf("0");
 }
 
-double calculate_limit(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double a) {
-    double left = a - EPSILON;
-    double right = a + EPSILON;
-    double val_left = eval_polynomial(terms, num_terms, left) + eval_trig(trig_terms, num_trig, left);
-    double val_right = eval_polynomial(terms, num_terms, right) + eval_trig(trig_terms, num_trig, right);
-    return (val_left + val_right) / 2.0;
+// Tarefa i: C[i*MC:(i+1)*MC, jc:jc+nc] += A empacotada * B empacotada
+static void calc_gemm_task(void *ctx, int index) {
+    CalcGemm *g = ctx;
+    int i0 = index * CALC_GEMM_MC;
+    int mc = g->a->rows - i0 < CALC_GEMM_MC ? g->a->rows - i0 : CALC_GEMM_MC;
+    calc_gemm_block(mc, g->nc, g->kc, g->apack + (long)i0 * g->kc, g->bpack, &CALC_MAT_AT(g->c, i0, g->jc),
+                    g->c->stride);
 }
 
-double integrate_trapezoid(Term *terms, int num_terms, TrigTerm *trig_terms, int num_trig, double a, double b) {
-    double h = (b - a) / TRAPEZOID_STEPS;
-    double sum = 0.0;
-    for (int i = 0; i < TRAPEZOID_STEPS; i++) {
-        double x0 = a + i * h;
-        double x1 = a + (i + 1) * h;
-        double f0 = eval_polynomial(terms, num_terms, x0) + eval_trig(trig_terms, num_trig, x0);
-        double f1 = eval_polynomial(terms, num_terms, x1) + eval_trig(trig_terms, num_trig, x1);
-        sum += (f0 + f1) * h / 2.0;
+// C = A * B; NULL se as dimensoes nao batem ou falta memoria
+static CalcMatrix *calc_mat_mul(const CalcMatrix *a, const CalcMatrix *b, CalcPool *pool) {
+    if (a->cols != b->rows) return NULL;
+    int blocks = (a->rows + CALC_GEMM_MC - 1) / CALC_GEMM_MC;
+    CalcGemm g = { a, b, calc_mat_new(a->rows, b->cols), 0, 0, 0, 0, NULL, NULL };
+    g.apack = calc_aligned_alloc((size_t)blocks * CALC_GEMM_MC * CALC_GEMM_KC * sizeof(double));
+    g.bpack = calc_aligned_alloc((size_t)CALC_GEMM_KC * CALC_GEMM_NC * sizeof(double));
+    if (g.c && g.apack && g.bpack) {
+        for (g.pc = 0; g.pc < a->cols; g.pc += CALC_GEMM_KC) {
+            g.kc = a->cols - g.pc < CALC_GEMM_KC ? a->cols - g.pc : CALC_GEMM_KC;
+            calc_pool_run(pool, blocks, calc_gemm_pack_a, &g);
+            for (g.jc = 0; g.jc < b->cols; g.jc += CALC_GEMM_NC) {
+                g.nc = b->cols - g.jc < CALC_GEMM_NC ? b->cols - g.jc : CALC_GEMM_NC;
+                calc_gemm_pack_b(&g);
+                calc_pool_run(pool, blocks, calc_gemm_task, &g);
+            }
+        }
+    } else {
+        calc_mat_free(g.c);
+        g.c = NULL;
     }
-    return sum;
+    free(g.apack);
+    free(g.bpack);
+    return g.c;
+}
+
+// Fatoracao PA = LU no lugar (L abaixo da diagonal, com 1s implicitos, e U
+// no resto). perm[i] e a linha original que foi para a posicao i e *sign o
+// sinal da permutacao. Devolve false se algum pivo for exatamente zero.
+static bool calc_mat_lu(CalcMatrix *a, int *perm, int *sign) {
+    int n = a->rows;
+    *sign = 1;
+    for (int i = 0; i < n; i++) perm[i] = i;
+    for (int k = 0; k < n; k++) {
+        int piv = k;
+        for (int i = k + 1; i < n; i++) {
+            if (fabs(CALC_MAT_AT(a, i, k)) > fabs(CALC_MAT_AT(a, piv, k))) piv = i;
+        }
+        if (CALC_MAT_AT(a, piv, k) == 0.0) return false;
+        if (piv != k) {
+            double *rk = &CALC_MAT_AT(a, k, 0), *rp = &CALC_MAT_AT(a, piv, 0);
+            for (int j = 0; j < n; j++) {
+                double t = rk[j];
+                rk[j] = rp[j];
+                rp[j] = t;
+            }
+            int t = perm[k];
+            perm[k] = perm[piv];
+            perm[piv] = t;
+            *sign = -*sign;
+        }
+        const double *rk = &CALC_MAT_AT(a, k, 0);
+        for (int i = k + 1; i < n; i++) {
+            double *ri = &CALC_MAT_AT(a, i, 0);
+            double l = ri[k] / rk[k];
+            ri[k] = l;
+            if (l == 0.0) continue;
+            for (int j = k + 1; j < n; j++) ri[j] -= l * rk[j];
+        }
+    }
+    return true;
+}
+
+// Razao entre o menor e o maior pivo de U: perto de DBL_EPSILON, a matriz
+// e numericamente singular e a resposta nao merece confianca
+static double calc_mat_pivot_ratio(const CalcMatrix *lu) {
+    double lo = INFINITY, hi = 0.0;
+    for (int k = 0; k < lu->rows; k++) {
+        double d = fabs(CALC_MAT_AT(lu, k, k));
+        lo = d < lo ? d : lo;
+        hi = d > hi ? d : hi;
+    }
+    return hi > 0 ? lo / hi : 0.0;
+}
+
+// X = A^-1 B a partir da LU de A: permuta as linhas de B e faz as duas
+// substituicoes linha a linha (cada passo e uma combinacao de linhas de X)
+static CalcMatrix *calc_mat_lu_solve(const CalcMatrix *lu, const int *perm, const CalcMatrix *b) {
+    int n = lu->rows, p = b->cols;
+    CalcMatrix *x = calc_mat_new(n, p);
+    if (!x) return NULL;
+    for (int i = 0; i < n; i++) memcpy(&CALC_MAT_AT(x, i, 0), &CALC_MAT_AT(b, perm[i], 0), p * sizeof(double));
+    for (int i = 0; i < n; i++) {
+        double *xi = &CALC_MAT_AT(x, i, 0);
+        for (int k = 0; k < i; k++) {
+            double l = CALC_MAT_AT(lu, i, k);
+            const double *xk = &CALC_MAT_AT(x, k, 0);
+            if (l != 0.0) for (int j = 0; j < p; j++) xi[j] -= l * xk[j];
+        }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double *xi = &CALC_MAT_AT(x, i, 0);
+        for (int k = i + 1; k < n; k++) {
+            double u = CALC_MAT_AT(lu, i, k);
+            const double *xk = &CALC_MAT_AT(x, k, 0);
+            if (u != 0.0) for (int j = 0; j < p; j++) xi[j] -= u * xk[j];
+        }
+        double d = CALC_MAT_AT(lu, i, i);
+        for (int j = 0; j < p; j++) xi[j] /= d;
+    }
+    return x;
+}
+
+// Triangulariza a (m x n) por refletores de Householder, aplicando os mesmos
+// refletores a b, e resolve R x = (Q^T b)[0:n]. v e w sao areas de trabalho.
+static void calc_mat_householder(CalcMatrix *a, CalcMatrix *b, CalcMatrix *x, double *v, double *w, bool *rank_ok) {
+    int m = a->rows, n = a->cols, p = b->cols;
+    double rmax = 0.0;
+    for (int k = 0; k < n; k++) {
+        // refletor v que zera a coluna k abaixo da diagonal
+        double norm = 0.0;
+        for (int i = k; i < m; i++) norm = hypot(norm, CALC_MAT_AT(a, i, k));
+        double alpha = CALC_MAT_AT(a, k, k) > 0 ? -norm : norm;
+        double vnorm2 = 0.0;
+        for (int i = k; i < m; i++) {
+            v[i] = CALC_MAT_AT(a, i, k) - (i == k ? alpha : 0.0);
+            vnorm2 += v[i] * v[i];
+        }
+        rmax = fmax(rmax, fabs(alpha));
+        if (vnorm2 > 0.0) {
+            // aplica H = I - 2 v v^T / |v|^2 a A[k:, k:] e a B, por linhas:
+            // w = v^T M, depois M -= (2/|v|^2) v w
+            CalcMatrix *targets[2] = { a, b };
+            int first[2] = { k, 0 }, last[2] = { n, p };
+            for (int t = 0; t < 2; t++) {
+                CalcMatrix *mt = targets[t];
+                int j0 = first[t], j1 = last[t];
+                for (int j = j0; j < j1; j++) w[j] = 0.0;
+                for (int i = k; i < m; i++) {
+                    const double *row = &CALC_MAT_AT(mt, i, 0);
+                    for (int j = j0; j < j1; j++) w[j] += v[i] * row[j];
+                }
+                double beta = 2.0 / vnorm2;
+                for (int i = k; i < m; i++) {
+                    double *row = &CALC_MAT_AT(mt, i, 0);
+                    double f = beta * v[i];
+                    for (int j = j0; j < j1; j++) row[j] -= f * w[j];
+                }
+            }
+        }
+        CALC_MAT_AT(a, k, k) = alpha;
+    }
+    for (int k = 0; k < n; k++) {
+        if (fabs(CALC_MAT_AT(a, k, k)) <= DBL_EPSILON * (m > n ? m : n) * rmax) *rank_ok = false;
+    }
+    // R X = (Q^T B)[0:n]
+    for (int i = n - 1; i >= 0 && *rank_ok; i--) {
+        double *xi = &CALC_MAT_AT(x, i, 0);
+        memcpy(xi, &CALC_MAT_AT(b, i, 0), p * sizeof(double));
+        for (int k = i + 1; k < n; k++) {
+            double r = CALC_MAT_AT(a, i, k);
+            const double *xk = &CALC_MAT_AT(x, k, 0);
+            for (int j = 0; j < p; j++) xi[j] -= r * xk[j];
+        }
+        double d = CALC_MAT_AT(a, i, i);
+        for (int j = 0; j < p; j++) xi[j] /= d;
+    }
+}
+
+// Minimos quadrados por QR de Householder: X minimiza |A X - B| (com m >= n
+// linhas; quadrada, e a solucao exata). A e B sao copiadas. *rank_ok fica
+// false quando algum |R[k][k]| e desprezivel diante do maior.
+static CalcMatrix *calc_mat_qr_solve(const CalcMatrix *a_in, const CalcMatrix *b_in, bool *rank_ok) {
+    int m = a_in->rows, n = a_in->cols, p = b_in->cols;
+    CalcMatrix *a = calc_mat_copy(a_in), *b = calc_mat_copy(b_in), *x = calc_mat_new(n, p);
+    double *v = malloc(m * sizeof(double));
+    double *w = malloc((size_t)(n > p ? n : p) * sizeof(double));
+    *rank_ok = true;
+    if (a && b && x && v && w) {
+        calc_mat_householder(a, b, x, v, w, rank_ok);
+    } else {
+        calc_mat_free(x);
+        x = NULL;
+    }
+    calc_mat_free(a);
+    calc_mat_free(b);
+    free(v);
+    free(w);
+    return x;
+}
+
+// Referencia sem blocos para o bench: o laco i-k-j, que ao menos percorre
+// B e C por linha
+static void calc_mat_mul_naive(const CalcMatrix *a, const CalcMatrix *b, CalcMatrix *c) {
+    for (int i = 0; i < a->rows; i++) {
+        double *ci = &CALC_MAT_AT(c, i, 0);
+        memset(ci, 0, b->cols * sizeof(double));
+        for (int k = 0; k < a->cols; k++) {
+            double aik = CALC_MAT_AT(a, i, k);
+            const double *bk = &CALC_MAT_AT(b, k, 0);
+            for (int j = 0; j < b->cols; j++) ci[j] += aik * bk[j];
+        }
+    }
+}
+
+static CalcMatrix *calc_mat_random(int rows, int cols, unsigned *seed) {
+    CalcMatrix *m = calc_mat_new(rows, cols);
+    if (!m) return NULL;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            *seed = *seed * 1664525u + 1013904223u;
+            CALC_MAT_AT(m, i, j) = (double)(*seed >> 8) / 16777215.0 - 0.5;
+        }
+    }
+    return m;
 }
 
-void execute_calc(const char *args) {
-    if (args == NULL || strlen(args) == 0) {
-        printf("Uso: calc <operacao> <parametros>\n");
-        printf("Operacoes disponiveis:\n");
-        printf("  soma <num1> <num2> - Soma dois números\n");
-        printf("  sub <num1> <num2> - Subtrai dois números\n");
-        printf("  mult <num1> <num2> - Multiplica dois números\n");
-        printf("  div <num1> <num2> - Divide dois números\n");
-        printf("  deriv_poly <coef1> <exp1> <coef2> <exp2> ... - Derivada de polinômio (até 5 termos)\n");
-        printf("  deriv_trig <coef> <tipo> - Derivada de função trigonométrica (tipo: sin, cos, tan)\n");
-        printf("  limit <a> <coef1> <exp1> ... / <coef> <tipo> - Limite em x=a (polinômio ou trigonométrica)\n");
-        printf("  integ <a> <b> <coef1> <exp1> ... / <coef> <tipo> - Integral de a a b (polinômio ou trigonométrica)\n");
+#define CALC_MAT_BENCH_NAIVE_MAX 1024
+#define CALC_MAT_BENCH_CHECKS 64
+
+// calc mat bench [n ...] [-j N]: GFLOP/s da multiplicacao n x n em blocos
+// (e da ingenua ate 1024), conferindo elementos sorteados contra o produto
+// interno direto
+static int calc_mat_bench(FILE *out, int argc, char **argv, CalcPool *pool, int threads) {
+    static const int default_sizes[] = { 128, 256, 512, 1024, 2048, 4096 };
+    int sizes[16], count = 0;
+    for (int i = 3; i < argc && count < 16; i++) {
+        sizes[count] = atoi(argv[i]);
+        if (sizes[count] < 1 || (long)sizes[count] * sizes[count] > CALC_MAT_MAX_ELEMS) {
+            fprintf(out, "Uso: calc mat bench [n ...] [-j N]\n");
+            return 2;
+        }
+        count++;
+    }
+    if (count == 0) {
+        count = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+    fprintf(out, "C = A * B, n x n (núcleo %s, %d thread%s):\n", calc_batch_isa, threads, threads > 1 ? "s" : "");
+    unsigned seed = 12345;
+    for (int s = 0; s < count; s++) {
+        int n = sizes[s];
+        CalcMatrix *a = calc_mat_random(n, n, &seed), *b = calc_mat_random(n, n, &seed);
+        double flops = 2.0 * n * n * (double)n;
+        double t0 = calc_now();
+        CalcMatrix *c = a && b ? calc_mat_mul(a, b, pool) : NULL;
+        double t_blocked = calc_now() - t0;
+        if (!c) {
+            fprintf(out, "  n = %d: sem memória\n", n);
+            calc_mat_free(a);
+            calc_mat_free(b);
+            break;
+        }
+        double diff = 0.0;
+        for (int t = 0; t < CALC_MAT_BENCH_CHECKS; t++) {
+            seed = seed * 1664525u + 1013904223u;
+            int i = (int)(seed % (unsigned)n), j = (int)((seed >> 16) % (unsigned)n);
+            CalcSum dot = {0};
+            double scale = 0.0;
+            for (int k = 0; k < n; k++) {
+                calc_sum_add(&dot, CALC_MAT_AT(a, i, k) * CALC_MAT_AT(b, k, j));
+                scale += fabs(CALC_MAT_AT(a, i, k) * CALC_MAT_AT(b, k, j));
+            }
+            diff = fmax(diff, fabs(CALC_MAT_AT(c, i, j) - calc_sum_value(&dot)) / fmax(scale, DBL_MIN));
+        }
+        fprintf(out, "  n = %4d: %7.2f GFLOP/s (%.3f s, erro relativo %.1g)", n, flops / t_blocked / 1e9, t_blocked, diff);
+        if (n <= CALC_MAT_BENCH_NAIVE_MAX) {
+            t0 = calc_now();
+            calc_mat_mul_naive(a, b, c);
+            double t_naive = calc_now() - t0;
+            fprintf(out, "; ingênua %6.2f GFLOP/s (%.1fx)", flops / t_naive / 1e9, t_naive / t_blocked);
+        }
+        fputc('\n', out);
+        calc_mat_free(a);
+        calc_mat_free(b);
+        calc_mat_free(c);
+    }
+    return 0;
+}
+
+// calc mat <op> ...: mul, t, det, inv, solve, bench
+static int calc_mat_command(FILE *out, int argc, char **argv) {
+    const char *out_path = calc_take_option(&argc, argv, 3, "--saida");
+    int threads = calc_take_threads(&argc, argv, 3);
+    bool use_qr = false;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--qr") == 0) {
+            memmove(argv + i, argv + i + 1, (argc - i - 1) * sizeof(char *));
+            argc--;
+            i--;
+            use_qr = true;
+        }
+    }
+    const char *op = argc > 2 ? argv[2] : "";
+    int operands = strcmp(op, "mul") == 0 || strcmp(op, "solve") == 0 ? 2
+                 : strcmp(op, "t") == 0 || strcmp(op, "det") == 0 || strcmp(op, "inv") == 0 ? 1 : -1;
+    if (threads < 0 || (operands < 0 && strcmp(op, "bench") != 0) || (operands > 0 && argc != 3 + operands)) {
+        fprintf(out, "Uso: calc mat <op> ...\n");
+        fprintf(out, "  mul <A> <B> [-j N] - produto A*B\n");
+        fprintf(out, "  t <A> - transposta\n");
+        fprintf(out, "  det <A> - determinante (por LU)\n");
+        fprintf(out, "  inv <A> - inversa (por LU)\n");
+        fprintf(out, "  solve <A> <B> [--qr] - X com A*X = B (LU; com --qr, mínimos quadrados)\n");
+        fprintf(out, "  bench [n ...] [-j N] - GFLOP/s da multiplicação\n");
+        fprintf(out, "Matrizes: arquivo (uma linha por linha) ou literal \"[1 2; 3 4]\"; --saida <arquivo> grava o resultado.\n");
+        return 2;
+    }
+    CalcPool *pool = calc_pool_create(threads);
+    if (operands < 0) {
+        int status = calc_mat_bench(out, argc, argv, pool, threads);
+        calc_pool_destroy(pool);
+        return status;
+    }
+    char err[128];
+    CalcMatrix *a = calc_mat_arg(argv[3], err, sizeof(err)), *b = NULL, *r = NULL;
+    int status = 0;
+    if (!a || (operands == 2 && !(b = calc_mat_arg(argv[4], err, sizeof(err))))) {
+        fprintf(out, "Erro na matriz: %s\n", err);
+        status = 2;
+    } else if (strcmp(op, "mul") == 0) {
+        if (a->cols != b->rows) {
+            fprintf(out, "Erro: A é %dx%d e B é %dx%d; as colunas de A devem ser as linhas de B.\n",
+                    a->rows, a->cols, b->rows, b->cols);
+            status = 2;
+        } else if (!(r = calc_mat_mul(a, b, pool))) {
+            fprintf(out, "Erro: sem memória para o produto.\n");
+            status = 1;
+        }
+    } else if (strcmp(op, "t") == 0) {
+        if (!(r = calc_mat_transpose(a))) {
+            fprintf(out, "Erro: sem memória.\n");
+            status = 1;
+        }
+    } else if (a->rows != a->cols && !(strcmp(op, "solve") == 0 && use_qr)) {
+        fprintf(out, "Erro: a matriz é %dx%d; %s precisa de uma matriz quadrada%s.\n", a->rows, a->cols, op,
+                strcmp(op, "solve") == 0 ? " (para mínimos quadrados, use --qr)" : "");
+        status = 2;
+    } else if (b && b->rows != a->rows) {
+        fprintf(out, "Erro: A tem %d linhas e B tem %d.\n", a->rows, b->rows);
+        status = 2;
+    } else if (use_qr) {
+        bool rank_ok;
+        if (a->rows < a->cols) {
+            fprintf(out, "Erro: com --qr, A precisa ter ao menos tantas linhas quanto colunas.\n");
+            status = 2;
+        } else if (!(r = calc_mat_qr_solve(a, b, &rank_ok))) {
+            fprintf(out, "Erro: sem memória.\n");
+            status = 1;
+        } else if (!rank_ok) {
+            fprintf(out, "Erro: A não tem posto completo; a solução não é única.\n");
+            calc_mat_free(r);
+            r = NULL;
+            status = 1;
+        }
+    } else {
+        // det, inv e solve por LU
+        int *perm = malloc(a->rows * sizeof(int)), sign;
+        bool regular = perm && calc_mat_lu(a, perm, &sign);
+        if (!perm) {
+            fprintf(out, "Erro: sem memória.\n");
+            status = 1;
+        } else if (strcmp(op, "det") == 0) {
+            // soma dos logs: o produto direto estoura antes do determinante
+            double log_det = 0.0;
+            for (int k = 0; regular && k < a->rows; k++) {
+                double d = CALC_MAT_AT(a, k, k);
+                if (d < 0) sign = -sign;
+                log_det += log(fabs(d));
+            }
+            double det = regular ? sign * exp(log_det) : 0.0;
+            if (regular && (det == 0.0 || isinf(det))) {
+                // fora da faixa do double: mantissa e expoente decimal
+                double e10 = floor(log_det / M_LN10);
+                fprintf(out, "Determinante: %.12g × 10^%.0f\n", sign * pow(10.0, log_det / M_LN10 - e10), e10);
+            } else {
+                fprintf(out, "Determinante: %.12g\n", det);
+            }
+            if (regular && calc_mat_pivot_ratio(a) < 1e3 * DBL_EPSILON) {
+                fprintf(out, "Aviso: a matriz é quase singular; o valor tem poucos dígitos corretos.\n");
+            }
+        } else if (!regular) {
+            fprintf(out, "Erro: a matriz é singular.\n");
+            status = 1;
+        } else {
+            CalcMatrix *rhs = b;
+            if (!rhs && (rhs = calc_mat_new(a->rows, a->rows))) {
+                for (int i = 0; i < a->rows; i++) CALC_MAT_AT(rhs, i, i) = 1.0;
+            }
+            r = rhs ? calc_mat_lu_solve(a, perm, rhs) : NULL;
+            if (rhs != b) calc_mat_free(rhs);
+            if (!r) {
+                fprintf(out, "Erro: sem memória.\n");
+                status = 1;
+            } else if (calc_mat_pivot_ratio(a) < 1e3 * DBL_EPSILON) {
+                fprintf(out, "Aviso: a matriz é quase singular; o resultado tem poucos dígitos corretos.\n");
+            }
+        }
+        free(perm);
+    }
+    if (r) status = calc_mat_output(out, r, out_path);
+    calc_mat_free(a);
+    calc_mat_free(b);
+    calc_mat_free(r);
+    calc_pool_destroy(pool);
+    return status;
+}
+
+// --- Estatisticas ---
+//
+// calc stats <arquivo> [--col N]: uma passada sobre uma coluna de um CSV ou
+// de um arquivo separado por espacos. O arquivo e mapeado com mmap e cortado
+// em blocos de CALC_STATS_CHUNK bytes; uma linha pertence ao bloco onde
+// comeca. Cada bloco (uma tarefa do pool) produz um resumo: contagem, media e
+// M2 (Welford, atualizado por lotes de valores ja em cache com a formula de
+// Chan), minimo, maximo e um t-digest. Os resumos sao combinados na ordem
+// dos blocos, entao o resultado nao depende de -j. Paginas ja lidas sao
+// devolvidas com madvise, e a memoria fica constante qualquer que seja o
+// tamanho do arquivo.
+//
+// Os numeros sao lidos por calc_parse_double em vez de strtod: os digitos
+// vao para um inteiro de 64 bits, oito de cada vez quando da (SWAR: oito
+// bytes num registro, validados e convertidos com tres multiplicacoes), e
+// com mantissa < 2^53 e expoente em [-22, 22] o resultado e uma so
+// multiplicacao ou divisao exata, arredondada corretamente (caminho rapido
+// de Clinger). O resto, raro, vai para strtod.
+#define CALC_STATS_CHUNK (4L << 20)
+#define CALC_STATS_WAVE 16
+#define CALC_STATS_BATCH 8192        // valores acumulados antes de cada atualizacao
+#define CALC_STATS_BINS 20
+#define CALC_TDIGEST_DELTA 200.0     // compressao: ~delta centroides, erro ~1/delta nas pontas
+#define CALC_TDIGEST_MAX 512
+
+typedef struct {
+    double mean;
+    double weight;
+} CalcCentroid;
+
+typedef struct {
+    CalcCentroid c[CALC_TDIGEST_MAX];
+    int n;
+    double total;
+} CalcTDigest;
+
+typedef struct {
+    long count;
+    long skipped;        // linhas sem numero na coluna (cabecalho, vazias, NA)
+    double mean, m2;
+    double min, max;
+    CalcTDigest digest;
+} CalcStats;
+
+static inline bool calc_is_8digits(uint64_t v) {
+    return ((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+           0x3333333333333333ULL;
+}
+
+// Oito digitos ASCII (o primeiro no byte baixo) para o inteiro que escrevem
+static inline uint32_t calc_parse_8digits(uint64_t v) {
+    v -= 0x3030303030303030ULL;
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)) +
+         ((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+    return (uint32_t)v;
+}
+
+// Acumula digitos em *mant enquanto couberem 19; os que sobram so contam em
+// *dropped. Devolve o fim dos digitos.
+static const char *calc_parse_digits(const char *p, const char *end, uint64_t *mant, int *ndigits, int *dropped) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - p >= 8 && *ndigits + 8 <= 19) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        if (!calc_is_8digits(v)) break;
+        *mant = *mant * 100000000ULL + calc_parse_8digits(v);
+        if (*ndigits > 0 || *mant > 0) *ndigits += 8;
+        p += 8;
+    }
+#endif
+    for (; p < end && (unsigned)(*p - '0') < 10; p++) {
+        if (*ndigits < 19) {
+            *mant = *mant * 10 + (uint64_t)(*p - '0');
+            if (*ndigits > 0 || *mant > 0) (*ndigits)++;
+        } else {
+            (*dropped)++;
+        }
+    }
+    return p;
+}
+
+// Le um numero em [p, end); devolve o fim dele ou NULL se nao ha numero
+static const char *calc_parse_double(const char *p, const char *end, double *out) {
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char *start = p;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    uint64_t mant = 0;
+    int ndigits = 0, dropped = 0;
+    const char *digits = p;
+    p = calc_parse_digits(p, end, &mant, &ndigits, &dropped);
+    int exp10 = dropped;
+    bool any = p > digits;
+    if (p < end && *p == '.') {
+        const char *frac = ++p;
+        int lost = dropped;
+        p = calc_parse_digits(p, end, &mant, &ndigits, &dropped);
+        // cada digito da fracao que entrou em mant (zeros a esquerda
+        // inclusive) desloca a virgula uma casa
+        exp10 -= (int)(p - frac) - (dropped - lost);
+        any = any || p > frac;
+    }
+    if (!any) return NULL;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool exp_negative = q < end && *q == '-';
+        if (q < end && (*q == '-' || *q == '+')) q++;
+        if (q < end && (unsigned)(*q - '0') < 10) {
+            int e = 0;
+            for (; q < end && (unsigned)(*q - '0') < 10; q++) e = e < 100000 ? e * 10 + (*q - '0') : e;
+            exp10 += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+    if (dropped == 0 && mant < (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        double v = (double)mant;
+        v = exp10 < 0 ? v / pow10[-exp10] : v * pow10[exp10];
+        *out = negative ? -v : v;
+        return p;
+    }
+    char buf[128];
+    size_t len = (size_t)(p - start);
+    if (len >= sizeof(buf)) return NULL;
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    *out = strtod(buf, NULL);
+    return p;
+}
+
+// Ordena doubles por radix LSD (8 passadas de 8 bits, puladas quando todos
+// caem no mesmo balde) sobre chaves que preservam a ordem: negativos com
+// todos os bits invertidos, positivos so com o sinal. qsort, com uma chamada
+// indireta por comparacao, era o gargalo da leitura. tmp tem n posicoes.
+static void calc_sort_doubles(double *v, int n, uint64_t *tmp) {
+    uint64_t *keys = (uint64_t *)v;
+    uint32_t counts[8][256] = {{0}};
+    for (int i = 0; i < n; i++) {
+        uint64_t k;
+        memcpy(&k, &v[i], sizeof(k));
+        k = k >> 63 ? ~k : k | 0x8000000000000000ull;
+        keys[i] = k;
+        for (int d = 0; d < 8; d++) counts[d][(k >> (8 * d)) & 0xff]++;
+    }
+    uint64_t *src = keys, *dst = tmp;
+    for (int d = 0; d < 8; d++) {
+        uint32_t *c = counts[d];
+        if (c[(src[0] >> (8 * d)) & 0xff] == (uint32_t)n) continue;
+        uint32_t pos = 0;
+        for (int b = 0; b < 256; b++) {
+            uint32_t t = c[b];
+            c[b] = pos;
+            pos += t;
+        }
+        for (int i = 0; i < n; i++) dst[c[(src[i] >> (8 * d)) & 0xff]++] = src[i];
+        uint64_t *t = src;
+        src = dst;
+        dst = t;
+    }
+    for (int i = 0; i < n; i++) {
+        uint64_t k = src[i] >> 63 ? src[i] & 0x7fffffffffffffffull : ~src[i];
+        memcpy(&v[i], &k, sizeof(k));
+    }
+}
+
+// Escala k1 do t-digest: centroides pequenos nas pontas, grandes no meio
+static double calc_tdigest_k(double q) {
+    return CALC_TDIGEST_DELTA / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+// Junta itens ja ordenados por media em centroides: um item entra no
+// centroide atual enquanto o centroide cobre no maximo uma unidade de k
+static void calc_tdigest_compress(CalcTDigest *d, const CalcCentroid *items, int count, double total) {
+    d->n = 0;
+    d->total = total;
+    double done = 0.0;           // peso dos centroides ja fechados
+    double k_left = calc_tdigest_k(0.0);
+    for (int i = 0; i < count; i++) {
+        CalcCentroid *cur = d->n ? &d->c[d->n - 1] : NULL;
+        if (cur && calc_tdigest_k((done + cur->weight + items[i].weight) / total) - k_left <= 1.0) {
+            cur->weight += items[i].weight;
+            cur->mean += (items[i].mean - cur->mean) * items[i].weight / cur->weight;
+            continue;
+        }
+        if (cur) {
+            done += cur->weight;
+            k_left = calc_tdigest_k(done / total);
+        }
+        if (d->n == CALC_TDIGEST_MAX) {
+            // nao acontece com a escala k1 (ha ~delta centroides), mas o
+            // ultimo absorve o resto em vez de estourar
+            d->n--;
+            done -= d->c[d->n].weight;
+            d->c[d->n].weight += items[i].weight;
+            d->c[d->n].mean += (items[i].mean - d->c[d->n].mean) * items[i].weight / d->c[d->n].weight;
+            d->n++;
+            continue;
+        }
+        d->c[d->n++] = items[i];
+    }
+}
+
+// Acrescenta valores ordenados (peso 1) ao digest; scratch tem espaco para
+// CALC_TDIGEST_MAX + n itens
+static void calc_tdigest_add_sorted(CalcTDigest *d, const double *v, int n, CalcCentroid *scratch) {
+    int i = 0, j = 0, k = 0;
+    while (i < d->n || j < n) {
+        if (j == n || (i < d->n && d->c[i].mean <= v[j])) scratch[k++] = d->c[i++];
+        else scratch[k++] = (CalcCentroid){ v[j++], 1.0 };
+    }
+    calc_tdigest_compress(d, scratch, k, d->total + n);
+}
+
+// d += src; scratch com espaco para 2 * CALC_TDIGEST_MAX itens
+static void calc_tdigest_merge(CalcTDigest *d, const CalcTDigest *src, CalcCentroid *scratch) {
+    int i = 0, j = 0, k = 0;
+    while (i < d->n || j < src->n) {
+        if (j == src->n || (i < d->n && d->c[i].mean <= src->c[j].mean)) scratch[k++] = d->c[i++];
+        else scratch[k++] = src->c[j++];
+    }
+    calc_tdigest_compress(d, scratch, k, d->total + src->total);
+}
+
+// Valor no quantil q, interpolando entre os centros dos centroides (e
+// min/max nas pontas)
+static double calc_tdigest_quantile(const CalcTDigest *d, double q, double min, double max) {
+    if (d->n == 0) return NAN;
+    double target = q * d->total, left = 0.0;
+    double prev_x = min, prev_w = 0.0;
+    for (int i = 0; i < d->n; i++) {
+        double center = left + d->c[i].weight / 2.0;
+        if (target < center) {
+            double t = center > prev_w ? (target - prev_w) / (center - prev_w) : 0.0;
+            return prev_x + t * (d->c[i].mean - prev_x);
+        }
+        prev_x = d->c[i].mean;
+        prev_w = center;
+        left += d->c[i].weight;
+    }
+    double t = d->total > prev_w ? (target - prev_w) / (d->total - prev_w) : 1.0;
+    return prev_x + t * (max - prev_x);
+}
+
+// Fracao dos valores <= x (inversa de calc_tdigest_quantile)
+static double calc_tdigest_cdf(const CalcTDigest *d, double x, double min, double max) {
+    if (d->n == 0 || x < min) return 0.0;
+    if (x >= max) return 1.0;
+    double left = 0.0, prev_x = min, prev_w = 0.0;
+    for (int i = 0; i < d->n; i++) {
+        double center = left + d->c[i].weight / 2.0;
+        if (x < d->c[i].mean) {
+            double t = d->c[i].mean > prev_x ? (x - prev_x) / (d->c[i].mean - prev_x) : 1.0;
+            return (prev_w + t * (center - prev_w)) / d->total;
+        }
+        prev_x = d->c[i].mean;
+        prev_w = center;
+        left += d->c[i].weight;
+    }
+    double t = max > prev_x ? (x - prev_x) / (max - prev_x) : 1.0;
+    return (prev_w + t * (d->total - prev_w)) / d->total;
+}
+
+// Combina b em a (Chan et al.: a atualizacao de Welford para um lote inteiro)
+static void calc_stats_merge(CalcStats *a, const CalcStats *b, CalcCentroid *scratch) {
+    a->skipped += b->skipped;
+    if (b->count == 0) return;
+    if (a->count == 0) {
+        long skipped = a->skipped;
+        *a = *b;
+        a->skipped = skipped;
         return;
     }
+    double n = (double)a->count + (double)b->count;
+    double delta = b->mean - a->mean;
+    a->mean += delta * (double)b->count / n;
+    a->m2 += b->m2 + delta * delta * (double)a->count * (double)b->count / n;
+    a->count += b->count;
+    a->min = fmin(a->min, b->min);
+    a->max = fmax(a->max, b->max);
+    calc_tdigest_merge(&a->digest, &b->digest, scratch);
+}
 
-    char buffer[512];
-    // FIX: Use strncpy for safety to prevent buffer overflows
-    strncpy(buffer, args, sizeof(buffer) - 1);
-    buffer[sizeof(buffer) - 1] = '\0';
+// Um lote de valores ja lidos: media e M2 em duas passadas sobre o lote (que
+// esta na cache), depois a combinacao com o acumulado
+static void calc_stats_flush(CalcStats *s, double *v, int n, uint64_t *tmp, CalcCentroid *scratch) {
+    if (n == 0) return;
+    calc_sort_doubles(v, n, tmp);
+    double sum = 0.0, m2 = 0.0;
+    for (int i = 0; i < n; i++) sum += v[i];
+    double mean = sum / n;
+    for (int i = 0; i < n; i++) m2 += (v[i] - mean) * (v[i] - mean);
+    CalcStats batch = { .count = n, .mean = mean, .m2 = m2, .min = v[0], .max = v[n - 1] };
+    calc_tdigest_add_sorted(&batch.digest, v, n, scratch);
+    calc_stats_merge(s, &batch, scratch);
+}
 
-    char *argv[30];
-    int argc = 0;
+typedef struct {
+    const char *data;
+    size_t size;
+    int col;             // 0 = primeira coluna
+    long first;          // indice do primeiro bloco da leva
+    long chunks;
+    CalcStats *partial;  // um resumo por bloco da leva
+    bool failed;
+} CalcStatsWave;
 
-    argv[argc++] = "calc";
-    char *token = strtok(buffer, " ");
-    while(token != NULL && argc < 29) {
-        argv[argc++] = token;
-        token = strtok(NULL, " ");
+// Inicio do campo col da linha [p, eol), ou NULL se a linha tem menos campos.
+// Separadores: virgula ou ponto e virgula (um campo vazio entre dois conta)
+// e sequencias de espacos e tabs.
+static const char *calc_stats_field(const char *p, const char *eol, int col) {
+    for (int c = 0;; c++) {
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (c == col) return p;
+        while (p < eol && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        while (p < eol && (*p == ' ' || *p == '\t')) p++;
+        if (p < eol && (*p == ',' || *p == ';')) p++;
+        else if (p >= eol) return NULL;
     }
-    argv[argc] = NULL;
+}
 
-    if (argc < 2) {
-        printf("Comando da calculadora invalido. Use 'calc <operacao>'.\n");
+static void calc_stats_task(void *ctx, int index) {
+    CalcStatsWave *wave = ctx;
+    long chunk = wave->first + index;
+    CalcStats *s = &wave->partial[index];
+    memset(s, 0, sizeof(*s));
+    if (chunk >= wave->chunks) return;
+    size_t start = (size_t)chunk * CALC_STATS_CHUNK;
+    size_t stop = start + CALC_STATS_CHUNK < wave->size ? start + CALC_STATS_CHUNK : wave->size;
+    const char *p = wave->data + start, *end = wave->data + wave->size;
+    // a linha que atravessa o inicio do bloco e do bloco anterior
+    if (start > 0 && p[-1] != '\n') {
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    double *values = malloc(CALC_STATS_BATCH * sizeof(double));
+    uint64_t *tmp = malloc(CALC_STATS_BATCH * sizeof(uint64_t));
+    CalcCentroid *scratch = malloc((CALC_STATS_BATCH + 2 * CALC_TDIGEST_MAX) * sizeof(CalcCentroid));
+    if (!values || !tmp || !scratch) {
+        free(values);
+        free(tmp);
+        free(scratch);
+        wave->failed = true;
         return;
     }
+    int n = 0;
+    while (p < wave->data + stop) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        const char *f = calc_stats_field(p, eol, wave->col);
+        double x;
+        const char *after = NULL;
+        if (f) {
+            bool quoted = f < eol && *f == '"';
+            after = calc_parse_double(f + quoted, eol, &x);
+            if (after && quoted) after = after < eol && *after == '"' ? after + 1 : NULL;
+        }
+        // o numero precisa ocupar o campo inteiro ("12abc" nao conta)
+        if (after && (after == eol || strchr(",; \t\r", *after)) && isfinite(x)) {
+            values[n++] = x;
+            if (n == CALC_STATS_BATCH) {
+                calc_stats_flush(s, values, n, tmp, scratch);
+                n = 0;
+            }
+        } else if (eol > p && !(eol - p == 1 && *p == '\r')) {
+            s->skipped++;
+        }
+        p = eol + 1;
+    }
+    calc_stats_flush(s, values, n, tmp, scratch);
+    free(values);
+    free(tmp);
+    free(scratch);
+}
+
+#define CALC_STATS_PERCENTILES 9
+
+// calc stats <arquivo> [--col N] [-j N]
+static int calc_stats_command(FILE *out, int argc, char **argv) {
+    const char *col_arg = calc_take_option(&argc, argv, 2, "--col");
+    int threads = calc_take_threads(&argc, argv, 2);
+    int col = col_arg ? atoi(col_arg) : 1;
+    if (argc != 3 || col < 1 || threads < 0) {
+        fprintf(out, "Uso: calc stats <arquivo> [--col N] [-j N] (colunas a partir de 1)\n");
+        return 2;
+    }
+    const char *path = argv[2];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(out, "Erro: não foi possível abrir '%s' como arquivo.\n", path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *data = NULL;
+    if (size > 0) {
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(out, "Erro: não foi possível mapear '%s'.\n", path);
+            close(fd);
+            return 1;
+        }
+        data = map;
+        madvise(map, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    double t0 = calc_now();
+    CalcStats total = {0};
+    CalcStatsWave wave = { data, size, col - 1, 0, (long)((size + CALC_STATS_CHUNK - 1) / CALC_STATS_CHUNK), NULL, false };
+    wave.partial = malloc(CALC_STATS_WAVE * sizeof(CalcStats));
+    CalcCentroid *scratch = malloc(2 * CALC_TDIGEST_MAX * sizeof(CalcCentroid));
+    CalcPool *pool = calc_pool_create(threads);
+    wave.failed = !wave.partial || !scratch;
+    for (; wave.first < wave.chunks && !wave.failed; wave.first += CALC_STATS_WAVE) {
+        long count = wave.chunks - wave.first < CALC_STATS_WAVE ? wave.chunks - wave.first : CALC_STATS_WAVE;
+        calc_pool_run(pool, (int)count, calc_stats_task, &wave);
+        for (long i = 0; i < count; i++) calc_stats_merge(&total, &wave.partial[i], scratch);
+        // a leva ja foi lida: as paginas saem da memoria do processo
+        size_t done = (size_t)(wave.first + count) * CALC_STATS_CHUNK;
+        size_t from = (size_t)wave.first * CALC_STATS_CHUNK;
+        madvise((void *)(data + from), (done < size ? done : size) - from, MADV_DONTNEED);
+    }
+    double elapsed = calc_now() - t0;
+    calc_pool_destroy(pool);
+    free(wave.partial);
+    free(scratch);
+    if (data) munmap((void *)data, size);
+    if (wave.failed) {
+        fprintf(out, "Erro: sem memória.\n");
+        return 1;
+    }
+
+    fprintf(out, "Arquivo: %s (%.1f MB), coluna %d\n", path, size / 1e6, col);
+    fprintf(out, "Valores: %ld (linhas ignoradas: %ld)\n", total.count, total.skipped);
+    if (total.count == 0) {
+        fprintf(out, "Nenhum valor numérico na coluna %d.\n", col);
+        return 1;
+    }
+    double var = total.count > 1 ? total.m2 / (double)(total.count - 1) : 0.0;
+    fprintf(out, "Média: %.12g\n", total.mean);
+    fprintf(out, "Variância (amostral): %.12g\n", var);
+    fprintf(out, "Desvio padrão: %.12g\n", sqrt(var));
+    fprintf(out, "Mínimo: %.12g\n", total.min);
+    fprintf(out, "Máximo: %.12g\n", total.max);
+    static const double percentiles[CALC_STATS_PERCENTILES] = { 1, 5, 10, 25, 50, 75, 90, 95, 99 };
+    fprintf(out, "Percentis (t-digest):");
+    for (int i = 0; i < CALC_STATS_PERCENTILES; i++) {
+        fprintf(out, "%s p%g = %.6g", i ? "," : "", percentiles[i],
+                calc_tdigest_quantile(&total.digest, percentiles[i] / 100.0, total.min, total.max));
+    }
+    fputc('\n', out);
+
+    // histograma de faixas iguais entre min e max, contado pela cdf do digest
+    int bins = total.max > total.min ? CALC_STATS_BINS : 1;
+    long counts[CALC_STATS_BINS], biggest = 0, below = 0;
+    for (int b = 0; b < bins; b++) {
+        double edge = total.min + (total.max - total.min) * (b + 1) / bins;
+        long upto = b == bins - 1 ? total.count : lround(total.count * calc_tdigest_cdf(&total.digest, edge, total.min, total.max));
+        counts[b] = upto > below ? upto - below : 0;
+        below = upto > below ? upto : below;
+        biggest = counts[b] > biggest ? counts[b] : biggest;
+    }
+    fprintf(out, "Histograma (%d faixas, contagens aproximadas pelo t-digest):\n", bins);
+    for (int b = 0; b < bins; b++) {
+        double lo = total.min + (total.max - total.min) * b / bins;
+        double hi = total.min + (total.max - total.min) * (b + 1) / bins;
+        int bar = biggest ? (int)((40 * counts[b] + biggest / 2) / biggest) : 0;
+        fprintf(out, "  [%11.5g, %11.5g%c %10ld %.*s\n", lo, hi, b == bins - 1 ? ']' : ')', counts[b], bar,
+                "########################################");
+    }
+    fprintf(out, "Tempo: %.3f s (%.0f MB/s)\n", elapsed, size / 1e6 / fmax(elapsed, 1e-9));
+    return 0;
+}
+
+// O nucleo ja entrega argv separado (argv[0] == "calc")
+int execute_calc(const PluginCall *call) {
+    FILE *out = call->out;
+    int argc = call->argc;
+    char **argv = call->argv;
+
+    if (argc < 2) {
+        fprintf(out, "Uso: calc <operacao> <parametros>\n");
+        fprintf(out, "Operacoes disponiveis:\n");
+        fprintf(out, "  soma <num1> <num2> - Soma dois números\n");
+        fprintf(out, "  sub <num1> <num2> - Subtrai dois números\n");
+        fprintf(out, "  mult <num1> <num2> - Multiplica dois números\n");
+        fprintf(out, "  div <num1> <num2> - Divide dois números\n");
+        fprintf(out, "  deriv_poly <coef1> <exp1> <coef2> <exp2> ... - Derivada de polinômio (até 5 termos)\n");
+        fprintf(out, "  deriv_trig <coef> <tipo> - Derivada de função trigonométrica (tipo: sin, cos, tan)\n");
+        fprintf(out, "  eval <expr> [var=valor ...] - Avalia uma expressão (ex.: eval \"2*sin(x)^2 + log(y)\" x=1 y=2)\n");
+        fprintf(out, "  deriv <expr> [--var x] [--ordem n] [var=valor ...] - Derivada simbólica (e o valor dela)\n");
+        fprintf(out, "  solve <expr> [--x0 v] - Raiz de expr = 0 pelo método de Newton\n");
+        fprintf(out, "  limit <a> <expr> - Limite em x=a (ou a forma antiga <coef1> <exp1> ... / <coef> <tipo>)\n");
+        fprintf(out, "  integ <a> <b> <expr> [--tol t] [-j N] - Integral de a a b, adaptativa (ou a forma antiga <coef1> <exp1> ... / <coef> <tipo>)\n");
+        fprintf(out, "  table <a> <b> <passo> <expr> [-j N] - Tabela de valores de a a b\n");
+        fprintf(out, "  bench <expr> [--pontos N] - Avaliações por segundo, ponto a ponto e em lote\n");
+        fprintf(out, "  mat <op> ... - Matrizes: mul, t, det, inv, solve, bench (veja calc mat)\n");
+        fprintf(out, "  stats <arquivo> [--col N] [-j N] - Estatísticas de uma coluna de um arquivo CSV ou de números\n");
+        return 2;
+    }
     if (strcmp(argv[1], "soma") == 0 && argc == 4) {
         double num1 = atof(argv[2]);
         double num2 = atof(argv[3]);
-        printf("Resultado: %.2f + %.2f = %.2f\n", num1, num2, num1 + num2);
+        fprintf(out, "Resultado: %.2f + %.2f = %.2f\n", num1, num2, num1 + num2);
     } else if (strcmp(argv[1], "sub") == 0 && argc == 4) {
         double num1 = atof(argv[2]);
         double num2 = atof(argv[3]);
-        printf("Resultado: %.2f - %.2f = %.2f\n", num1, num2, num1 - num2);
+        fprintf(out, "Resultado: %.2f - %.2f = %.2f\n", num1, num2, num1 - num2);
     } else if (strcmp(argv[1], "mult") == 0 && argc == 4) {
         double num1 = atof(argv[2]);
         double num2 = atof(argv[3]);
-        printf("Resultado: %.2f * %.2f = %.2f\n", num1, num2, num1 * num2);
+        fprintf(out, "Resultado: %.2f * %.2f = %.2f\n", num1, num2, num1 * num2);
     } else if (strcmp(argv[1], "div") == 0 && argc == 4) {
         double num1 = atof(argv[2]);
         double num2 = atof(argv[3]);
         if (num2 != 0) {
-            printf("Resultado: %.2f / %.2f = %.2f\n", num1, num2, num1 / num2);
+            fprintf(out, "Resultado: %.2f / %.2f = %.2f\n", num1, num2, num1 / num2);
         } else {
-            printf("Erro: Divisao por zero!\n");
+            fprintf(out, "Erro: Divisao por zero!\n");
+            return 1;
         }
     } else if (strcmp(argv[1], "deriv_poly") == 0 && argc >= 4 && (argc - 2) % 2 == 0) {
         int num_terms = (argc - 2) / 2;
         if (num_terms > MAX_TERMS) num_terms = MAX_TERMS;
         Term terms[MAX_TERMS] = {0};
-        Term result[MAX_TERMS] = {0};
         
         for (int i = 0; i < num_terms; i++) {
             terms[i].coef = atof(argv[2 + 2 * i]);
             terms[i].exp = atoi(argv[3 + 2 * i]);
         }
-        
-        printf("Polinomio original: ");
-        print_polynomial(terms, num_terms);
-        printf("\n");
-        derive_polynomial(terms, num_terms, result);
-        printf("Derivada: ");
-        print_polynomial(result, num_terms);
-        printf("\n");
+        return calc_deriv_terms_command(out, "Polinomio original", terms, num_terms, NULL, 0);
     } else if (strcmp(argv[1], "deriv_trig") == 0 && argc == 4) {
         TrigTerm trig_terms[1] = {0};
-        TrigTerm result[1] = {0};
         trig_terms[0].coef = atof(argv[2]);
         strncpy(trig_terms[0].type, argv[3], sizeof(trig_terms[0].type) - 1);
-        
-        printf("Funcao original: ");
-        print_trig(trig_terms, 1);
-        printf("\n");
-        derive_trig(trig_terms, 1, result);
-        printf("Derivada: ");
-        print_trig(result, 1);
-        printf("\n");
+        return calc_deriv_terms_command(out, "Funcao original", NULL, 0, trig_terms, 1);
+    } else if (strcmp(argv[1], "eval") == 0 && argc >= 3) {
+        return calc_eval_command(out, argc, argv);
+    } else if (strcmp(argv[1], "deriv") == 0 && argc >= 3) {
+        return calc_deriv_command(out, argc, argv);
+    } else if (strcmp(argv[1], "solve") == 0 && argc >= 3) {
+        return calc_solve_command(out, argc, argv);
+    } else if (strcmp(argv[1], "table") == 0 && argc >= 6) {
+        return calc_table_command(out, argc, argv);
+    } else if (strcmp(argv[1], "bench") == 0) {
+        return calc_bench_command(out, argc, argv);
+    } else if (strcmp(argv[1], "stats") == 0) {
+        return calc_stats_command(out, argc, argv);
+    } else if (strcmp(argv[1], "mat") == 0) {
+        return calc_mat_command(out, argc, argv);
     } else if (strcmp(argv[1], "limit") == 0 && argc >= 4) {
-        double a = atof(argv[2]);
-        Term terms[MAX_TERMS] = {0};
-        TrigTerm trig_terms[MAX_TERMS] = {0};
-        int num_terms = 0, num_trig = 0;
-        int is_trig = 0;
-        for (int i = 3; i < argc; i++) {
-            if (strcmp(argv[i], "/") == 0) {
-                is_trig = 1;
-                continue;
-            }
-            if (!is_trig && i + 1 < argc && num_terms < MAX_TERMS) {
-                terms[num_terms].coef = atof(argv[i]);
-                terms[num_terms].exp = atoi(argv[i + 1]);
-                num_terms++;
-                i++; // Increment extra for the pair
-            } else if (is_trig && i + 1 < argc && num_trig < MAX_TERMS) {
-                trig_terms[num_trig].coef = atof(argv[i]);
-                strncpy(trig_terms[num_trig].type, argv[i + 1], sizeof(trig_terms[num_trig].type) - 1);
-                num_trig++;
-                i++; // Increment extra for the pair
-            }
-        }
-        double limit_val = calculate_limit(terms, num_terms, trig_terms, num_trig, a);
-        printf("Limite aproximado em x = %.2f: %.4f\n", a, limit_val);
+        return calc_limit_command(out, argc, argv);
     } else if (strcmp(argv[1], "integ") == 0 && argc >= 5) {
+        const char *tol_arg = calc_take_option(&argc, argv, 4, "--tol");
+        double tol = tol_arg ? atof(tol_arg) : CALC_INTEG_TOL;
+        int threads = calc_take_threads(&argc, argv, 4);
+        if (argc < 5 || !(tol > 0) || threads < 0) {
+            fprintf(out, "Uso: calc integ <a> <b> <func> [--tol 1e-10] [-j N]\n");
+            return 2;
+        }
         double a = atof(argv[2]);
         double b = atof(argv[3]);
-        Term terms[MAX_TERMS] = {0};
-        TrigTerm trig_terms[MAX_TERMS] = {0};
-        int num_terms = 0, num_trig = 0;
-        int is_trig = 0;
-        for (int i = 4; i < argc; i++) {
-            if (strcmp(argv[i], "/") == 0) {
-                is_trig = 1;
-                continue;
-            }
-            if (!is_trig && i + 1 < argc && num_terms < MAX_TERMS) {
-                terms[num_terms].coef = atof(argv[i]);
-                terms[num_terms].exp = atoi(argv[i + 1]);
-                num_terms++;
-                i++;
-            } else if (is_trig && i + 1 < argc && num_trig < MAX_TERMS) {
-                trig_terms[num_trig].coef = atof(argv[i]);
-                strncpy(trig_terms[num_trig].type, argv[i + 1], sizeof(trig_terms[num_trig].type) - 1);
-                num_trig++;
-                i++;
-            }
+        char err[128];
+        CalcProgram *f = calc_function_arg(argc, argv, 4, err, sizeof(err));
+        if (!f) {
+            fprintf(out, "Erro na função: %s\n", err);
+            return 2;
+        }
+        CalcPool *pool = calc_pool_create(threads);
+        CalcQuadResult r = integrate_adaptive(f, a, b, tol, pool);
+        calc_pool_destroy(pool);
+        calc_program_free(f);
+        if (!isfinite(r.value)) {
+            fprintf(out, "A integral de %g a %g não converge (a função não é finita no intervalo).\n", a, b);
+            return 1;
+        }
+        fprintf(out, "Integral de %g a %g: %.12g\n", a, b, r.value);
+        fprintf(out, "Erro estimado: %.2g (%ld avaliações, %d intervalos)\n", r.error, r.evals, r.intervals);
+        if (!r.converged) {
+            fprintf(out, "Aviso: a tolerância %.1g não foi atingida; a função pode ter uma singularidade ou a integral divergir.\n", tol);
         }
-        double integral_val = integrate_trapezoid(terms, num_terms, trig_terms, num_trig, a, b);
-        printf("Integral aproximada de %.2f a %.2f: %.4f\n", a, b, integral_val);
     } else {
-        printf("Comando ou argumentos invalidos para 'calc'.\n");
-        return;
+        fprintf(out, "Comando ou argumentos invalidos para 'calc'.\n");
+        return 2;
     }
+    return 0;
 }
 
-Plugin* register_plugin() {
-    static Plugin calc_plugin = {
+static const PluginCommand calc_commands[] = {
+    { "calc", execute_calc, "Calculadora: soma, sub, mult, div, expressões, derivadas, limites, integrais, matrizes e estatísticas.",
+      PLUGIN_CAP_THREAD_SAFE },
+};
+
+PluginV2* register_plugin_v2() {
+    static PluginV2 calc_plugin = {
+        JNTD_PLUGIN_ABI_VERSION,
         "calc",
-        execute_calc
+        calc_commands,
+        sizeof(calc_commands) / sizeof(calc_commands[0]),
+        calc_batch_init,
+        NULL
     };
     return &calc_plugin;
 }
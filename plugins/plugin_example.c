@@ -3,46 +3,92 @@
  *
  * This file serves as a basic template for creating new plugins for the JNTD framework.
  * It demonstrates the essential components required for a plugin to be successfully loaded
- * and executed by the main application.
+ * and executed by the main application, using the v2 plugin ABI declared in plugin.h.
  *
- * To create your own plugin, you can copy this file and modify the `execute_example`
- * function to implement your desired functionality. Remember to also update the
- * `register_plugin` function to reflect the new name of your plugin.
+ * To create your own plugin, you can copy this file, rename the command functions and
+ * update the `example_commands` table and `register_plugin_v2` to describe your plugin.
+ *
+ * Plugins written against the old ABI (a single `register_plugin` returning a `Plugin`
+ * with an `execute(const char *args)` function) still load, but they have to parse their
+ * own argument string and cannot declare capabilities.
  */
 
 #include <stdio.h>
 #include "plugin.h"
 
+static int example_calls = 0;
+
 /*
- * This is the core function of the plugin, where you can define its primary behavior.
- * It receives a constant character pointer `args` as a parameter, which allows you to
- * pass arguments from the main application to the plugin.
- *
- * For example, if a user runs `example hello world`, the `args` parameter will contain
- * the string "hello world", which you can then parse and use within your function.
+ * A command receives a `PluginCall`. The core has already split the user's input:
+ * `argv[0]` is the command name and `argv[1..argc-1]` are the arguments, with quotes
+ * honoured, so `example "hello world" 42` gives argc == 3. `raw_args` still holds the
+ * text exactly as typed. Write output to `call->out` rather than stdout, and return 0
+ * on success or a non-zero status on error.
  */
-void execute_example(const char *args) {
-    printf("Hello from the example plugin!\n");
-    if (args) {
-        printf("Received arguments: %s\n", args);
+static int execute_example(const PluginCall *call) {
+    example_calls++;
+    fprintf(call->out, "Hello from the example plugin!\n");
+    for (int i = 1; i < call->argc; i++) {
+        fprintf(call->out, "Received argument %d: %s\n", i, call->argv[i]);
     }
+    return 0;
 }
 
 /*
- * The `register_plugin` function is responsible for creating and configuring an instance
- * of the `Plugin` struct. This struct holds the essential information about the plugin,
- * including its name and a pointer to its execution function.
+ * A plugin may expose more than one command. This one just echoes its arguments back
+ * and fails when it receives none, to show how a status is returned.
+ */
+static int execute_echo(const PluginCall *call) {
+    if (call->argc < 2) {
+        fprintf(call->out, "Usage: example_echo <text>\n");
+        return 2;
+    }
+    fprintf(call->out, "%s\n", call->raw_args);
+    return 0;
+}
+
+/*
+ * `init` runs once, right after the plugin is loaded; returning non-zero makes the core
+ * reject the plugin. `shutdown` runs once before the library is unloaded. Both are
+ * optional: set them to NULL when there is no expensive setup to do.
+ */
+static int example_init(void) {
+    example_calls = 0;
+    return 0;
+}
+
+static void example_shutdown(void) {
+}
+
+/*
+ * The command table. Each entry has a name, the function to run, a one-line description
+ * (shown by `help` and used by the 2b router) and capability flags:
  *
- * - The `name` field defines the command that users will enter to run the plugin.
- * - The `execute` field is a function pointer that points to the plugin's main logic.
+ * - PLUGIN_CAP_THREAD_SAFE: the command does not touch shared state unsafely.
+ * - PLUGIN_CAP_ASYNC: the command may keep running after the prompt comes back.
+ * - PLUGIN_CAP_NEEDS_TTY: the command reads from the terminal (prompts, editors).
+ */
+static const PluginCommand example_commands[] = {
+    { "example", execute_example, "Plugin de exemplo: imprime os argumentos recebidos.", 0 },
+    { "example_echo", execute_echo, "Plugin de exemplo: repete o texto digitado.", PLUGIN_CAP_THREAD_SAFE },
+};
+
+/*
+ * The core looks for `register_plugin_v2` first. The returned struct must stay valid
+ * while the plugin is loaded, so it is declared static.
  *
- * When the main application loads the plugin, it will call this function to retrieve
- * the plugin's metadata.
+ * Whenever plugins/ changes, the core opens every .so once inside the shell process to
+ * rebuild its manifest. That runs this function and any library constructors even if the
+ * plugin is never used, so keep both free of side effects and do setup in `init`.
  */
-Plugin* register_plugin() {
-    static Plugin example_plugin = {
-        "example",      // The command name for this plugin
-        execute_example // The function to be executed
+PluginV2* register_plugin_v2() {
+    static PluginV2 example_plugin = {
+        JNTD_PLUGIN_ABI_VERSION,   // ABI version this plugin was built against
+        "example",                 // Plugin name, shown in `help`
+        example_commands,          // Commands exposed by the plugin
+        sizeof(example_commands) / sizeof(example_commands[0]),
+        example_init,              // Optional one-time setup
+        example_shutdown           // Optional teardown
     };
     return &example_plugin;
 }
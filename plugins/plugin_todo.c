@@ -1,16 +1,85 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // strptime, pthread_tryjoin_np
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <ctype.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include "plugin.h"
 
-#define MAX_TODO_LINES 100
-static char lines[MAX_TODO_LINES][1024];
-static int count;
+// Armazenamento dos TODOs: um log so de acrescimo (todo.log) com registros
+// de tamanho fixo. Cada registro e uma versao completa da tarefa (PUT) ou
+// uma lapide (DEL); o indice em memoria aponta cada id para o offset da
+// versao mais recente, entao add, remove e edit custam um append. Os
+// registros de uma transacao sao gravados juntos e o ultimo leva a flag de
+// commit; na abertura, uma transacao sem commit ou com CRC invalido no fim
+// do arquivo (queda no meio da gravacao) e descartada. Quando as versoes
+// mortas passam das vivas, uma thread compacta o log num arquivo novo.
+#define TODO_LOG_FILE "todo.log"
+#define TODO_LOG_COMPACT_FILE "todo.log.compact"
+#define TODO_LEGACY_FILE "todo.txt"
+#define TODO_LOG_MAGIC "JNTDTODO"
+#define TODO_LOG_VERSION 1
+#define TODO_HEADER_SIZE 64
+#define TODO_RECORD_SIZE 768
+#define TODO_RECORD_MAGIC 0x4f444f54u // "TODO"
+#define TODO_OWNER_MAX 96
+#define TODO_TEXT_MAX (TODO_RECORD_SIZE - 40 - TODO_OWNER_MAX)
+#define TODO_COMPACT_MIN_GARBAGE 1024
+
+enum { TODO_REC_PUT = 1, TODO_REC_DEL = 2 };
+#define TODO_REC_COMMIT 0x01
+
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;        // CRC-32 de tudo depois deste campo
+    uint32_t id;         // estavel: nao muda com edicoes nem com a compactacao
+    uint8_t type;        // TODO_REC_PUT ou TODO_REC_DEL
+    uint8_t flags;       // TODO_REC_COMMIT no ultimo registro da transacao
+    uint16_t reserved;
+    uint64_t txn;
+    int64_t created;
+    int64_t due;         // -1 = sem prazo
+    char owner[TODO_OWNER_MAX];
+    char text[TODO_TEXT_MAX];
+} TodoRecord;
+
+_Static_assert(sizeof(TodoRecord) == TODO_RECORD_SIZE, "TodoRecord deve ter TODO_RECORD_SIZE bytes");
+
+typedef struct {
+    int fd;
+    int dir_fd;              // diretorio do log, fixado na abertura
+    unsigned char *map;      // mapeamento somente leitura do log
+    size_t map_len;
+    uint64_t size;           // fim do ultimo registro confirmado
+    uint64_t *offsets;       // id -> offset da versao atual (0 = nao existe)
+    uint32_t id_cap;
+    uint32_t next_id;
+    uint64_t next_txn;
+    uint32_t live;
+    uint32_t garbage;        // registros que nao sao a versao atual de ninguem
+    bool open;
+    bool legacy_checked;     // a migracao do todo.txt ja foi tentada nesta abertura
+    pthread_mutex_t lock;
+    pthread_t compactor;
+    bool compacting;
+} TodoStore;
+
+static TodoStore todo_store = { .fd = -1, .dir_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
 
 // Forward declarations
 void check_todos();
@@ -19,41 +88,45 @@ void list_todo();
 void remove_todo(const char *args);
 void edit_todo(const char *args);
 void edit_with_vim();
+int search_todo(int argc, char **argv);
+int import_todo(int argc, char **argv);
+int export_todo(int argc, char **argv);
 time_t parse_date(const char *date_str);
+static bool todo_store_open(bool create);
+static void todo_store_close();
+static int todo_compact_now();
+static void todo_notifier_start();
+static void todo_notifier_stop();
+
+static plugin_notify_func todo_notify = NULL;
 
-void execute_todo(const char* args) {
-    char command[256] = {0};
-    const char* sub_args = "";
+// Chamada pelo nucleo antes do init, so no modo interativo.
+void plugin_set_notifier(plugin_notify_func notify) {
+    todo_notify = notify;
+}
 
-    if (args == NULL || strlen(args) == 0) {
+// argv[1] e a acao; o resto da linha (com os espacos originais) vai para ela
+int execute_todo(const PluginCall *call) {
+    if (call->argc < 2) {
         printf("Comando TODO incompleto. Uso: todo <ação>\n");
-        printf("Ações disponiveis: add, list, remove, edit, check, vim\n");
-        return;
+        printf("Ações disponiveis: add, list, search, remove, edit, check, vim, import, export, compact\n");
+        return 2;
     }
 
-    const char* first_space = strchr(args, ' ');
-    if (first_space) {
-        size_t cmd_len = first_space - args;
-        if (cmd_len < sizeof(command)) {
-            strncpy(command, args, cmd_len);
-            command[cmd_len] = '\0';
-        } else {
-            strncpy(command, args, sizeof(command) - 1);
-            command[sizeof(command) - 1] = '\0';
-        }
-        sub_args = first_space + 1;
-        while (*sub_args && isspace((unsigned char)*sub_args)) {
-            sub_args++;
-        }
-    } else {
-        strncpy(command, args, sizeof(command) - 1);
-        command[sizeof(command) - 1] = '\0';
-    }
+    const char *command = call->argv[1];
+    const char *sub_args = call->raw_args;
+    while (*sub_args && isspace((unsigned char)*sub_args)) sub_args++;
+    while (*sub_args && !isspace((unsigned char)*sub_args)) sub_args++;
+    while (*sub_args && isspace((unsigned char)*sub_args)) sub_args++;
 
+    if (!todo_store_open(true)) return 1;
+    todo_notifier_start(); // o log pode ter sido criado agora
     if (strcmp(command, "add") == 0) {
         handle_add_todo(sub_args);
     } else if (strcmp(command, "list") == 0) {
         list_todo();
+    } else if (strcmp(command, "search") == 0) {
+        return search_todo(call->argc - 2, call->argv + 2);
     } else if (strcmp(command, "remove") == 0) {
         remove_todo(sub_args);
     } else if (strcmp(command, "edit") == 0) {
@@ -62,15 +135,45 @@ void execute_todo(const char* args) {
         check_todos();
     } else if (strcmp(command, "vim") == 0) {
         edit_with_vim();
+    } else if (strcmp(command, "import") == 0) {
+        return import_todo(call->argc - 2, call->argv + 2);
+    } else if (strcmp(command, "export") == 0) {
+        return export_todo(call->argc - 2, call->argv + 2);
+    } else if (strcmp(command, "compact") == 0) {
+        return todo_compact_now();
     } else {
-        printf("Ação TODO desconhecida: '%s'. Use 'add', 'list', 'remove', 'edit', 'check', 'vim'.\n", command);
+        printf("Ação TODO desconhecida: '%s'. Use 'add', 'list', 'search', 'remove', 'edit', 'check', 'vim', 'import', 'export', 'compact'.\n", command);
+        return 2;
     }
+    return 0;
 }
 
-Plugin* register_plugin() {
-    static Plugin todo_plugin = {
+static int todo_plugin_init(void) {
+    // com avisos, abre o log ja para armar o timer do proximo prazo; sem
+    // log ainda nao ha prazo: criar e migrar fica para o primeiro comando
+    if (todo_notify && todo_store_open(false)) todo_notifier_start();
+    return 0;
+}
+
+static void todo_plugin_shutdown(void) {
+    todo_store_close();
+}
+
+// 'add' pergunta responsavel e prazo e 'vim' abre o editor: precisa do
+// terminal. NOTIFY: avisa quando um prazo vence, mesmo sem ser chamado.
+static const PluginCommand todo_commands[] = {
+    { "todo", execute_todo, "Gerencia tarefas (add, list, search, remove, edit, check, vim, import, export).",
+      PLUGIN_CAP_NEEDS_TTY | PLUGIN_CAP_NOTIFY },
+};
+
+PluginV2* register_plugin_v2() {
+    static PluginV2 todo_plugin = {
+        JNTD_PLUGIN_ABI_VERSION,
         "todo",
-        execute_todo
+        todo_commands,
+        sizeof(todo_commands) / sizeof(todo_commands[0]),
+        todo_plugin_init,
+        todo_plugin_shutdown
     };
     return &todo_plugin;
 }
@@ -86,123 +189,1681 @@ time_t parse_date(const char *date_str) {
     tm.tm_mon -= 1;
     tm.tm_year -= 1900;
     tm.tm_hour = 23; tm.tm_min = 59; tm.tm_sec = 59;
+    tm.tm_isdst = -1;
     return mktime(&tm);
 }
 
-void check_todos() {
-    FILE *todo_file = fopen("todo.txt", "r");
-    if (todo_file == NULL) {
-        if (access("todo.txt", F_OK) == -1) {
-            printf("Nenhum TODO encontrado.\n");
+static void format_due(int64_t due, char *out, size_t size) {
+    if (due < 0) {
+        snprintf(out, size, "Sem prazo");
+        return;
+    }
+    time_t t = (time_t)due;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(out, size, "%d/%m/%Y", &tm);
+}
+
+// --- registros e CRC ---
+
+// CRC-32 (o mesmo do zlib) com slicing-by-8: oito tabelas, oito bytes por
+// passo. Todo registro passa por aqui ao ser gravado e ao abrir o log, e a
+// versao byte a byte dominava o tempo de um import grande.
+static uint32_t todo_crc_table[8][256];
+static pthread_once_t todo_crc_once = PTHREAD_ONCE_INIT;
+
+static void todo_crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        todo_crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = todo_crc_table[t - 1][i];
+            todo_crc_table[t][i] = (prev >> 8) ^ todo_crc_table[0][prev & 0xff];
+        }
+    }
+}
+
+static uint32_t todo_crc32(const void *data, size_t n) {
+    pthread_once(&todo_crc_once, todo_crc_init);
+    uint32_t crc = 0xffffffffu;
+    const unsigned char *p = data;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = todo_crc_table[7][lo & 0xff] ^ todo_crc_table[6][(lo >> 8) & 0xff] ^
+              todo_crc_table[5][(lo >> 16) & 0xff] ^ todo_crc_table[4][lo >> 24] ^
+              todo_crc_table[3][hi & 0xff] ^ todo_crc_table[2][(hi >> 8) & 0xff] ^
+              todo_crc_table[1][(hi >> 16) & 0xff] ^ todo_crc_table[0][hi >> 24];
+    }
+#endif
+    while (n--) crc = todo_crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static void todo_record_seal(TodoRecord *r) {
+    r->magic = TODO_RECORD_MAGIC;
+    r->crc = todo_crc32((const char *)r + 8, TODO_RECORD_SIZE - 8);
+}
+
+static bool todo_record_valid(const TodoRecord *r) {
+    return r->magic == TODO_RECORD_MAGIC && r->crc == todo_crc32((const char *)r + 8, TODO_RECORD_SIZE - 8) &&
+           (r->type == TODO_REC_PUT || r->type == TODO_REC_DEL) && r->id != 0;
+}
+
+static void todo_record_fill(TodoRecord *r, uint32_t id, int64_t created, int64_t due,
+                             const char *owner, const char *text) {
+    memset(r, 0, sizeof(*r));
+    r->id = id;
+    r->type = TODO_REC_PUT;
+    r->created = created;
+    r->due = due;
+    snprintf(r->owner, sizeof(r->owner), "%s", owner && *owner ? owner : "Desconhecido");
+    snprintf(r->text, sizeof(r->text), "%s", text ? text : "");
+}
+
+static const TodoRecord *todo_record_at(uint64_t offset) {
+    return (const TodoRecord *)(todo_store.map + offset);
+}
+
+// Versao atual do id, ou NULL (chamar com o lock).
+static const TodoRecord *todo_get(uint32_t id) {
+    if (id == 0 || id >= todo_store.id_cap || todo_store.offsets[id] == 0) return NULL;
+    return todo_record_at(todo_store.offsets[id]);
+}
+
+// --- prazos ---
+
+// Heap minimo de (prazo, id) que guarda a posicao de cada id, para trocar ou
+// tirar o prazo de uma tarefa em O(log n). todo_due_heap tem todas as
+// tarefas com prazo (base do 'todo check'); todo_alarm_heap so as que ainda
+// nao venceram, e o topo dela e o instante em que o timerfd esta armado.
+typedef struct {
+    int64_t due;
+    uint32_t id;
+} TodoDeadline;
+
+typedef struct {
+    TodoDeadline *items;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *pos;      // id -> posicao + 1 (0 = fora do heap)
+    uint32_t pos_cap;
+} TodoHeap;
+
+static TodoHeap todo_due_heap;
+static TodoHeap todo_alarm_heap;
+static int todo_timer_fd = -1;
+static int todo_wake_fd = -1;    // eventfd que encerra a thread de avisos
+static int64_t todo_armed_due = -1;
+static pthread_t todo_notifier;
+static bool todo_notifier_running = false;
+
+static bool todo_deadline_before(const TodoDeadline *a, const TodoDeadline *b) {
+    return a->due < b->due || (a->due == b->due && a->id < b->id);
+}
+
+static void todo_heap_place(TodoHeap *h, uint32_t i, TodoDeadline d) {
+    h->items[i] = d;
+    h->pos[d.id] = i + 1;
+}
+
+static void todo_heap_sift(TodoHeap *h, uint32_t i) {
+    TodoDeadline d = h->items[i];
+    while (i > 0 && todo_deadline_before(&d, &h->items[(i - 1) / 2])) {
+        todo_heap_place(h, i, h->items[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= h->count) break;
+        if (child + 1 < h->count && todo_deadline_before(&h->items[child + 1], &h->items[child])) child++;
+        if (!todo_deadline_before(&h->items[child], &d)) break;
+        todo_heap_place(h, i, h->items[child]);
+        i = child;
+    }
+    todo_heap_place(h, i, d);
+}
+
+static void todo_heap_remove(TodoHeap *h, uint32_t id) {
+    if (id >= h->pos_cap || h->pos[id] == 0) return;
+    uint32_t i = h->pos[id] - 1;
+    h->pos[id] = 0;
+    TodoDeadline last = h->items[--h->count];
+    if (i == h->count) return;
+    h->items[i] = last;
+    todo_heap_sift(h, i);
+}
+
+static bool todo_heap_set(TodoHeap *h, uint32_t id, int64_t due) {
+    if (id >= h->pos_cap) {
+        uint32_t cap = h->pos_cap ? h->pos_cap : 1024;
+        while (cap <= id) cap *= 2;
+        uint32_t *grown = realloc(h->pos, cap * sizeof(uint32_t));
+        if (!grown) return false;
+        memset(grown + h->pos_cap, 0, (cap - h->pos_cap) * sizeof(uint32_t));
+        h->pos = grown;
+        h->pos_cap = cap;
+    }
+    TodoDeadline d = { due, id };
+    if (h->pos[id]) {
+        uint32_t i = h->pos[id] - 1;
+        h->items[i] = d;
+        todo_heap_sift(h, i);
+        return true;
+    }
+    if (h->count == h->cap) {
+        uint32_t cap = h->cap ? h->cap * 2 : 256;
+        TodoDeadline *grown = realloc(h->items, cap * sizeof(TodoDeadline));
+        if (!grown) return false;
+        h->items = grown;
+        h->cap = cap;
+    }
+    h->items[h->count] = d;
+    todo_heap_sift(h, h->count++);
+    return true;
+}
+
+static void todo_heap_free(TodoHeap *h) {
+    free(h->items);
+    free(h->pos);
+    memset(h, 0, sizeof(*h));
+}
+
+// Visita so os nos com prazo <= limite: os filhos de um no vencido podem
+// estar vencidos, os de um no no futuro nao. Custa O(k) para k vencidos.
+static uint32_t todo_heap_collect(const TodoHeap *h, int64_t limit, TodoDeadline *out, uint32_t max) {
+    if (h->count == 0 || h->items[0].due > limit) return 0;
+    uint32_t *stack = malloc(h->count * sizeof(uint32_t));
+    if (!stack) return 0;
+    uint32_t top = 0, found = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t i = stack[--top];
+        if (out && found < max) out[found] = h->items[i];
+        found++;
+        for (uint32_t c = 2 * i + 1; c <= 2 * i + 2 && c < h->count; c++) {
+            if (h->items[c].due <= limit) stack[top++] = c;
+        }
+    }
+    free(stack);
+    return found;
+}
+
+static int compare_deadlines(const void *a, const void *b) {
+    return todo_deadline_before(a, b) ? -1 : todo_deadline_before(b, a) ? 1 : 0;
+}
+
+// Arma o timerfd para o prazo mais proximo que ainda nao venceu (chamar
+// com o lock). So faz a syscall quando o topo do heap mudou.
+static void todo_alarm_rearm() {
+    if (todo_timer_fd < 0) return;
+    int64_t due = todo_alarm_heap.count ? todo_alarm_heap.items[0].due : 0;
+    if (due == todo_armed_due) return;
+    todo_armed_due = due;
+    // tv_sec 0 desarma; TFD_TIMER_CANCEL_ON_SET acorda a thread se o
+    // relogio do sistema for ajustado, para reavaliar os prazos
+    struct itimerspec its = { .it_value = { .tv_sec = due } };
+    if (timerfd_settime(todo_timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) != 0) {
+        perror("todo: timerfd_settime");
+    }
+}
+
+// Mantem os dois heaps em dia com a versao atual de uma tarefa.
+static void todo_deadline_update(uint32_t id, int64_t due) {
+    if (due < 0) {
+        todo_heap_remove(&todo_due_heap, id);
+        todo_heap_remove(&todo_alarm_heap, id);
+    } else {
+        todo_heap_set(&todo_due_heap, id, due);
+        if (due > (int64_t)time(NULL)) todo_heap_set(&todo_alarm_heap, id, due);
+        else todo_heap_remove(&todo_alarm_heap, id);
+    }
+    todo_alarm_rearm();
+}
+
+// --- busca ---
+
+// Indice invertido: cada palavra do texto (minusculas, separada por
+// qualquer coisa que nao seja letra ou digito; bytes UTF-8 contam como
+// letra) aponta para a lista ordenada dos ids que a contem. todo_owners e
+// o indice secundario por responsavel, com o nome inteiro como chave. As
+// listas so mudam quando uma tarefa muda, dentro de todo_index_apply.
+#define TODO_TERM_MAX 64
+
+typedef struct {
+    char *key;          // NULL = posicao vazia
+    uint32_t *ids;      // ordenados, sem repeticao
+    uint32_t count;
+    uint32_t cap;
+} TodoPosting;
+
+typedef struct {
+    TodoPosting *slots; // enderecamento aberto, cap potencia de 2
+    uint32_t cap;
+    uint32_t used;
+} TodoTermIndex;
+
+static TodoTermIndex todo_words;
+static TodoTermIndex todo_owners;
+
+static uint32_t todo_term_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool todo_terms_grow(TodoTermIndex *idx) {
+    uint32_t cap = idx->cap ? idx->cap * 2 : 1024;
+    TodoPosting *slots = calloc(cap, sizeof(TodoPosting));
+    if (!slots) return false;
+    for (uint32_t i = 0; i < idx->cap; i++) {
+        TodoPosting *p = &idx->slots[i];
+        if (!p->key) continue;
+        uint32_t h = todo_term_hash(p->key, strlen(p->key)) & (cap - 1);
+        while (slots[h].key) h = (h + 1) & (cap - 1);
+        slots[h] = *p;
+    }
+    free(idx->slots);
+    idx->slots = slots;
+    idx->cap = cap;
+    return true;
+}
+
+// Lista de uma chave; com create, cria a chave se ela nao existe.
+static TodoPosting *todo_terms_find(TodoTermIndex *idx, const char *key, size_t len, bool create) {
+    if (create && (idx->used + 1) * 10 > idx->cap * 7 && !todo_terms_grow(idx)) return NULL;
+    if (idx->cap == 0) return NULL;
+    uint32_t h = todo_term_hash(key, len) & (idx->cap - 1);
+    for (; idx->slots[h].key; h = (h + 1) & (idx->cap - 1)) {
+        TodoPosting *p = &idx->slots[h];
+        if (strncmp(p->key, key, len) == 0 && p->key[len] == '\0') return p;
+    }
+    if (!create) return NULL;
+    TodoPosting *p = &idx->slots[h];
+    p->key = strndup(key, len);
+    if (!p->key) return NULL;
+    idx->used++;
+    return p;
+}
+
+// Primeira posicao com ids[i] >= id.
+static uint32_t todo_posting_lower(const TodoPosting *p, uint32_t id) {
+    uint32_t lo = 0, hi = p->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->ids[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Avanca *cursor ate o primeiro ids[i] >= id e diz se achou id. Os ids
+// consultados so crescem, entao a busca e exponencial a partir do cursor:
+// cruzar uma lista curta com uma longa nao paga log n por id.
+static bool todo_posting_seek(const TodoPosting *p, uint32_t *cursor, uint32_t id) {
+    uint32_t lo = *cursor, hi = lo, step = 1;
+    while (hi < p->count && p->ids[hi] < id) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > p->count) hi = p->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->ids[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    *cursor = lo;
+    return lo < p->count && p->ids[lo] == id;
+}
+
+static void todo_posting_add(TodoPosting *p, uint32_t id) {
+    // ids novos sao sempre os maiores: o caso comum e um append
+    uint32_t i = p->count && p->ids[p->count - 1] < id ? p->count : todo_posting_lower(p, id);
+    if (i < p->count && p->ids[i] == id) return;
+    if (p->count == p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : 4;
+        uint32_t *grown = realloc(p->ids, cap * sizeof(uint32_t));
+        if (!grown) return;
+        p->ids = grown;
+        p->cap = cap;
+    }
+    memmove(p->ids + i + 1, p->ids + i, (p->count - i) * sizeof(uint32_t));
+    p->ids[i] = id;
+    p->count++;
+}
+
+static void todo_posting_del(TodoPosting *p, uint32_t id) {
+    uint32_t i = todo_posting_lower(p, id);
+    if (i >= p->count || p->ids[i] != id) return;
+    memmove(p->ids + i, p->ids + i + 1, (p->count - i - 1) * sizeof(uint32_t));
+    p->count--;
+}
+
+static void todo_terms_free(TodoTermIndex *idx) {
+    for (uint32_t i = 0; i < idx->cap; i++) {
+        free(idx->slots[i].key);
+        free(idx->slots[i].ids);
+    }
+    free(idx->slots);
+    memset(idx, 0, sizeof(*idx));
+}
+
+// Proxima palavra de *s, em minusculas, em out; retorna o tamanho (0 no fim).
+static size_t todo_next_term(const char **s, char *out) {
+    const unsigned char *p = (const unsigned char *)*s;
+    while (*p && !(isalnum(*p) || *p >= 0x80)) p++;
+    size_t len = 0;
+    for (; *p && (isalnum(*p) || *p >= 0x80); p++) {
+        if (len < TODO_TERM_MAX) out[len++] = (char)tolower(*p);
+    }
+    *s = (const char *)p;
+    return len;
+}
+
+// Chave do indice de responsaveis: o nome em minusculas, sem espacos nas pontas.
+static size_t todo_owner_key(const char *owner, char *out, size_t size) {
+    while (isspace((unsigned char)*owner)) owner++;
+    size_t len = 0;
+    for (; *owner && len < size - 1; owner++) out[len++] = (char)tolower((unsigned char)*owner);
+    while (len > 0 && isspace((unsigned char)out[len - 1])) len--;
+    out[len] = '\0';
+    return len;
+}
+
+// Tira (add = false) ou poe uma versao de tarefa nos indices de busca.
+static void todo_search_update(const TodoRecord *r, bool add) {
+    char term[TODO_TERM_MAX];
+    const char *s = r->text;
+    size_t len;
+    while ((len = todo_next_term(&s, term)) > 0) {
+        TodoPosting *p = todo_terms_find(&todo_words, term, len, add);
+        if (p && add) todo_posting_add(p, r->id);
+        else if (p) todo_posting_del(p, r->id);
+    }
+    char owner[TODO_OWNER_MAX];
+    len = todo_owner_key(r->owner, owner, sizeof(owner));
+    TodoPosting *p = todo_terms_find(&todo_owners, owner, len, add);
+    if (p && add) todo_posting_add(p, r->id);
+    else if (p) todo_posting_del(p, r->id);
+}
+
+// --- indice ---
+
+static bool todo_index_reserve(uint32_t id) {
+    if (id < todo_store.id_cap) return true;
+    uint32_t cap = todo_store.id_cap ? todo_store.id_cap : 1024;
+    while (cap <= id) cap *= 2;
+    uint64_t *grown = realloc(todo_store.offsets, cap * sizeof(uint64_t));
+    if (!grown) return false;
+    memset(grown + todo_store.id_cap, 0, (cap - todo_store.id_cap) * sizeof(uint64_t));
+    todo_store.offsets = grown;
+    todo_store.id_cap = cap;
+    return true;
+}
+
+// Aplica um registro confirmado ao indice.
+static void todo_index_apply(const TodoRecord *r, uint64_t offset) {
+    if (!todo_index_reserve(r->id)) return;
+    bool existed = todo_store.offsets[r->id] != 0;
+    if (existed) {
+        todo_store.garbage++; // a versao anterior morreu
+        todo_search_update(todo_record_at(todo_store.offsets[r->id]), false);
+    }
+    if (r->type == TODO_REC_PUT) todo_search_update(r, true);
+    if (r->type == TODO_REC_PUT) {
+        todo_store.offsets[r->id] = offset;
+        if (!existed) todo_store.live++;
+    } else {
+        todo_store.offsets[r->id] = 0;
+        todo_store.garbage++; // a lapide tambem so ocupa espaco
+        if (existed) todo_store.live--;
+    }
+    if (r->id >= todo_store.next_id) todo_store.next_id = r->id + 1;
+    if (r->txn >= todo_store.next_txn) todo_store.next_txn = r->txn + 1;
+    todo_deadline_update(r->id, r->type == TODO_REC_PUT ? r->due : -1);
+}
+
+static bool todo_map(uint64_t need) {
+    if (need <= todo_store.map_len && todo_store.map) return true;
+    size_t len = todo_store.map_len ? todo_store.map_len : (1 << 20);
+    while (len < need) len *= 2;
+    if (todo_store.map) munmap(todo_store.map, todo_store.map_len);
+    // mapear alem do fim do arquivo e permitido; so lemos ate todo_store.size
+    void *m = mmap(NULL, len, PROT_READ, MAP_SHARED, todo_store.fd, 0);
+    if (m == MAP_FAILED) {
+        todo_store.map = NULL;
+        todo_store.map_len = 0;
+        return false;
+    }
+    todo_store.map = m;
+    todo_store.map_len = len;
+    return true;
+}
+
+// Le o log inteiro, aplica as transacoes confirmadas e corta o resto.
+static bool todo_replay(uint64_t file_size) {
+    if (!todo_map(file_size)) return false;
+    uint64_t off = TODO_HEADER_SIZE;
+    uint64_t txn_start = off;
+    uint64_t committed = off;
+    while (off + TODO_RECORD_SIZE <= file_size) {
+        const TodoRecord *r = todo_record_at(off);
+        if (!todo_record_valid(r) || r->txn != todo_record_at(txn_start)->txn) break;
+        off += TODO_RECORD_SIZE;
+        if (r->flags & TODO_REC_COMMIT) {
+            for (uint64_t o = txn_start; o < off; o += TODO_RECORD_SIZE) todo_index_apply(todo_record_at(o), o);
+            committed = txn_start = off;
+        }
+    }
+    if (committed < file_size) {
+        fprintf(stderr, "todo: descartando %llu bytes de uma gravação incompleta em %s.\n",
+                (unsigned long long)(file_size - committed), TODO_LOG_FILE);
+        if (ftruncate(todo_store.fd, committed) != 0) perror("todo: ftruncate");
+    }
+    todo_store.size = committed;
+    return true;
+}
+
+static bool todo_write_at(const void *data, size_t bytes, uint64_t off) {
+    const char *p = data;
+    for (size_t done = 0; done < bytes;) {
+        ssize_t w = pwrite(todo_store.fd, p + done, bytes - done, off + done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            perror("todo: erro ao gravar o log");
+            return false;
+        }
+        done += w;
+    }
+    return true;
+}
+
+// Uma transacao gravada aos pedacos: os registros vao para o log a partir
+// de todo_store.size, todos com o mesmo txn, mas so valem quando o ultimo,
+// com a flag de commit, estiver no disco. O ultimo registro de cada pedaco
+// fica segurado ate o proximo, para que o commit saia nele. Chamar com o
+// lock do begin ao commit/abort.
+typedef struct {
+    uint64_t txn;
+    uint64_t start;     // todo_store.size quando a transacao comecou
+    uint64_t end;       // fim do que ja foi gravado
+    TodoRecord held;
+    bool has_held;
+    bool failed;
+} TodoTxn;
+
+static void todo_txn_begin(TodoTxn *t) {
+    t->txn = todo_store.next_txn++;
+    t->start = t->end = todo_store.size;
+    t->has_held = false;
+    t->failed = false;
+}
+
+static bool todo_txn_write(TodoTxn *t, TodoRecord *records, size_t n) {
+    if (t->failed || n == 0) return !t->failed;
+    if (t->has_held) {
+        todo_record_seal(&t->held);
+        t->failed = !todo_write_at(&t->held, TODO_RECORD_SIZE, t->end);
+        t->end += TODO_RECORD_SIZE;
+    }
+    for (size_t i = 0; i < n; i++) {
+        records[i].txn = t->txn;
+        records[i].flags = 0;
+        if (i < n - 1) todo_record_seal(&records[i]);
+    }
+    size_t bytes = (n - 1) * TODO_RECORD_SIZE;
+    if (!t->failed && bytes) t->failed = !todo_write_at(records, bytes, t->end);
+    t->end += bytes;
+    t->held = records[n - 1];
+    t->has_held = true;
+    return !t->failed;
+}
+
+static void todo_txn_abort(TodoTxn *t) {
+    if (t->end > t->start && ftruncate(todo_store.fd, t->start) != 0) perror("todo: ftruncate");
+    t->end = t->start;
+    t->has_held = false;
+}
+
+// Grava o registro segurado com a flag de commit, um unico fdatasync e so
+// entao aplica tudo ao indice.
+static bool todo_txn_commit(TodoTxn *t) {
+    if (!t->failed && t->has_held) {
+        t->held.flags = TODO_REC_COMMIT;
+        todo_record_seal(&t->held);
+        t->failed = !todo_write_at(&t->held, TODO_RECORD_SIZE, t->end);
+        t->end += TODO_RECORD_SIZE;
+    }
+    if (!t->failed && t->end > t->start && fdatasync(todo_store.fd) != 0) {
+        perror("todo: fdatasync");
+        t->failed = true;
+    }
+    if (t->failed || !todo_map(t->end)) {
+        todo_txn_abort(t);
+        return false;
+    }
+    todo_store.size = t->end;
+    for (uint64_t off = t->start; off < t->end; off += TODO_RECORD_SIZE) todo_index_apply(todo_record_at(off), off);
+    return true;
+}
+
+// Grava os registros como uma transacao pequena (add, edit, remove, vim).
+static bool todo_commit(TodoRecord *records, size_t n) {
+    if (n == 0) return true;
+    TodoTxn t;
+    todo_txn_begin(&t);
+    todo_txn_write(&t, records, n);
+    return todo_txn_commit(&t);
+}
+
+// --- migracao do todo.txt antigo ---
+
+// Linha antiga: "[Mon Oct 19 10:00:00 2026] TODO: texto | Usuário: nome | Prazo: dd/mm/aaaa"
+static bool todo_parse_legacy_line(char *line, TodoRecord *r, uint32_t id) {
+    line[strcspn(line, "\n")] = '\0';
+    char *text = strstr(line, "TODO: ");
+    if (!text) return false;
+    text += 6;
+    char *owner = strstr(text, " | Usuário: ");
+    char *due = strstr(text, " | Prazo: ");
+    int64_t created = time(NULL);
+    if (line[0] == '[') {
+        struct tm tm = {0};
+        if (strptime(line + 1, "%a %b %d %H:%M:%S %Y", &tm)) {
+            tm.tm_isdst = -1;
+            created = mktime(&tm);
+        }
+    }
+    int64_t due_time = due ? parse_date(due + strlen(" | Prazo: ")) : -1;
+    if (owner) *owner = '\0';
+    if (due) *due = '\0';
+    todo_record_fill(r, id, created, due_time, owner ? owner + strlen(" | Usuário: ") : NULL, text);
+    return true;
+}
+
+static void todo_migrate_legacy() {
+    int fd = openat(todo_store.dir_fd, TODO_LEGACY_FILE, O_RDONLY | O_CLOEXEC);
+    FILE *f = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!f) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    TodoRecord *batch = NULL;
+    size_t n = 0, cap = 0;
+    bool oom = false;
+    char line[2048];
+    while (!oom && fgets(line, sizeof(line), f)) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            TodoRecord *grown = realloc(batch, cap * sizeof(TodoRecord));
+            if (!grown) {
+                oom = true;
+                break;
+            }
+            batch = grown;
+        }
+        if (todo_parse_legacy_line(line, &batch[n], todo_store.next_id + n)) n++;
+    }
+    fclose(f);
+    // migracao parcial seria pior que nenhuma: o todo.txt fica para a proxima
+    if (oom) {
+        fprintf(stderr, "todo: sem memória para migrar %s; o arquivo foi mantido e a migração será tentada de novo.\n", TODO_LEGACY_FILE);
+    } else if (todo_commit(batch, n)) {
+        renameat(todo_store.dir_fd, TODO_LEGACY_FILE, todo_store.dir_fd, TODO_LEGACY_FILE ".migrado");
+        if (n) printf("todo: %zu tarefas migradas de %s para %s.\n", n, TODO_LEGACY_FILE, TODO_LOG_FILE);
+    }
+    free(batch);
+}
+
+// --- abertura ---
+
+static bool todo_write_header(int fd) {
+    char header[TODO_HEADER_SIZE] = {0};
+    memcpy(header, TODO_LOG_MAGIC, 8);
+    uint32_t version = TODO_LOG_VERSION, record_size = TODO_RECORD_SIZE;
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &record_size, 4);
+    return pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header);
+}
+
+static bool todo_store_open_log(bool create) {
+    pthread_mutex_lock(&todo_store.lock);
+    todo_store.next_id = 1;
+    todo_store.next_txn = 1;
+    // o shell pode mudar de diretorio depois (cd); a compactacao e a
+    // migracao precisam continuar falando do mesmo todo.log
+    todo_store.dir_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    todo_store.fd = todo_store.dir_fd >= 0 ? openat(todo_store.dir_fd, TODO_LOG_FILE,
+                                                    O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644) : -1;
+    // sem create, um log que nao existe (ou nunca recebeu o cabecalho) nao e erro
+    bool quiet = !create && todo_store.fd < 0 && errno == ENOENT;
+    struct stat st;
+    bool ok = todo_store.fd >= 0 && fstat(todo_store.fd, &st) == 0;
+    if (ok && st.st_size < TODO_HEADER_SIZE && !create) {
+        ok = false;
+        quiet = true;
+    } else if (ok && st.st_size < TODO_HEADER_SIZE) {
+        ok = todo_write_header(todo_store.fd);
+        st.st_size = TODO_HEADER_SIZE;
+    } else if (ok) {
+        char magic[8];
+        uint32_t record_size = 0;
+        ok = pread(todo_store.fd, magic, 8, 0) == 8 && memcmp(magic, TODO_LOG_MAGIC, 8) == 0 &&
+             pread(todo_store.fd, &record_size, 4, 12) == 4 && record_size == TODO_RECORD_SIZE;
+        if (!ok) fprintf(stderr, "todo: %s não é um log de tarefas válido.\n", TODO_LOG_FILE);
+    }
+    ok = ok && todo_replay(st.st_size);
+    if (!ok) {
+        if (todo_store.fd >= 0) close(todo_store.fd);
+        if (todo_store.dir_fd >= 0) close(todo_store.dir_fd);
+        todo_store.fd = todo_store.dir_fd = -1;
+        pthread_mutex_unlock(&todo_store.lock);
+        if (!quiet) perror("todo: erro ao abrir " TODO_LOG_FILE);
+        return false;
+    }
+    todo_store.open = true;
+    pthread_mutex_unlock(&todo_store.lock);
+    return true;
+}
+
+// Abre o log de tarefas. create: e um comando explicito, entao cria o log
+// se preciso e, com ele vazio, traz o todo.txt antigo (uma migracao que
+// falhou deixa o arquivo no lugar e e tentada de novo na proxima abertura).
+// Sem create (os avisos, no init) so abre um log que ja existe.
+static bool todo_store_open(bool create) {
+    if (!todo_store.open && !todo_store_open_log(create)) return false;
+    if (create && !todo_store.legacy_checked) {
+        pthread_mutex_lock(&todo_store.lock);
+        todo_store.legacy_checked = true;
+        if (todo_store.size == TODO_HEADER_SIZE) todo_migrate_legacy();
+        pthread_mutex_unlock(&todo_store.lock);
+    }
+    return true;
+}
+
+static void todo_store_close() {
+    if (!todo_store.open) return;
+    todo_notifier_stop();
+    if (todo_store.compacting) pthread_join(todo_store.compactor, NULL);
+    todo_store.compacting = false;
+    if (todo_store.map) munmap(todo_store.map, todo_store.map_len);
+    close(todo_store.fd);
+    close(todo_store.dir_fd);
+    free(todo_store.offsets);
+    todo_store.map = NULL;
+    todo_store.map_len = 0;
+    todo_store.offsets = NULL;
+    todo_store.id_cap = 0;
+    todo_store.live = todo_store.garbage = 0;
+    todo_store.fd = todo_store.dir_fd = -1;
+    todo_store.open = false;
+    todo_store.legacy_checked = false;
+    todo_heap_free(&todo_due_heap);
+    todo_heap_free(&todo_alarm_heap);
+    todo_terms_free(&todo_words);
+    todo_terms_free(&todo_owners);
+}
+
+// --- avisos ---
+
+#define TODO_NOTIFY_MAX 10 // avisos individuais por disparo; o resto vira um resumo
+
+// Dorme no timerfd ate o proximo prazo vencer, avisa as tarefas vencidas e
+// rearma para o seguinte. Nao ha polling: fora dos disparos, so acorda
+// quando o shell encerra o plugin.
+static void *todo_notifier_main(void *arg) {
+    (void)arg;
+    struct pollfd pfd[2] = { { .fd = todo_timer_fd, .events = POLLIN }, { .fd = todo_wake_fd, .events = POLLIN } };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfd[1].revents) break;
+        if (!(pfd[0].revents & POLLIN)) continue;
+        uint64_t expirations;
+        ssize_t n = read(todo_timer_fd, &expirations, sizeof(expirations)); // ECANCELED: o relogio mudou
+        (void)n;
+
+        pthread_mutex_lock(&todo_store.lock);
+        int64_t now = time(NULL);
+        uint32_t count = 0;
+        while (todo_alarm_heap.count && todo_alarm_heap.items[0].due <= now) {
+            uint32_t id = todo_alarm_heap.items[0].id;
+            todo_heap_remove(&todo_alarm_heap, id);
+            const TodoRecord *r = todo_get(id);
+            if (r && count++ < TODO_NOTIFY_MAX) {
+                char due[16];
+                char msg[TODO_TEXT_MAX + TODO_OWNER_MAX + 64];
+                format_due(r->due, due, sizeof(due));
+                snprintf(msg, sizeof(msg), "Prazo vencido: %u: %s (%s, %s)", r->id, r->text, r->owner, due);
+                todo_notify("todo", msg);
+            }
+        }
+        if (count > TODO_NOTIFY_MAX) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "... e mais %u tarefa(s) vencida(s). Use 'todo check'.", count - TODO_NOTIFY_MAX);
+            todo_notify("todo", msg);
+        }
+        todo_armed_due = -1; // o timer disparou (ou foi cancelado): arma de novo
+        todo_alarm_rearm();
+        pthread_mutex_unlock(&todo_store.lock);
+    }
+    return NULL;
+}
+
+static void todo_notifier_start() {
+    if (todo_notifier_running || !todo_notify) return;
+    todo_timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    todo_wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (todo_timer_fd < 0 || todo_wake_fd < 0) {
+        perror("todo: timerfd");
+        todo_notifier_stop();
+        return;
+    }
+    pthread_mutex_lock(&todo_store.lock);
+    todo_armed_due = -1;
+    todo_alarm_rearm();
+    uint32_t overdue = todo_heap_collect(&todo_due_heap, time(NULL), NULL, 0);
+    pthread_mutex_unlock(&todo_store.lock);
+    todo_notifier_running = pthread_create(&todo_notifier, NULL, todo_notifier_main, NULL) == 0;
+    if (overdue > 0) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "%u tarefa(s) com prazo vencido. Use 'todo check'.", overdue);
+        todo_notify("todo", msg);
+    }
+}
+
+static void todo_notifier_stop() {
+    if (todo_notifier_running) {
+        uint64_t one = 1;
+        ssize_t w = write(todo_wake_fd, &one, sizeof(one));
+        (void)w;
+        pthread_join(todo_notifier, NULL);
+        todo_notifier_running = false;
+    }
+    if (todo_timer_fd >= 0) close(todo_timer_fd);
+    if (todo_wake_fd >= 0) close(todo_wake_fd);
+    todo_timer_fd = todo_wake_fd = -1;
+}
+
+// --- compactacao ---
+
+// Reescreve as versoes atuais num arquivo novo. A copia principal roda sem
+// o lock (le por pread do fd antigo, que continua valido); no fim, com o
+// lock, copia o que foi gravado nesse meio tempo, troca os arquivos e
+// corrige os offsets.
+static void *todo_compact_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&todo_store.lock);
+    uint64_t snap_size = todo_store.size;
+    uint32_t snap_ids = todo_store.next_id;
+    uint32_t *ids = malloc((todo_store.live + 1) * sizeof(uint32_t));
+    uint64_t *old_offsets = malloc((todo_store.live + 1) * sizeof(uint64_t));
+    uint32_t count = 0;
+    for (uint32_t id = 1; ids && old_offsets && id < snap_ids && count < todo_store.live; id++) {
+        if (todo_store.offsets[id]) {
+            ids[count] = id;
+            old_offsets[count++] = todo_store.offsets[id];
+        }
+    }
+    int old_fd = dup(todo_store.fd);
+    pthread_mutex_unlock(&todo_store.lock);
+
+    int fd = openat(todo_store.dir_fd, TODO_LOG_COMPACT_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = ids && old_offsets && old_fd >= 0 && fd >= 0 && todo_write_header(fd);
+    TodoRecord block[64];
+    uint64_t out = TODO_HEADER_SIZE;
+    for (uint32_t i = 0; ok && i < count;) {
+        uint32_t n = 0;
+        for (; n < 64 && i < count; n++, i++) {
+            ok = pread(old_fd, &block[n], TODO_RECORD_SIZE, old_offsets[i]) == TODO_RECORD_SIZE;
+            if (!ok) break;
+            // cada versao viva vira uma transacao confirmada sozinha
+            block[n].flags = TODO_REC_COMMIT;
+            todo_record_seal(&block[n]);
+        }
+        ok = ok && pwrite(fd, block, n * TODO_RECORD_SIZE, out) == (ssize_t)(n * TODO_RECORD_SIZE);
+        out += n * TODO_RECORD_SIZE;
+    }
+    ok = ok && fdatasync(fd) == 0;
+
+    pthread_mutex_lock(&todo_store.lock);
+    // o que entrou no log durante a copia vem inteiro, ja confirmado
+    uint64_t tail_base = out;
+    for (uint64_t off = snap_size; ok && off < todo_store.size; off += TODO_RECORD_SIZE) {
+        ok = pwrite(fd, todo_record_at(off), TODO_RECORD_SIZE, out) == TODO_RECORD_SIZE;
+        out += TODO_RECORD_SIZE;
+    }
+    ok = ok && fdatasync(fd) == 0 && renameat(todo_store.dir_fd, TODO_LOG_COMPACT_FILE, todo_store.dir_fd, TODO_LOG_FILE) == 0;
+    if (ok) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (todo_store.offsets[ids[i]] == old_offsets[i]) todo_store.offsets[ids[i]] = TODO_HEADER_SIZE + (uint64_t)i * TODO_RECORD_SIZE;
+        }
+        for (uint32_t id = 1; id < todo_store.next_id; id++) {
+            if (todo_store.offsets[id] >= snap_size) todo_store.offsets[id] = todo_store.offsets[id] - snap_size + tail_base;
+        }
+        close(todo_store.fd);
+        todo_store.fd = fd;
+        fd = -1;
+        munmap(todo_store.map, todo_store.map_len);
+        todo_store.map = NULL;
+        todo_store.map_len = 0;
+        todo_map(out);
+        todo_store.size = out;
+        todo_store.garbage = (uint32_t)((out - TODO_HEADER_SIZE) / TODO_RECORD_SIZE) - todo_store.live;
+    } else {
+        unlinkat(todo_store.dir_fd, TODO_LOG_COMPACT_FILE, 0);
+    }
+    pthread_mutex_unlock(&todo_store.lock);
+    if (fd >= 0) close(fd);
+    if (old_fd >= 0) close(old_fd);
+    free(ids);
+    free(old_offsets);
+    return (void *)(intptr_t)ok;
+}
+
+// Chamado depois de cada commit (com o lock): compacta em segundo plano
+// quando as versoes mortas passam das vivas.
+static void todo_maybe_compact() {
+    if (todo_store.garbage < TODO_COMPACT_MIN_GARBAGE || todo_store.garbage <= todo_store.live) return;
+    if (todo_store.compacting) {
+        // a anterior ja terminou?
+        if (pthread_tryjoin_np(todo_store.compactor, NULL) != 0) return;
+        todo_store.compacting = false;
+    }
+    todo_store.compacting = pthread_create(&todo_store.compactor, NULL, todo_compact_main, NULL) == 0;
+}
+
+static int todo_compact_now() {
+    if (todo_store.compacting) pthread_join(todo_store.compactor, NULL);
+    todo_store.compacting = false;
+    uint64_t before = todo_store.size;
+    void *ok = todo_compact_main(NULL);
+    if (!ok) {
+        printf("Erro ao compactar %s.\n", TODO_LOG_FILE);
+        return 1;
+    }
+    printf("Log compactado: %llu KB -> %llu KB (%u tarefas).\n", (unsigned long long)before / 1024,
+           (unsigned long long)todo_store.size / 1024, todo_store.live);
+    return 0;
+}
+
+// --- importar e exportar ---
+
+// CSV (RFC 4180: aspas agrupam, "" e uma aspa) ou JSONL (um objeto por
+// linha). A primeira linha do CSV pode nomear as colunas; sem ela, as
+// colunas sao texto,responsavel,prazo. Os dados sao lidos e escritos em
+// blocos de 1 MB; o import grava os registros direto no log como uma so
+// transacao, entao um erro em qualquer linha desfaz tudo.
+#define TODO_IO_BLOCK (1 << 20)
+#define TODO_IO_LINE_MAX (64 * 1024)
+#define TODO_IMPORT_CHUNK 1024 // registros por pwrite
+#define TODO_MAX_COLUMNS 16
+
+typedef enum { TODO_FMT_CSV, TODO_FMT_JSONL } TodoFormat;
+typedef enum { TODO_COL_IGNORE, TODO_COL_TEXT, TODO_COL_OWNER, TODO_COL_DUE, TODO_COL_CREATED } TodoColumn;
+
+static int todo_column(const char *name) {
+    static const struct { const char *name; TodoColumn col; } names[] = {
+        { "id", TODO_COL_IGNORE }, { "texto", TODO_COL_TEXT }, { "text", TODO_COL_TEXT }, { "tarefa", TODO_COL_TEXT },
+        { "responsavel", TODO_COL_OWNER }, { "responsável", TODO_COL_OWNER }, { "usuario", TODO_COL_OWNER },
+        { "usuário", TODO_COL_OWNER }, { "owner", TODO_COL_OWNER }, { "prazo", TODO_COL_DUE }, { "due", TODO_COL_DUE },
+        { "criado", TODO_COL_CREATED }, { "created", TODO_COL_CREATED },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(name, names[i].name) == 0) return names[i].col;
+    }
+    return -1;
+}
+
+// Dias desde 1970-01-01 no calendario gregoriano (algoritmo de H. Hinnant).
+static int64_t todo_days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static bool todo_valid_date(int y, int m, int d) {
+    static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (y < 1900 || y > 9999 || m < 1 || m > 12 || d < 1) return false;
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return d <= days[m - 1] + (m == 2 && leap);
+}
+
+static bool todo_digits(const char *s, int n, int *out) {
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (!isdigit((unsigned char)s[i])) return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    *out = v;
+    return true;
+}
+
+// Prazo de uma linha importada: vazio, "Sem prazo", dd/mm/aaaa ou
+// aaaa-mm-dd. O mktime (fuso e horario de verao) so roda uma vez por data
+// distinta: as datas se repetem muito num import grande.
+static bool todo_parse_due_field(const char *s, int64_t *out) {
+    static struct { int key; int64_t value; } cache[1024];
+    int y, m, d;
+    size_t len = strlen(s);
+    if (len == 0 || strcasecmp(s, "Sem prazo") == 0 || strcmp(s, "-") == 0) {
+        *out = -1;
+        return true;
+    }
+    if (len == 10 && s[2] == '/' && s[5] == '/') {
+        if (!todo_digits(s, 2, &d) || !todo_digits(s + 3, 2, &m) || !todo_digits(s + 6, 4, &y)) return false;
+    } else if (len == 10 && s[4] == '-' && s[7] == '-') {
+        if (!todo_digits(s, 4, &y) || !todo_digits(s + 5, 2, &m) || !todo_digits(s + 8, 2, &d)) return false;
+    } else {
+        return false;
+    }
+    if (!todo_valid_date(y, m, d)) return false;
+    int key = y * 10000 + m * 100 + d;
+    unsigned slot = (unsigned)key % 1024;
+    if (cache[slot].key != key) {
+        struct tm tm = { .tm_mday = d, .tm_mon = m - 1, .tm_year = y - 1900,
+                         .tm_hour = 23, .tm_min = 59, .tm_sec = 59, .tm_isdst = -1 };
+        cache[slot].value = mktime(&tm);
+        cache[slot].key = key;
+    }
+    *out = cache[slot].value;
+    return true;
+}
+
+// Criacao: segundos desde 1970 ou aaaa-mm-ddThh:mm:ssZ (UTC, como o export grava).
+static bool todo_parse_created_field(const char *s, int64_t *out) {
+    char *end;
+    if (*s == '\0') {
+        *out = time(NULL);
+        return true;
+    }
+    long long v = strtoll(s, &end, 10);
+    if (*end == '\0' && end != s) {
+        *out = v;
+        return true;
+    }
+    int y, mo, d, h, mi, sec;
+    if (strlen(s) != 20 || s[4] != '-' || s[7] != '-' || s[10] != 'T' || s[13] != ':' || s[16] != ':' || s[19] != 'Z' ||
+        !todo_digits(s, 4, &y) || !todo_digits(s + 5, 2, &mo) || !todo_digits(s + 8, 2, &d) ||
+        !todo_digits(s + 11, 2, &h) || !todo_digits(s + 14, 2, &mi) || !todo_digits(s + 17, 2, &sec) ||
+        !todo_valid_date(y, mo, d) || h > 23 || mi > 59 || sec > 60) {
+        return false;
+    }
+    *out = todo_days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+    return true;
+}
+
+// Separa um registro CSV no lugar: tira as aspas, troca "" por " e quebras
+// de linha dentro de aspas por espaco. Retorna o numero de campos.
+static int todo_csv_split(char *rec, char **fields, int max) {
+    int n = 0;
+    char *r = rec, *w = rec;
+    for (;;) {
+        if (n == max) return n + 1; // campos demais
+        fields[n++] = w;
+        if (*r == '"') {
+            r++;
+            for (;;) {
+                if (*r == '\0') return -1; // aspas sem fechar
+                if (*r == '"' && r[1] == '"') {
+                    *w++ = '"';
+                    r += 2;
+                } else if (*r == '"') {
+                    r++;
+                    break;
+                } else {
+                    *w++ = *r == '\n' || *r == '\r' ? ' ' : *r;
+                    r++;
+                }
+            }
+            if (*r != ',' && *r != '\0') return -1;
+        } else {
+            while (*r && *r != ',') *w++ = *r++;
+        }
+        bool more = *r == ',';
+        *w++ = '\0';
+        if (!more) return n;
+        r++;
+    }
+}
+
+static void todo_utf8_put(char **w, unsigned cp) {
+    unsigned char *p = (unsigned char *)*w;
+    if (cp < 0x80) {
+        *p++ = cp;
+    } else if (cp < 0x800) {
+        *p++ = 0xc0 | (cp >> 6);
+        *p++ = 0x80 | (cp & 0x3f);
+    } else if (cp < 0x10000) {
+        *p++ = 0xe0 | (cp >> 12);
+        *p++ = 0x80 | ((cp >> 6) & 0x3f);
+        *p++ = 0x80 | (cp & 0x3f);
+    } else {
+        *p++ = 0xf0 | (cp >> 18);
+        *p++ = 0x80 | ((cp >> 12) & 0x3f);
+        *p++ = 0x80 | ((cp >> 6) & 0x3f);
+        *p++ = 0x80 | (cp & 0x3f);
+    }
+    *w = (char *)p;
+}
+
+// Le uma string JSON em *r (ja depois da aspa de abertura) e a decodifica
+// no lugar, em *w. Retorna o inicio da string decodificada ou NULL.
+static char *todo_json_string(char **r, char **w) {
+    char *out = *w, *p = *r;
+    for (;;) {
+        unsigned char c = *p++;
+        if (c == '"') break;
+        if (c == '\0' || c < 0x20) return NULL;
+        if (c != '\\') {
+            *(*w)++ = c;
+            continue;
+        }
+        c = *p++;
+        switch (c) {
+        case '"': case '\\': case '/': *(*w)++ = c; break;
+        case 'b': case 'f': case 'n': case 'r': case 't': *(*w)++ = ' '; break;
+        case 'u': {
+            unsigned cp = 0;
+            for (int i = 0; i < 4; i++, p++) {
+                if (!isxdigit((unsigned char)*p)) return NULL;
+                cp = cp * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+            }
+            if (cp >= 0xd800 && cp < 0xdc00 && p[0] == '\\' && p[1] == 'u') {
+                unsigned lo = 0;
+                for (int i = 2; i < 6; i++) {
+                    if (!isxdigit((unsigned char)p[i])) return NULL;
+                    lo = lo * 16 + (isdigit((unsigned char)p[i]) ? p[i] - '0' : (tolower((unsigned char)p[i]) - 'a' + 10));
+                }
+                if (lo >= 0xdc00 && lo < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    p += 6;
+                }
+            }
+            todo_utf8_put(w, cp);
+            break;
+        }
+        default:
+            return NULL;
+        }
+    }
+    *(*w)++ = '\0';
+    *r = p;
+    return out;
+}
+
+// Um objeto JSON plano por linha; valores string, numero ou null. Os pares
+// conhecidos vao para values[coluna]. Decodifica no lugar.
+static const char *todo_jsonl_parse(char *line, const char **values) {
+    char *r = line, *w = line;
+    while (isspace((unsigned char)*r)) r++;
+    if (*r++ != '{') return "esperado '{'";
+    for (bool first = true;; first = false) {
+        while (isspace((unsigned char)*r)) r++;
+        if (*r == '}' && first) {
+            r++;
+            break;
+        }
+        if (*r++ != '"') return "esperada uma chave entre aspas";
+        char *key = todo_json_string(&r, &w);
+        if (!key) return "string inválida";
+        while (isspace((unsigned char)*r)) r++;
+        if (*r++ != ':') return "esperado ':'";
+        while (isspace((unsigned char)*r)) r++;
+        char *value;
+        if (*r == '"') {
+            r++;
+            value = todo_json_string(&r, &w);
+            if (!value) return "string inválida";
+        } else if (strncmp(r, "null", 4) == 0) {
+            r += 4;
+            value = NULL;
+        } else {
+            value = w;
+            while (*r == '-' || *r == '+' || *r == '.' || *r == 'e' || *r == 'E' || isdigit((unsigned char)*r)) *w++ = *r++;
+            if (w == value) return "valor inválido";
+            *w++ = '\0';
+        }
+        int col = todo_column(key);
+        if (col > 0) values[col] = value;
+        while (isspace((unsigned char)*r)) r++;
+        if (*r == ',') {
+            r++;
+            continue;
+        }
+        if (*r++ != '}') return "esperado ',' ou '}'";
+        break;
+    }
+    while (isspace((unsigned char)*r)) r++;
+    return *r ? "texto depois do objeto" : NULL;
+}
+
+// Monta o registro a partir dos valores por coluna; NULL = ok, senao o erro.
+static const char *todo_import_record(const char **values, uint32_t id, TodoRecord *r) {
+    const char *text = values[TODO_COL_TEXT];
+    const char *owner = values[TODO_COL_OWNER];
+    int64_t due, created;
+    if (!text || !*text) return "texto vazio";
+    if (strlen(text) >= TODO_TEXT_MAX) return "texto longo demais";
+    if (owner && strlen(owner) >= TODO_OWNER_MAX) return "responsável longo demais";
+    if (!todo_parse_due_field(values[TODO_COL_DUE] ? values[TODO_COL_DUE] : "", &due)) return "prazo inválido (use dd/mm/aaaa ou aaaa-mm-dd)";
+    if (!todo_parse_created_field(values[TODO_COL_CREATED] ? values[TODO_COL_CREATED] : "", &created)) return "data de criação inválida";
+    todo_record_fill(r, id, created, due, owner, text);
+    return NULL;
+}
+
+static TodoFormat todo_format_for(const char *path, const char *format) {
+    if (format) return strcasecmp(format, "jsonl") == 0 || strcasecmp(format, "json") == 0 ? TODO_FMT_JSONL : TODO_FMT_CSV;
+    size_t len = strlen(path);
+    bool jsonl = (len > 6 && strcasecmp(path + len - 6, ".jsonl") == 0) || (len > 5 && strcasecmp(path + len - 5, ".json") == 0);
+    return jsonl ? TODO_FMT_JSONL : TODO_FMT_CSV;
+}
+
+// <arquivo> [--format csv|jsonl]; "-" e a entrada/saida padrao.
+static bool todo_io_args(int argc, char **argv, const char **path, TodoFormat *fmt) {
+    const char *format = NULL;
+    *path = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) format = argv[++i];
+        else if (!*path) *path = argv[i];
+        else return false;
+    }
+    if (!*path || (format && strcasecmp(format, "csv") != 0 && strcasecmp(format, "jsonl") != 0 &&
+                   strcasecmp(format, "json") != 0)) {
+        return false;
+    }
+    *fmt = todo_format_for(*path, format);
+    return true;
+}
+
+// Fim do proximo registro em buf[0, n): um '\n' fora de aspas (no CSV).
+static char *todo_record_end(char *buf, size_t n, TodoFormat fmt) {
+    char *p = buf, *end = buf + n;
+    bool quoted = false;
+    for (;;) {
+        char *nl = memchr(p, '\n', end - p);
+        if (!nl || fmt == TODO_FMT_JSONL) return nl;
+        for (char *q = memchr(p, '"', nl - p); q; q = memchr(q + 1, '"', nl - q - 1)) quoted = !quoted;
+        if (!quoted) return nl;
+        p = nl + 1;
+    }
+}
+
+int import_todo(int argc, char **argv) {
+    const char *path;
+    TodoFormat fmt;
+    if (!todo_io_args(argc, argv, &path, &fmt)) {
+        printf("Uso: todo import <arquivo|-> [--format csv|jsonl]\n");
+        return 2;
+    }
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Erro ao abrir '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    size_t cap = TODO_IO_BLOCK + TODO_IO_LINE_MAX;
+    char *buf = malloc(cap + 1);
+    TodoRecord *chunk = malloc(TODO_IMPORT_CHUNK * sizeof(TodoRecord));
+    if (!buf || !chunk) {
+        free(buf);
+        free(chunk);
+        if (fd != STDIN_FILENO) close(fd);
+        return 1;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    pthread_mutex_lock(&todo_store.lock);
+    TodoTxn txn;
+    todo_txn_begin(&txn);
+    uint32_t next_id = todo_store.next_id;
+    uint32_t imported = 0, pending = 0;
+    unsigned long line_no = 0;
+    int columns[TODO_MAX_COLUMNS] = { TODO_COL_TEXT, TODO_COL_OWNER, TODO_COL_DUE };
+    int column_count = 3;
+    bool header_checked = fmt == TODO_FMT_JSONL;
+    const char *error = NULL;
+    size_t start = 0, end = 0;
+    bool eof = false;
+    while (!error) {
+        char *rec;
+        char *nl = todo_record_end(buf + start, end - start, fmt);
+        if (nl) {
+            rec = buf + start;
+            *nl = '\0';
+            start = nl + 1 - buf;
+        } else if (eof) {
+            if (start == end) break;
+            rec = buf + start;
+            buf[end] = '\0';
+            start = end;
         } else {
-            perror("Erro ao abrir o arquivo todo.txt para verificação");
+            // registro incompleto: traz o resto para o inicio e le mais um bloco
+            memmove(buf, buf + start, end - start);
+            end -= start;
+            start = 0;
+            if (end >= TODO_IO_LINE_MAX && end == cap) {
+                error = "linha longa demais";
+                line_no++;
+                break;
+            }
+            ssize_t n = read(fd, buf + end, cap - end < TODO_IO_BLOCK ? cap - end : TODO_IO_BLOCK);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                error = strerror(errno);
+                break;
+            }
+            if (n == 0) eof = true;
+            end += n;
+            continue;
+        }
+        line_no++;
+        size_t len = strlen(rec);
+        if (len && rec[len - 1] == '\r') rec[--len] = '\0';
+        if (len == 0) continue;
+
+        const char *values[TODO_COL_CREATED + 1] = { 0 };
+        if (fmt == TODO_FMT_JSONL) {
+            error = todo_jsonl_parse(rec, values);
+        } else {
+            char *fields[TODO_MAX_COLUMNS];
+            int n = todo_csv_split(rec, fields, TODO_MAX_COLUMNS);
+            if (n < 0) {
+                error = "aspas sem fechar";
+            } else if (n > TODO_MAX_COLUMNS) {
+                error = "colunas demais";
+            } else if (!header_checked) {
+                // primeira linha: e cabecalho se todos os campos sao nomes de coluna
+                header_checked = true;
+                bool header = true;
+                for (int i = 0; i < n && header; i++) header = todo_column(fields[i]) >= 0;
+                if (header) {
+                    for (int i = 0; i < n; i++) columns[i] = todo_column(fields[i]);
+                    column_count = n;
+                    continue;
+                }
+            }
+            for (int i = 0; !error && i < n && i < column_count; i++) {
+                if (columns[i] != TODO_COL_IGNORE) values[columns[i]] = fields[i];
+            }
         }
+        if (!error) error = todo_import_record(values, next_id, &chunk[pending]);
+        if (error) break;
+        next_id++;
+        imported++;
+        if (++pending == TODO_IMPORT_CHUNK) {
+            if (!todo_txn_write(&txn, chunk, pending)) error = "erro ao gravar o log";
+            pending = 0;
+        }
+    }
+    if (!error && pending && !todo_txn_write(&txn, chunk, pending)) error = "erro ao gravar o log";
+    bool ok = !error && todo_txn_commit(&txn);
+    if (error) todo_txn_abort(&txn);
+    if (ok) todo_maybe_compact();
+    pthread_mutex_unlock(&todo_store.lock);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (fd != STDIN_FILENO) close(fd);
+    free(buf);
+    free(chunk);
+    if (error) {
+        printf("Erro na linha %lu: %s. Nada foi importado.\n", line_no, error);
+        return 1;
+    }
+    if (!ok) {
+        printf("Erro ao gravar o log. Nada foi importado.\n");
+        return 1;
+    }
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("%u tarefa(s) importada(s) em %.1f ms.\n", imported, ms);
+    return 0;
+}
+
+// Buffer de saida do export: acumula ate um bloco e grava com write.
+typedef struct {
+    int fd;
+    char *data;
+    size_t len;
+    bool failed;
+} TodoOut;
+
+static void todo_out_flush(TodoOut *o) {
+    for (size_t done = 0; !o->failed && done < o->len;) {
+        ssize_t w = write(o->fd, o->data + done, o->len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) o->failed = true;
+        else done += w;
+    }
+    o->len = 0;
+}
+
+static void todo_out_bytes(TodoOut *o, const char *s, size_t n) {
+    if (o->len + n > TODO_IO_BLOCK) todo_out_flush(o);
+    memcpy(o->data + o->len, s, n);
+    o->len += n;
+}
+
+static void todo_out_csv(TodoOut *o, const char *s) {
+    if (!strpbrk(s, ",\"\r\n")) {
+        todo_out_bytes(o, s, strlen(s));
         return;
     }
+    todo_out_bytes(o, "\"", 1);
+    for (const char *q; (q = strchr(s, '"')); s = q + 1) {
+        todo_out_bytes(o, s, q - s + 1);
+        todo_out_bytes(o, "\"", 1);
+    }
+    todo_out_bytes(o, s, strlen(s));
+    todo_out_bytes(o, "\"", 1);
+}
+
+static void todo_out_json(TodoOut *o, const char *s) {
+    todo_out_bytes(o, "\"", 1);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        char esc[8];
+        if (c == '"' || c == '\\') {
+            esc[0] = '\\';
+            esc[1] = c;
+            todo_out_bytes(o, esc, 2);
+        } else if (c < 0x20) {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            todo_out_bytes(o, esc, 6);
+        } else {
+            todo_out_bytes(o, s, 1);
+        }
+    }
+    todo_out_bytes(o, "\"", 1);
+}
+
+int export_todo(int argc, char **argv) {
+    const char *path;
+    TodoFormat fmt;
+    if (!todo_io_args(argc, argv, &path, &fmt)) {
+        printf("Uso: todo export <arquivo|-> [--format csv|jsonl]\n");
+        return 2;
+    }
+    bool to_stdout = strcmp(path, "-") == 0;
+    TodoOut o = { .fd = to_stdout ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (o.fd < 0) {
+        printf("Erro ao criar '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    o.data = malloc(TODO_IO_BLOCK);
+    if (!o.data) {
+        if (!to_stdout) close(o.fd);
+        return 1;
+    }
+    if (to_stdout) fflush(stdout);
+    if (fmt == TODO_FMT_CSV) todo_out_bytes(&o, "id,texto,responsavel,prazo,criado\n", 34);
+
+    pthread_mutex_lock(&todo_store.lock);
+    uint32_t exported = 0;
+    for (uint32_t id = 1; id < todo_store.next_id && !o.failed; id++) {
+        const TodoRecord *r = todo_get(id);
+        if (!r) continue;
+        char num[16], due[16], created[32];
+        int num_len = snprintf(num, sizeof(num), "%u", r->id);
+        if (r->due >= 0) format_due(r->due, due, sizeof(due));
+        else due[0] = '\0';
+        time_t t = (time_t)r->created;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        if (fmt == TODO_FMT_CSV) {
+            todo_out_bytes(&o, num, num_len);
+            todo_out_bytes(&o, ",", 1);
+            todo_out_csv(&o, r->text);
+            todo_out_bytes(&o, ",", 1);
+            todo_out_csv(&o, r->owner);
+            todo_out_bytes(&o, ",", 1);
+            todo_out_bytes(&o, due, strlen(due));
+            todo_out_bytes(&o, ",", 1);
+            todo_out_bytes(&o, created, strlen(created));
+            todo_out_bytes(&o, "\n", 1);
+        } else {
+            todo_out_bytes(&o, "{\"id\":", 6);
+            todo_out_bytes(&o, num, num_len);
+            todo_out_bytes(&o, ",\"texto\":", 9);
+            todo_out_json(&o, r->text);
+            todo_out_bytes(&o, ",\"responsavel\":", 15);
+            todo_out_json(&o, r->owner);
+            todo_out_bytes(&o, ",\"prazo\":", 9);
+            if (due[0]) todo_out_json(&o, due);
+            else todo_out_bytes(&o, "null", 4);
+            todo_out_bytes(&o, ",\"criado\":", 10);
+            todo_out_json(&o, created);
+            todo_out_bytes(&o, "}\n", 2);
+        }
+        exported++;
+    }
+    pthread_mutex_unlock(&todo_store.lock);
+    todo_out_flush(&o);
+    bool ok = !o.failed && (to_stdout || fsync(o.fd) == 0);
+    if (!to_stdout && close(o.fd) != 0) ok = false;
+    free(o.data);
+    if (!ok) {
+        printf("Erro ao gravar '%s'.\n", path);
+        return 1;
+    }
+    if (!to_stdout) printf("%u tarefa(s) exportada(s) para %s.\n", exported, path);
+    return 0;
+}
+
+// --- comandos ---
+
+// Numero da tarefa no inicio de args: so digitos, seguidos do fim ou de um
+// espaco ("3abc", "-1" e "+3" nao sao ids).
+static uint32_t parse_todo_id(const char *args) {
+    if (!args || !isdigit((unsigned char)*args)) return 0;
+    char *end;
+    unsigned long id = strtoul(args, &end, 10);
+    return (*end == '\0' || isspace((unsigned char)*end)) && id > 0 && id < UINT32_MAX ? (uint32_t)id : 0;
+}
+
+static void print_todo(const TodoRecord *r) {
+    char created[26];
+    char due[16];
+    time_t t = (time_t)r->created;
+    ctime_r(&t, created);
+    created[24] = '\0';
+    format_due(r->due, due, sizeof(due));
+    printf("%u: [%s] TODO: %s | Usuário: %s | Prazo: %s\n", r->id, created, r->text, r->owner, due);
+}
+
+void check_todos() {
     time_t now = time(NULL);
     struct tm *tm_now = localtime(&now);
     char current_date[11];
     snprintf(current_date, sizeof(current_date), "%02d/%02d/%04d",
              tm_now->tm_mday, tm_now->tm_mon + 1, tm_now->tm_year + 1900);
     printf("Verificando TODOs vencidos ou a vencer hoje (%s)...\n", current_date);
-    int has_overdue = 0;
-    char line[1024];
-    while (fgets(line, sizeof(line), todo_file) != NULL) {
-        line[strcspn(line, "\n")] = '\0';
-        char *prazo_start = strstr(line, "Prazo: ");
-        if (prazo_start) {
-            prazo_start += 7;
-            char prazo[32] = {0};
-            strncpy(prazo, prazo_start, sizeof(prazo) - 1);
-            time_t prazo_time = parse_date(prazo);
-            if (prazo_time != -1) {
-                if (difftime(now, prazo_time) >= 0) {
-                    has_overdue = 1;
-                    printf("TODO VENCIDO OU HOJE: %s\n", line);
-                }
-            }
+    pthread_mutex_lock(&todo_store.lock);
+    // so os vencidos saem do heap; o resto das tarefas nem e visitado
+    uint32_t count = todo_heap_collect(&todo_due_heap, now, NULL, 0);
+    TodoDeadline *overdue = count ? malloc(count * sizeof(TodoDeadline)) : NULL;
+    if (overdue) {
+        todo_heap_collect(&todo_due_heap, now, overdue, count);
+        qsort(overdue, count, sizeof(TodoDeadline), compare_deadlines);
+        for (uint32_t i = 0; i < count; i++) {
+            printf("TODO VENCIDO OU HOJE: ");
+            print_todo(todo_get(overdue[i].id));
         }
     }
-    fclose(todo_file);
-    if (!has_overdue) {
+    pthread_mutex_unlock(&todo_store.lock);
+    free(overdue);
+    if (count == 0) {
         printf("Nenhum TODO vencido ou a vencer hoje.\n");
     }
 }
 
 void list_todo() {
-    count = 0;
     printf("Lista de TODOs:\n");
     printf("------------------------------------------------\n");
-    FILE *todo_file = fopen("todo.txt", "r");
-    if (todo_file == NULL) {
-        if (access("todo.txt", F_OK) == -1) {
-            printf("Nenhum TODO encontrado. Adicione um com 'todo add <tarefa>'.\n");
-        } else {
-            perror("Erro ao abrir o arquivo todo.txt");
-        }
-        return;
+    pthread_mutex_lock(&todo_store.lock);
+    uint32_t shown = 0;
+    for (uint32_t id = 1; id < todo_store.next_id; id++) {
+        const TodoRecord *r = todo_get(id);
+        if (!r) continue;
+        print_todo(r);
+        shown++;
     }
-    char line[1024];
-    while (fgets(line, sizeof(line), todo_file) != NULL) {
-        line[strcspn(line, "\n")] = '\0';
-        printf("%d: %s\n", ++count, line);
-    }
-    fclose(todo_file);
-    if (count == 0) {
-        printf("Nenhum TODO encontrado no arquivo.\n");
+    pthread_mutex_unlock(&todo_store.lock);
+    if (shown == 0) {
+        printf("Nenhum TODO encontrado. Adicione um com 'todo add <tarefa>'.\n");
     }
     printf("------------------------------------------------\n");
 }
 
-void remove_todo(const char *args) {
-    if (args == NULL || strlen(args) == 0) {
-        printf("Uso: todo remove <número do item>\n");
-        list_todo();
-        return;
-    }
-
-    int index = atoi(args);
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
 
-    FILE *todo_file = fopen("todo.txt", "r");
-    if (todo_file == NULL) {
-        perror("Erro ao abrir o arquivo todo.txt para remoção");
-        return;
+// todo search <termos> [--owner X] [--before dd/mm/aaaa]: tarefas com todas
+// as palavras, do responsavel e com prazo antes da data. Parte do menor
+// conjunto de candidatos (a lista mais curta, ou os prazos vencidos ate a
+// data pelo heap) e confere os outros filtros em cada candidato.
+int search_todo(int argc, char **argv) {
+    const char *owner = NULL;
+    int64_t before = -1;
+    char terms[16][TODO_TERM_MAX + 1];
+    int term_count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--owner") == 0 && i + 1 < argc) {
+            owner = argv[++i];
+        } else if (strcmp(argv[i], "--before") == 0 && i + 1 < argc) {
+            before = parse_date(argv[++i]);
+            if (before < 0) {
+                printf("Data inválida: '%s'. Use dd/mm/aaaa.\n", argv[i]);
+                return 2;
+            }
+        } else {
+            const char *s = argv[i];
+            size_t len;
+            while (term_count < 16 && (len = todo_next_term(&s, terms[term_count])) > 0) {
+                terms[term_count++][len] = '\0';
+            }
+        }
     }
-
-    int current_line = 0;
-    while (fgets(lines[current_line], sizeof(lines[current_line]), todo_file) != NULL && current_line < MAX_TODO_LINES) {
-        lines[current_line][strcspn(lines[current_line], "\n")] = '\0';
-        current_line++;
+    if (term_count == 0 && !owner && before < 0) {
+        printf("Uso: todo search <termos> [--owner <responsável>] [--before dd/mm/aaaa]\n");
+        return 2;
     }
-    fclose(todo_file);
 
-    if (current_line == 0) {
-        printf("Nenhum TODO para remover.\n");
-        return;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_mutex_lock(&todo_store.lock);
+    const TodoPosting *lists[17];
+    int list_count = 0;
+    bool empty = false;
+    for (int i = 0; i < term_count && !empty; i++) {
+        lists[list_count] = todo_terms_find(&todo_words, terms[i], strlen(terms[i]), false);
+        empty = !lists[list_count] || lists[list_count]->count == 0;
+        list_count++;
+    }
+    if (owner && !empty) {
+        char key[TODO_OWNER_MAX];
+        size_t len = todo_owner_key(owner, key, sizeof(key));
+        lists[list_count] = todo_terms_find(&todo_owners, key, len, false);
+        empty = !lists[list_count] || lists[list_count]->count == 0;
+        list_count++;
     }
 
-    if (index <= 0 || index > current_line) {
-        printf("Número de TODO inválido. Use 'todo list' para ver os números válidos (1-%d).\n", current_line);
-        return;
+    uint32_t *ids = NULL;
+    uint32_t count = 0;
+    if (!empty && list_count > 0) {
+        int shortest = 0;
+        for (int i = 1; i < list_count; i++) {
+            if (lists[i]->count < lists[shortest]->count) shortest = i;
+        }
+        uint32_t cursors[17] = {0};
+        ids = malloc(lists[shortest]->count * sizeof(uint32_t));
+        for (uint32_t k = 0; ids && k < lists[shortest]->count; k++) {
+            uint32_t id = lists[shortest]->ids[k];
+            bool match = true;
+            for (int i = 0; i < list_count && match; i++) {
+                if (i != shortest) match = todo_posting_seek(lists[i], &cursors[i], id);
+            }
+            if (match && before >= 0) {
+                // o prazo vem do heap (em memoria), sem tocar no registro
+                uint32_t pos = id < todo_due_heap.pos_cap ? todo_due_heap.pos[id] : 0;
+                match = pos && todo_due_heap.items[pos - 1].due < before;
+            }
+            if (match) ids[count++] = id;
+        }
+    } else if (!empty) {
+        // so --before: o heap de prazos entrega exatamente os que vencem antes
+        uint32_t n = todo_heap_collect(&todo_due_heap, before - 1, NULL, 0);
+        TodoDeadline *due = n ? malloc(n * sizeof(TodoDeadline)) : NULL;
+        ids = due ? malloc(n * sizeof(uint32_t)) : NULL;
+        if (ids) {
+            todo_heap_collect(&todo_due_heap, before - 1, due, n);
+            for (uint32_t k = 0; k < n; k++) ids[count++] = due[k].id;
+            qsort(ids, count, sizeof(uint32_t), compare_ids);
+        }
+        free(due);
     }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (uint32_t k = 0; k < count; k++) print_todo(todo_get(ids[k]));
+    pthread_mutex_unlock(&todo_store.lock);
+    free(ids);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("%u resultado(s) em %.3f ms.\n", count, ms);
+    return 0;
+}
 
-    FILE *temp_file = fopen("todo_temp.txt", "w");
-    if (temp_file == NULL) {
-        perror("Erro ao criar arquivo temporário");
+void remove_todo(const char *args) {
+    uint32_t id = parse_todo_id(args);
+    if (id == 0) {
+        printf("Uso: todo remove <número do item>\n");
         return;
     }
-    for (int i = 0; i < current_line; i++) {
-        if (i != index - 1) {
-            fprintf(temp_file, "%s\n", lines[i]);
-        }
+    pthread_mutex_lock(&todo_store.lock);
+    const TodoRecord *current = todo_get(id);
+    bool ok = false;
+    if (current) {
+        TodoRecord tomb;
+        memset(&tomb, 0, sizeof(tomb));
+        tomb.id = id;
+        tomb.type = TODO_REC_DEL;
+        ok = todo_commit(&tomb, 1);
+        if (ok) todo_maybe_compact();
+    }
+    pthread_mutex_unlock(&todo_store.lock);
+    if (!current) {
+        printf("TODO número %u não existe. Use 'todo list' para ver os números válidos.\n", id);
+    } else if (ok) {
+        printf("TODO número %u removido com sucesso.\n", id);
     }
-    fclose(temp_file);
+}
 
-    if (remove("todo.txt") != 0 || rename("todo_temp.txt", "todo.txt") != 0) {
-        perror("Erro ao atualizar o arquivo todo.txt");
-        return;
+// Pergunta um campo; linha vazia mantem o valor padrao.
+static bool prompt_field(const char *question, const char *fallback, char *out, size_t size) {
+    char temp_input[256] = {0};
+    printf("%s", question);
+    fflush(stdout);
+    if (fgets(temp_input, sizeof(temp_input), stdin) == NULL) {
+        return false;
     }
-    printf("TODO número %d removido com sucesso.\n", index);
+    temp_input[strcspn(temp_input, "\n")] = '\0';
+    snprintf(out, size, "%s", strlen(temp_input) > 0 ? temp_input : fallback);
+    return true;
 }
 
 void handle_add_todo(const char *input) {
@@ -211,76 +1872,242 @@ void handle_add_todo(const char *input) {
         return;
     }
 
-    char tarefa[512];
-    strncpy(tarefa, input, sizeof(tarefa) - 1);
-    tarefa[sizeof(tarefa) - 1] = '\0';
-
-    char usuario[128] = {0};
+    char usuario[TODO_OWNER_MAX] = {0};
     char prazo[32] = {0};
-    char temp_input[256] = {0};
-
-    printf("Digite o nome do responsável (ou deixe vazio para 'Desconhecido'): ");
-    fflush(stdout);
-    if (fgets(temp_input, sizeof(temp_input), stdin) == NULL) {
+    if (!prompt_field("Digite o nome do responsável (ou deixe vazio para 'Desconhecido'): ", "Desconhecido",
+                      usuario, sizeof(usuario))) {
         perror("Erro ao ler o nome do responsável");
         return;
     }
-    temp_input[strcspn(temp_input, "\n")] = '\0';
-    if (strlen(temp_input) > 0) {
-        strncpy(usuario, temp_input, sizeof(usuario) - 1);
-        usuario[sizeof(usuario)-1] = '\0';
-    } else {
-        strcpy(usuario, "Desconhecido");
+    if (!prompt_field("Digite a data de vencimento (dd/mm/aaaa ou deixe vazio para 'Sem prazo'): ", "Sem prazo",
+                      prazo, sizeof(prazo))) {
+        perror("Erro ao ler a data de vencimento");
+        return;
     }
 
-    printf("Digite a data de vencimento (dd/mm/aaaa ou deixe vazio para 'Sem prazo'): ");
-    fflush(stdout);
-    if (fgets(temp_input, sizeof(temp_input), stdin) == NULL) {
-        perror("Erro ao ler a data de vencimento");
+    pthread_mutex_lock(&todo_store.lock);
+    TodoRecord r;
+    uint32_t id = todo_store.next_id;
+    todo_record_fill(&r, id, time(NULL), parse_date(prazo), usuario, input);
+    bool ok = todo_commit(&r, 1);
+    pthread_mutex_unlock(&todo_store.lock);
+    if (ok) printf("TODO %u salvo com sucesso: '%s' por '%s' com prazo '%s'\n", id, input, usuario, prazo);
+}
+
+// todo edit <id> [novo texto]: sem texto, pergunta texto, responsavel e
+// prazo (Enter mantem o atual). Grava uma nova versao com o mesmo id.
+void edit_todo(const char *args) {
+    uint32_t id = parse_todo_id(args);
+    if (id == 0) {
+        printf("Uso: todo edit <número> [novo texto]\n");
         return;
     }
-    temp_input[strcspn(temp_input, "\n")] = '\0';
-    if (strlen(temp_input) > 0) {
-        strncpy(prazo, temp_input, sizeof(prazo) - 1);
-        prazo[sizeof(prazo)-1] = '\0';
+    while (*args && isdigit((unsigned char)*args)) args++;
+    while (*args && isspace((unsigned char)*args)) args++;
+
+    pthread_mutex_lock(&todo_store.lock);
+    const TodoRecord *current = todo_get(id);
+    TodoRecord r;
+    if (current) r = *current;
+    pthread_mutex_unlock(&todo_store.lock);
+    if (!current) {
+        printf("TODO número %u não existe. Use 'todo list' para ver os números válidos.\n", id);
+        return;
+    }
+
+    char text[TODO_TEXT_MAX], owner[TODO_OWNER_MAX], due[32];
+    format_due(r.due, due, sizeof(due));
+    if (*args) {
+        snprintf(text, sizeof(text), "%s", args);
+        snprintf(owner, sizeof(owner), "%s", r.owner);
     } else {
-        strcpy(prazo, "Sem prazo");
+        char question[TODO_TEXT_MAX + 64];
+        snprintf(question, sizeof(question), "Texto [%s]: ", r.text);
+        bool ok = prompt_field(question, r.text, text, sizeof(text));
+        snprintf(question, sizeof(question), "Responsável [%s]: ", r.owner);
+        ok = ok && prompt_field(question, r.owner, owner, sizeof(owner));
+        char current_due[32];
+        snprintf(current_due, sizeof(current_due), "%s", due);
+        snprintf(question, sizeof(question), "Prazo (dd/mm/aaaa ou 'Sem prazo') [%s]: ", current_due);
+        ok = ok && prompt_field(question, current_due, due, sizeof(due));
+        if (!ok) {
+            printf("Edição cancelada.\n");
+            return;
+        }
     }
 
-    char time_str[26];
-    time_t now = time(NULL);
-    ctime_r(&now, time_str);
-    time_str[24] = '\0';
+    pthread_mutex_lock(&todo_store.lock);
+    bool ok = todo_get(id) != NULL;
+    if (ok) {
+        todo_record_fill(&r, id, r.created, parse_date(due), owner, text);
+        ok = todo_commit(&r, 1);
+        if (ok) todo_maybe_compact();
+    }
+    pthread_mutex_unlock(&todo_store.lock);
+    if (ok) printf("TODO %u atualizado.\n", id);
+    else printf("TODO número %u não pôde ser atualizado.\n", id);
+}
 
-    FILE *todo_file = fopen("todo.txt", "a");
-    if (todo_file == NULL) {
-        perror("Erro ao abrir todo.txt");
-        return;
+// Campo de id do arquivo do Vim: "#<numero>" e nada mais. Uma tarefa nova
+// cujo texto comeca com um numero nao e confundida com uma existente.
+static uint32_t parse_vim_id(const char *field) {
+    if (field[0] != '#' || !isdigit((unsigned char)field[1])) return 0;
+    char *end;
+    unsigned long id = strtoul(field + 1, &end, 10);
+    return *end == '\0' && id > 0 && id < UINT32_MAX ? (uint32_t)id : 0;
+}
+
+// Escreve um campo para o Vim com '\\', '|' e quebras de linha escapados:
+// assim " | " so aparece como separador.
+static void vim_put_field(FILE *f, const char *s) {
+    for (; *s; s++) {
+        if (*s == '\\' || *s == '|') fputc('\\', f);
+        if (*s == '\n') fputs("\\n", f);
+        else fputc(*s, f);
     }
-    fprintf(todo_file, "[%s] TODO: %s | Usuário: %s | Prazo: %s\n", time_str, tarefa, usuario, prazo);
-    fclose(todo_file);
-    printf("TODO salvo com sucesso: '%s' por '%s' com prazo '%s'\n", tarefa, usuario, prazo);
 }
 
-void edit_todo(const char *args) {
-    printf("Funcionalidade 'edit' ainda não implementada.\n");
-    printf("Use 'todo vim' para editar o arquivo diretamente.\n");
+// Desfaz o escape de vim_put_field no lugar.
+static void vim_unescape_field(char *s) {
+    char *w = s;
+    for (char *r = s; *r; r++) {
+        if (*r == '\\' && r[1]) {
+            r++;
+            *w++ = *r == 'n' ? '\n' : *r;
+        } else {
+            *w++ = *r;
+        }
+    }
+    *w = '\0';
 }
 
+// Abre as tarefas no Vim como texto ("#id | texto | responsável | prazo") e
+// aplica o resultado como uma unica transacao: linhas alteradas viram novas
+// versoes, linhas apagadas viram lapides e linhas sem id viram tarefas novas.
 void edit_with_vim() {
+    char path[] = "/tmp/jntd-todo-XXXXXX.txt";
+    int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        perror("mkstemps");
+        return;
+    }
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        perror("fdopen");
+        close(fd);
+        unlink(path);
+        return;
+    }
+    fprintf(f, "# #id | texto | responsável | prazo (dd/mm/aaaa ou Sem prazo)\n");
+    fprintf(f, "# Apague uma linha para remover; uma linha sem #id cria uma tarefa.\n");
+    fprintf(f, "# No texto e no responsável, '|' e '\\' aparecem como '\\|' e '\\\\'.\n");
+    pthread_mutex_lock(&todo_store.lock);
+    uint32_t max_id = todo_store.next_id;
+    for (uint32_t id = 1; id < max_id; id++) {
+        const TodoRecord *r = todo_get(id);
+        if (!r) continue;
+        char due[16];
+        format_due(r->due, due, sizeof(due));
+        fprintf(f, "#%u | ", r->id);
+        vim_put_field(f, r->text);
+        fputs(" | ", f);
+        vim_put_field(f, r->owner);
+        fprintf(f, " | %s\n", due);
+    }
+    pthread_mutex_unlock(&todo_store.lock);
+    fclose(f);
+
     pid_t pid = fork();
     if (pid == -1) {
         perror("fork");
+        unlink(path);
         return;
     }
     if (pid == 0) {
-        char *args[] = {"vim", "todo.txt", NULL};
+        char *args[] = {"vim", path, NULL};
         execvp("vim", args);
         perror("execvp");
         exit(1);
     }
-    else {
-        int status;
-        waitpid(pid, &status, 0);
+    int status;
+    waitpid(pid, &status, 0);
+    f = fopen(path, "r");
+    unlink(path);
+    if (!f || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        if (f) fclose(f);
+        printf("Vim não terminou normalmente; nada foi alterado.\n");
+        return;
     }
-}
\ No newline at end of file
+
+    pthread_mutex_lock(&todo_store.lock);
+    uint8_t *seen = calloc(max_id + 1, 1);
+    TodoRecord *batch = NULL;
+    size_t n = 0, cap = 0;
+    uint32_t next_new = todo_store.next_id;
+    // sem memoria no meio da leitura, as linhas que faltam nao seriam
+    // marcadas em seen e virariam lapides: aborta tudo
+    bool oom = !seen;
+    char line[TODO_TEXT_MAX + TODO_OWNER_MAX + 64];
+    while (!oom && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        if ((line[0] == '#' && !isdigit((unsigned char)line[1])) || line[0] == '\0') continue;
+        char *fields[4] = {0};
+        int nf = 0;
+        for (char *p = line; p && nf < 4; nf++) {
+            fields[nf] = p;
+            p = strstr(p, " | ");
+            if (p) {
+                *p = '\0';
+                p += 3;
+            }
+        }
+        for (int i = 0; i < nf; i++) vim_unescape_field(fields[i]);
+        uint32_t id = parse_vim_id(fields[0]);
+        bool has_id = id > 0 && id < max_id && nf >= 2;
+        const char *text = has_id ? fields[1] : fields[0];
+        const char *owner = has_id ? (nf > 2 ? fields[2] : NULL) : (nf > 1 ? fields[1] : NULL);
+        const char *due = has_id ? (nf > 3 ? fields[3] : "Sem prazo") : (nf > 2 ? fields[2] : "Sem prazo");
+        const TodoRecord *current = has_id ? todo_get(id) : NULL;
+        if (has_id && !current) continue;
+        if (has_id) seen[id] = 1;
+        TodoRecord r;
+        todo_record_fill(&r, has_id ? id : next_new, current ? current->created : time(NULL), parse_date(due), owner, text);
+        if (current && current->due == r.due && strcmp(current->text, r.text) == 0 &&
+            strcmp(current->owner, r.owner) == 0) continue; // sem mudanca
+        if (!has_id) next_new++;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            TodoRecord *grown = realloc(batch, cap * sizeof(TodoRecord));
+            if (!grown) {
+                oom = true;
+                break;
+            }
+            batch = grown;
+        }
+        batch[n++] = r;
+    }
+    fclose(f);
+    size_t changed = n;
+    for (uint32_t id = 1; !oom && id < max_id; id++) {
+        if (seen[id] || !todo_get(id)) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            TodoRecord *grown = realloc(batch, cap * sizeof(TodoRecord));
+            if (!grown) {
+                oom = true;
+                break;
+            }
+            batch = grown;
+        }
+        memset(&batch[n], 0, sizeof(TodoRecord));
+        batch[n].id = id;
+        batch[n++].type = TODO_REC_DEL;
+    }
+    bool ok = !oom && todo_commit(batch, n);
+    if (ok) todo_maybe_compact();
+    pthread_mutex_unlock(&todo_store.lock);
+    free(batch);
+    free(seen);
+    if (oom) printf("Erro: sem memória para aplicar a edição; nada foi alterado.\n");
+    if (ok) printf("%zu tarefa(s) alterada(s) ou criada(s), %zu removida(s).\n", changed, n - changed);
+}